@@ -0,0 +1,137 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ */
+
+
+/* System headers */
+#include <errno.h>
+
+/* Project header */
+#include "pksh.h"
+
+/* Identifiers */
+#define NAME         "pkattach"
+#define BRIEF        "Attach the shell to the interfaces captured by a pkshd daemon"
+#define SYNOPSIS     "pkattach [options] [socket]"
+#define DESCRIPTION  "No description yet"
+
+/* Public variable */
+pksh_cmd_t cmd_attach = { NAME, BRIEF, SYNOPSIS, DESCRIPTION, pksh_pkattach };
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  OPT_DETACH      = 'd',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  { "detach",        no_argument,       NULL, OPT_DETACH      },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' attaches the shell to the interfaces captured by a pkshd daemon, they are then available\n", progname);
+  printf ("     to all the commands as read-only interfaces, refreshed each time a command is run\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] [socket]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s                     # attach to the daemon listening on %s\n", progname, pkshdsocket (false));
+  printf ("   %s /var/run/pkshd      # attach to the daemon listening on /var/run/pkshd\n", progname);
+  printf ("   %s -d                  # detach the shell from the daemon (captures keep running)\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -d, --detach                 detach from the daemon\n");
+}
+
+
+/* Attach the shell to a capture daemon */
+int pksh_pkattach (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+  char * sopts    = optlegitimate (lopts);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  bool detach     = false;
+
+  int option;
+
+  /* Local variables */
+  char * path = pkshdsocket (false);
+
+  /* Lookup for the command in the static table of registered extensions */
+  if (! cmd_by_name (progname))
+    {
+      printf ("%s: Command [%s] not found.\n", progname, progname);
+      return -1;
+    }
+
+  /* Parse command line options */
+  optind = 0;
+  optarg = NULL;
+  argv [0] = progname;
+  while ((option = getopt_long (argc, argv, sopts, lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:   usage (progname, lopts); return 0;
+	case OPT_QUIET:  quiet = true;            break;
+
+	case OPT_DETACH: detach = true;           break;
+	}
+    }
+
+  if (detach)
+    {
+      if (! remoteattached ())
+	{
+	  if (! quiet)
+	    printf ("%s: the shell is not attached to any daemon\n", progname);
+	  return -1;
+	}
+      remotedetach ();
+      return 0;
+    }
+
+  if (optind < argc)
+    path = argv [optind ++];
+
+  if (remoteattach (path) == -1)
+    {
+      if (! quiet)
+	printf ("%s: cannot attach to %s (%s)\n", progname, path, strerror (errno));
+      return -1;
+    }
+
+  /* Bye bye! */
+  return 0;
+}
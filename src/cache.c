@@ -18,24 +18,70 @@
 
 /* System headers */
 #include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <arpa/inet.h>
 
 /* Project header */
 #include "pksh.h"
 
 
-/* Allocate a new host on the given interface */
-static host_t * mkhost (interface_t * intf)
+/* The longest textual key of a host, an IPv6 address followed by %vlan */
+#define KEYLEN       (INET6_ADDRSTRLEN + 8)
+
+/* The binary key of an IPv6 address, followed by its VLAN when hosts in different VLANs are kept apart */
+typedef struct
 {
-  host_t * h = calloc (sizeof (host_t), 1);
-  if (! h)
-    return NULL;
+  struct in6_addr addr;
+  uint16_t vlan;
+
+} ip6key_t;
+
+#define IP6KEY_VLAN  (offsetof (ip6key_t, vlan) + sizeof (uint16_t))
+
+
+/* Allocate a new host seen in 'vlan' on the given interface with the next free identifier in its registry */
+static host_t * mkhost (interface_t * intf, int vlan)
+{
+  unsigned id = intf -> hostno;
+  host_t * chunk;
+  host_t * h;
+
+  /* The registry is full, the first host left out is told once and the others are just counted */
+  if (id >= HOSTS_CHUNK * HOSTS_CHUNKS)
+    {
+      if (! intf -> hostsmissed ++)
+	printf ("\n%s: the hosts cache is full (%u hosts), new hosts are no longer counted (see pkstatus)\n",
+		intf -> name, HOSTS_CHUNK * HOSTS_CHUNKS);
+      return NULL;
+    }
+
+  /* Buy memory for a new chunk of hosts when the previous one is full */
+  if (! (chunk = intf -> chunks [id / HOSTS_CHUNK]))
+    {
+      if (! (chunk = calloc (HOSTS_CHUNK, sizeof (host_t))))
+	return NULL;
+      intf -> chunks [id / HOSTS_CHUNK] = chunk;
+    }
+
+  h = chunk + id % HOSTS_CHUNK;
 
-  gettimeofday (& h -> first, NULL);
-  gettimeofday (& h -> last, NULL);
+  /* The capture time of the frame being decoded (see the sniffer) */
+  h -> first = intf -> clock;
+  h -> last  = intf -> clock;
 
   h -> intf = intf;
+  h -> id   = id;
+  h -> vlan = vlan;
+  h -> ifindex = intf -> ifindex;
   h -> ttl_shortest = 256;  /* This allow to correctly calculate its minimum value */
 
+  /*
+   * Only the sniffer adds hosts and the registry is never shrunk, so the host is
+   * published once fully initialized and a concurrent walk from hostfirst() is safe
+   */
+  __atomic_store_n (& intf -> hostno, id + 1, __ATOMIC_RELEASE);
+
   return h;
 }
 
@@ -64,21 +110,44 @@ host_t ** hargsadd (host_t * argv [], host_t * h)
 }
 
 
-/* Return all the pointers to the hosts maintained into the internal hash tables */
-host_t ** hostsall (interface_t * intf)
+/* Lookup a host by its identifier into the registry of 'intf' */
+host_t * hostbyid (interface_t * intf, unsigned id)
 {
-  /* Almost all the hosts are kept in the 'ipnames' hash table */
-  host_t ** hosts = (host_t **) htvalues (& intf -> ipnames);
+  return intf && id < __atomic_load_n (& intf -> hostno, __ATOMIC_ACQUIRE) ? intf -> chunks [id / HOSTS_CHUNK] + id % HOSTS_CHUNK : NULL;
+}
 
-  /* To complete the list I have to put all the IP-less equipment of the local subnet */
-  host_t ** hw = (host_t **) htvalues (& intf -> hwnames);
 
-  while (hw && * hw)
-    {
-      if (hostipless (* hw))
-	hosts = hargsadd (hosts, * hw);
-      hw ++;
-    }
+/*
+ * Cursor over the hosts cache of 'intf', each host is returned only once
+ * in the order they were first seen:
+ *
+ *   for (h = hostfirst (intf); h; h = hostnext (h))
+ *     ...
+ */
+host_t * hostfirst (interface_t * intf)
+{
+  return hostbyid (intf, 0);
+}
+
+
+/* Move the cursor to the next host in the cache */
+host_t * hostnext (host_t * h)
+{
+  return h ? hostbyid (h -> intf, h -> id + 1) : NULL;
+}
+
+
+/* Return all the pointers to the hosts maintained into the internal hash tables in a NULL terminated table */
+host_t ** hostsall (interface_t * intf)
+{
+  unsigned n = intf -> hostno;
+  host_t ** hosts = calloc (n + 1, sizeof (host_t *));
+  host_t * h;
+  unsigned i = 0;
+
+  /* Hosts added while walking are left out */
+  for (h = hostfirst (intf); hosts && h && i < n; h = hostnext (h))
+    hosts [i ++] = h;
 
   return hosts;
 }
@@ -98,43 +167,42 @@ char ** hostskeys (interface_t * intf)
 }
 
 
-/* Return the # of hosts on the local subnet */
-int hostnolocal (host_t * hosts [])
+/* Lookup for a key 'ksize' bytes long into the hash table 't' and return the host its content refers to (that is an identifier in the registry) */
+static host_t * hostlookup (interface_t * intf, void * k, unsigned long ksize, struct hash_table * t)
 {
-  int argc = 0;
-  while (hosts && * hosts)
-    if ((* hosts ++) -> hwaddress)
-      argc ++;
+  struct datum pair;
+  struct datum * h;
 
-  return argc;
+  pair . key   = k;
+  pair . ksize = ksize;
+
+  return (h = hash_table_search (t, & pair)) ? hostbyid (intf, (uintptr_t) h -> val) : NULL;
 }
 
 
-/* Return the # of hosts not on the local subnet */
-int hostnoforeign (host_t * hosts [])
+/*
+ * The binary key of an IPv6 address 'k' (optionally followed by %vlan) into 'key'
+ * and its size (0 if it is not an IPv6 address)
+ */
+static unsigned long ip6key (char * k, ip6key_t * key)
 {
-  int argc = 0;
-  while (hosts && * hosts)
-    {
-      if (! (* hosts) -> hwaddress && (* hosts) -> ipaddr)
-	argc ++;
-      hosts ++;
-    }
+  char addr [INET6_ADDRSTRLEN];
+  char * vlan = strrchr (k, '%');
+  char * end;
+  unsigned long v;
 
-  return argc;
-}
+  if (! vlan)
+    return inet_pton (AF_INET6, k, & key -> addr) == 1 ? sizeof (key -> addr) : 0;
 
+  v = strtoul (vlan + 1, & end, 10);
+  if (vlan - k >= (ptrdiff_t) sizeof (addr) || end == vlan + 1 || * end || ! v || v >= VLAN_IDS)
+    return 0;
 
-/* Lookup for a key into the hash table 't' and return its content (that is a pointer to host_t) */
-static host_t * hostlookup (char * k, struct hash_table * t)
-{
-  struct datum pair;
-  struct datum * h;
+  memcpy (addr, k, vlan - k);
+  addr [vlan - k] = '\0';
+  key -> vlan = v;
 
-  pair . key   = k;
-  pair . ksize = strlen (k);
-
-  return (h = hash_table_search (t, & pair)) ? (host_t *) h -> val : NULL;
+  return inet_pton (AF_INET6, addr, & key -> addr) == 1 ? IP6KEY_VLAN : 0;
 }
 
 
@@ -142,41 +210,80 @@ static host_t * hostlookup (char * k, struct hash_table * t)
 host_t * hostbykey (interface_t * intf, char * k)
 {
   host_t * h;
-  return (h = hostlookup (k, & intf -> hwnames)) || (h = hostlookup (k, & intf -> ipnames)) || (h = hostlookup (k, & intf -> hostnames)) ? h : NULL; 
+  ip6key_t ip6;
+  unsigned long len = strlen (k);
+
+  return (h = hostlookup (intf, k, len, & intf -> hwnames)) || (h = hostlookup (intf, k, len, & intf -> ipnames)) ||
+    (h = hostlookup (intf, k, len, & intf -> hostnames)) ||
+    ((len = ip6key (k, & ip6)) && (h = hostlookup (intf, & ip6, len, & intf -> ip6names))) ? h : NULL;
+}
+
+
+/* The key of a host in 'vlan', that is key%vlan (hosts are only keyed in a VLAN when those in different VLANs are kept apart) */
+static char * vlankey (char * key, int vlan, char * buf, size_t size)
+{
+  if (! key || ! vlan)
+    return key;
+
+  snprintf (buf, size, "%s%%%d", key, vlan);
+  return buf;
+}
+
+
+/* A private copy of a key 'ksize' bytes long (also a string as it is '\0' terminated) */
+static void * keydup (void * key, unsigned long ksize)
+{
+  char * k = malloc (ksize + 1);
+
+  if (k)
+    memcpy (k, key, ksize),
+      k [ksize] = '\0';
+  return k;
 }
 
 
-/* Insert an item (key => pointer to host_t) into the hash table 't' */
-static host_t * htadd (interface_t * intf, char * key, struct hash_table * t)
+/*
+ * Insert an item (key => identifier of a new host) into the hash table 't' and bump 'count' when a new host is allocated.
+ * The key is 'ksize' bytes long, 'name' is the same key for humans
+ */
+static host_t * htadd (interface_t * intf, int vlan, void * key, unsigned long ksize, char * name, struct hash_table * t, unsigned * count)
 {
   struct datum pair;
   host_t * h;
 
   /* Lookup if the name is already known */
-  if ((h = hostlookup (key, t)))
+  if ((h = hostlookup (intf, key, ksize, t)))
     {
       /* Already in, then set the time it was last seen */
-      gettimeofday (& h -> last, NULL);
+      h -> last = intf -> clock;
       return h;
     }
 
+  /* A new host in the registry */
+  if (! (h = mkhost (intf, vlan)))
+    return NULL;
+  (* count) ++;
+
   /* The key */
-  pair . key   = strdup (key);
-  pair . ksize = strlen (key);
+  pair . key   = keydup (key, ksize);
+  pair . ksize = ksize;
 
-  /* The value is a pointer to a new allocated host_t */
-  h = pair . val = mkhost (intf);
-  pair . vsize   = sizeof (host_t);
+  /* The value is the identifier of the host in the registry (not an object to be freed) */
+  pair . val   = (void *) (uintptr_t) h -> id;
+  pair . vsize = 0;
 
-  /* Insert only the key into the table and a reference to the object */
+  /* Insert the key into the table and the identifier of the host */
   hash_table_refer (t, & pair);
 
+  /* Make the new name available for completion */
+  trieadd (& intf -> names, name);
+
   return h;
 }
 
 
-/* Bind an item (key => reference to host_t) into the hash table 't' */
-static host_t * htbind (char * key, host_t * ref, struct hash_table * t)
+/* Bind an item (key 'ksize' bytes long => identifier of the already existing host 'ref') into the hash table 't' */
+static host_t * htbind (interface_t * intf, void * key, unsigned long ksize, char * name, host_t * ref, struct hash_table * t)
 {
   struct datum pair;
   host_t * h;
@@ -185,51 +292,162 @@ static host_t * htbind (char * key, host_t * ref, struct hash_table * t)
     return NULL;
 
   /* Lookup if the name is already known */
-  if ((h = hostlookup (key, t)))
+  if ((h = hostlookup (intf, key, ksize, t)))
     {
       /* Already in, then set the time it was last seen */
-      gettimeofday (& h -> last, NULL);
+      h -> last = intf -> clock;
       return h;
     }
 
+  /* Nothing to bind to (e.g. the receiver of a broadcast frame) */
+  if (! ref)
+    return NULL;
+
   /* The key */
-  pair . key   = strdup (key);
-  pair . ksize = strlen (key);
+  pair . key   = keydup (key, ksize);
+  pair . ksize = ksize;
 
-  /* The value is a pointer to an already existing object host_t referenced by 'ref' */
-  pair . val   = ref;
-  pair . vsize = sizeof (host_t);
+  /* The value is the identifier of the host referenced by 'ref' */
+  pair . val   = (void *) (uintptr_t) ref -> id;
+  pair . vsize = 0;
 
-  /* Insert the only the key into the table and the reference to the object */
+  /* Insert the key into the table and the identifier of the host */
   hash_table_refer (t, & pair);
 
+  /* Make the new name available for completion */
+  trieadd (& intf -> names, name);
+
   return ref;
 }
 
 
 /* Add a HW address to the hash table of knows names (if not already in) */
-host_t * addtohwnames (interface_t * intf, char * key)
+host_t * addtohwnames (interface_t * intf, char * key, int vlan)
 {
-  return htadd (intf, key, & intf -> hwnames);
+  char buf [KEYLEN];
+
+  key = vlankey (key, vlan, buf, sizeof (buf));
+  return htadd (intf, vlan, key, strlen (key), key, & intf -> hwnames, & intf -> hostno_local);
 }
 
 
 /* Add an IP address to the hash table of knows address (if not already in) */
-host_t * addtoipnames (interface_t * intf, char * key)
+host_t * addtoipnames (interface_t * intf, char * key, int vlan)
 {
-  return strcmp (key, NULL_IPADDR) ? htadd (intf, key, & intf -> ipnames) : NULL;
+  char buf [KEYLEN];
+
+  if (! strcmp (key, NULL_IPADDR))
+    return NULL;
+
+  key = vlankey (key, vlan, buf, sizeof (buf));
+  return htadd (intf, vlan, key, strlen (key), key, & intf -> ipnames, & intf -> hostno_foreign);
 }
 
 
 /* Bind an IP address to an already allocated object passed by reference 'h' (if not already bound) */
-host_t * bindtoipnames (interface_t * intf, char * ipaddr, host_t * h)
+host_t * bindtoipnames (interface_t * intf, char * ipaddr, int vlan, host_t * h)
 {
-  return htbind (ipaddr, h, & intf -> ipnames);
+  char buf [KEYLEN];
+
+  ipaddr = vlankey (ipaddr, vlan, buf, sizeof (buf));
+  return ipaddr ? htbind (intf, ipaddr, strlen (ipaddr), ipaddr, h, & intf -> ipnames) : NULL;
 }
 
 
 /* Bind a hostname to an already allocated object passed by reference 'h' (if not already bound) */
 host_t * bindtohostnames (interface_t * intf, char * hostname, host_t * h)
 {
-  return htbind (hostname, h, & intf -> hostnames);
+  return hostname ? htbind (intf, hostname, strlen (hostname), hostname, h, & intf -> hostnames) : NULL;
+}
+
+
+/*
+ * The hash function of the IPv6 addresses (the keys begin with the 16 bytes of the address,
+ * the same address in different VLANs just falls in the same bucket)
+ */
+unsigned long hash_ip6 (char * key)
+{
+  uint64_t hi;
+  uint64_t lo;
+  uint64_t x;
+
+  memcpy (& hi, key, sizeof (hi));
+  memcpy (& lo, key + sizeof (hi), sizeof (lo));
+
+  /* The interface identifier changes the most, mix it with the prefix (murmur3 finalizer) */
+  x = lo ^ (hi * 0x9e3779b97f4a7c15ULL);
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+
+  return x;
+}
+
+
+/* The binary key of an IPv6 address in 'vlan' (and its size) */
+static unsigned long ip6vlankey (struct in6_addr * addr, int vlan, ip6key_t * key)
+{
+  memset (key, 0, sizeof (* key));
+  key -> addr = * addr;
+
+  if (! vlan)
+    return sizeof (key -> addr);
+
+  key -> vlan = vlan;
+  return IP6KEY_VLAN;
+}
+
+
+/* The same binary key for humans */
+static char * ip6name (ip6key_t * key, char * name, size_t size)
+{
+  if (! inet_ntop (AF_INET6, & key -> addr, name, size))
+    return NULL;
+
+  if (key -> vlan)
+    snprintf (name + strlen (name), size - strlen (name), "%%%u", key -> vlan);
+  return name;
+}
+
+
+/* Add an IPv6 address to the hash table of knows IPv6 addresses (if not already in), the address is never converted when already known */
+host_t * addtoip6names (interface_t * intf, struct in6_addr * addr, int vlan)
+{
+  host_t * h;
+  ip6key_t key;
+  unsigned long ksize;
+  char name [KEYLEN];
+
+  if (IN6_IS_ADDR_UNSPECIFIED (addr))
+    return NULL;
+
+  ksize = ip6vlankey (addr, vlan, & key);
+  if ((h = hostlookup (intf, & key, ksize, & intf -> ip6names)))
+    {
+      /* Already in, then set the time it was last seen */
+      h -> last = intf -> clock;
+      return h;
+    }
+
+  return htadd (intf, vlan, & key, ksize, ip6name (& key, name, sizeof (name)), & intf -> ip6names, & intf -> hostno_foreign);
+}
+
+
+/* Bind an IPv6 address to an already allocated object passed by reference 'h' (if not already bound) */
+host_t * bindtoip6names (interface_t * intf, struct in6_addr * addr, int vlan, host_t * h)
+{
+  host_t * known;
+  ip6key_t key;
+  unsigned long ksize;
+  char name [KEYLEN];
+
+  ksize = ip6vlankey (addr, vlan, & key);
+  if ((known = hostlookup (intf, & key, ksize, & intf -> ip6names)))
+    {
+      /* Already in, then set the time it was last seen */
+      known -> last = intf -> clock;
+      return known;
+    }
+
+  return htbind (intf, & key, ksize, ip6name (& key, name, sizeof (name)), h, & intf -> ip6names);
 }
@@ -0,0 +1,245 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * The Internet checksum (RFC 1071) of the IP, TCP and UDP packets
+ *
+ * The 16-bit words are added in the byte order of the host and the sum is
+ * only compared with 0xffff (a packet with a right checksum sums to -0), so
+ * it never needs to be swapped.  The words are added in 32-bit lanes (16 at
+ * a time with AVX2, 8 with SSE2, 2 by the scalar loop) and folded once at the
+ * end.  The AVX2 kernel is chosen at run time when the CPU has it, whatever
+ * the flags the sources are compiled with.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* # of blocks added before the 32-bit lanes are flushed to 64 bits (each lane grows by at most 2 * 0xffff per block) */
+#define CKSUM_FLUSH  16384
+
+
+/* A checksum kernel: the ones' complement sum of 'len' bytes at 'p' added to 'sum' (not folded) */
+typedef uint64_t kernel_f (const u_char * p, size_t len, uint64_t sum);
+
+
+/* Fold a sum to 16 bits */
+static uint16_t fold (uint64_t sum)
+{
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return sum;
+}
+
+
+/* The bytes left over by the vector kernels (less than a block), 32 bits at a time */
+static uint64_t tail (const u_char * p, size_t len, uint64_t sum)
+{
+  uint32_t w32;
+  uint16_t w16 = 0;
+
+  for (; len >= 4; p += 4, len -= 4)
+    memcpy (& w32, p, 4),
+      sum += w32;
+
+  if (len >= 2)
+    memcpy (& w16, p, 2),
+      sum += w16,
+      p += 2,
+      len -= 2;
+
+  /* An odd byte is the first of a word padded with zero */
+  if (len)
+    {
+      u_char last [2] = { * p, 0 };
+      memcpy (& w16, last, 2);
+      sum += w16;
+    }
+
+  return sum;
+}
+
+
+/* The scalar kernel */
+static uint64_t scalar (const u_char * p, size_t len, uint64_t sum)
+{
+  return tail (p, len, sum);
+}
+
+
+#if defined(__SSE2__)
+/* 16 bytes at a time, the 8 words are widened to 32 bits and added in 4 lanes */
+static uint64_t sse2 (const u_char * p, size_t len, uint64_t sum)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+
+  while (len >= 16)
+    {
+      __m128i acc = zero;
+      uint32_t lanes [4];
+      size_t n;
+
+      for (n = 0; len >= 16 && n < CKSUM_FLUSH; p += 16, len -= 16, n ++)
+	{
+	  __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+	  acc = _mm_add_epi32 (acc, _mm_unpacklo_epi16 (v, zero));
+	  acc = _mm_add_epi32 (acc, _mm_unpackhi_epi16 (v, zero));
+	}
+
+      _mm_storeu_si128 ((__m128i *) lanes, acc);
+      sum += (uint64_t) lanes [0] + lanes [1] + lanes [2] + lanes [3];
+    }
+
+  return tail (p, len, sum);
+}
+#endif /* __SSE2__ */
+
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CKSUM_AVX2
+/* 32 bytes at a time, the 16 words are widened to 32 bits and added in 8 lanes */
+__attribute__ ((target ("avx2")))
+static uint64_t avx2 (const u_char * p, size_t len, uint64_t sum)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+
+  while (len >= 32)
+    {
+      __m256i acc = zero;
+      uint32_t lanes [8];
+      size_t n;
+      int i;
+
+      for (n = 0; len >= 32 && n < CKSUM_FLUSH; p += 32, len -= 32, n ++)
+	{
+	  __m256i v = _mm256_loadu_si256 ((const __m256i *) p);
+	  acc = _mm256_add_epi32 (acc, _mm256_unpacklo_epi16 (v, zero));
+	  acc = _mm256_add_epi32 (acc, _mm256_unpackhi_epi16 (v, zero));
+	}
+
+      _mm256_storeu_si256 ((__m256i *) lanes, acc);
+      for (i = 0; i < 8; i ++)
+	sum += lanes [i];
+    }
+
+  return tail (p, len, sum);
+}
+#endif /* CKSUM_AVX2 */
+
+
+/* The fastest kernel of this CPU (chosen once, see pick()) */
+static kernel_f * fastest = NULL;
+static char * fastestname = "scalar";
+
+
+/* Choose the fastest kernel of this CPU */
+static kernel_f * pick (void)
+{
+  kernel_f * k = scalar;
+  char * name = "scalar";
+
+#if defined(__SSE2__)
+  k = sse2;
+  name = "sse2";
+#endif /* __SSE2__ */
+#if defined(CKSUM_AVX2)
+  if (__builtin_cpu_supports ("avx2"))
+    k = avx2,
+      name = "avx2";
+#endif /* CKSUM_AVX2 */
+
+  /* All the threads pick the same, a race here is harmless */
+  fastestname = name;
+  return fastest = k;
+}
+
+
+/* The ones' complement sum of 'len' bytes at 'p' added to 'sum', folded to 16 bits (0xffff if the checksum they include is right) */
+uint16_t cksum (const void * p, size_t len, uint32_t sum)
+{
+  return fold ((fastest ? fastest : pick ()) (p, len, sum));
+}
+
+
+/* The same by the scalar kernel only (see pkbench) */
+uint16_t cksumscalar (const void * p, size_t len, uint32_t sum)
+{
+  return fold (scalar (p, len, sum));
+}
+
+
+/* The name of the kernel used by cksum() */
+char * cksumname (void)
+{
+  if (! fastest)
+    pick ();
+  return fastestname;
+}
+
+
+/* Is the header checksum of the IPv4 packet 'ip' right? (the whole header is there, see ip()) */
+bool ipsumok (struct ip * ip)
+{
+  return cksum (ip, ip -> ip_hl * 4, 0) == 0xffff;
+}
+
+
+/*
+ * Is the checksum of the TCP or UDP segment 'p' (of the IP 'proto') right?  The IP header in front of it is 'h -> protocol'.
+ * Return 1 if right, 0 if wrong, -1 if it cannot be told (a fragment, a segment not captured in full or no checksum at all)
+ */
+int l4sumok (interface_t * intf, header_t * h, u_char * p, int proto)
+{
+  const u_char * iph = h -> protocol;
+  size_t len;
+  uint32_t sum;
+
+  if (intf -> fragment)
+    return -1;
+
+  /* The length of the segment is told by the IP header, the frame may be padded */
+  if ((iph [0] >> 4) == 4)
+    {
+      struct ip * ip = (struct ip *) iph;
+
+      if (ntohs (ip -> ip_len) < p - iph)
+	return -1;
+      len = ntohs (ip -> ip_len) - (p - iph);
+
+      /* Source and destination addresses, then the protocol and the length */
+      sum = cksum (& ip -> ip_src, 2 * sizeof (struct in_addr), 0);
+    }
+  else
+    {
+      struct ip6_hdr * ip6 = (struct ip6_hdr *) iph;
+
+      if (ntohs (ip6 -> ip6_plen) + sizeof (struct ip6_hdr) < (size_t) (p - iph))
+	return -1;
+      len = ntohs (ip6 -> ip6_plen) + sizeof (struct ip6_hdr) - (p - iph);
+
+      sum = cksum (& ip6 -> ip6_src, 2 * sizeof (struct in6_addr), 0);
+    }
+
+  /* A segment not captured in full, or an UDP datagram over IPv4 sent with no checksum */
+  if (len > h -> caplen || (proto == IPPROTO_UDP && (iph [0] >> 4) == 4 && len >= 8 && ! p [6] && ! p [7]))
+    return -1;
+
+  sum += htons (proto) + htons (len);
+
+  return cksum (p, len, sum) == 0xffff;
+}
@@ -129,13 +129,17 @@ int pksh_pkclose (int argc, char * argv [])
       /* Lookup for the given name in the table of enabled interfaces */
       if (! (interface = intfbyname (interfaces, name)))
 	printf ("%s: unknown interface %s\n", argv [0], name);
+      else if (interface -> remote)
+	printf ("%s: interface %s is captured by pkshd (use 'pkattach --detach')\n", argv [0], name);
       else
 	{
 	  /* This should allow the sniffer thread to terminate as soon as possible */
 	  interface -> status = INTERFACE_READY;
 
 	  /* Free the descriptor from the table of network interfaces */
+	  intflock ();
 	  interfaces = intfsub (interfaces, name);
+	  intfunlock ();
 
 	  /* Keep track of the last active interface */
 	  resetactiveintf (interface);
@@ -20,6 +20,7 @@ static pksh_cmd_t * commands [] =
   & cmd_about,
   & cmd_version,
   & cmd_license,
+  & cmd_complete,
 
   /* Network Interfaces */
   & cmd_dev,
@@ -30,6 +31,9 @@ static pksh_cmd_t * commands [] =
   & cmd_uptime,
   & cmd_filter,
   & cmd_swap,
+  & cmd_attach,
+  & cmd_metrics,
+  & cmd_dump,
 
   /* Viewers */
   & cmd_packets,
@@ -39,6 +43,7 @@ static pksh_cmd_t * commands [] =
   & cmd_finger,
   & cmd_last,
   & cmd_who,
+  & cmd_vlans,
 #if defined(ROCCO)
   & cmd_services,
 #endif /* ROCCO */
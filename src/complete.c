@@ -0,0 +1,152 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+
+/* Project header */
+#include "pksh.h"
+
+/* Identifiers */
+#define NAME         "pkcomplete"
+#define BRIEF        "List the hosts identifiers starting with a given prefix"
+#define SYNOPSIS     "pkcomplete [options] [prefix]"
+#define DESCRIPTION  "Used by the shell for TAB-completion of hosts identifiers"
+
+/* Public variable */
+pksh_cmd_t cmd_complete = { NAME, BRIEF, SYNOPSIS, DESCRIPTION, pksh_pkcomplete };
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  /* Interface */
+  OPT_INTERFACE   = 'i',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  /* Interface */
+  { "interface",     required_argument, NULL, OPT_INTERFACE   },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' lists all the HW addresses, IP addresses and hostnames seen on an interface starting with 'prefix'\n", progname);
+  printf ("     (when 'prefix' is not given it is the last word of $COMMAND_LINE as set by the shell during completion)\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] [prefix]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s 192.168.        # list all the addresses in the 192.168/16 network\n", progname);
+  printf ("   complete pkhosts 'p/*/`%s`/'  # how the shell uses it\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -i, --interface              specify the interface (default the active one)\n");
+}
+
+
+/* The word being completed (empty when the command line ends with a blank) */
+static char * lastword (char * line)
+{
+  char * word = line;
+  char * p;
+
+  if (! line)
+    return "";
+
+  for (p = line; * p; p ++)
+    if (* p == ' ' || * p == '\t')
+      word = p + 1;
+
+  return word;
+}
+
+
+/* List the identifiers in the hosts index starting with a given prefix */
+int pksh_pkcomplete (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+  char * sopts    = optlegitimate (lopts);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  char * name     = NULL;
+
+  int option;
+
+  /* Local variables */
+  interface_t * interface;
+  char * prefix;
+  char ** keys;
+  char ** k;
+
+  /* Lookup for the command in the static table of registered extensions */
+  if (! cmd_by_name (progname))
+    {
+      printf ("%s: Command [%s] not found.\n", progname, progname);
+      return -1;
+    }
+
+  /* Parse command line options to the application via standard system calls */
+  optind = 0;
+  optarg = NULL;
+  argv [0] = progname;
+  while ((option = getopt_long (argc, argv, sopts, lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:  usage (progname, lopts); return 0;
+	case OPT_QUIET: quiet = true;            break;
+
+	  /* Interface */
+	case OPT_INTERFACE: name = optarg;       break;
+	}
+    }
+
+  /* Nothing to complete when no interface is capturing packets */
+  if (! name && ! (name = getintfname ()))
+    return 0;
+  if (! (interface = intfbyname (interfaces, name)) || interface -> status != INTERFACE_ENABLED)
+    return 0;
+
+  prefix = optind < argc ? argv [optind] : lastword (getenv ("COMMAND_LINE"));
+
+  /* The index is queried directly, only the matching subtree is visited */
+  keys = trieprefix (& interface -> names, prefix);
+  for (k = keys; k && * k; k ++)
+    printf ("%s\n", * k);
+  if (keys)
+    argsclear (keys);
+
+  /* Bye bye! */
+  return 0;
+}
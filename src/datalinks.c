@@ -8,7 +8,8 @@
  *
  * Network interfaces protocol decoders for:
  *   * DLT_NULL (Loopback interface)
- *   * DLT_EN10MB (Ethernet 10Mb and up)
+ *   * DLT_EN10MB (Ethernet 10Mb and up, also 802.1Q and 802.1ad/QinQ tagged)
+ *   * DLT_LINUX_SLL and DLT_LINUX_SLL2 (Linux cooked capture of the 'any' device)
  */
 
 
@@ -28,6 +29,41 @@
  * It contains a network order 32 bit integer that specifies the family, e.g. AF_INET */
 #define LOOPBACK_HEADER 4
 
+/* The length of a VLAN tag (TPID + TCI) and the TPIDs of 802.1Q, 802.1ad (QinQ) and the pre-standard QinQ */
+#define VLAN_TAG        4
+#define TPID_8021Q      0x8100
+#define TPID_8021AD     0x88a8
+#define TPID_QINQ       0x9100
+
+/* The TPID of a frame is a VLAN tag? */
+#define ISVLAN(t)       ((t) == TPID_8021Q || (t) == TPID_8021AD || (t) == TPID_QINQ)
+
+/*
+ * The Linux cooked capture headers (see pcap-linktype(7)), all fields in network order
+ *   SLL  (16 bytes): packet type (2), hardware type (2), address length (2), address (8), protocol (2)
+ *   SLL2 (20 bytes): protocol (2), reserved (2), interface index (4), hardware type (2), packet type (1), address length (1), address (8)
+ */
+#define SLL_HEADER      16
+#define SLL2_HEADER     20
+#define SLL_ADDRLEN     8
+
+/* The packet types of the cooked headers */
+#define SLL_BROADCAST   1
+#define SLL_MULTICAST   2
+
+/* The hardware type of Ethernet devices (ARPHRD_ETHER), only their addresses name hosts */
+#define SLL_ETHER       1
+
+/* The longest headers the decoders look at past the data-link header (see headerslen) */
+#define VLAN_MAXTAGS    2              /* QinQ                                                  */
+#define IP_MAXHEADER    60             /* 15 words, IP options included                         */
+#define IP6_MAXHEADER   (40 + 64)      /* the fixed header and up to 64 bytes of extension ones */
+#define TCP_MAXHEADER   60             /* 15 words, the options needed by the OS fingerprints   */
+
+/* Fields in network order */
+#define GET16(p)        ((unsigned) (p) [0] << 8 | (p) [1])
+#define GET32(p)        (GET16 (p) << 16 | GET16 ((p) + 2))
+
 
 /* Ethernet address length in human readable format "xx:xx:xx:xx:xx:xx" */
 #define ETHADDRLEN      18
@@ -63,6 +99,7 @@ static char * eth_multicast [] =
 static protocol_t l2_protocols [] =
 {
   { ETHERTYPE_IP,     ip   },
+  { ETHERTYPE_IPV6,   ip6  },
   { ETHERTYPE_ARP,    arp  },
   { ETHERTYPE_REVARP, rarp },
   { -1,               NULL },
@@ -97,7 +134,7 @@ int multicast (char * addr)
 static char hex [] = "0123456789abcdef";
 char * mactoa (u_char * e)
 {
-  static char mac [ETHADDRLEN];
+  static __thread char mac [ETHADDRLEN];  /* each sniffer has its own */
 
   char * p = mac;
   int i;
@@ -112,18 +149,61 @@ char * mactoa (u_char * e)
 }
 
 
+/*
+ * Strip the VLAN tags (if any) following the 'hlen' bytes of the header of a frame whose protocol is 'type',
+ * count the frame foreach VLAN and return the length of the header including the tags (the innermost VLAN
+ * identifier is that of the frame and 'type' is set to the encapsulated protocol)
+ */
+static unsigned vlanstrip (interface_t * intf, struct pcap_pkthdr * h, const u_char * p, unsigned hlen, unsigned * type)
+{
+  unsigned tags = 0;
+
+  while (ISVLAN (* type) && h -> caplen >= hlen + VLAN_TAG)
+    {
+      unsigned vid = GET16 (p + hlen) & (VLAN_IDS - 1);
+
+      if (vid)
+	intf -> vlan = vid;
+      * type = GET16 (p + hlen + 2);
+      hlen += VLAN_TAG;
+      tags ++;
+    }
+
+  if (tags)
+    {
+      intf -> bytes_vlan += h -> len * intf -> weight;
+      intf -> pkts_vlan += intf -> weight;
+      if (tags > 1)
+	intf -> pkts_qinq += intf -> weight;
+
+      /* Dense counters indexed by the VLAN identifier (allocated at the first tagged frame) */
+      if (intf -> vlans || (intf -> vlans = calloc (VLAN_IDS, sizeof (vlan_t))))
+	{
+	  intf -> vlans [intf -> vlan] . bytes += h -> len * intf -> weight;
+	  intf -> vlans [intf -> vlan] . pkts += intf -> weight;
+	}
+    }
+
+  return hlen;
+}
+
+
 /* Protocol decoder/counter for Ethernet interfaces
  *  Ethernet sizes
  *
- * The header is 14 bytes long - eg. sizeof (struct ether_header)
+ * The header is 14 bytes long - eg. sizeof (struct ether_header) - plus 4 bytes foreach VLAN tag.
+ * Tags are stripped before the encapsulated protocol is decoded, and the frame is counted in
+ * the VLAN of its innermost tag (the customer VLAN of QinQ frames)
  */
 void ethernet (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
 {
   /* The Ethernet Protocol */
   struct ether_header * eth = (struct ether_header *) p;
+  unsigned hlen;
+  unsigned type;
 
   /* Header for the encapsulated protocols (IP, ARP, RARP, ...) */
-  header_t header = { p, & h -> ts, h -> len - ETHERNET_HEADER, h -> caplen - ETHERNET_HEADER };
+  header_t header;
 
   char * addr;
   host_t * tx;
@@ -131,20 +211,32 @@ void ethernet (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
   protocol_t * protocol;
 
   /* Update bytes and packets counters */
-  intf -> headers_total += ETHERNET_HEADER;
-  intf -> bytes_total += h -> len;
-  intf -> pkts_total ++;
+  intf -> bytes_total += h -> len * intf -> weight;
+  intf -> pkts_total += intf -> weight;
 
   /* Check for boundaries */
+  intf -> vlan = 0;
   if (h -> caplen < ETHERNET_HEADER)
-    return;
+    {
+      intf -> headers_total += ETHERNET_HEADER * intf -> weight;
+      return;
+    }
+
+  type = ntohs (eth -> ether_type);
+  hlen = vlanstrip (intf, h, p, ETHERNET_HEADER, & type);
+  intf -> headers_total += hlen * intf -> weight;
+
+  header . protocol = p;
+  header . ts       = & h -> ts;
+  header . len      = h -> len > hlen ? h -> len - hlen : 0;
+  header . caplen   = h -> caplen > hlen ? h -> caplen - hlen : 0;
 
   /* Get source Ethernet address and add it to the space of known HW names (if not already in) */
-  tx = addtohwnames (intf, addr = mactoa ((u_char *) & eth -> ether_shost));
+  tx = addtohwnames (intf, addr = mactoa ((u_char *) & eth -> ether_shost), KEYVLAN (intf));
 
   /* Update bytes and packets counters for the transmitting TX equipment */
-  tx -> bytes_sent += h -> len;
-  tx -> pkts_sent ++;
+  tx -> bytes_sent += h -> len * intf -> weight;
+  tx -> pkts_sent += intf -> weight;
 
   /* Update TX source Ethernet address and vendor name (if still missing) */
   if (! tx -> hwaddress)
@@ -154,29 +246,29 @@ void ethernet (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
   /* Get destination Ethernet address and lookup for Broadcast Ethernet address to avoid its inclusion to the space of known HW names */
   if (! strcmp (addr = mactoa ((u_char *) & eth -> ether_dhost), ETH_BROADCAST))
     {
-      intf -> bytes_broadcast += h -> len;
-      intf -> pkts_broadcast ++;
-      tx -> bytes_broadcast += h -> len;
-      tx -> pkts_broadcast ++;
+      intf -> bytes_broadcast += h -> len * intf -> weight;
+      intf -> pkts_broadcast += intf -> weight;
+      tx -> bytes_broadcast += h -> len * intf -> weight;
+      tx -> pkts_broadcast += intf -> weight;
     }
   else
     {
       /* Lookup for Multicast destination Ethernet address to avoid inclusion into hosts cache */
       if (multicast (addr))
 	{
-	  intf -> bytes_multicast += h -> len;
-	  intf -> pkts_multicast ++;
-	  tx -> bytes_multicast += h -> len;
-	  tx -> pkts_multicast ++;
+	  intf -> bytes_multicast += h -> len * intf -> weight;
+	  intf -> pkts_multicast += intf -> weight;
+	  tx -> bytes_multicast += h -> len * intf -> weight;
+	  tx -> pkts_multicast += intf -> weight;
 	}
       else
 	{
 	  /* Add destination Ethernet address to the space of known HW names (if not already in) */
-	  rx = addtohwnames (intf, addr);
+	  rx = addtohwnames (intf, addr, KEYVLAN (intf));
 
 	  /* Update bytes and packets counters for the receiving RX equipment */
-	  rx -> bytes_recv += h -> len;
-	  rx -> pkts_recv ++;
+	  rx -> bytes_recv += h -> len * intf -> weight;
+	  rx -> pkts_recv += intf -> weight;
 
 	  /* Update RX destination Ethernet address and vendor name (if still missing) */
 	  if (! rx -> hwaddress)
@@ -186,11 +278,135 @@ void ethernet (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
     }
 
   /* Attempt to decode and count packets foreach known protocol id (IP, ARP, RARP, ...) */
-  if ((protocol = l2_protocol (ntohs (eth -> ether_type))))
-    protocol -> counter (intf, & header, (u_char *) eth + ETHERNET_HEADER, tx, rx);
+  if (! ISVLAN (type) && (protocol = l2_protocol (type)))
+    protocol -> counter (intf, & header, (u_char *) p + hlen, tx, rx);
   else
-    intf -> bytes_non_ip += h -> len - ETHERNET_HEADER,
-      intf -> pkts_non_ip ++;
+    intf -> bytes_non_ip += header . len * intf -> weight,
+      intf -> pkts_non_ip += intf -> weight;
+}
+
+
+/* Count a frame on the device 'ifindex' seen by the 'any' device (the counters are allocated in chunks at the first frame seen on them) */
+static void ifcount (interface_t * intf, unsigned ifindex, unsigned len)
+{
+  ifindex_t * chunk;
+
+  if (ifindex >= IFINDEX_CHUNK * IFINDEX_CHUNKS)
+    return;
+
+  if (! (chunk = intf -> ifindexes [ifindex / IFINDEX_CHUNK]))
+    {
+      if (! (chunk = calloc (IFINDEX_CHUNK, sizeof (ifindex_t))))
+	return;
+      __atomic_store_n (& intf -> ifindexes [ifindex / IFINDEX_CHUNK], chunk, __ATOMIC_RELEASE);
+    }
+
+  chunk [ifindex % IFINDEX_CHUNK] . bytes += len * intf -> weight;
+  chunk [ifindex % IFINDEX_CHUNK] . pkts += intf -> weight;
+
+  if (ifindex >= intf -> ifindexmax)
+    __atomic_store_n (& intf -> ifindexmax, ifindex + 1, __ATOMIC_RELEASE);
+}
+
+
+/*
+ * Protocol decoder/counter for the Linux cooked capture, once the fields of the 'hlen' bytes long header are known:
+ * the packet type, the hardware type and the address of the sender, the encapsulated protocol and the index of the
+ * device (0 if unknown).  The receiver is not in the header, so only the sender is known by its hardware address
+ */
+static void cooked (interface_t * intf, struct pcap_pkthdr * h, const u_char * p, unsigned hlen,
+		    unsigned pkttype, unsigned hatype, unsigned halen, const u_char * addr, unsigned type, unsigned ifindex)
+{
+  /* Header for the encapsulated protocols (IP, ARP, RARP, ...) */
+  header_t header;
+
+  char * mac;
+  host_t * tx = NULL;
+  protocol_t * protocol;
+
+  /* The device and the VLAN (if still tagged) of the frame being decoded, hosts first seen now are bound to them */
+  intf -> ifindex = ifindex;
+  intf -> vlan    = 0;
+  ifcount (intf, ifindex, h -> len);
+
+  hlen = vlanstrip (intf, h, p, hlen, & type);
+  intf -> headers_total += hlen * intf -> weight;
+
+  header . protocol = p;
+  header . ts       = & h -> ts;
+  header . len      = h -> len > hlen ? h -> len - hlen : 0;
+  header . caplen   = h -> caplen > hlen ? h -> caplen - hlen : 0;
+
+  /* Get source Ethernet address and add it to the space of known HW names (if not already in) */
+  if (hatype == SLL_ETHER && halen == ETHER_ADDR_LEN && (tx = addtohwnames (intf, mac = mactoa ((u_char *) addr), KEYVLAN (intf))))
+    {
+      tx -> bytes_sent += h -> len * intf -> weight;
+      tx -> pkts_sent += intf -> weight;
+
+      if (! tx -> hwaddress)
+	tx -> hwaddress = strdup (mac);
+      resolvvendorname (tx);
+    }
+
+  if (pkttype == SLL_BROADCAST)
+    {
+      intf -> bytes_broadcast += h -> len * intf -> weight;
+      intf -> pkts_broadcast += intf -> weight;
+      if (tx)
+	tx -> bytes_broadcast += h -> len * intf -> weight,
+	  tx -> pkts_broadcast += intf -> weight;
+    }
+  else if (pkttype == SLL_MULTICAST)
+    {
+      intf -> bytes_multicast += h -> len * intf -> weight;
+      intf -> pkts_multicast += intf -> weight;
+      if (tx)
+	tx -> bytes_multicast += h -> len * intf -> weight,
+	  tx -> pkts_multicast += intf -> weight;
+    }
+
+  /* Attempt to decode and count packets foreach known protocol id (IP, ARP, RARP, ...) */
+  if (! ISVLAN (type) && (protocol = l2_protocol (type)))
+    protocol -> counter (intf, & header, (u_char *) p + hlen, tx, NULL);
+  else
+    intf -> bytes_non_ip += header . len * intf -> weight,
+      intf -> pkts_non_ip += intf -> weight;
+}
+
+
+/* Protocol decoder/counter for the Linux cooked capture (DLT_LINUX_SLL, the device of the frames is unknown) */
+void sll (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
+{
+  /* Update bytes and packets counters */
+  intf -> bytes_total += h -> len * intf -> weight;
+  intf -> pkts_total += intf -> weight;
+
+  /* Check for boundaries */
+  if (h -> caplen < SLL_HEADER)
+    {
+      intf -> headers_total += SLL_HEADER * intf -> weight;
+      return;
+    }
+
+  cooked (intf, h, p, SLL_HEADER, GET16 (p), GET16 (p + 2), MIN (GET16 (p + 4), SLL_ADDRLEN), p + 6, GET16 (p + 14), 0);
+}
+
+
+/* Protocol decoder/counter for the Linux cooked capture v2 (DLT_LINUX_SLL2, with the index of the device of the frames) */
+void sll2 (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
+{
+  /* Update bytes and packets counters */
+  intf -> bytes_total += h -> len * intf -> weight;
+  intf -> pkts_total += intf -> weight;
+
+  /* Check for boundaries */
+  if (h -> caplen < SLL2_HEADER)
+    {
+      intf -> headers_total += SLL2_HEADER * intf -> weight;
+      return;
+    }
+
+  cooked (intf, h, p, SLL2_HEADER, p [10], GET16 (p + 8), MIN (p [11], SLL_ADDRLEN), p + 12, GET16 (p), GET32 (p + 4));
 }
 
 
@@ -201,22 +417,56 @@ void loopback (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
   struct ether_header * e = (struct ether_header *) p;
 
   /* Header for the encapsulated protocol (IP, ARP, RARP, ...) */
-  header_t header = { p, & h -> ts, h -> len - LOOPBACK_HEADER, h -> caplen - LOOPBACK_HEADER };
+  header_t header;
 
   protocol_t * protocol;
-
-  /* Add source loopback IP address into the IP space of known names (if not already in) */
-  host_t * srchost = addtohwnames (intf, LOOPBACK_ADDR);
+  host_t * srchost;
 
   /* Update counters */
-  intf -> headers_total += LOOPBACK_HEADER;
-  intf -> bytes_total += h -> len;
-  intf -> pkts_total ++;
+  intf -> headers_total += LOOPBACK_HEADER * intf -> weight;
+  intf -> bytes_total += h -> len * intf -> weight;
+  intf -> pkts_total += intf -> weight;
+
+  /* Check for boundaries (the type is that of the Ethernet header) */
+  if (h -> caplen < ETHERNET_HEADER)
+    return;
+
+  header . protocol = p;
+  header . ts       = & h -> ts;
+  header . len      = h -> len - LOOPBACK_HEADER;
+  header . caplen   = h -> caplen - LOOPBACK_HEADER;
+
+  /* Add source loopback IP address into the IP space of known names (if not already in) */
+  srchost = addtohwnames (intf, LOOPBACK_ADDR, KEYVLAN (intf));
 
   /* Attempt to decode and count packets foreach known protocol id (IP, ARP, RARP, ...) */
   if ((protocol = l2_protocol (ntohs (e -> ether_type))))
     protocol -> counter (intf, & header, (u_char *) p + LOOPBACK_HEADER, srchost, NULL);
   else
-    intf -> bytes_non_ip += h -> len - LOOPBACK_HEADER,
-      intf -> pkts_non_ip ++;
+    intf -> bytes_non_ip += (h -> len - LOOPBACK_HEADER) * intf -> weight,
+      intf -> pkts_non_ip += intf -> weight;
+}
+
+
+/*
+ * The shortest snapshot length with all the headers the decoders look at in frames of the data-link 'datalink'
+ * (-1 for the longest over all the known data-links): the data-link header with up to two VLAN tags, the IP
+ * header with its options (or the IPv6 header with some extension headers) and the TCP header with its options
+ */
+unsigned headerslen (int datalink)
+{
+  unsigned link;
+
+  switch (datalink)
+    {
+    case DLT_NULL:       link = ETHERNET_HEADER;                         break;   /* see loopback() */
+    case DLT_EN10MB:     link = ETHERNET_HEADER + VLAN_MAXTAGS * VLAN_TAG; break;
+    case DLT_LINUX_SLL:  link = SLL_HEADER + VLAN_MAXTAGS * VLAN_TAG;    break;
+#if defined(DLT_LINUX_SLL2)
+    case DLT_LINUX_SLL2: link = SLL2_HEADER + VLAN_MAXTAGS * VLAN_TAG;   break;
+#endif /* DLT_LINUX_SLL2 */
+    default:             link = MAX (ETHERNET_HEADER, SLL2_HEADER) + VLAN_MAXTAGS * VLAN_TAG; break;
+    }
+
+  return link + MAX (IP_MAXHEADER, IP6_MAXHEADER) + TCP_MAXHEADER;
 }
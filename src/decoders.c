@@ -20,6 +20,8 @@
 # endif
 #endif
 #include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <netinet/ip6.h>
 
 /* Project header */
 #include "pksh.h"
@@ -42,6 +44,16 @@ static protocol_t ip_protocols [] =
 };
 
 
+/* The table of known protocols over IPv6 (ICMPv6 is counted as ICMP) */
+static protocol_t ip6_protocols [] =
+{
+  { IPPROTO_ICMPV6, icmp },
+  { IPPROTO_TCP,    tcp  },
+  { IPPROTO_UDP,    udp  },
+  { -1,             NULL },
+};
+
+
 /* The table of known TCP protocols over known IP Protocols */
 static protocol_t tcp_protocols [] =
 {
@@ -63,6 +75,18 @@ static protocol_t * ip_protocol (int id)
 }
 
 
+/* Check if a parser exists for this protocol over IPv6 */
+static protocol_t * ip6_protocol (int id)
+{
+  protocol_t * p;
+
+  for (p = ip6_protocols; p -> counter; p ++)
+    if (p -> id == id)
+      return p;
+  return NULL;
+}
+
+
 /* Check if a parser exists for this TCP protocol */
 static protocol_t * tcp_protocol (int id)
 {
@@ -114,10 +138,11 @@ static u_char TTL_PREDICTOR (u_char x)
 }
 
 
-/* Access the fingerprint hash table to resolve OS name (if not already in and only for SYN or SYN-ACK packets) */
+/* Access the fingerprint hash table to resolve OS name (if not already in and only for SYN or SYN-ACK packets)
+ * 'len' is the length of the IP and TCP headers, as in the ettercap database */
 static void resolvsystemname (host_t * h, struct ip * ip, struct tcphdr * tcp, int len)
 {
-  u_char * opts = (u_char *) tcp + 1;                  /* TCP options (if present) */
+  u_char * opts = (u_char *) (tcp + 1);                /* TCP options (if present) */
   u_char * data = (u_char *) tcp + tcp -> th_off * 4;  /* TCP data (if present)    */
 
   /* Need to calculate the fingerprint only if the system in currently unknown, there are TCP optionsand the packet is a SYN */
@@ -133,20 +158,24 @@ static void resolvsystemname (host_t * h, struct ip * ip, struct tcphdr * tcp, i
       while (opts < data && * opts != TCPOPT_EOL)
 	{
 	  int type = * opts ++;
-	  int len  = type == TCPOPT_EOL || type == TCPOPT_NOP ? 1 : * opts ++;
+	  int len  = type == TCPOPT_EOL || type == TCPOPT_NOP ? 1 : opts < data ? * opts ++ : 0;
+
+	  /* Malformed (or running past the TCP header) */
+	  if (len < 1 || (len < 2 && type != TCPOPT_NOP) || (type != TCPOPT_NOP && opts + len - 2 > data))
+	    break;
 
 	  switch (type)
 	    {
 	    case TCPOPT_EOL: break;
 	    case TCPOPT_NOP: nop = 1; break;
-	    case TCPOPT_MAXSEG: sprintf (mss, "%04X", * opts & 0xffffffff); break;
+	    case TCPOPT_MAXSEG: if (len >= 4) sprintf (mss, "%04X", (opts [0] << 8) | opts [1]); break;
 	    case TCPOPT_SACK_PERMITTED: sack = 1; break;
-	    case TCPOPT_WINDOW: sprintf (ws, "%02X", * opts & 0xffff); break;
+	    case TCPOPT_WINDOW: if (len >= 3) sprintf (ws, "%02X", * opts & 0xff); break;
 	    case TCPOPT_TIMESTAMP: ts = 1; break;
 
 	    default: break;
 	    }
-	  opts += len - 1;   /* len includes the type too */
+	  opts += type == TCPOPT_NOP ? 0 : len - 2;   /* len includes the type and itself too */
 	}
 
       /* Need to build first an unique fingerprint accordingly to the passive OS fingerprint database specification */
@@ -162,20 +191,46 @@ static void resolvsystemname (host_t * h, struct ip * ip, struct tcphdr * tcp, i
 /* Check if 'ip' belongs to the subnet 'network' with the 'netmask' */
 static int islocalhost (uint32_t ip, uint32_t network, uint32_t netmask)
 {
-  return (ip & netmask) == network;
+  return netmask && (ip & netmask) == network;
 }
 
 
 /* Update the TTL distribution by size */
 static void ttl_by_size (short ttl, interface_t * interface)
 {
-  if (ttl <= 32)       interface -> ttl_upto32 ++;
-  else if (ttl <= 64)  interface -> ttl_upto64 ++;
-  else if (ttl <= 128) interface -> ttl_upto128 ++;
-  else if (ttl <= 160) interface -> ttl_upto160 ++;
-  else if (ttl <= 192) interface -> ttl_upto192 ++;
-  else if (ttl <= 224) interface -> ttl_upto224 ++;
-  else                 interface -> ttl_above224 ++;
+  if (ttl <= 32)       interface -> ttl_upto32 += interface -> weight;
+  else if (ttl <= 64)  interface -> ttl_upto64 += interface -> weight;
+  else if (ttl <= 128) interface -> ttl_upto128 += interface -> weight;
+  else if (ttl <= 160) interface -> ttl_upto160 += interface -> weight;
+  else if (ttl <= 192) interface -> ttl_upto192 += interface -> weight;
+  else if (ttl <= 224) interface -> ttl_upto224 += interface -> weight;
+  else                 interface -> ttl_above224 += interface -> weight;
+}
+
+
+/* Update the bytes and packets sent/received distribution of hosts 'srclocal' and 'dstlocal' */
+static void locality (host_t * srchost, host_t * dsthost, int srclocal, int dstlocal, int len)
+{
+  if (srclocal && dstlocal)
+    srchost -> bytes_sent_local += len * srchost -> intf -> weight,
+      srchost -> pkts_sent_local += srchost -> intf -> weight,
+      dsthost -> bytes_recv_local += len * srchost -> intf -> weight,
+      dsthost -> pkts_recv_local += srchost -> intf -> weight;
+  else if (srclocal && ! dstlocal)
+    srchost -> bytes_sent_foreign += len * srchost -> intf -> weight,
+      srchost -> pkts_sent_foreign += srchost -> intf -> weight,
+      dsthost -> bytes_recv_local += len * srchost -> intf -> weight,
+      dsthost -> pkts_recv_local += srchost -> intf -> weight;
+  else if (! srclocal && dstlocal)
+    srchost -> bytes_sent_local += len * srchost -> intf -> weight,
+      srchost -> pkts_sent_local += srchost -> intf -> weight,
+      dsthost -> bytes_recv_foreign += len * srchost -> intf -> weight,
+      dsthost -> pkts_recv_foreign += srchost -> intf -> weight;
+  else
+    srchost -> bytes_sent_foreign += len * srchost -> intf -> weight,
+      srchost -> pkts_sent_foreign += srchost -> intf -> weight,
+      dsthost -> bytes_recv_foreign += len * srchost -> intf -> weight,
+      dsthost -> pkts_recv_foreign += srchost -> intf -> weight;
 }
 
 
@@ -183,31 +238,122 @@ static void ttl_by_size (short ttl, interface_t * interface)
 static void local_vs_foreign (host_t * srchost, host_t * dsthost, int len)
 {
   if (srchost && dsthost)
+    locality (srchost, dsthost,
+	      islocalhost (srchost -> ip . s_addr, srchost -> intf -> pcapnetwork, srchost -> intf -> pcapnetmask),
+	      islocalhost (dsthost -> ip . s_addr, dsthost -> intf -> pcapnetwork, dsthost -> intf -> pcapnetmask),
+	      len);
+}
+
+
+/* Check if the IPv6 address 'ip6' is link-local or it belongs to one of the prefixes of 'intf' */
+static int islocalhost6 (interface_t * intf, struct in6_addr * ip6)
+{
+  unsigned i;
+
+  if (IN6_IS_ADDR_LINKLOCAL (ip6))
+    return 1;
+
+  for (i = 0; i < intf -> ip6prefixes; i ++)
     {
-      if (islocalhost (srchost -> ip . s_addr, srchost -> intf -> pcapnetwork, srchost -> intf -> pcapnetmask) &&
-	  islocalhost (dsthost -> ip . s_addr, dsthost -> intf -> pcapnetwork, dsthost -> intf -> pcapnetmask))
-	srchost -> bytes_sent_local += len,
-	  srchost -> pkts_sent_local ++,
-	  dsthost -> bytes_recv_local += len,
-	  dsthost -> pkts_recv_local ++;
-      else if (islocalhost (srchost -> ip . s_addr, srchost -> intf -> pcapnetwork, srchost -> intf -> pcapnetmask) &&
-	       ! islocalhost (dsthost -> ip . s_addr, dsthost -> intf -> pcapnetwork, dsthost -> intf -> pcapnetmask))
-	srchost -> bytes_sent_foreign += len,
-	  srchost -> pkts_sent_foreign ++,
-	  dsthost -> bytes_recv_local += len,
-	  dsthost -> pkts_recv_local ++;
-      else if (! islocalhost (srchost -> ip . s_addr, srchost -> intf -> pcapnetwork, srchost -> intf -> pcapnetmask) &&
-	       islocalhost (dsthost -> ip . s_addr, dsthost -> intf -> pcapnetwork, dsthost -> intf -> pcapnetmask))
-	srchost -> bytes_sent_local += len,
-	  srchost -> pkts_sent_local ++,
-	  dsthost -> bytes_recv_foreign += len,
-	  dsthost -> pkts_recv_foreign ++;
-      else
-	srchost -> bytes_sent_foreign += len,
-	  srchost -> pkts_sent_foreign ++,
-	  dsthost -> bytes_recv_foreign += len,
-	  dsthost -> pkts_recv_foreign ++;
+      unsigned bytes = intf -> ip6prefixlen [i] / 8;
+      unsigned bits  = intf -> ip6prefixlen [i] % 8;
+
+      if (! memcmp (ip6, & intf -> ip6prefix [i], bytes) &&
+	  (! bits || ! ((ip6 -> s6_addr [bytes] ^ intf -> ip6prefix [i] . s6_addr [bytes]) & (0xff << (8 - bits)))))
+	return 1;
     }
+  return 0;
+}
+
+
+/*
+ * Walk the IPv6 extension headers of the packet 'ip6' ('caplen' bytes captured) up to the upper-layer protocol.
+ * Return the protocol and its offset in 'hlen', or IPPROTO_NONE when there is no upper-layer header to look at
+ * (truncated, encrypted or not the first fragment), 'fragment' tells if there is a fragment header
+ */
+static int ip6walk (struct ip6_hdr * ip6, unsigned caplen, unsigned * hlen, bool * fragment)
+{
+  u_char * p = (u_char *) ip6;
+  int next = ip6 -> ip6_nxt;
+
+  * hlen = sizeof (struct ip6_hdr);
+  * fragment = false;
+
+  while (1)
+    {
+      u_char * ext = p + * hlen;
+
+      switch (next)
+	{
+	case IPPROTO_HOPOPTS:
+	case IPPROTO_ROUTING:
+	case IPPROTO_DSTOPTS:
+	  if (caplen < * hlen + 8)
+	    return IPPROTO_NONE;
+	  next = ext [0];
+	  * hlen += (ext [1] + 1) * 8;     /* in units of 8 bytes, not including the first 8 */
+	  break;
+
+	case IPPROTO_AH:
+	  if (caplen < * hlen + 8)
+	    return IPPROTO_NONE;
+	  next = ext [0];
+	  * hlen += (ext [1] + 2) * 4;     /* in units of 4 bytes, minus 2 */
+	  break;
+
+	case IPPROTO_FRAGMENT:
+	  if (caplen < * hlen + sizeof (struct ip6_frag))
+	    return IPPROTO_NONE;
+	  next = ((struct ip6_frag *) ext) -> ip6f_nxt;
+	  * hlen += sizeof (struct ip6_frag);
+	  * fragment = true;
+	  if (((struct ip6_frag *) ext) -> ip6f_offlg & IP6F_OFF_MASK)
+	    return IPPROTO_NONE;
+	  break;
+
+	default:
+	  return * hlen <= caplen ? next : IPPROTO_NONE;
+	}
+    }
+}
+
+
+/* Verify the checksum of the TCP/UDP segment 'p' (when asked) and count it in 'badsum' if it is wrong */
+static void l4verify (interface_t * intf, header_t * h, u_char * p, int proto, host_t * srchost, counter_t * badsum)
+{
+  switch (l4sumok (intf, h, p, proto))
+    {
+    case 0:
+      * badsum += intf -> weight;
+      if (srchost)
+	srchost -> pkts_badsum_sent += intf -> weight;
+      break;
+
+    case -1:
+      intf -> pkts_unverified += intf -> weight;
+      break;
+    }
+}
+
+
+/* Count the payload 'h' of a TCP/UDP segment foreach application protocol 'app' with no decoder of its own (TLS, SSH, ...) */
+static void appcount (interface_t * intf, header_t * h, unsigned app)
+{
+  counter_t * bytes;
+  counter_t * pkts;
+
+  switch (app)
+    {
+    case APP_TLS:  bytes = & intf -> bytes_tls;  pkts = & intf -> pkts_tls;  break;
+    case APP_SSH:  bytes = & intf -> bytes_ssh;  pkts = & intf -> pkts_ssh;  break;
+    case APP_IMAP: bytes = & intf -> bytes_imap; pkts = & intf -> pkts_imap; break;
+    case APP_POP:  bytes = & intf -> bytes_pop;  pkts = & intf -> pkts_pop;  break;
+    case APP_DNS:  bytes = & intf -> bytes_dns;  pkts = & intf -> pkts_dns;  break;
+    default:       return;
+    }
+
+  * bytes += h -> len * intf -> weight;
+  * pkts += intf -> weight;
 }
 
 
@@ -222,22 +368,53 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
   struct ip * ip = (struct ip *) p;
 
   /* Header for the encapsulated protocols (IP, ARP, RARP, ...) */
-  header_t header = { p, h -> ts, h -> len - IP_HEADER (ip), h -> caplen - IP_HEADER (ip) };
+  header_t header;
 
   char * addr;
   host_t * srchost = NULL;
   host_t * dsthost = NULL;
   protocol_t * protocol;
+  bool badsum;
 
   /* Update bytes and packets counters */
-  intf -> headers_ip += IP_HEADER (ip);
-  intf -> bytes_ip += h -> len;
-  intf -> pkts_ip ++;
+  intf -> bytes_ip += h -> len * intf -> weight;
+  intf -> pkts_ip += intf -> weight;
 
   /* Check for boundaries */
+  if (h -> caplen < sizeof (struct ip))
+    return;
+
+  /* Malformed: not version 4, or a header shorter than 20 bytes or longer than the packet (a length of 0 is left to TSO) */
+  if (ip -> ip_v != 4 || IP_HEADER (ip) < sizeof (struct ip) || h -> len < IP_HEADER (ip) ||
+      (ntohs (ip -> ip_len) && ntohs (ip -> ip_len) < IP_HEADER (ip)))
+    {
+      intf -> pkts_malformed += intf -> weight;
+      return;
+    }
+
+  /* The whole header with its options, nothing is read past it */
   if (h -> caplen < IP_HEADER (ip))
     return;
 
+  intf -> headers_ip += IP_HEADER (ip) * intf -> weight;
+
+  header . protocol = p;
+  header . ts       = h -> ts;
+  header . len      = h -> len > IP_HEADER (ip) ? h -> len - IP_HEADER (ip) : 0;
+  header . caplen   = h -> caplen - IP_HEADER (ip);
+
+  /* Fragments, only the first one carries the header of the upper-layer protocol */
+  if ((intf -> fragment = ntohs (ip -> ip_off) & (IP_MF | IP_OFFMASK)))
+    {
+      intf -> pkts_ip_fragments += intf -> weight;
+      if (ntohs (ip -> ip_off) & IP_OFFMASK)
+	header . caplen = 0;
+    }
+
+  /* Verify the header checksum (when asked) */
+  if ((badsum = intf -> checksums && ! ipsumok (ip)))
+    intf -> pkts_ip_badsum += intf -> weight;
+
   /* Update TTL distribution by size */
   ttl_by_size (ip -> ip_ttl, intf);
 
@@ -252,13 +429,13 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
 	  tx -> ipaddr = strdup (addr),
 	  resolvhostname (tx);
 
-      srchost = bindtoipnames (intf, addr, tx);    /* The same object is referenced by two keys in hwnames and ipnames */
+      srchost = bindtoipnames (intf, addr, KEYVLAN (intf), tx);    /* The same object is referenced by two keys in hwnames and ipnames */
     }
   else
     /* Add source IP address to the space of known IP names (if not already in) and update bytes and packets counters */
-    if ((srchost = addtoipnames (intf, addr)))
-      srchost -> bytes_sent += h -> len,
-	srchost -> pkts_sent ++;
+    if ((srchost = addtoipnames (intf, addr, KEYVLAN (intf))))
+      srchost -> bytes_sent += h -> len * intf -> weight,
+	srchost -> pkts_sent += intf -> weight;
 
   /* Update source IP address and hostname (if still missing) */
   if (srchost)
@@ -269,8 +446,13 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
 	  resolvhostname (srchost);
 
       /* Update number of IP bytes and packets sent */
-      srchost -> bytes_ip_sent += h -> len,
-	srchost -> pkts_ip_sent ++;
+      srchost -> bytes_ip_sent += h -> len * intf -> weight,
+	srchost -> pkts_ip_sent += intf -> weight;
+
+      if (intf -> fragment)
+	srchost -> pkts_fragments_sent += intf -> weight;
+      if (badsum)
+	srchost -> pkts_badsum_sent += intf -> weight;
 
       /* Update TTL values */
       if (ip -> ip_ttl < 255)
@@ -281,30 +463,30 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
   /* Lookup for Broadcast destination IP address to avoid its inclusion to the space of known IP names */
   if (ip -> ip_dst . s_addr == intf -> broadcastbin)
     {
-      intf -> bytes_ip_broadcast += h -> len,
-	intf -> pkts_ip_broadcast ++;
+      intf -> bytes_ip_broadcast += h -> len * intf -> weight,
+	intf -> pkts_ip_broadcast += intf -> weight;
       if (srchost)
-	srchost -> bytes_ip_broadcast += h -> len,
-	  srchost -> pkts_ip_broadcast ++;
+	srchost -> bytes_ip_broadcast += h -> len * intf -> weight,
+	  srchost -> pkts_ip_broadcast += intf -> weight;
     }
   /* Lookup for destination to all IP addresses to avoid its inclusion to the space of known IP names */
   else if (ip -> ip_dst . s_addr == INADDR_BROADCAST)
     {
-      intf -> bytes_ip_all_hosts += h -> len,
-	intf -> pkts_ip_all_hosts ++;
+      intf -> bytes_ip_all_hosts += h -> len * intf -> weight,
+	intf -> pkts_ip_all_hosts += intf -> weight;
       if (srchost)
-	srchost -> bytes_ip_all_hosts += h -> len,
-	  srchost -> pkts_ip_all_hosts ++;
+	srchost -> bytes_ip_all_hosts += h -> len * intf -> weight,
+	  srchost -> pkts_ip_all_hosts += intf -> weight;
     }
   /* Lookup for Multicast destination IP address to avoid its inclusion to the space of known IP names
    * Multicast IP addresses range from 224.0.0.0 to 239.255.255.255 */
   else if (IN_MULTICAST (ntohl (ip -> ip_dst . s_addr)))
     {
-      intf -> bytes_ip_multicast += h -> len,
-	intf -> pkts_ip_multicast ++;
+      intf -> bytes_ip_multicast += h -> len * intf -> weight,
+	intf -> pkts_ip_multicast += intf -> weight;
       if (srchost)
-	srchost -> bytes_ip_multicast += h -> len,
-	  srchost -> pkts_ip_multicast ++;
+	srchost -> bytes_ip_multicast += h -> len * intf -> weight,
+	  srchost -> pkts_ip_multicast += intf -> weight;
     }
   else
     {
@@ -319,14 +501,14 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
 	      rx -> ipaddr = strdup (addr),
 	      resolvhostname (rx);
 
-	  dsthost = bindtoipnames (intf, addr, rx);    /* The same object is referenced by two keys in hwnames and ipnames */
+	  dsthost = bindtoipnames (intf, addr, KEYVLAN (intf), rx);    /* The same object is referenced by two keys in hwnames and ipnames */
 	}
       else
 	/* Add destination IP address into the space of known IP names (if not already in) and update bytes and packets counters */
-	if ((dsthost = addtoipnames (intf, addr)))
+	if ((dsthost = addtoipnames (intf, addr, KEYVLAN (intf))))
 	  {
-	    dsthost -> bytes_recv += h -> len,
-	      dsthost -> pkts_recv ++;
+	    dsthost -> bytes_recv += h -> len * intf -> weight,
+	      dsthost -> pkts_recv += intf -> weight;
 
 	    /* Update destination IP address and hostname (if still missing) */
 	    if (! dsthost -> ipaddr)
@@ -337,8 +519,8 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
 
       /* Update number of IP bytes and packets received */
       if (dsthost)
-	dsthost -> bytes_ip_recv += h -> len,
-	  dsthost -> pkts_ip_recv ++;
+	dsthost -> bytes_ip_recv += h -> len * intf -> weight,
+	  dsthost -> pkts_ip_recv += intf -> weight;
 
       /* Update local vs foreign bytes and packets sent/received distribution */
       local_vs_foreign (srchost, dsthost, h -> len);
@@ -346,10 +528,156 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
 
   /* Attempt to decode and count packets foreach known protocol id (TCP, UDP, ICMP, ...) */
   if ((protocol = ip_protocol (ip -> ip_p)))
-    protocol -> counter (intf, & header, (u_char *) ip + IP_HEADER (ip), srchost, dsthost);
+    {
+      /* An overloaded sniffer counts the hosts only up to IP (see shed.c) */
+      if (intf -> shedding >= SHED_HOSTS_L4)
+	srchost = dsthost = NULL;
+      protocol -> counter (intf, & header, (u_char *) ip + IP_HEADER (ip), srchost, dsthost);
+    }
   else
-    intf -> bytes_other_ip += h -> len - IP_HEADER (ip),
-      intf -> pkts_other_ip ++;
+    intf -> bytes_other_ip += (h -> len - IP_HEADER (ip)) * intf -> weight,
+      intf -> pkts_other_ip += intf -> weight;
+}
+
+
+/* Decoder/counter for the IPv6 Protocol
+ *  IPv6 sizes
+ *   40 bytes                => size of the fixed IPv6 Header
+ *   + extension headers     => walked up to the upper-layer protocol (TCP, UDP, ICMPv6, ...)
+ *
+ * Hosts are looked up by the 16 bytes of their addresses, which are converted for humans only once foreach new host
+ */
+void ip6 (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
+{
+  /* The IPv6 Protocol */
+  struct ip6_hdr * ip6 = (struct ip6_hdr *) p;
+
+  /* Header for the encapsulated protocols (TCP, UDP, ICMPv6, ...) */
+  header_t header;
+
+  unsigned hlen;
+  int next;
+  int srclocal;
+  int dstlocal;
+  char addr [INET6_ADDRSTRLEN];
+  host_t * srchost = NULL;
+  host_t * dsthost = NULL;
+  protocol_t * protocol;
+  bool fragment;
+
+  /* Update bytes and packets counters (IPv6 is also IP) */
+  intf -> bytes_ip += h -> len * intf -> weight;
+  intf -> pkts_ip += intf -> weight;
+  intf -> bytes_ip6 += h -> len * intf -> weight;
+  intf -> pkts_ip6 += intf -> weight;
+
+  /* Check for boundaries */
+  if (h -> caplen < sizeof (struct ip6_hdr))
+    return;
+
+  /* Malformed: not version 6 */
+  if ((ip6 -> ip6_vfc >> 4) != 6)
+    {
+      intf -> pkts_malformed += intf -> weight;
+      return;
+    }
+
+  /* Walk the extension headers */
+  next = ip6walk (ip6, h -> caplen, & hlen, & fragment);
+
+  if ((intf -> fragment = fragment))
+    intf -> pkts_ip_fragments += intf -> weight;
+
+  intf -> headers_ip += MIN (hlen, h -> len) * intf -> weight;
+  intf -> headers_ip6 += MIN (hlen, h -> len) * intf -> weight;
+
+  /* Update Hop Limit distribution by size */
+  ttl_by_size (ip6 -> ip6_hlim, intf);
+
+  /* Bind the IPv6 address of the transmitting TX host if the source address is on the local prefixes */
+  if ((srclocal = islocalhost6 (intf, & ip6 -> ip6_src)) && tx)
+    srchost = bindtoip6names (intf, & ip6 -> ip6_src, KEYVLAN (intf), tx);    /* The same object is referenced by two keys in hwnames and ip6names */
+  else
+    /* Add source IPv6 address to the space of known IPv6 names (if not already in) and update bytes and packets counters */
+    if ((srchost = addtoip6names (intf, & ip6 -> ip6_src, KEYVLAN (intf))))
+      srchost -> bytes_sent += h -> len * intf -> weight,
+	srchost -> pkts_sent += intf -> weight;
+
+  /* Update source IPv6 address and hostname (if still missing) */
+  if (srchost)
+    {
+      if (! srchost -> ipaddr)
+	srchost -> ip6 = ip6 -> ip6_src,
+	  srchost -> ipaddr = strdup (inet_ntop (AF_INET6, & ip6 -> ip6_src, addr, sizeof (addr))),
+	  resolvqueue (srchost);
+
+      /* Update number of IP bytes and packets sent */
+      srchost -> bytes_ip_sent += h -> len * intf -> weight,
+	srchost -> pkts_ip_sent += intf -> weight;
+
+      if (fragment)
+	srchost -> pkts_fragments_sent += intf -> weight;
+
+      /* Update TTL values */
+      if (ip6 -> ip6_hlim < 255)
+	srchost -> ttl_shortest = MIN (srchost -> ttl_shortest, ip6 -> ip6_hlim),
+	  srchost -> ttl_longest = MAX (srchost -> ttl_longest, ip6 -> ip6_hlim);
+    }
+
+  /* Lookup for Multicast destination IPv6 address (there is no broadcast in IPv6) to avoid its inclusion to the space of known IPv6 names */
+  if (IN6_IS_ADDR_MULTICAST (& ip6 -> ip6_dst))
+    {
+      intf -> bytes_ip_multicast += h -> len * intf -> weight,
+	intf -> pkts_ip_multicast += intf -> weight;
+      if (srchost)
+	srchost -> bytes_ip_multicast += h -> len * intf -> weight,
+	  srchost -> pkts_ip_multicast += intf -> weight;
+    }
+  else
+    {
+      /* Bind the IPv6 address of the receiving RX host if the destination address is on the local prefixes */
+      if ((dstlocal = islocalhost6 (intf, & ip6 -> ip6_dst)) && rx)
+	dsthost = bindtoip6names (intf, & ip6 -> ip6_dst, KEYVLAN (intf), rx);    /* The same object is referenced by two keys in hwnames and ip6names */
+      else
+	/* Add destination IPv6 address into the space of known IPv6 names (if not already in) and update bytes and packets counters */
+	if ((dsthost = addtoip6names (intf, & ip6 -> ip6_dst, KEYVLAN (intf))))
+	  dsthost -> bytes_recv += h -> len * intf -> weight,
+	    dsthost -> pkts_recv += intf -> weight;
+
+      if (dsthost)
+	{
+	  /* Update destination IPv6 address and hostname (if still missing) */
+	  if (! dsthost -> ipaddr)
+	    dsthost -> ip6 = ip6 -> ip6_dst,
+	      dsthost -> ipaddr = strdup (inet_ntop (AF_INET6, & ip6 -> ip6_dst, addr, sizeof (addr))),
+	      resolvqueue (dsthost);
+
+	  /* Update number of IP bytes and packets received */
+	  dsthost -> bytes_ip_recv += h -> len * intf -> weight,
+	    dsthost -> pkts_ip_recv += intf -> weight;
+	}
+
+      /* Update local vs foreign bytes and packets sent/received distribution */
+      if (srchost && dsthost)
+	locality (srchost, dsthost, srclocal, dstlocal, h -> len);
+    }
+
+  /* Attempt to decode and count packets foreach known upper-layer protocol (TCP, UDP, ICMPv6, ...) */
+  header . protocol = p;
+  header . ts       = h -> ts;
+  header . len      = h -> len > hlen ? h -> len - hlen : 0;
+  header . caplen   = h -> caplen > hlen ? h -> caplen - hlen : 0;
+
+  if ((protocol = ip6_protocol (next)))
+    {
+      /* An overloaded sniffer counts the hosts only up to IP (see shed.c) */
+      if (intf -> shedding >= SHED_HOSTS_L4)
+	srchost = dsthost = NULL;
+      protocol -> counter (intf, & header, p + hlen, srchost, dsthost);
+    }
+  else
+    intf -> bytes_other_ip += header . len * intf -> weight,
+      intf -> pkts_other_ip += intf -> weight;
 }
 
 
@@ -357,16 +685,16 @@ void ip (interface_t * intf, header_t * h, u_char * p, host_t * tx, host_t * rx)
 void arp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost)
 {
   /* Update bytes and packets counters */
-  intf -> bytes_arp += h -> len;
-  intf -> pkts_arp ++;
+  intf -> bytes_arp += h -> len * intf -> weight;
+  intf -> pkts_arp += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_arp_sent += h -> len,
-      srchost -> pkts_arp_sent ++;
+    srchost -> bytes_arp_sent += h -> len * intf -> weight,
+      srchost -> pkts_arp_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_arp_recv += h -> len,
-      dsthost -> pkts_arp_recv ++;
+    dsthost -> bytes_arp_recv += h -> len * intf -> weight,
+      dsthost -> pkts_arp_recv += intf -> weight;
 }
 
 
@@ -374,16 +702,16 @@ void arp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t
 void rarp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost)
 {
   /* Update bytes and packets counters */
-  intf -> bytes_rarp += h -> len;
-  intf -> pkts_rarp ++;
+  intf -> bytes_rarp += h -> len * intf -> weight;
+  intf -> pkts_rarp += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_rarp_sent += h -> len,
-      srchost -> pkts_rarp_sent ++;
+    srchost -> bytes_rarp_sent += h -> len * intf -> weight,
+      srchost -> pkts_rarp_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_rarp_recv += h -> len,
-      dsthost -> pkts_rarp_recv ++;
+    dsthost -> bytes_rarp_recv += h -> len * intf -> weight,
+      dsthost -> pkts_rarp_recv += intf -> weight;
 }
 
 
@@ -391,16 +719,16 @@ void rarp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_
 void icmp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost)
 {
   /* Update bytes and packets counters */
-  intf -> bytes_icmp += h -> len;
-  intf -> pkts_icmp ++;
+  intf -> bytes_icmp += h -> len * intf -> weight;
+  intf -> pkts_icmp += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_icmp_sent += h -> len,
-      srchost -> pkts_icmp_sent ++;
+    srchost -> bytes_icmp_sent += h -> len * intf -> weight,
+      srchost -> pkts_icmp_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_icmp_recv += h -> len,
-      dsthost -> pkts_icmp_recv ++;
+    dsthost -> bytes_icmp_recv += h -> len * intf -> weight,
+      dsthost -> pkts_icmp_recv += intf -> weight;
 }
 
 
@@ -414,57 +742,92 @@ void tcp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t
   /* The TCP Protocol */
   struct tcphdr * tcp = (struct tcphdr *) p;
 
+  /* The IP Protocol carrying it */
+  struct ip * ip = (struct ip *) h -> protocol;
+
   /* Header for the encapsulated protocols (HTTP, FTP, SMTP, ...) */
-  header_t header = { p, h -> ts, h -> len - TCP_HEADER (tcp), h -> caplen - TCP_HEADER (tcp) };
+  header_t header;
 
-#if defined(ROCCO)
   int srcport;
-#endif /* ROCCO */
   int dstport;
   protocol_t * protocol;
+  unsigned app = APP_NONE;
 
   /* Update bytes and packets counters */
-  intf -> headers_tcp += TCP_HEADER (tcp);
-  intf -> bytes_tcp += h -> len;
-  intf -> pkts_tcp ++;
+  intf -> bytes_tcp += h -> len * intf -> weight;
+  intf -> pkts_tcp += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_tcp_sent += h -> len,
-      srchost -> pkts_tcp_sent ++;
+    srchost -> bytes_tcp_sent += h -> len * intf -> weight,
+      srchost -> pkts_tcp_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_tcp_recv += h -> len,
-      dsthost -> pkts_tcp_recv ++;
+    dsthost -> bytes_tcp_recv += h -> len * intf -> weight,
+      dsthost -> pkts_tcp_recv += intf -> weight;
 
-  /* Check for boundaries */
+  /* Check for boundaries (nothing at all in the fragments after the first) */
+  if (h -> caplen < sizeof (struct tcphdr))
+    return;
+
+  /* Malformed: a header shorter than 20 bytes or longer than the segment */
+  if (TCP_HEADER (tcp) < sizeof (struct tcphdr) || h -> len < TCP_HEADER (tcp))
+    {
+      intf -> pkts_malformed += intf -> weight;
+      if (srchost)
+	srchost -> pkts_malformed_sent += intf -> weight;
+      return;
+    }
+
+  /* The whole header with its options, nothing is read past it */
   if (h -> caplen < TCP_HEADER (tcp))
     return;
 
+  if (intf -> checksums)
+    l4verify (intf, h, p, IPPROTO_TCP, srchost, & intf -> pkts_tcp_badsum);
+
+  intf -> headers_tcp += TCP_HEADER (tcp) * intf -> weight;
+
+  header . protocol = p;
+  header . ts       = h -> ts;
+  header . len      = h -> len > TCP_HEADER (tcp) ? h -> len - TCP_HEADER (tcp) : 0;
+  header . caplen   = h -> caplen - TCP_HEADER (tcp);
+
   /* Get source and destination port */
-#if defined(ROCCO)
   srcport = ntohs (tcp -> th_sport);
-#endif /* ROCCO */
   dstport = ntohs (tcp -> th_dport);
 
-  /* Attempt to resolve OS system name (if not already in) */
-  resolvsystemname (srchost, (struct ip *) h -> protocol, tcp, h -> len);
-  resolvsystemname (dsthost, (struct ip *) h -> protocol, tcp, h -> len);
-
-  /* Attempt to decode and count packets foreach known destination port (HTTP, FTP, SMTP, ...) */
-  if ((protocol = tcp_protocol (dstport)))
+  /* Attempt to resolve OS system name (if not already in, the fingerprints in the database are about IPv4 only) */
+  if (ip -> ip_v == 4 && intf -> shedding < SHED_FINGERPRINTS)
+    resolvsystemname (srchost, ip, tcp, IP_HEADER (ip) + TCP_HEADER (tcp)),
+      resolvsystemname (dsthost, ip, tcp, IP_HEADER (ip) + TCP_HEADER (tcp));
+
+  /* The application protocol told by the payload of the first segments of the connection (shed along with the fingerprints) */
+  if (intf -> payload && intf -> shedding < SHED_FINGERPRINTS)
+    app = payloadapp (intf, h -> protocol, p, IPPROTO_TCP, & header, (u_char *) tcp + TCP_HEADER (tcp));
+
+  /* Attempt to decode and count packets foreach protocol told by the payload, otherwise foreach known port (HTTP, FTP, SMTP, ...) */
+  if (app == APP_HTTP)
+    http (intf, & header, (u_char *) tcp + TCP_HEADER (tcp), srchost, dsthost);
+  else if (app == APP_SMTP)
+    smtp (intf, & header, (u_char *) tcp + TCP_HEADER (tcp), srchost, dsthost);
+  else if (app == APP_NONE && ((protocol = tcp_protocol (dstport)) || (protocol = tcp_protocol (srcport))))
     protocol -> counter (intf, & header, (u_char *) tcp + TCP_HEADER (tcp), srchost, dsthost);
   else
     {
-      intf -> bytes_other_tcp += h -> len - TCP_HEADER (tcp),
-	intf -> pkts_other_tcp ++;
+      /* The protocols told by the payload with no decoder of their own are a breakdown of the other TCP traffic, taken out of it */
+      if (app != APP_NONE)
+	appcount (intf, & header, app);
+      else
+	intf -> bytes_other_tcp += header . len * intf -> weight,
+	  intf -> pkts_other_tcp += intf -> weight;
 
       if (srchost)
-	srchost -> bytes_other_tcp_sent += h -> len,
-	  srchost -> pkts_other_tcp_sent ++;
+	srchost -> bytes_other_tcp_sent += h -> len * intf -> weight,
+	  srchost -> pkts_other_tcp_sent += intf -> weight;
 
       if (dsthost)
-	dsthost -> bytes_other_tcp_recv += h -> len,
-	  dsthost -> pkts_other_tcp_recv ++;
+	dsthost -> bytes_other_tcp_recv += h -> len * intf -> weight,
+	  dsthost -> pkts_other_tcp_recv += intf -> weight;
     }
 }
 
@@ -472,17 +835,50 @@ void tcp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t
 /* Decoder/counter for the UDP Protocol */
 void udp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost)
 {
+  /* Header for the encapsulated protocols (DNS, ...) */
+  header_t header;
+  unsigned ulen;
+
   /* Update bytes and packets counters */
-  intf -> bytes_udp += h -> len;
-  intf -> pkts_udp ++;
+  intf -> bytes_udp += h -> len * intf -> weight;
+  intf -> pkts_udp += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_udp_sent += h -> len,
-      srchost -> pkts_udp_sent ++;
+    srchost -> bytes_udp_sent += h -> len * intf -> weight,
+      srchost -> pkts_udp_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_udp_recv += h -> len,
-      dsthost -> pkts_udp_recv ++;
+    dsthost -> bytes_udp_recv += h -> len * intf -> weight,
+      dsthost -> pkts_udp_recv += intf -> weight;
+
+  /* Check for boundaries (nothing at all in the fragments after the first) */
+  if (h -> caplen < sizeof (struct udphdr))
+    return;
+
+  /* Malformed: a length shorter than the header itself */
+  if (ntohs (((struct udphdr *) p) -> uh_ulen) < sizeof (struct udphdr))
+    {
+      intf -> pkts_malformed += intf -> weight;
+      if (srchost)
+	srchost -> pkts_malformed_sent += intf -> weight;
+      return;
+    }
+
+  if (intf -> checksums)
+    l4verify (intf, h, p, IPPROTO_UDP, srchost, & intf -> pkts_udp_badsum);
+
+  /* The application protocol told by the payload of the first datagrams between the same ends */
+  if (! intf -> payload || intf -> shedding >= SHED_FINGERPRINTS)
+    return;
+
+  ulen = ntohs (((struct udphdr *) p) -> uh_ulen);
+
+  header . protocol = p;
+  header . ts       = h -> ts;
+  header . len      = ulen - sizeof (struct udphdr);
+  header . caplen   = h -> caplen - sizeof (struct udphdr) < header . len ? h -> caplen - sizeof (struct udphdr) : header . len;
+
+  appcount (intf, & header, payloadapp (intf, h -> protocol, p, IPPROTO_UDP, & header, p + sizeof (struct udphdr)));
 }
 
 
@@ -490,16 +886,16 @@ void udp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t
 void http (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost)
 {
   /* Update bytes and packets counters */
-  intf -> bytes_http += h -> len;
-  intf -> pkts_http ++;
+  intf -> bytes_http += h -> len * intf -> weight;
+  intf -> pkts_http += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_http_sent += h -> len,
-      srchost -> pkts_http_sent ++;
+    srchost -> bytes_http_sent += h -> len * intf -> weight,
+      srchost -> pkts_http_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_http_recv += h -> len,
-      dsthost -> pkts_http_recv ++;
+    dsthost -> bytes_http_recv += h -> len * intf -> weight,
+      dsthost -> pkts_http_recv += intf -> weight;
 }
 
 
@@ -507,14 +903,14 @@ void http (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_
 void smtp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost)
 {
   /* Update bytes and packets counters */
-  intf -> bytes_smtp += h -> len;
-  intf -> pkts_smtp ++;
+  intf -> bytes_smtp += h -> len * intf -> weight;
+  intf -> pkts_smtp += intf -> weight;
 
   if (srchost)
-    srchost -> bytes_smtp_sent += h -> len,
-      srchost -> pkts_smtp_sent ++;
+    srchost -> bytes_smtp_sent += h -> len * intf -> weight,
+      srchost -> pkts_smtp_sent += intf -> weight;
 
   if (dsthost)
-    dsthost -> bytes_smtp_recv += h -> len,
-      dsthost -> pkts_smtp_recv ++;
+    dsthost -> bytes_smtp_recv += h -> len * intf -> weight,
+      dsthost -> pkts_smtp_recv += intf -> weight;
 }
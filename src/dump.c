@@ -0,0 +1,360 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <errno.h>
+
+/* Project header */
+#include "pksh.h"
+
+/* Identifiers */
+#define NAME         "pkdump"
+#define BRIEF        "Record the captured frames into rotating pcap/pcapng files or keep the last ones in memory"
+#define SYNOPSIS     "pkdump [options] [file]"
+#define DESCRIPTION  "No description yet"
+
+/* Public variable */
+pksh_cmd_t cmd_dump = { NAME, BRIEF, SYNOPSIS, DESCRIPTION, pksh_pkdump };
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  /* Interface */
+  OPT_INTERFACE   = 'i',
+
+  OPT_SIZE        = 'C',
+  OPT_SECONDS     = 'G',
+  OPT_FILES       = 'W',
+  OPT_PCAPNG      = 'n',
+  OPT_BUFFER      = 'B',
+  OPT_STOP        = 'x',
+
+  /* The ring of the last frames */
+  OPT_RING        = 'R',
+  OPT_LAST        = 'L',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  /* Interface */
+  { "interface",     required_argument, NULL, OPT_INTERFACE   },
+
+  { "size",          required_argument, NULL, OPT_SIZE        },
+  { "seconds",       required_argument, NULL, OPT_SECONDS     },
+  { "files",         required_argument, NULL, OPT_FILES       },
+  { "pcapng",        no_argument,       NULL, OPT_PCAPNG      },
+  { "buffer",        required_argument, NULL, OPT_BUFFER      },
+  { "stop",          no_argument,       NULL, OPT_STOP        },
+
+  /* The ring of the last frames */
+  { "ring",          required_argument, NULL, OPT_RING        },
+  { "last",          required_argument, NULL, OPT_LAST        },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' records the frames captured on an interface into a file, or into rotating files by size\n", progname);
+  printf ("     and/or time (named file.0, file.1, ...).  Frames are handed by the sniffer to a writer thread\n");
+  printf ("     through a queue, and they are dropped (and counted) rather than slowing down the capture.\n");
+  printf ("     The last frames can also be kept in a preallocated ring in memory and saved on demand\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] [file]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s                          # tell about the recorders of all the interfaces\n", progname);
+  printf ("   %s /tmp/eth0.pcap           # record the active interface into /tmp/eth0.pcap\n", progname);
+  printf ("   %s -C 100 -W 10 /tmp/x.pcap # rotate every 100MB and keep the last 10 files\n", progname);
+  printf ("   %s -G 3600 -n /tmp/x.pcapng # rotate every hour and write pcapng\n", progname);
+  printf ("   %s -x                       # stop recording on the active interface\n", progname);
+  printf ("   %s -R 256                   # keep the last 256MB of frames in memory\n", progname);
+  printf ("   %s --last 30s /tmp/x.pcap   # save the frames of the last 30 seconds kept in memory\n", progname);
+  printf ("   %s --last 50M /tmp/x.pcap   # save the last 50MB of frames kept in memory\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -q, --quiet                  run quietly\n");
+  printf ("   -i, --interface              specify the interface (default the active one)\n");
+  printf ("   -C, --size MB                rotate when a file gets MB megabytes\n");
+  printf ("   -G, --seconds secs           rotate when a file gets 'secs' seconds old\n");
+  printf ("   -W, --files N                keep only the last N rotated files\n");
+  printf ("   -n, --pcapng                 write pcapng rather than pcap\n");
+  printf ("   -B, --buffer MB              size of the queue from the sniffer (default %d MB)\n", RECORDER_QUEUE / (1024 * 1024));
+  printf ("   -x, --stop                   stop recording (once the frames already captured are on disk)\n");
+  printf ("   -R, --ring MB                keep the last MB megabytes of frames in memory (0 to release them), rounded\n");
+  printf ("                                down to a power of two\n");
+  printf ("   -L, --last N[s|m|h|K|M|G]    save the frames kept in memory over the last N secs/mins/hours\n");
+  printf ("                                or within the last N bytes/KB/MB/GB (as a pcap file).  The ring is bounded\n");
+  printf ("                                by its size only, so it holds N secs of frames only while they fit in it\n");
+}
+
+
+/* Parse a window given either as a time (default secs) or as an amount of bytes */
+static bool window (char * spec, unsigned * seconds, size_t * bytes)
+{
+  char * end;
+  unsigned long n = strtoul (spec, & end, 10);
+
+  * seconds = 0;
+  * bytes   = 0;
+
+  if (end == spec || ! n)
+    return false;
+
+  switch (* end)
+    {
+    case '\0':
+    case 's': * seconds = n;                       break;
+    case 'm': * seconds = n * 60;                  break;
+    case 'h': * seconds = n * 3600;                break;
+    case 'K': * bytes   = n * 1024;                break;
+    case 'M': * bytes   = n * 1024 * 1024;         break;
+    case 'G': * bytes   = n * 1024 * 1024 * 1024;  break;
+    default:  return false;
+    }
+
+  return ! * end || ! end [1];
+}
+
+
+/* Tell about the recorder of an interface */
+static void recprint (interface_t * intf)
+{
+  recorder_t * r = intf -> recorder;
+  char pbuf [64];
+  char bbuf [64];
+
+  if (! r)
+    printf ("%-10s not recording\n", intf -> name);
+  else
+    printf ("%-10s recording to %s [%s, %u files] %s pkts, %s written, %s dropped, %u errors\n",
+	    intf -> name, r -> path, r -> pcapng ? "pcapng" : "pcap", r -> rotated + 1,
+	    fmtpkts_r (r -> pkts, pbuf, sizeof (pbuf)), fmtbytes_r (r -> written, bbuf, sizeof (bbuf)),
+	    fmtpkts (r -> dropped), r -> errors);
+
+  if (intf -> ring)
+    printf ("%-10s keeping the last %s of frames in memory, %s overwritten, %s dropped\n",
+	    intf -> name, fmtbytes_r (intf -> ring -> size, bbuf, sizeof (bbuf)),
+	    fmtpkts_r (intf -> ring -> overwritten, pbuf, sizeof (pbuf)), fmtpkts (intf -> ring -> dropped));
+}
+
+
+/* Record the captured frames into rotating files */
+int pksh_pkdump (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+  char * sopts    = optlegitimate (lopts);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  char * name     = NULL;
+  unsigned long size = 0;
+  unsigned seconds   = 0;
+  unsigned files     = 0;
+  bool pcapng        = false;
+  size_t buffer      = RECORDER_QUEUE;
+  bool stop          = false;
+  long ring          = -1;
+  char * last        = NULL;
+
+  int option;
+
+  /* Local variables */
+  interface_t * interface;
+  interface_t ** i;
+
+  /* Lookup for the command in the static table of registered extensions */
+  if (! cmd_by_name (progname))
+    {
+      printf ("%s: Command [%s] not found.\n", progname, progname);
+      return -1;
+    }
+
+  /* Parse command line options */
+  optind = 0;
+  optarg = NULL;
+  argv [0] = progname;
+  while ((option = getopt_long (argc, argv, sopts, lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:      usage (progname, lopts); return 0;
+	case OPT_QUIET:     quiet = true;            break;
+
+	  /* Interface */
+	case OPT_INTERFACE: name = optarg;           break;
+
+	case OPT_SIZE:      size = strtoul (optarg, NULL, 0) * 1024 * 1024;          break;
+	case OPT_SECONDS:   seconds = atoi (optarg);                                 break;
+	case OPT_FILES:     files = atoi (optarg);                                   break;
+	case OPT_PCAPNG:    pcapng = true;                                           break;
+	case OPT_BUFFER:    buffer = strtoul (optarg, NULL, 0) * 1024 * 1024;        break;
+	case OPT_STOP:      stop = true;                                             break;
+
+	  /* The ring of the last frames */
+	case OPT_RING:      ring = atol (optarg);                                    break;
+	case OPT_LAST:      last = optarg;                                           break;
+	}
+    }
+
+  /* Tell about all the recorders */
+  if (! stop && optind == argc && ! name && ring == -1 && ! last)
+    {
+      for (i = interfaces; i && * i; i ++)
+	if (! (* i) -> remote)
+	  recprint (* i);
+      return 0;
+    }
+
+  if (! name && ! (name = getintfname ()))
+    {
+      printf ("%s: no interface is currently enabled for packet sniffing\n", progname);
+      return -1;
+    }
+
+  if (! (interface = intfbyname (interfaces, name)))
+    {
+      printf ("%s: unknown interface %s\n", progname, name);
+      return -1;
+    }
+
+  /* Only the process owning the capture sees the frames */
+  if ((ring != -1 || last) && (interface -> remote || ! interface -> pcap))
+    {
+      printf ("%s: frames captured on %s cannot be kept by this shell\n", progname, name);
+      return -1;
+    }
+
+  /* Allocate (or release) the ring of the last frames */
+  if (ring == 0)
+    ringstop (interface);
+  else if (ring > 0)
+    {
+      if (interface -> ring)
+	{
+	  printf ("%s: the last frames of %s are already kept in memory (release them first with '%s -R 0')\n",
+		  progname, name, progname);
+	  return -1;
+	}
+      if (! ringstart (interface, ring * 1024 * 1024))
+	{
+	  printf ("%s: cannot keep %ld MB of frames of %s in memory (%s)\n", progname, ring, name, strerror (errno));
+	  return -1;
+	}
+      if (! quiet)
+	printf ("keeping the last %s of frames of %s in memory%s\n", fmtbytes (interface -> ring -> size), name,
+		interface -> ring -> size != (size_t) ring * 1024 * 1024 ? " (rounded down to a power of two)" : "");
+    }
+
+  /* Save the frames kept in memory */
+  if (last)
+    {
+      unsigned seconds;
+      size_t bytes;
+      unsigned long saved;
+      unsigned long lost;
+
+      if (! window (last, & seconds, & bytes))
+	{
+	  printf ("%s: invalid window [%s]\n", progname, last);
+	  return -1;
+	}
+      if (optind == argc)
+	{
+	  printf ("%s: missing file\n", progname);
+	  return -1;
+	}
+      if (ringsave (interface, argv [optind], seconds, bytes, & saved, & lost) == -1)
+	{
+	  printf ("%s: cannot save the frames of %s kept in memory into %s (%s)\n",
+		  progname, name, argv [optind], errno == ENOENT ? "they are not kept, see -R" : strerror (errno));
+	  return -1;
+	}
+      if (! quiet)
+	{
+	  printf ("saved %lu frames of %s into %s (%lu overwritten while saving)\n", saved, name, argv [optind], lost);
+
+	  /* The oldest frames of the window may have been overwritten before the save */
+	  if (seconds && interface -> ring && interface -> ring -> overwritten)
+	    {
+	      unsigned long pkts;
+	      time_t first;
+	      time_t now;
+
+	      ringspan (interface -> ring, & pkts, & first, & now);
+	      if (pkts && now - first + 1 < (time_t) seconds)
+		printf ("%s: the ring only holds the last %ld secs of frames of %s, not %u\n",
+			progname, (long) (now - first + 1), name, seconds);
+	    }
+	}
+      return 0;
+    }
+
+  if (ring != -1)
+    return 0;
+
+  if (stop)
+    {
+      if (! interface -> recorder)
+	{
+	  if (! quiet)
+	    printf ("%s: %s is not recording\n", progname, name);
+	  return -1;
+	}
+      recstop (interface);
+      return 0;
+    }
+
+  if (optind == argc)
+    {
+      recprint (interface);
+      return 0;
+    }
+
+  /* Only the process owning the capture sees the frames */
+  if (interface -> remote || ! interface -> pcap)
+    {
+      printf ("%s: frames captured on %s cannot be recorded by this shell\n", progname, name);
+      return -1;
+    }
+
+  if (! recstart (interface, argv [optind], size, seconds, files, pcapng, buffer))
+    {
+      printf ("%s: cannot record %s into %s (%s)\n", progname, name, argv [optind], strerror (errno));
+      return -1;
+    }
+
+  if (! quiet)
+    printf ("recording %s into %s%s\n", name, argv [optind], size || seconds ? ".N" : "");
+
+  /* Bye bye! */
+  return 0;
+}
@@ -21,6 +21,7 @@
 /* System headers */
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 
 /* Project header */
 #include "pksh.h"
@@ -46,6 +47,7 @@ enum
   OPT_PROMISCUOUS = 'p',
   OPT_TIMEOUT     = 't',
   OPT_MAXCOUNT    = 'c',
+  OPT_SHM         = 'm',
 };
 
 
@@ -60,6 +62,15 @@ static struct option lopts [] =
   { "promiscuous",   no_argument,       NULL, OPT_PROMISCUOUS },
   { "timeout",       required_argument, NULL, OPT_TIMEOUT     },
   { "maxcount",      required_argument, NULL, OPT_MAXCOUNT    },
+  { "shm",           no_argument,       NULL, OPT_SHM         },
+  { "shm-hosts",     required_argument, NULL, 131             },
+  { "sample",        required_argument, NULL, 132             },
+  { "sample-random", no_argument,       NULL, 133             },
+  { "no-shed",       no_argument,       NULL, 134             },
+  { "headers-only",  no_argument,       NULL, 135             },
+  { "checksums",     no_argument,       NULL, 136             },
+  { "payload",       no_argument,       NULL, 137             },
+  { "vlan-keys",     no_argument,       NULL, 138             },
 
   { "hardware-size", required_argument, NULL, 128             },
   { "ip-size",       required_argument, NULL, 129             },
@@ -87,9 +98,12 @@ static datalink_t datalinks [] =
 {
   { DLT_NULL,       loopback   },   /* BSD loopback encapsulation     */
   { DLT_EN10MB,     ethernet   },   /* Ethernet (10Mb)                */
+  { DLT_LINUX_SLL,  sll        },   /* Linux 'any' device             */
+#if defined(DLT_LINUX_SLL2)
+  { DLT_LINUX_SLL2, sll2       },   /* Linux 'any' device (v2)        */
+#endif /* DLT_LINUX_SLL2 */
 
 #if defined(FIXME)
-  { DLT_ANY,        anylinux,  },   /* Linux 'any' device             */
   { DLT_IEEE802,    tokenring  },   /* 802.5 Token Ring               */
   { DLT_SLIP,       slip       },   /* Serial Line IP                 */
   { DLT_PPP,        ppp        },   /* Point-to-point Protocol        */
@@ -126,27 +140,27 @@ static void packets_by_size (int size, interface_t * interface)
   interface -> shortest = MIN (interface -> shortest, size);
   interface -> longest  = MAX (interface -> longest, size);
 
-  if (size <= 75)        interface -> upto75 ++;
-  else if (size <= 150)  interface -> upto150 ++;
-  else if (size <= 225)  interface -> upto225 ++;
-  else if (size <= 300)  interface -> upto300 ++;
-  else if (size <= 375)  interface -> upto375 ++;
-  else if (size <= 450)  interface -> upto450 ++;
-  else if (size <= 525)  interface -> upto525 ++;
-  else if (size <= 600)  interface -> upto600 ++;
-  else if (size <= 675)  interface -> upto675 ++;
-  else if (size <= 750)  interface -> upto750 ++;
-  else if (size <= 825)  interface -> upto825 ++;
-  else if (size <= 900)  interface -> upto900 ++;
-  else if (size <= 975)  interface -> upto975 ++;
-  else if (size <= 1050) interface -> upto1050 ++;
-  else if (size <= 1125) interface -> upto1125 ++;
-  else if (size <= 1200) interface -> upto1200 ++;
-  else if (size <= 1275) interface -> upto1275 ++;
-  else if (size <= 1350) interface -> upto1350 ++;
-  else if (size <= 1425) interface -> upto1425 ++;
-  else if (size <= 1514) interface -> upto1514 ++;
-  else                   interface -> above1514 ++;
+  if (size <= 75)        interface -> upto75 += interface -> weight;
+  else if (size <= 150)  interface -> upto150 += interface -> weight;
+  else if (size <= 225)  interface -> upto225 += interface -> weight;
+  else if (size <= 300)  interface -> upto300 += interface -> weight;
+  else if (size <= 375)  interface -> upto375 += interface -> weight;
+  else if (size <= 450)  interface -> upto450 += interface -> weight;
+  else if (size <= 525)  interface -> upto525 += interface -> weight;
+  else if (size <= 600)  interface -> upto600 += interface -> weight;
+  else if (size <= 675)  interface -> upto675 += interface -> weight;
+  else if (size <= 750)  interface -> upto750 += interface -> weight;
+  else if (size <= 825)  interface -> upto825 += interface -> weight;
+  else if (size <= 900)  interface -> upto900 += interface -> weight;
+  else if (size <= 975)  interface -> upto975 += interface -> weight;
+  else if (size <= 1050) interface -> upto1050 += interface -> weight;
+  else if (size <= 1125) interface -> upto1125 += interface -> weight;
+  else if (size <= 1200) interface -> upto1200 += interface -> weight;
+  else if (size <= 1275) interface -> upto1275 += interface -> weight;
+  else if (size <= 1350) interface -> upto1350 += interface -> weight;
+  else if (size <= 1425) interface -> upto1425 += interface -> weight;
+  else if (size <= 1514) interface -> upto1514 += interface -> weight;
+  else                   interface -> above1514 += interface -> weight;
 }
 
 
@@ -170,22 +184,62 @@ static void * sniffer (void * _interface)
 	{
 	  datalink_t * d;
 
-	  /* Update packets distribution by size */
-	  packets_by_size (header . len, interface);
+	  /* What the kernel copies against what is on the wire */
+	  interface -> bytes_seen += header . len;
+	  interface -> bytes_captured += header . caplen;
 
-	  /* Attempt to decode and count packets based on the type of data-link */
-	  if ((d = knowndatalink (interface -> datalink)))
-	    d -> counter (interface, & header, packet);
-	  else
+	  /* The hosts are seen at the time the frame was captured, not when it is decoded */
+	  interface -> clock = interface -> lastpkt = header . ts;
+	  if (! interface -> firstpkt . tv_sec)
+	    interface -> firstpkt = header . ts;
+
+	  /* Only the frames in the sample are decoded, each one is counted for all the frames it stands for */
+	  if (sampled (interface))
 	    {
-	      interface -> bytes_total += header . len;
-	      interface -> pkts_total ++;
-	      interface -> bytes_other += header . len;
-	      interface -> pkts_other ++;
+	      /* Update packets distribution by size */
+	      packets_by_size (header . len, interface);
+
+	      /* Attempt to decode and count packets based on the type of data-link */
+	      if ((d = knowndatalink (interface -> datalink)))
+		d -> counter (interface, & header, packet);
+	      else
+		{
+		  interface -> bytes_total += header . len * interface -> weight;
+		  interface -> pkts_total += interface -> weight;
+		  interface -> bytes_other += header . len * interface -> weight;
+		  interface -> pkts_other += interface -> weight;
+		}
+	      interface -> pkts_decoded ++;
 	    }
 	}
+      else
+	{
+	  /* Nothing read for a whole timeout, the clock goes on by as much without asking the system */
+	  interface -> clock . tv_usec += (long) interface -> timeout * 1000;
+	  interface -> clock . tv_sec  += interface -> clock . tv_usec / 1000000;
+	  interface -> clock . tv_usec %= 1000000;
+	}
+
+      /* Hand the frame to the recorder (which never blocks the capture) and keep it in the ring */
+      if (interface -> recorder)
+	recpkt (interface, packet ? & header : NULL, packet);
+      if (interface -> ring)
+	ringpkt (interface, packet ? & header : NULL, packet);
+
+      /* Run the rate tick over the hosts cache once per second and publish the counters just computed */
+      if (interface -> clock . tv_sec != interface -> lasttick)
+	{
+	  resolvdrain (interface);
+	  histtick (interface, interface -> clock . tv_sec);
+	  accttick (interface);
+	  shmtick (interface, interface -> clock . tv_sec);
+	  shedtick (interface, packet ? & header . ts : NULL);
+	}
     }
 
+  /* The counters are no longer updated */
+  shmunexport (interface);
+
   /* Allow next run */
   interface -> status = INTERFACE_READY;
   return NULL;
@@ -197,7 +251,8 @@ static void usage (char * progname, struct option * options)
 {
   printf ("`%s' starts capturing and processing packets from one (or more) network interface(s).\n", progname);
   printf ("More than one interface may be specified in a comma separated list.\n");
-  printf ("On Linux systems with kernels 2.2 or later, an argument of 'any' can be used to capture packets from all available interfaces.\n");
+  printf ("On Linux systems with kernels 2.2 or later, an argument of 'any' can be used to capture packets from all available interfaces\n");
+  printf ("in a single thread, with counters and hosts foreach of them (by interface index, see 'pkstatus any').\n");
   printf ("Please refer to the pcap (Packet Capture) library for more info about filter expressions ('man pcap').\n");
   printf ("See also documentation of other networking applications if you are in trouble with the meaning of filtering network traffic\n");
   printf ("(e.g. tcpdump, wireshark, snort)\n");
@@ -211,6 +266,9 @@ static void usage (char * progname, struct option * options)
   printf ("   %s eth1                    # open interface eth1 and start processing packets\n", progname);
   printf ("   %s eth2,eth0,eth1          # start processing packets on interfaces eth2, eth0 and eth1 in this order. Latest is the 'active'\n", progname);
   printf ("   %s hme0 host tecsiel.it    # open interface hme0 to look at packets only for host tecsiel.it\n", progname);
+  printf ("   %s -m eth0                 # open interface eth0 and export its counters to shared memory %seth0\n", progname, PKSHM_PREFIX);
+  printf ("   %s any                     # capture on all the interfaces (e.g. the veths of containers) in one thread\n", progname);
+  printf ("   %s --sample 100 eth0       # decode only 1 frame out of 100 on eth0, counters are then estimates\n", progname);
 
   printf ("\n");
   printf ("Main options are:\n");
@@ -219,10 +277,25 @@ static void usage (char * progname, struct option * options)
   printf ("   -p, --promiscuous                  disable promiscuous mode of operation\n");
   printf ("   -t, --timeout                      specify the read timeout in ms (default %d)\n", DEFAULT_TIMEOUT);
   printf ("   -c, --maxcount                     capture maxcount packets and then stop (but interface is left open)\n");
+  printf ("   -m, --shm                          export the counters to shared memory (see pkshm.h and pkshm-dump)\n");
+  printf ("  --shm-hosts                         specify the # of hosts exported to shared memory (default %d)\n", PKSHM_HOSTS);
+  printf ("  --sample N                          decode only 1 frame out of N (every N-th) and count it N times\n");
+  printf ("  --sample-random                     take the frames of the sample at random (in the kernel on Linux 3.15 or later,\n");
+  printf ("                                      so the others are not even copied, except on the 'any' device)\n");
+  printf ("  --no-shed                           always decode in full, even when the kernel drops frames (otherwise the sniffer\n");
+  printf ("                                      sheds fingerprints and payload signatures, then per-host TCP/UDP counters, then\n");
+  printf ("                                      samples when it falls behind)\n");
+  printf ("  --headers-only                      capture only the headers the decoders look at rather than a snapshot of each frame\n");
+  printf ("  --checksums                         verify the IP, TCP and UDP checksums (the frames sent by this host may look\n");
+  printf ("                                      wrong when the NIC computes them, see pkstatus)\n");
+  printf ("  --payload                           tell the application protocols by the first bytes of the payload of each\n");
+  printf ("                                      conversation (HTTP, TLS, SSH, SMTP, IMAP, POP3, DNS) rather than by the\n");
+  printf ("                                      well-known ports only (the default)\n");
 
   printf ("  --hw, --hardware-size               specify hash table size for hardware identifiers (default %d)\n", DEFAULT_HW_SIZE);
   printf ("  --ip, --ip-size                     specify hash table size for IP address (default %d)\n", DEFAULT_IP_SIZE);
   printf ("  --ht, --hostname-size               specify hash table size for hostnames (default %d)\n", DEFAULT_HOST_SIZE);
+  printf ("  --vlan-keys                         keep apart the same address seen in different VLANs (as address%%vlan)\n");
 }
 
 
@@ -248,6 +321,15 @@ int pksh_pkenable (int argc, char * argv [])
   int hwsize       = DEFAULT_HW_SIZE;
   int ipsize       = DEFAULT_IP_SIZE;
   int hostsize     = DEFAULT_HOST_SIZE;
+  bool shm         = false;
+  int shmhosts     = PKSHM_HOSTS;
+  unsigned sample  = 0;
+  bool samplerandom = false;
+  bool shed        = true;
+  bool headersonly = false;
+  bool checksums   = false;
+  bool payload     = false;
+  bool vlankeys    = false;
 
   char ebuf [PCAP_ERRBUF_SIZE] = { '\0' };
   char * ptrptr;
@@ -285,10 +367,19 @@ int pksh_pkenable (int argc, char * argv [])
 	case OPT_PROMISCUOUS: promiscuous = 0;          break;
 	case OPT_TIMEOUT:     timeout = atoi (optarg);  break;
 	case OPT_MAXCOUNT:    maxcount = atoi (optarg); break;
+	case OPT_SHM:         shm = true;               break;
 
 	case 128: hwsize = atoi (optarg);   break;
 	case 129: ipsize = atoi (optarg);   break;
 	case 130: hostsize = atoi (optarg); break;
+	case 131: shmhosts = atoi (optarg); shm = true; break;
+	case 132: sample = atoi (optarg);   break;
+	case 133: samplerandom = true;      break;
+	case 134: shed = false;             break;
+	case 135: headersonly = true;       break;
+	case 136: checksums = true;         break;
+	case 137: payload = true;           break;
+	case 138: vlankeys = true;          break;
 	}
     }
 
@@ -347,6 +438,14 @@ int pksh_pkenable (int argc, char * argv [])
 	      cmdargv = argsmore (cmdargv, value);
 	    }
 
+	  /* headers only => --headers-only (it takes the place of the snapshot) */
+	  if (headersonly)
+	    cmdargv = argsmore (cmdargv, "--headers-only");
+
+	  /* payload => --payload (the headers only are followed by the bytes scanned for a signature) */
+	  if (headersonly && payload)
+	    cmdargv = argsmore (cmdargv, "--payload");
+
 	  /* promiscuous => -p */
 	  if (! promiscuous)
 	    cmdargv = argsmore (cmdargv, "-p");
@@ -380,6 +479,10 @@ int pksh_pkenable (int argc, char * argv [])
 	      cmdargv = argsmore (cmdargv, value);
 	    }
 
+	  /* vlan keys => --vlan-keys */
+	  if (vlankeys)
+	    cmdargv = argsmore (cmdargv, "--vlan-keys");
+
 	  /* interface name */
 	  cmdargv = argsmore (cmdargv, name);
 
@@ -399,8 +502,17 @@ int pksh_pkenable (int argc, char * argv [])
 
       if (rc != -1)
 	{
+	  bool resample;
+
 	  interface = intfbyname (interfaces, name);
 
+	  /* Sampling is set ahead of the filter, the kernel may be the one taking the frames in front of it */
+	  resample = interface -> samplekernel;
+	  samplestart (interface, sample, samplerandom);
+	  shedstart (interface, shed);
+	  interface -> checksums = checksums;
+	  interface -> payload   = payload;
+
 	  /* Save the new filter expression */
 	  if (filter)
 	    {
@@ -409,26 +521,27 @@ int pksh_pkenable (int argc, char * argv [])
 	      interface -> filter = strdup (filter);
 	    }
 
-	  if (interface -> filter)
+	  if (interface -> filter || interface -> samplerandom || resample)
 	    {
-	      /* Compile the optional 'filter' into a BPF program */
-	      if (pcap_compile (interface -> pcap, & bpf_program, interface -> filter, 1, interface -> pcapnetmask) == -1)
+	      /* Compile the optional 'filter' into a BPF program (an empty one takes all the frames) */
+	      if (pcap_compile (interface -> pcap, & bpf_program, interface -> filter ? interface -> filter : "", 1, interface -> pcapnetmask) == -1)
 		{
-		  printf ("%s: cannot compile the filter [%s] (%s)\n", argv [0], interface -> filter, pcap_geterr (interface -> pcap));
+		  printf ("%s: cannot compile the filter [%s] (%s)\n", argv [0], interface -> filter ? interface -> filter : "", pcap_geterr (interface -> pcap));
 		  free (interface -> filter);
 		  interface -> filter = NULL;
 		  rc = -1;
 		}
 	      else
 		{
-		  /* Apply the filter to the Packet Capture descriptor */
-		  if (pcap_setfilter (interface -> pcap, & bpf_program) == -1)
+		  /* Apply the filter to the Packet Capture descriptor (and let the kernel take the frames of the sample when it can) */
+		  if (samplesetfilter (interface, & bpf_program) == -1)
 		    {
-		      printf ("%s: cannot set the filter [%s] (%s)\n", argv [0], interface -> filter, pcap_geterr (interface -> pcap));
+		      printf ("%s: cannot set the filter [%s] (%s)\n", argv [0], interface -> filter ? interface -> filter : "", pcap_geterr (interface -> pcap));
 		      free (interface -> filter);
 		      interface -> filter = NULL;
 		      rc = -1;
 		    }
+		  pcap_freecode (& bpf_program);
 		}
 	    }
 
@@ -438,6 +551,14 @@ int pksh_pkenable (int argc, char * argv [])
 	      if (maxcount)
 		interface -> maxcount = maxcount;
 
+	      /* Create the shared memory segment before the sniffer starts writing to it */
+	      if (shm && shmexport (interface, shmhosts > 0 ? shmhosts : PKSHM_HOSTS) == -1)
+		printf ("%s: cannot export the counters of '%s' to shared memory (%s)\n",
+			argv [0], interface -> name, strerror (errno));
+
+	      /* The signatures are read by all the sniffers, so they are ready before the first one starts */
+	      payloadinit ();
+
 	      /* Start a new thread to look at packets on this interface */
 	      if (pthread_create (& interface -> tid, NULL, sniffer, interface))
 		{
@@ -450,9 +571,13 @@ int pksh_pkenable (int argc, char * argv [])
 		printf ("started sniffer on interface '%s' with filter expression set to \"%s\" ...\n", name, interface -> filter);
 	      else
 		printf ("started sniffer on interface '%s' (no filter enabled)...\n", name);
+	      if (interface -> sampling)
+		printf ("decoding 1 frame out of %u on interface '%s' (%s), counters are estimates\n", interface -> sampling, name,
+			interface -> samplekernel ? "at random, taken by the kernel" : interface -> samplerandom ? "at random" : "in sequence");
 
 	      /* Set the time the interface was enabled for sniffing */
 	      gettimeofday (& interface -> started, NULL);
+	      interface -> clock = interface -> started;
 
 	      /* Change the status of the interface to ENABLED */
 	      interface -> status = INTERFACE_ENABLED;
@@ -96,7 +96,7 @@ char * osfingerprintmatch (char * fp)
     {
       strcpy (wildcard, fp);
       memcpy (wildcard + 5, "_MSS", 4);
-      if ((os = lookup (fp, & osfpht)))
+      if ((os = lookup (wildcard, & osfpht)))
 	return os;
     }
 
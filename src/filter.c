@@ -140,6 +140,13 @@ int pksh_pkfilter (int argc, char * argv [])
       return -1;
     }
 
+  /* The filter of an interface captured by pkshd is owned by the daemon */
+  if (interface -> remote && optind < argc)
+    {
+      printf ("%s: interface %s is captured by pkshd\n", argv [0], name);
+      return -1;
+    }
+
   /* Build a filter from all remaining command line arguments */
   if (optind < argc && (filter = argsjoin (argv + optind)))
     {
@@ -150,12 +157,14 @@ int pksh_pkfilter (int argc, char * argv [])
 	  return -1;
 	}
 
-      /* And apply the filter to the pcap descriptor */
-      if (pcap_setfilter (interface -> pcap, & bpf_program) == -1)
+      /* And apply the filter to the pcap descriptor (keeping the frames of a random sample taken by the kernel in front of it) */
+      if (samplesetfilter (interface, & bpf_program) == -1)
 	{
 	  printf ("%s: cannot set the filter [%s] (%s)\n", argv [0], filter, pcap_geterr (interface -> pcap));
+	  pcap_freecode (& bpf_program);
 	  return -1;
 	}
+      pcap_freecode (& bpf_program);
 
       /* Save the new filter expression */
       if (filter)
@@ -218,10 +218,10 @@ int pksh_pkfinger (int argc, char * argv [])
       /* TCP Protocol distribution */
       tcp_protocols_distribution (host);
 
-#if defined(FIXME)
       /* Traffic distribution by hour */
       bytes_all_by_hour (host);
 
+#if defined(FIXME)
       /* Contacted peers */
       contacted_peers (host);
 
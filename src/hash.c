@@ -21,6 +21,7 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "hash.h"
@@ -77,6 +78,7 @@ void hash_table_init (struct hash_table *h)
 		h->func = hash_pjw;
 
 	h->size = (unsigned int) find_prime (h->size);
+	h->count = 0;
 	h->tbl = (struct list *) malloc (h->size * (sizeof (struct list)));
 	if (!h->tbl)
 		return;
@@ -104,7 +106,7 @@ void hash_table_free (struct hash_table *h)
 				d = (struct datum *) curr->data;
 				if (d->key)
 					free (d->key);
-				if (d->val)
+				if (d->val && d->vsize)
 					free (d->val);
 			}
 		}
@@ -117,6 +119,7 @@ void hash_table_free (struct hash_table *h)
 	h->func = NULL;
 	h->size = 0;
 	h->tbl = NULL;
+	h->count = 0;
 
 	return;
 }
@@ -151,6 +154,8 @@ struct datum *hash_table_insert (struct hash_table *h, struct datum *d)
 
 	slot = (int) (h->func (d->key) % h->size);
 	item = list_insert (&(h->tbl[slot]), (void *) new, sizeof (struct datum));
+	if (item)
+		h->count++;
 	goto EXIT;
 
 ERROR:
@@ -222,9 +227,10 @@ void hash_table_delete (struct hash_table *h, struct datum *k)
 		d = (struct datum *) l->data;
 		if (d->key)
 			free (d->key);
-		if (d->val)
+		if (d->val && d->vsize)
 			free (d->val);
 		list_delete ((struct list_item *) l);
+		h->count--;
 	}
 
 	return;
@@ -262,6 +268,8 @@ struct datum *hash_table_refer (struct hash_table *h, struct datum *d)
 
 	slot = (int) (h->func (d->key) % h->size);
 	item = list_insert (&(h->tbl[slot]), (void *) new, sizeof (struct datum));
+	if (item)
+		h->count++;
 	goto EXIT;
 
 ERROR:
@@ -277,15 +285,7 @@ EXIT:
 /* Return the # of items in the hash table 't' */
 int htno (struct hash_table * t)
 {
-  int argc = 0;
-  int i = 0;
-  struct list_item * item;
-
-  for (i = 0; i < t -> size; i ++)
-    for (item = t -> tbl [i] . head; item; item = item -> next)
-      argc ++;
-
-  return argc;
+  return t -> count;
 }
 
 
@@ -293,12 +293,17 @@ int htno (struct hash_table * t)
 char ** htkeys (struct hash_table * t)
 {
   int i = 0;
+  unsigned n = 0;
   struct list_item * item;
-  char ** keys = NULL;
+  char ** keys;
+
+  /* The table knows its size, so the result can be allocated once */
+  if (! t -> count || ! (keys = calloc (t -> count + 1, sizeof (char *))))
+    return NULL;
 
   for (i = 0; i < t -> size; i ++)
-    for (item = t -> tbl [i] . head; item; item = item -> next)
-      keys = argsmore (keys, ((struct datum *) item -> data) -> key);
+    for (item = t -> tbl [i] . head; item && n < t -> count; item = item -> next)
+      keys [n ++] = strdup (((struct datum *) item -> data) -> key);
 
   return keys;
 }
@@ -308,12 +313,16 @@ char ** htkeys (struct hash_table * t)
 void ** htvalues (struct hash_table * t)
 {
   int i = 0;
+  unsigned n = 0;
   struct list_item * item;
-  void ** values = NULL;
+  void ** values;
+
+  if (! t -> count || ! (values = calloc (t -> count + 1, sizeof (void *))))
+    return NULL;
 
   for (i = 0; i < t -> size; i ++)
-    for (item = t -> tbl [i] . head; item; item = item -> next)
-      values = vamore (values, ((struct datum *) item -> data) -> val);
+    for (item = t -> tbl [i] . head; item && n < t -> count; item = item -> next)
+      values [n ++] = ((struct datum *) item -> data) -> val;
 
   return values;
 }
@@ -31,13 +31,14 @@ struct datum {
 	void *key;
 	unsigned long ksize;
 	void *val;
-	unsigned long vsize;
+	unsigned long vsize;	/* 0 when val is not an object to be freed */
 };
 
 struct hash_table {
 	hash_func func;
 	unsigned int size;
 	struct list *tbl;
+	unsigned int count;	/* # of items, maintained on insert/delete */
 };
 
 /* Peter J. Wienberger's hash */
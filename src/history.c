@@ -0,0 +1,255 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Per-host throughput and compact traffic history (by minute and by hour)
+ *
+ * Each bucket of the history is an 8-bit minifloat with 5 bits of exponent
+ * and 3 bits of mantissa: codes 0-7 are exact, then value = (8 + m) << (e - 1).
+ * The relative error is below 6.25% and the largest value is about 16G, which
+ * is plenty for rendering sparklines while keeping the ring very small.
+ * Hourly bytes are kept in KBytes to avoid saturation on busy hosts.
+ *
+ * The packets of a bucket are not counted on their own but told by the mean
+ * size of the packets, coded in 4 bits on a log scale from 16 to 8192 bytes
+ * (0.6 octave steps, the relative error is below 23%), and two of them fit
+ * in a byte. So the packets cost half the bytes with no range to saturate.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* Largest coded value */
+#define MF_MAX 0xff
+
+/* Mean packet size foreach 4-bit code (2^(4 + 0.6 * code)) */
+static const uint16_t sizes [16] =
+{
+  16, 24, 37, 56, 84, 128, 194, 294, 446, 676, 1024, 1552, 2353, 3566, 5405, 8192
+};
+
+
+/* Code a counter into an 8-bit minifloat (saturating) */
+static uint8_t mfencode (uint64_t value)
+{
+  unsigned shift = 0;
+
+  if (value < 8)
+    return value;
+
+  /* Normalize the mantissa into [8, 16) rounding to the nearest */
+  while ((value >> shift) >= 16)
+    shift ++;
+  if (shift)
+    value = (value + ((uint64_t) 1 << (shift - 1))) >> shift;
+  if (value == 16)
+    value = 8,
+      shift ++;
+
+  return shift + 1 > 31 ? MF_MAX : ((shift + 1) << 3) | (value - 8);
+}
+
+
+/* Decode an 8-bit minifloat */
+static counter_t mfdecode (uint8_t code)
+{
+  return code < 8 ? code : (counter_t) (8 + (code & 7)) << ((code >> 3) - 1);
+}
+
+
+/* Code the mean size of 'pkts' packets making 'bytes' bytes to the nearest (in the log scale) of the sizes */
+static uint8_t szencode (counter_t bytes, counter_t pkts)
+{
+  uint64_t mean = pkts ? (bytes + pkts / 2) / pkts : 0;
+  uint8_t code = 0;
+
+  while (code < 15 && mean * mean > (uint64_t) sizes [code] * sizes [code + 1])
+    code ++;
+
+  return code;
+}
+
+
+/* The packets making 'bytes' bytes with a coded mean size (there is at least one packet in a bucket with traffic) */
+static counter_t szdecode (counter_t bytes, uint8_t code)
+{
+  return bytes ? MAX (1, (bytes + sizes [code] / 2) / sizes [code]) : 0;
+}
+
+
+/* Get and set the i-th 4-bit code of 'codes' */
+static uint8_t nibble (uint8_t codes [], unsigned i)
+{
+  return (codes [i / 2] >> (i % 2 * 4)) & 0x0f;
+}
+
+
+static void setnibble (uint8_t codes [], unsigned i, uint8_t code)
+{
+  codes [i / 2] = (codes [i / 2] & ~(0x0f << (i % 2 * 4))) | code << (i % 2 * 4);
+}
+
+
+/* Close the minute currently being filled and roll it into the hour ring when the hour is over */
+static void histclose (history_t * hist)
+{
+  unsigned slot = hist -> minute % HISTORY_MINUTES;
+
+  hist -> mbytes [slot] = mfencode (hist -> bytes);
+  setnibble (hist -> msizes, slot, szencode (hist -> bytes, hist -> pkts));
+  hist -> bytes = 0;
+  hist -> pkts  = 0;
+
+  /* The minute ring holds exactly one hour, so it can be summed up on the last minute */
+  if (slot == HISTORY_MINUTES - 1)
+    {
+      counter_t bytes = 0;
+      counter_t pkts = 0;
+      unsigned i;
+
+      for (i = 0; i < HISTORY_MINUTES; i ++)
+	{
+	  counter_t b = mfdecode (hist -> mbytes [i]);
+
+	  bytes += b;
+	  pkts  += szdecode (b, nibble (hist -> msizes, i));
+	}
+
+      slot = (hist -> minute / HISTORY_MINUTES) % HISTORY_HOURS;
+      hist -> hbytes [slot] = mfencode (bytes / 1024);
+      setnibble (hist -> hsizes, slot, szencode (bytes, pkts));
+    }
+}
+
+
+/* Advance the history up to the minute 'minute' (since the Epoch) */
+static void histadvance (history_t * hist, uint32_t minute)
+{
+  /* First time ever (or too old to be worth replaying) */
+  if (! hist -> minute || minute - hist -> minute > HISTORY_MINUTES * HISTORY_HOURS)
+    {
+      if (hist -> minute)
+	memset (hist, 0, sizeof (* hist));
+      hist -> minute = minute;
+      return;
+    }
+
+  while (hist -> minute < minute)
+    histclose (hist),
+      hist -> minute ++;
+}
+
+
+/*
+ * The rate tick, once per second run over the hosts cache of 'intf' to:
+ *  o evaluate current/average/peak throughput
+ *  o account the traffic since the previous tick into the per-minute history
+ *  o advance the per-minute and per-hour rings
+ */
+void histtick (interface_t * intf, time_t now)
+{
+  time_t elapsed = intf -> lasttick ? now - intf -> lasttick : 1;
+  host_t * host;
+
+  /* The capture clock stepped back, there is no rate to tell but the next tick is due a second from now */
+  if (elapsed <= 0)
+    {
+      intf -> lasttick = now;
+      return;
+    }
+
+  for (host = hostfirst (intf); host; host = hostnext (host))
+    {
+      counter_t bytes = host -> bytes_sent + host -> bytes_recv;
+      counter_t pkts  = host -> pkts_sent + host -> pkts_recv;
+      time_t age = now - host -> first . tv_sec;
+
+      /* Throughput */
+      host -> bytes_current = (bytes - host -> bytes_tick) / elapsed;
+      host -> pkts_current  = (pkts - host -> pkts_tick) / elapsed;
+      host -> bytes_average = bytes / (age > 0 ? age : 1);
+      host -> pkts_average  = pkts / (age > 0 ? age : 1);
+      host -> bytes_peak    = MAX (host -> bytes_peak, host -> bytes_current);
+      host -> pkts_peak     = MAX (host -> pkts_peak, host -> pkts_current);
+
+      /* Traffic history */
+      histadvance (& host -> history, now / 60);
+      host -> history . bytes += bytes - host -> bytes_tick;
+      host -> history . pkts  += pkts - host -> pkts_tick;
+
+      host -> bytes_tick = bytes;
+      host -> pkts_tick  = pkts;
+    }
+
+  intf -> lasttick = now;
+}
+
+
+/* Fill 'bytes' and 'pkts' with the last HISTORY_MINUTES minutes (oldest first, the current minute last) */
+void histminutes (history_t * hist, counter_t bytes [], counter_t pkts [])
+{
+  unsigned i;
+
+  for (i = 0; i < HISTORY_MINUTES - 1; i ++)
+    {
+      unsigned slot = (hist -> minute + 1 + i) % HISTORY_MINUTES;
+
+      bytes [i] = mfdecode (hist -> mbytes [slot]);
+      pkts [i]  = szdecode (bytes [i], nibble (hist -> msizes, slot));
+    }
+
+  bytes [i] = hist -> bytes;
+  pkts [i]  = hist -> pkts;
+}
+
+
+/* Fill 'bytes' and 'pkts' with the last HISTORY_HOURS hours (oldest first, the current hour last) */
+void histhours (history_t * hist, counter_t bytes [], counter_t pkts [])
+{
+  unsigned hour = hist -> minute / HISTORY_MINUTES;
+  unsigned i;
+
+  for (i = 0; i < HISTORY_HOURS - 1; i ++)
+    {
+      unsigned slot = (hour + 1 + i) % HISTORY_HOURS;
+
+      bytes [i] = mfdecode (hist -> hbytes [slot]) * 1024;
+      pkts [i]  = szdecode (bytes [i], nibble (hist -> hsizes, slot));
+    }
+
+  /* The current hour is still in the minute ring */
+  bytes [i] = hist -> bytes;
+  pkts [i]  = hist -> pkts;
+  for (hour = 0; hour < hist -> minute % HISTORY_MINUTES; hour ++)
+    {
+      counter_t b = mfdecode (hist -> mbytes [hour]);
+
+      bytes [i] += b;
+      pkts [i]  += szdecode (b, nibble (hist -> msizes, hour));
+    }
+}
+
+
+/* Return the # of bytes seen during the last 60 minutes */
+counter_t histlasthour (history_t * hist)
+{
+  counter_t bytes [HISTORY_MINUTES];
+  counter_t pkts [HISTORY_MINUTES];
+  counter_t total = 0;
+  unsigned i;
+
+  histminutes (hist, bytes, pkts);
+  for (i = 0; i < HISTORY_MINUTES; i ++)
+    total += bytes [i];
+
+  return total;
+}
@@ -35,7 +35,7 @@ static char __released__ [] = PKSH_RELEASED;
 static char __id__ []       = "A hack of the popular 'tcsh' with builtin extensions for network monitoring.";
 
 
-/* This is the list of commands where completion on variable [$hosts] would take effect */
+/* This is the list of commands where completion on hosts identifiers would take effect */
 static char * completions [] =
   { "packets", "bytes", "protocols", "throughput", "services", "pkhosts", "pkarp", "pklast", "pkwho", "pkfinger", NULL };
 
@@ -68,10 +68,10 @@ static void set_completions (int cargc, char * cargv [])
     {
       int hargc;
 
-      /* complete pkhosts 'p/\*\/$hosts' */
+      /* complete pkhosts 'p/\*\/`pkcomplete`/' (the index of hosts identifiers is queried at each TAB) */
       hargv = argsmore (NULL, "complete");
       hargv = argsmore (hargv, cargv [i]);
-      hargv = argsmore (hargv, "p/\\*/$hosts/");
+      hargv = argsmore (hargv, "p/\\*/`pkcomplete`/");
 
       hargc = argslen (hargv);
 
@@ -122,8 +122,8 @@ void pksh_init (char * progname, int quiet)
       xprintf ("Type 'help' for the list of builtin extensions implemented by this shell.\n\n");
     }
 
-  /* Set unbuffered stdout */
-  setvbuf (stdout, NULL, _IONBF, 0);
+  /* Set fully buffered stdout for tables rendering */
+  renderinit ();
 
   /* Initialize the vendor hash table */
   vtfill ();
@@ -131,7 +131,7 @@ void pksh_init (char * progname, int quiet)
   /* Initialize the OS fingerprint hash table */
   osfingerprintfill ();
 
-  /* Define the set of [pksh] commands where the completion would take effect on the [$hosts] variable */
+  /* Define the set of [pksh] commands where the completion would take effect on hosts identifiers */
   set_completions (argslen (completions), completions);
 
   /* Set the $pksh variable */
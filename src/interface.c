@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <ifaddrs.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -26,6 +27,9 @@
 /* The table of network interfaces */
 interface_t ** interfaces = NULL;
 
+/* Held while the table changes (or one of its interfaces is released) and by the threads reading it outside the shell */
+static pthread_mutex_t intfmutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* The stack of most referenced interfaces (the current and the previous) */
 interface_t * active   = NULL;
 interface_t * previous = NULL;
@@ -178,6 +182,37 @@ static int mtu (char * interface)
 }
 
 
+/* Save the IPv6 prefixes of 'intf' (as returned by the OS via getifaddrs(), those of all the devices for 'any'), link-local ones are known in advance */
+static void ip6prefixes (interface_t * intf)
+{
+  struct ifaddrs * all;
+  struct ifaddrs * ifa;
+
+  if (getifaddrs (& all) == -1)
+    return;
+
+  for (ifa = all; ifa && intf -> ip6prefixes < IP6_PREFIXES; ifa = ifa -> ifa_next)
+    if (ifa -> ifa_addr && ifa -> ifa_netmask && ifa -> ifa_addr -> sa_family == AF_INET6 &&
+	(! strcmp (ifa -> ifa_name, intf -> name) || ! strcmp (intf -> name, ANY_DEVICE)))
+      {
+	struct in6_addr * addr = & ((struct sockaddr_in6 *) ifa -> ifa_addr) -> sin6_addr;
+	struct in6_addr * mask = & ((struct sockaddr_in6 *) ifa -> ifa_netmask) -> sin6_addr;
+	unsigned bits = 0;
+	int i;
+
+	if (IN6_IS_ADDR_LINKLOCAL (addr))
+	  continue;
+
+	for (i = 0; i < 16; i ++)
+	  intf -> ip6prefix [intf -> ip6prefixes] . s6_addr [i] = addr -> s6_addr [i] & mask -> s6_addr [i],
+	    bits += __builtin_popcount (mask -> s6_addr [i]);
+	intf -> ip6prefixlen [intf -> ip6prefixes ++] = bits;
+      }
+
+  freeifaddrs (all);
+}
+
+
 /* Return the current referenced interface */
 interface_t * activeintf (void)
 {
@@ -218,6 +253,19 @@ char * getintfname (void)
 }
 
 
+/* Serialize the changes to the table of interfaces with its concurrent readers */
+void intflock (void)
+{
+  pthread_mutex_lock (& intfmutex);
+}
+
+
+void intfunlock (void)
+{
+  pthread_mutex_unlock (& intfmutex);
+}
+
+
 /* Return the number of interfaces in the table */
 int intflen (interface_t * argv [])
 {
@@ -261,6 +309,7 @@ static interface_t * mkintf (char * name, int snapshot, int promiscuous, int tim
   intf -> netmaskbin   = netmask ? netmask -> sin_addr . s_addr : 0;
   intf -> networkbin   = intf -> ipbin & intf -> netmaskbin;
   intf -> broadcastbin = intf -> ipbin | ~ intf -> netmaskbin;
+  ip6prefixes (intf);
 
   /* Determine the type of the underlying network and the data-link encapsulation method
    * Warning:
@@ -291,8 +340,10 @@ static interface_t * mkintf (char * name, int snapshot, int promiscuous, int tim
   intf -> mtu         = mtu (name);
 
   intf -> shortest  = intf -> mtu;   /* temporary initialization until first packet has arrived */
+  intf -> weight    = 1;             /* each frame counts once until sampling is set */
 
   gettimeofday (& intf -> started, NULL);
+  intf -> clock = intf -> started;
 
   return intf;
 }
@@ -301,9 +352,21 @@ static interface_t * mkintf (char * name, int snapshot, int promiscuous, int tim
 /* Free allocated memory and resources used to store an interface */
 static void rmintf (interface_t * intf)
 {
+  unsigned i;
+
   if (! intf)
     return;
 
+  /* The segment is named after the interface */
+  shmunexport (intf);
+
+  /* The frames already captured are written to disk */
+  recstop (intf);
+  ringstop (intf);
+
+  /* The names still being looked up are of no use */
+  resolvforget (intf);
+
   if (intf -> name)
     free (intf -> name);
 
@@ -315,6 +378,20 @@ static void rmintf (interface_t * intf)
   if (intf -> hostname)
     free (intf -> hostname);
 
+  triefree (& intf -> names);
+
+  if (intf -> vlans)
+    free (intf -> vlans);
+  if (intf -> flows)
+    free (intf -> flows);
+  for (i = 0; i < IFINDEX_CHUNKS; i ++)
+    if (intf -> ifindexes [i])
+      free (intf -> ifindexes [i]);
+
+  /* The registry of hosts */
+  for (i = 0; i < HOSTS_CHUNKS && intf -> chunks [i]; i ++)
+    free (intf -> chunks [i]);
+
   free (intf);
 }
 
@@ -334,14 +411,12 @@ static int posintf (interface_t * argv [], char * name)
 }
 
 
-/* Add an interface to a table of currently active interfaces */
-interface_t ** intfadd (interface_t * argv [], char * name, int snapshot, int promiscuous,
-			int timeout, char * filter, pcap_t * pcap, interface_t ** more)
+/* Append an interface descriptor to a table of currently active interfaces */
+static interface_t ** intfappend (interface_t * argv [], interface_t * intf, interface_t ** more)
 {
   int argc;
-  interface_t * intf;
 
-  if ((intf = mkintf (name, snapshot, promiscuous, timeout, filter, pcap)))
+  if (intf)
     {
       argc = intflen (argv);
       argv = (interface_t **) realloc (argv, (1 + argc + 1) * sizeof (interface_t **));
@@ -360,6 +435,47 @@ interface_t ** intfadd (interface_t * argv [], char * name, int snapshot, int pr
 }
 
 
+/* Add an interface to a table of currently active interfaces */
+interface_t ** intfadd (interface_t * argv [], char * name, int snapshot, int promiscuous,
+			int timeout, char * filter, pcap_t * pcap, interface_t ** more)
+{
+  return intfappend (argv, mkintf (name, snapshot, promiscuous, timeout, filter, pcap), more);
+}
+
+
+/* Add the mirror of an interface served by pkshd (it is filled by the client in remote.c) */
+interface_t ** intfremote (interface_t * argv [], char * name, interface_t ** more)
+{
+  interface_t * intf = calloc (sizeof (interface_t), 1);
+
+  if (! intf)
+    return argv;
+
+  intf -> name   = strdup (name);
+  intf -> status = INTERFACE_ENABLED;
+  intf -> remote = true;
+  intf -> weight = 1;
+
+  intf -> hwnames . size = DEFAULT_HW_SIZE;
+  hash_table_init (& intf -> hwnames);
+
+  intf -> ipnames . size = DEFAULT_IP_SIZE;
+  hash_table_init (& intf -> ipnames);
+
+  intf -> ip6names . size = DEFAULT_IP_SIZE;
+  intf -> ip6names . func = hash_ip6;
+  hash_table_init (& intf -> ip6names);
+
+  intf -> hostnames . size = DEFAULT_HOST_SIZE;
+  hash_table_init (& intf -> hostnames);
+
+  gettimeofday (& intf -> started, NULL);
+  intf -> clock = intf -> started;
+
+  return intfappend (argv, intf, more);
+}
+
+
 /* Remove an interface from the table of currently active interfaces */
 interface_t ** intfsub (interface_t * argv [], char * name)
 {
@@ -426,3 +542,38 @@ counter_t intfpkts (interface_t * argv [])
     pkts += (* argv ++) -> pkts_total;
   return pkts;
 }
+
+
+/*
+ * Sample where the frames captured on 'intf' have gone, all the counters at the same time so they add up:
+ * received = dropped by the kernel + still queued + read by the sniffer (= decoded + skipped)
+ * Only one thread at a time may sample an interface (its sniffer while it runs)
+ */
+void accttick (interface_t * intf)
+{
+  struct pcap_stat stats;
+
+  if (! intf -> pcap || pcap_stats (intf -> pcap, & stats) == -1)
+    return;
+
+  /* The library counts in 32 bits, only what is new since the last sample is added (a wrap included) */
+  intf -> acct_recv   += (u_int) (stats . ps_recv - intf -> pcaprecv);
+  intf -> acct_drop   += (u_int) (stats . ps_drop - intf -> pcapdrop);
+  intf -> acct_ifdrop += (u_int) (stats . ps_ifdrop - intf -> pcapifdrop);
+  intf -> pcaprecv   = stats . ps_recv;
+  intf -> pcapdrop   = stats . ps_drop;
+  intf -> pcapifdrop = stats . ps_ifdrop;
+
+  intf -> acct_read     = intf -> pkts_seen;
+  intf -> acct_decoded  = intf -> pkts_decoded;
+  intf -> acct_userdrop = (intf -> recorder ? intf -> recorder -> dropped : 0) + (intf -> ring ? intf -> ring -> dropped : 0);
+
+  /*
+   * What is neither dropped nor read is still in the kernel buffer, unless the library has discarded it
+   * on its own (e.g. the outgoing copies of the frames on the Linux loopback), so it never goes below 0
+   */
+  intf -> acct_queued = intf -> acct_recv > intf -> acct_drop + intf -> acct_read ?
+    intf -> acct_recv - intf -> acct_drop - intf -> acct_read : 0;
+
+  intf -> acct_time = time (NULL);
+}
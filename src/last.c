@@ -35,6 +35,7 @@ enum
   OPT_NUMERIC            = 'n',
   OPT_UNSORT             = 'u',
   OPT_REVERSE            = 'r',
+  OPT_HEAD               = 'H',
   OPT_LOCAL              = 'l',
   OPT_FOREIGN            = 'f',
   OPT_INCLUDE_IPLESS     = 'p',
@@ -57,6 +58,7 @@ static struct option lopts [] =
   { "numeric",                     no_argument,       NULL, OPT_NUMERIC            },
   { "unsort",                      no_argument,       NULL, OPT_UNSORT             },
   { "reverse",                     no_argument,       NULL, OPT_REVERSE            },
+  { "head",                        required_argument, NULL, OPT_HEAD               },
   { "local",                       no_argument,       NULL, OPT_LOCAL              },
   { "foreign",                     no_argument,       NULL, OPT_FOREIGN            },
   { "include-ipless",              no_argument,       NULL, OPT_INCLUDE_IPLESS     },
@@ -140,6 +142,7 @@ static void usage (char * progname, struct option * options)
   printf ("Sorting options are:\n");
   printf ("    -u, --unsort                      do not sort (default sort by last seen)\n");
   printf ("    -r, --reverse                     reverse the result of sorting\n");
+  printf ("    -H, --head N                      display only the first N hosts of the table\n");
   printf ("  --s0, --sort-by-mac-address         sort the hosts cache by MAC addresses\n");
   printf ("  --s1, --sort-by-ip-address          sort the hosts cache by IP addresses\n");
   printf ("  --s2, --sort-by-hostname            sort the hosts cache by hostnames\n");
@@ -187,10 +190,10 @@ int pksh_pklast (int argc, char * argv [])
 
   sf * howtosort = sort_by_lastseen;  /* default sorted by last seen                */
   int reverse = 0;
+  int first = 0;
   int hostno = 0;
 
-  host_t ** srchosts = NULL;          /* The hosts cache as internal maintained     */
-  host_t ** host;                     /* An iterator in the previous table          */
+  host_t * host;                      /* A cursor over the hosts cache              */
   host_t ** dsthosts = NULL;          /* The unsorted array of pointers to hosts    */
 
   char ** headargv = NULL;
@@ -231,6 +234,15 @@ int pksh_pklast (int argc, char * argv [])
 	case OPT_NUMERIC:            numeric = 1;      break;      /* display mac/ip address not hostname */
 	case OPT_UNSORT:             howtosort = NULL; break;      /* do not sort                         */
 	case OPT_REVERSE:            reverse = 1;      break;      /* reverse sort                        */
+	case OPT_HEAD:                                             /* only the first N hosts              */
+	  if ((first = hostshead (optarg)) == -1)
+	    {
+	      if (! quiet)
+		printf ("%s: invalid # of hosts [%s]\n", progname, optarg);
+	      rc = -1;
+	      goto cleanup;
+	    }
+	  break;
 	case OPT_LOCAL:              foreign = 0;      break;      /* include only local addresses        */
 	case OPT_FOREIGN:            local = 0;        break;      /* include only foreign addresses      */
 	case OPT_INCLUDE_IPLESS:     ipless = 1;       break;      /* include IP-Less hosts               */
@@ -319,30 +331,39 @@ int pksh_pklast (int argc, char * argv [])
     }
   else
     {
-      /* Scan the hosts cache to display data according to user choices */
-      for (srchosts = host = hostsall (interface); host && * host; host ++)
+      host_t ** all;
+
+      /* All the hosts currently in the cache (those added meanwhile are left out) */
+      viewphase (VIEW_ENUMERATE);
+      dsthosts = hostsall (interface);
+
+      /* Keep in place only those to display according to user choices */
+      viewphase (VIEW_FILTER);
+      for (all = dsthosts; all && (host = * all); all ++)
 	{
 	  /* Check for multicast packets */
-	  if ((* host) -> hwaddress && multicast ((* host) -> hwaddress))
+	  if (host -> hwaddress && multicast (host -> hwaddress))
 	    continue;
 
 	  /* Not not include id-less hosts (damn threads!) */
-	  if (hostipless (* host) && ! (* host) -> hwaddress)
+	  if (hostipless (host) && ! host -> hwaddress)
 	    continue;
 
 	  /* Check for IP-Less hosts */
-	  if ((ipless == 0 && hostipless (* host)) || (ipless == 2 && ! hostipless (* host)))
+	  if ((ipless == 0 && hostipless (host)) || (ipless == 2 && ! hostipless (host)))
 	    continue;
 
 	  /* Check for unresolved hosts */
-	  if ((unresolved == 0 && hostunresolved (* host)) || (unresolved == 2 && ! hostunresolved (* host)))
+	  if ((unresolved == 0 && hostunresolved (host)) || (unresolved == 2 && ! hostunresolved (host)))
 	    continue;
 
 	  /* Check for local or remote hosts */
-	  if ((local && hostlocal (* host)) || (foreign && ! hostlocal (* host)))
+	  if ((local && hostlocal (host)) || (foreign && ! hostlocal (host)))
 	    /* Put the pointer to the host into the temporary unsorted array */
-	    dsthosts = hargsadd (dsthosts, * host);
+	    dsthosts [hostno ++] = host;
 	}
+      if (dsthosts)
+	dsthosts [hostno] = NULL;
     }
 
   /* Sort and print now the hosts cache accordingly to user choices */
@@ -350,37 +371,49 @@ int pksh_pklast (int argc, char * argv [])
     {
       int longest = hostlongest (dsthosts, numeric);
       char fmt [128];
+      int rows;
       int i;
+      colplan_t * headplan;
+      colplan_t * rowplan;
 
       /* Sort the temporary table now */
       if (numeric && howtosort == sort_by_hostname)
 	howtosort = sort_by_ip;
 
-      if (hostno && howtosort)
-	qsort (dsthosts, hostno, sizeof (host_t *), howtosort);
+      /* Sort (or select only the first rows of) the table in the order they have to be rendered */
+      viewphase (VIEW_SORT);
+      rows = hostsort (dsthosts, hostno, howtosort, reverse, first);
+      viewphase (VIEW_RENDER);
 
       /* Replace the placeholder */
       sprintf (fmt, "--label=Host Id[%d]", longest);
       argsreplace (headargv, "Host-PlaceHolder", fmt);
 
+      /* Replace the host's placeholder */
+      sprintf (fmt, numeric ? "--host-numeric=%d" : "--host-identifier=%d", longest);
+      argsreplace (rowargv, "Host-PlaceHolder", fmt);
+
+      /* Compile the columns of the table only once */
+      headplan = colplan (argslen (headargv), headargv, COL_SEP);
+      rowplan = colplan (argslen (rowargv), rowargv, COL_SEP);
+
       /* Print the table's title */
-      hostprintf (NULL, argslen (headargv), headargv, COL_SEP);
+      colprintf (headplan, NULL);
       printf ("\n");
 
       /* Print now the hosts cache accordingly to user choices */
-      for (i = 0; i < hostno; i ++)
+      for (i = 0; i < rows; i ++)
 	{
-	  /* Replace the host's placeholder */
-	  sprintf (fmt, numeric ? "--host-numeric=%d" : "--host-identifier=%d", longest);
-	  argsreplace (rowargv, "Host-PlaceHolder", fmt);
-
-	  hostprintf (reverse ? dsthosts [hostno - i - 1] : dsthosts [i], argslen (rowargv), rowargv, COL_SEP);
+	  colprintf (rowplan, dsthosts [i]);
 	  printf ("\n");
 	}
+
+      colfree (rowplan);
+      colfree (headplan);
+
+      viewphase (VIEW_DONE);
     }
 
-  if (srchosts)
-    free (srchosts);
   if (dsthosts)
     free (dsthosts);
 
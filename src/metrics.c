@@ -0,0 +1,166 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <errno.h>
+
+/* Project header */
+#include "pksh.h"
+
+/* Identifiers */
+#define NAME         "pkmetrics"
+#define BRIEF        "Serve the counters to Prometheus scrapers over HTTP"
+#define SYNOPSIS     "pkmetrics [options] [port | socket]"
+#define DESCRIPTION  "No description yet"
+
+/* Public variable */
+pksh_cmd_t cmd_metrics = { NAME, BRIEF, SYNOPSIS, DESCRIPTION, pksh_pkmetrics };
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  OPT_HEAD        = 'n',
+  OPT_INTERVAL    = 't',
+  OPT_STOP        = 'x',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  { "head",          required_argument, NULL, OPT_HEAD        },
+  { "interval",      required_argument, NULL, OPT_INTERVAL    },
+  { "stop",          no_argument,       NULL, OPT_STOP        },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' serves /metrics in the Prometheus text format over HTTP/1.1 from a thread of its own,\n", progname);
+  printf ("     either on a port of the loopback interface or on a Unix socket (any argument with a '/')\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] [port | socket]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s                     # serve http://127.0.0.1:%s/metrics (or tell where it is served)\n", progname, METRICS_PORT);
+  printf ("   %s -n 50 9999          # serve the 50 busiest hosts per interface on port 9999\n", progname);
+  printf ("   %s /run/pksh.metrics   # serve /metrics on a Unix socket\n", progname);
+  printf ("   %s -x                  # stop serving /metrics\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -q, --quiet                  run quietly\n");
+  printf ("   -n, --head N                 serve the N busiest hosts per interface (default %d)\n", METRICS_HEAD);
+  printf ("   -t, --interval secs          render the page at most once every 'secs' seconds (default %d)\n", METRICS_INTERVAL);
+  printf ("   -x, --stop                   stop serving /metrics\n");
+}
+
+
+/* Serve the counters to Prometheus scrapers */
+int pksh_pkmetrics (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+  char * sopts    = optlegitimate (lopts);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  int head        = METRICS_HEAD;
+  int interval    = METRICS_INTERVAL;
+  bool stop       = false;
+
+  int option;
+
+  /* Local variables */
+  char * addr = METRICS_PORT;
+
+  /* Lookup for the command in the static table of registered extensions */
+  if (! cmd_by_name (progname))
+    {
+      printf ("%s: Command [%s] not found.\n", progname, progname);
+      return -1;
+    }
+
+  /* Parse command line options */
+  optind = 0;
+  optarg = NULL;
+  argv [0] = progname;
+  while ((option = getopt_long (argc, argv, sopts, lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:     usage (progname, lopts);  return 0;
+	case OPT_QUIET:    quiet = true;             break;
+
+	case OPT_HEAD:     head = atoi (optarg);     break;
+	case OPT_INTERVAL: interval = atoi (optarg); break;
+	case OPT_STOP:     stop = true;              break;
+	}
+    }
+
+  if (stop)
+    {
+      if (! metricswhere ())
+	{
+	  if (! quiet)
+	    printf ("%s: /metrics is not served\n", progname);
+	  return -1;
+	}
+      metricsstop ();
+      return 0;
+    }
+
+  /* Already serving: just tell where */
+  if (metricswhere ())
+    {
+      if (optind < argc)
+	{
+	  printf ("%s: /metrics is already served on %s (stop it first with '%s -x')\n", progname, metricswhere (), progname);
+	  return -1;
+	}
+      if (! quiet)
+	printf ("/metrics is served on %s (%lu scrapes)\n", metricswhere (), metricsscrapes ());
+      return 0;
+    }
+
+  if (optind < argc)
+    addr = argv [optind ++];
+
+  if (metricsstart (addr, head, interval) == -1)
+    {
+      if (! quiet)
+	printf ("%s: cannot serve /metrics on %s (%s)\n", progname, addr, strerror (errno));
+      return -1;
+    }
+
+  if (! quiet)
+    printf ("serving /metrics on %s%s\n", strchr (addr, '/') ? "" : "127.0.0.1:", addr);
+
+  /* Bye bye! */
+  return 0;
+}
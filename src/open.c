@@ -66,6 +66,10 @@ static struct option lopts [] =
   { "ip",            required_argument, NULL, 129             },
   { "ht",            required_argument, NULL, 130             },
 
+  { "vlan-keys",     no_argument,       NULL, 131             },
+  { "headers-only",  no_argument,       NULL, 132             },
+  { "payload",       no_argument,       NULL, 133             },
+
   { NULL,            0,                 NULL, 0               }
 };
 
@@ -100,6 +104,9 @@ static void usage (char * progname, struct option * options)
   printf ("  --hw, --hardware-size             specify hash table size for hardware identifiers (default %d)\n", DEFAULT_HW_SIZE);
   printf ("  --ip, --ip-size                   specify hash table size for IP address (default %d)\n", DEFAULT_IP_SIZE);
   printf ("  --ht, --hostname-size             specify hash table size for hostnames (default %d)\n", DEFAULT_HOST_SIZE);
+  printf ("  --vlan-keys                       keep apart the same address seen in different VLANs (as address%%vlan)\n");
+  printf ("  --headers-only                    capture only the headers the decoders look at (%u bytes at most, see pkstatus)\n", headerslen (-1));
+  printf ("  --payload                         with --headers-only, also the first %u bytes of the payload (see pkenable --payload)\n", PAYLOAD_SCAN);
 }
 
 
@@ -125,6 +132,9 @@ int pksh_pkopen (int argc, char * argv [])
   int hwsize      = DEFAULT_HW_SIZE;
   int ipsize      = DEFAULT_IP_SIZE;
   int hostsize    = DEFAULT_HOST_SIZE;
+  bool vlankeys   = false;
+  bool headersonly = false;
+  bool payload     = false;
 
   char ebuf [PCAP_ERRBUF_SIZE] = { '\0' };
   char * ptrptr;
@@ -164,6 +174,9 @@ int pksh_pkopen (int argc, char * argv [])
 	case 128: hwsize = atoi (optarg);   break;
 	case 129: ipsize = atoi (optarg);   break;
 	case 130: hostsize = atoi (optarg); break;
+	case 131: vlankeys = true;          break;
+	case 132: headersonly = true;       break;
+	case 133: payload = true;           break;
 	}
     }
 
@@ -218,6 +231,10 @@ int pksh_pkopen (int argc, char * argv [])
 	printf ("%s: interface %s already enabled for packet capturing. Skipping it!\n", argv [0], name);
       else
 	{
+	  /* The data-link is not known until it is open, so the snapshot covers the longest of their headers (and the bytes scanned for a signature) */
+	  if (headersonly)
+	    snapshot = headerslen (-1) + (payload ? PAYLOAD_SCAN : 0);
+
 	  /* Time to initialize pcap library for the specified interface */
 	  if (! (pcap = pcap_open_live (name, snapshot, promiscuous, timeout, ebuf)))
 	    {
@@ -226,8 +243,17 @@ int pksh_pkopen (int argc, char * argv [])
 	    }
 	  else
 	    {
+#if defined(DLT_LINUX_SLL2)
+	      /* The cooked header v2 also tells the device of each frame captured on 'any' (if the library and the kernel can) */
+	      if (! strcmp (name, ANY_DEVICE))
+		pcap_set_datalink (pcap, DLT_LINUX_SLL2);
+#endif /* DLT_LINUX_SLL2 */
+
 	      /* Get a new descriptor and save current parameters to the table of interfaces managed by this program */
-	      if (! (interfaces = intfadd (interfaces, name, snapshot, promiscuous, timeout, filter, pcap, & interface)))
+	      intflock ();
+	      interfaces = intfadd (interfaces, name, snapshot, promiscuous, timeout, filter, pcap, & interface);
+	      intfunlock ();
+	      if (! interfaces)
 		{
 		  rc = -1;
 		  printf ("Sorry! There is no space left. Too many open network interfaces\n");
@@ -244,9 +270,16 @@ int pksh_pkopen (int argc, char * argv [])
 		  interface -> ipnames . size = ipsize;
 		  hash_table_init (& interface -> ipnames);
 
+		  interface -> ip6names . size = ipsize;
+		  interface -> ip6names . func = hash_ip6;
+		  hash_table_init (& interface -> ip6names);
+
 		  interface -> hostnames . size = hostsize;
 		  hash_table_init (& interface -> hostnames);
 
+		  interface -> vlankeys = vlankeys;
+		  interface -> headersonly = headersonly;
+
 		  /* Keep track of the last active interface */
 		  setactiveintf (interface);
 
@@ -0,0 +1,383 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * The application protocol of a conversation told by the first bytes of its payload
+ *
+ * Only the first PAYLOAD_TRIES segments with a payload of each conversation
+ * are looked at, the protocol told by them is then remembered for all the
+ * others in a table of PAYLOAD_FLOWS slots, where both directions of a
+ * conversation share the same slot (a busy slot is taken by the last one).
+ * The signatures over TCP are the first bytes of the payload under a mask,
+ * all the ones starting with the first byte of the payload are compared 16
+ * bytes at a time with SSE2 (a byte at a time otherwise).  DNS over UDP is
+ * told by the shape of its header and of its question instead.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* The longest signature (the bytes compared at once) */
+#define SIGNATURE_LEN  16
+
+
+/* A signature over TCP */
+typedef struct
+{
+  char * bytes;                 /* the first bytes of the payload                         */
+  char * care;                  /* 'x' foreach byte compared, '.' foreach byte skipped    */
+  unsigned app;                 /* the application protocol told (APP_HTTP, ...)          */
+  char * also;                  /* found in the first PAYLOAD_SCAN bytes too (if any)     */
+
+} signature_t;
+
+
+/* The table of the signatures over TCP (requests, responses, banners and greetings) */
+static signature_t signatures [] =
+{
+  { "GET ",             "xxxx",             APP_HTTP, NULL   },
+  { "POST ",            "xxxxx",            APP_HTTP, NULL   },
+  { "HEAD ",            "xxxxx",            APP_HTTP, NULL   },
+  { "PUT ",             "xxxx",             APP_HTTP, NULL   },
+  { "DELETE ",          "xxxxxxx",          APP_HTTP, NULL   },
+  { "OPTIONS ",         "xxxxxxxx",         APP_HTTP, NULL   },
+  { "CONNECT ",         "xxxxxxxx",         APP_HTTP, NULL   },
+  { "PATCH ",           "xxxxxx",           APP_HTTP, NULL   },
+  { "TRACE ",           "xxxxxx",           APP_HTTP, NULL   },
+  { "HTTP/1.",          "xxxxxxx",          APP_HTTP, NULL   },
+  { "PRI * HTTP/2.0",   "xxxxxxxxxxxxxx",   APP_HTTP, NULL   },
+
+  /* A handshake record (any version and length) with a ClientHello or a ServerHello */
+  { "\x16\x03...\x01",  "xx...x",           APP_TLS,  NULL   },
+  { "\x16\x03...\x02",  "xx...x",           APP_TLS,  NULL   },
+
+  { "SSH-",             "xxxx",             APP_SSH,  NULL   },
+
+  /* FTP greets with 220 too */
+  { "220 ",             "xxxx",             APP_SMTP, "SMTP" },
+  { "220-",             "xxxx",             APP_SMTP, "SMTP" },
+  { "EHLO ",            "xxxxx",            APP_SMTP, NULL   },
+  { "HELO ",            "xxxxx",            APP_SMTP, NULL   },
+
+  { "* OK ",            "xxxxx",            APP_IMAP, NULL   },
+  { "* PREAUTH ",       "xxxxxxxxxx",       APP_IMAP, NULL   },
+
+  { "+OK",              "xxx",              APP_POP,  NULL   },
+};
+
+#define SIGNATURES  (sizeof (signatures) / sizeof (signatures [0]))
+
+
+/* The signatures padded to SIGNATURE_LEN bytes with their masks (see compile()) */
+static u_char sigbytes [SIGNATURES][SIGNATURE_LEN] __attribute__ ((aligned (16)));
+static u_char sigmask [SIGNATURES][SIGNATURE_LEN] __attribute__ ((aligned (16)));
+static unsigned siglen [SIGNATURES];
+
+/* Foreach first byte of a payload, the bitmap of the signatures starting with it (none for most) */
+static uint32_t sigfirst [256];
+static pthread_once_t compiled = PTHREAD_ONCE_INIT;
+
+
+/* Pad the signatures and index them by their first byte */
+static void compile (void)
+{
+  unsigned i;
+  unsigned b;
+
+  for (i = 0; i < SIGNATURES; i ++)
+    {
+      siglen [i] = strlen (signatures [i] . care);
+      for (b = 0; b < siglen [i]; b ++)
+	if (signatures [i] . care [b] == 'x')
+	  sigbytes [i][b] = signatures [i] . bytes [b],
+	    sigmask [i][b] = 0xff;
+      sigfirst [(u_char) signatures [i] . bytes [0]] |= 1U << i;
+    }
+}
+
+
+/* Build the tables of the signatures, once and before any sniffer may scan a payload */
+void payloadinit (void)
+{
+  pthread_once (& compiled, compile);
+}
+
+
+/* Does the string 's' start in the first 'len' bytes of 'p'? */
+static bool scalarfind (const u_char * p, unsigned len, const char * s)
+{
+  size_t n = strlen (s);
+  unsigned i;
+
+  for (i = 0; i + n <= len; i ++)
+    if (! memcmp (p + i, s, n))
+      return true;
+  return false;
+}
+
+
+/* The signature 'i' is at the beginning of 'p' ('len' bytes captured) */
+static bool scalarmatch (const u_char * p, unsigned len, unsigned i)
+{
+  unsigned b;
+
+  if (siglen [i] > len)
+    return false;
+
+  for (b = 0; b < siglen [i]; b ++)
+    if ((p [b] & sigmask [i][b]) != sigbytes [i][b])
+      return false;
+
+  return ! signatures [i] . also || scalarfind (p, len, signatures [i] . also);
+}
+
+
+#if defined(__SSE2__)
+/*
+ * The same 16 bytes at a time, the first and the last byte of 's' are looked for at once at 16 positions
+ * (in a zero-padded copy of the payload the loads never read past)
+ */
+static bool sse2find (const u_char * payload, unsigned len, const char * s)
+{
+  size_t n = strlen (s);
+  const __m128i first = _mm_set1_epi8 (s [0]);
+  const __m128i last  = _mm_set1_epi8 (s [n - 1]);
+  u_char p [PAYLOAD_SCAN + 2 * SIGNATURE_LEN] = { 0 };
+  unsigned i;
+
+  memcpy (p, payload, len);
+
+  for (i = 0; i + n <= len; i += 16)
+    {
+      __m128i a = _mm_loadu_si128 ((const __m128i *) (p + i));
+      __m128i z = _mm_loadu_si128 ((const __m128i *) (p + i + n - 1));
+      unsigned hits = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (a, first), _mm_cmpeq_epi8 (z, last)));
+
+      for (; hits; hits &= hits - 1)
+	{
+	  unsigned at = i + __builtin_ctz (hits);
+	  if (at + n <= len && ! memcmp (p + at + 1, s + 1, n - 1))
+	    return true;
+	}
+    }
+
+  return false;
+}
+
+
+/* The signature 'i' is at the beginning of 'p' (all of its bytes under the mask are compared at once) */
+static bool sse2match (const u_char * p, unsigned len, __m128i head, unsigned i)
+{
+  __m128i masked;
+
+  if (siglen [i] > len)
+    return false;
+
+  masked = _mm_and_si128 (head, _mm_load_si128 ((const __m128i *) sigmask [i]));
+  if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (masked, _mm_load_si128 ((const __m128i *) sigbytes [i]))) != 0xffff)
+    return false;
+
+  return ! signatures [i] . also || sse2find (p, len, signatures [i] . also);
+}
+#endif /* __SSE2__ */
+
+
+/* Is 'p' ('len' bytes captured) the header of a DNS message with one question? */
+static bool dnslike (const u_char * p, unsigned len)
+{
+  unsigned opcode;
+  unsigned at;
+  unsigned qclass;
+
+  if (len < 12 + 5)
+    return false;
+
+  /* A query, a notify or an update, the Z bit clear, one question and not that many records */
+  opcode = (p [2] >> 3) & 0x0f;
+  if ((opcode != 0 && opcode != 4 && opcode != 5) || p [3] & 0x40)
+    return false;
+  if (p [4] || p [5] != 1 || p [6] || p [8] || p [10])
+    return false;
+
+  /* The name of the question, label by label (no compression pointers in there) */
+  for (at = 12; at < len && p [at]; at += 1 + p [at])
+    if (p [at] > 63)
+      return false;
+
+  if (at + 5 > len)
+    return false;
+
+  /* Its class (the top bit is the unicast-response bit of mDNS): IN, CH, HS or ANY */
+  qclass = (p [at + 3] << 8 | p [at + 4]) & 0x7fff;
+  return qclass == 1 || qclass == 3 || qclass == 4 || qclass == 255;
+}
+
+
+/* The application protocol told by the payload 'p' ('caplen' bytes captured) of the IP 'proto', APP_NONE if not known */
+unsigned payloadscan (const u_char * p, unsigned caplen, int proto)
+{
+#if defined(__SSE2__)
+  uint32_t candidates;
+  unsigned len;
+  __m128i first;
+
+  if (proto == IPPROTO_UDP)
+    return dnslike (p, caplen) ? APP_DNS : APP_NONE;
+
+  /* Most payloads (encrypted, compressed, ...) start with no signature at all */
+  if (! caplen || ! (candidates = sigfirst [p [0]]))
+    return APP_NONE;
+
+  /* The first 16 bytes at once (zero-padded when fewer are captured) */
+  len = caplen < PAYLOAD_SCAN ? caplen : PAYLOAD_SCAN;
+  if (len >= SIGNATURE_LEN)
+    first = _mm_loadu_si128 ((const __m128i *) p);
+  else
+    {
+      u_char buf [SIGNATURE_LEN] = { 0 };
+      memcpy (buf, p, len);
+      first = _mm_loadu_si128 ((const __m128i *) buf);
+    }
+
+  for (; candidates; candidates &= candidates - 1)
+    {
+      unsigned i = __builtin_ctz (candidates);
+      if (sse2match (p, len, first, i))
+	return signatures [i] . app;
+    }
+
+  return APP_NONE;
+#else
+  return payloadscanscalar (p, caplen, proto);
+#endif /* __SSE2__ */
+}
+
+
+/* The same a byte at a time (see pkbench) */
+unsigned payloadscanscalar (const u_char * p, unsigned caplen, int proto)
+{
+  uint32_t candidates;
+  unsigned len;
+
+  if (proto == IPPROTO_UDP)
+    return dnslike (p, caplen) ? APP_DNS : APP_NONE;
+
+  if (! caplen || ! (candidates = sigfirst [p [0]]))
+    return APP_NONE;
+
+  len = caplen < PAYLOAD_SCAN ? caplen : PAYLOAD_SCAN;
+  for (; candidates; candidates &= candidates - 1)
+    {
+      unsigned i = __builtin_ctz (candidates);
+      if (scalarmatch (p, len, i))
+	return signatures [i] . app;
+    }
+
+  return APP_NONE;
+}
+
+
+/* An endpoint of a conversation: the address (folded to 64 bits for IPv6) and the port */
+static uint64_t endpoint (const u_char * addr, bool v6, uint16_t port)
+{
+  uint32_t w [4];
+
+  memcpy (w, addr, v6 ? 16 : 4);
+  if (! v6)
+    return (uint64_t) w [0] << 16 | port;
+
+  return (w [0] * 0x9e3779b97f4a7c15ULL + w [1] * 0xc2b2ae3d27d4eb4fULL + w [2] * 0x165667b19e3779f9ULL + w [3]) ^ port;
+}
+
+
+/* The same key foreach direction of the conversation of the segment 'l4' (over the IP header 'iph') */
+static uint64_t flowkey (interface_t * intf, const u_char * iph, const u_char * l4, int proto)
+{
+  bool v6 = (iph [0] >> 4) == 6;
+  uint16_t ports [2];
+  uint64_t a;
+  uint64_t b;
+  uint64_t x;
+
+  /* The ports are the first 4 bytes of both TCP and UDP */
+  memcpy (ports, l4, sizeof (ports));
+  if (v6)
+    a = endpoint ((const u_char *) & ((const struct ip6_hdr *) iph) -> ip6_src, true, ports [0]),
+      b = endpoint ((const u_char *) & ((const struct ip6_hdr *) iph) -> ip6_dst, true, ports [1]);
+  else
+    a = endpoint ((const u_char *) & ((const struct ip *) iph) -> ip_src, false, ports [0]),
+      b = endpoint ((const u_char *) & ((const struct ip *) iph) -> ip_dst, false, ports [1]);
+
+  if (a > b)
+    x = a, a = b, b = x;
+
+  /* splitmix64 of it all, never 0 (the key of a free slot) */
+  x = a * 0x9e3779b97f4a7c15ULL ^ (b + 0x632be59bd9b4e019ULL) * 0xbf58476d1ce4e5b9ULL ^ ((uint64_t) proto << 56 | (unsigned) intf -> vlan);
+  x ^= x >> 31;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 29;
+
+  return x | 1;
+}
+
+
+/*
+ * The application protocol of the conversation of the TCP/UDP segment 'l4' (over the IP header 'iph'), whose payload is 'p'
+ * as told by 'h'.  Its payload is looked at only while the first segments of the conversation tell nothing (APP_NONE if so)
+ */
+unsigned payloadapp (interface_t * intf, const u_char * iph, const u_char * l4, int proto, header_t * h, u_char * p)
+{
+  uint64_t key = flowkey (intf, iph, l4, proto);
+  flow_t * f;
+
+  if (! intf -> flows && ! (intf -> flows = calloc (PAYLOAD_FLOWS, sizeof (flow_t))))
+    return h -> caplen ? payloadscan (p, h -> caplen, proto) : APP_NONE;
+
+  f = & intf -> flows [(key >> 32) & (PAYLOAD_FLOWS - 1)];
+
+  /* A new conversation, or a TCP connection opened again between the same ends */
+  if (f -> key != key || (proto == IPPROTO_TCP && (((const struct tcphdr *) l4) -> th_flags & (TH_SYN | TH_ACK)) == TH_SYN))
+    * f = (flow_t) { key, APP_NONE, 0 };
+
+  if (f -> app == APP_NONE && f -> tries < PAYLOAD_TRIES && h -> caplen)
+    {
+      f -> tries ++;
+      intf -> pkts_scanned += intf -> weight;
+      if ((f -> app = payloadscan (p, h -> caplen, proto)) != APP_NONE)
+	intf -> pkts_identified += intf -> weight;
+    }
+
+  return f -> app;
+}
+
+
+/* The name of the application protocol 'app' */
+char * appname (unsigned app)
+{
+  switch (app)
+    {
+    case APP_HTTP: return "HTTP";
+    case APP_TLS:  return "TLS";
+    case APP_SSH:  return "SSH";
+    case APP_SMTP: return "SMTP";
+    case APP_IMAP: return "IMAP";
+    case APP_POP:  return "POP3";
+    case APP_DNS:  return "DNS";
+    default:       return "none";
+    }
+}
@@ -0,0 +1,1121 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Microbenchmarks of the primitives, independent of any capture ('make bench')
+ *
+ * Each measure is printed on a line of its own as
+ *
+ *   name size ops ns/op
+ *
+ * where 'name' is suite.case, 'size' is the # of items the case works on
+ * (e.g. the fill level of a hash table or the # of hosts to sort) and 'ns/op'
+ * is the average time of a single operation.  Lines starting with '#' are
+ * comments, so the output can be diffed or fed to any tool to track regressions.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+/* Project header */
+#include "pksh.h"
+#include "hash.h"
+
+
+/* Inline sources */
+#include "missing.c"
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  OPT_SUITE       = 's',
+  OPT_HOSTS       = 'n',
+  OPT_LIST        = 'l',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  { "suite",         required_argument, NULL, OPT_SUITE       },
+  { "hosts",         required_argument, NULL, OPT_HOSTS       },
+  { "list",          no_argument,       NULL, OPT_LIST        },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* The largest # of hosts to sort (from 10K up) */
+#define BENCH_HOSTS   1000000
+
+/* The # of operations of the quick cases */
+#define BENCH_OPS     1000000
+
+/* The # of frames decoded by the capture cases, the max # of devices and the # of hosts talking on each of them */
+#define BENCH_FRAMES  262144
+#define BENCH_DEVICES 64
+#define BENCH_TALKERS 64
+
+
+/* Define a suite of benchmarks */
+typedef void suite_f (unsigned maxhosts);
+
+
+/* The clock of the measures */
+static uint64_t nsecs (void)
+{
+  struct timespec t;
+
+  clock_gettime (CLOCK_MONOTONIC, & t);
+  return (uint64_t) t . tv_sec * 1000000000 + t . tv_nsec;
+}
+
+
+/* Print a measure */
+static void report (char * suite, char * name, unsigned long size, unsigned long ops, uint64_t elapsed)
+{
+  printf ("%s.%s %lu %lu %.2f\n", suite, name, size, ops, ops ? (double) elapsed / ops : 0);
+  fflush (stdout);
+}
+
+
+/* Pseudo-random numbers, the same foreach run (xorshift64*) */
+static uint64_t seed = 88172645463325252ULL;
+
+static uint64_t rnd (void)
+{
+  seed ^= seed >> 12;
+  seed ^= seed << 25;
+  seed ^= seed >> 27;
+  return seed * 0x2545f4914f6cdd1dULL;
+}
+
+
+/* Keep the compiler from optimizing away the results */
+static volatile uintptr_t sink;
+
+
+/* ========================================================================= */
+
+/* hash_table_insert/search/refer at different fill levels (items per bucket) */
+static void bench_hash (unsigned maxhosts)
+{
+  static unsigned levels [] = { 1, 4, 16, 64 };
+  unsigned size = 1024;
+  unsigned l;
+
+  for (l = 0; l < sizeof (levels) / sizeof (levels [0]); l ++)
+    {
+      struct hash_table t = { .size = size };
+      struct datum d;
+      char ** keys;
+      unsigned n;
+      unsigned i;
+      uint64_t start;
+      char name [64];
+
+      hash_table_init (& t);
+      n = t . size * levels [l];
+      keys = calloc (2 * n, sizeof (char *));
+
+      /* The first half is inserted, the second half is only looked up (misses) */
+      for (i = 0; i < 2 * n; i ++)
+	{
+	  keys [i] = malloc (18);
+	  strcpy (keys [i], mactoa ((u_char *) (uint64_t []) { rnd () }));
+	}
+
+      start = nsecs ();
+      for (i = 0; i < n; i ++)
+	{
+	  d . key   = keys [i];
+	  d . ksize = strlen (keys [i]);
+	  d . val   = keys [i];
+	  d . vsize = 0;
+	  hash_table_insert (& t, & d);
+	}
+      snprintf (name, sizeof (name), "insert/fill%u", levels [l]);
+      report ("hash", name, n, n, nsecs () - start);
+
+      start = nsecs ();
+      for (i = 0; i < n; i ++)
+	{
+	  d . key   = keys [i];
+	  d . ksize = strlen (keys [i]);
+	  sink += (uintptr_t) hash_table_search (& t, & d);
+	}
+      snprintf (name, sizeof (name), "search-hit/fill%u", levels [l]);
+      report ("hash", name, n, n, nsecs () - start);
+
+      start = nsecs ();
+      for (i = n; i < 2 * n; i ++)
+	{
+	  d . key   = keys [i];
+	  d . ksize = strlen (keys [i]);
+	  sink += (uintptr_t) hash_table_search (& t, & d);
+	}
+      snprintf (name, sizeof (name), "search-miss/fill%u", levels [l]);
+      report ("hash", name, n, n, nsecs () - start);
+
+      hash_table_free (& t);
+
+      /* The same keys only referenced */
+      t . size = size;
+      hash_table_init (& t);
+      start = nsecs ();
+      for (i = 0; i < n; i ++)
+	{
+	  d . key   = keys [n + i];
+	  d . ksize = strlen (keys [n + i]);
+	  d . val   = keys [n + i];
+	  d . vsize = 0;
+	  hash_table_refer (& t, & d);
+	}
+      snprintf (name, sizeof (name), "refer/fill%u", levels [l]);
+      report ("hash", name, n, n, nsecs () - start);
+
+      /* The keys belong to the table now */
+      hash_table_free (& t);
+      for (i = 0; i < n; i ++)
+	free (keys [i]);
+      free (keys);
+    }
+}
+
+
+/* vendor() with mixes of known and unknown hardware addresses */
+static void bench_vendor (unsigned maxhosts)
+{
+  static unsigned hits [] = { 100, 50, 0 };
+  char ** known = NULL;
+  unsigned nknown = 0;
+  char ** macs = calloc (BENCH_OPS, sizeof (char *));
+  char * unknown = "02:00:00:00:00:00";
+  unsigned h;
+  unsigned i;
+
+  vtfill ();
+
+  /* Collect known prefixes by probing, so the benchmark does not depend on the layout of nic.h */
+  while (nknown < 4096)
+    {
+      char * mac = mactoa ((u_char *) (uint64_t []) { rnd () & 0xfeffffffffffULL });
+      if (vendor (mac))
+	{
+	  known = realloc (known, (nknown + 1) * sizeof (char *));
+	  known [nknown ++] = strdup (mac);
+	}
+    }
+
+  for (h = 0; h < sizeof (hits) / sizeof (hits [0]); h ++)
+    {
+      uint64_t start;
+      char name [64];
+
+      for (i = 0; i < BENCH_OPS; i ++)
+	macs [i] = rnd () % 100 < hits [h] ? known [rnd () % nknown] : unknown;
+
+      start = nsecs ();
+      for (i = 0; i < BENCH_OPS; i ++)
+	sink += (uintptr_t) vendor (macs [i]);
+      snprintf (name, sizeof (name), "lookup/hit%u", hits [h]);
+      report ("vendor", name, nknown, BENCH_OPS, nsecs () - start);
+    }
+
+  for (i = 0; i < nknown; i ++)
+    free (known [i]);
+  free (known);
+  free (macs);
+}
+
+
+/* osfingerprintmatch() with exact, wildcard MSS and unknown signatures */
+static void bench_fingerprint (unsigned maxhosts)
+{
+  static char * exact    = "4000:05B4:80:WS:1:1:1:0:S:30";   /* 'Windows ME / 2000 / XP'            */
+  static char * wildcard = "0000:05B4:FF:WS:0:0:0:0:A:28";   /* only its '_MSS' form is in database */
+  static char * miss     = "ABCD:1234:80:0C:1:1:1:1:S:3C";
+  char * cases [] = { exact, wildcard, miss };
+  char * names [] = { "exact", "wildcard", "miss" };
+  char fp [FPLEN];
+  unsigned c;
+  unsigned i;
+
+  osfingerprintfill ();
+
+  for (c = 0; c < sizeof (cases) / sizeof (cases [0]); c ++)
+    {
+      uint64_t start = nsecs ();
+
+      for (i = 0; i < BENCH_OPS; i ++)
+	{
+	  strcpy (fp, cases [c]);
+	  sink += (uintptr_t) osfingerprintmatch (fp);
+	}
+      report ("fingerprint", names [c], 1, BENCH_OPS, nsecs () - start);
+    }
+}
+
+
+/* The conversions of addresses for humans */
+static void bench_addresses (unsigned maxhosts)
+{
+  uint64_t start;
+  unsigned i;
+
+  start = nsecs ();
+  for (i = 0; i < BENCH_OPS; i ++)
+    sink += (uintptr_t) mactoa ((u_char *) (uint64_t []) { i * 0x9e3779b97f4a7c15ULL });
+  report ("address", "mactoa", 1, BENCH_OPS, nsecs () - start);
+
+  start = nsecs ();
+  for (i = 0; i < BENCH_OPS; i ++)
+    sink += (uintptr_t) inet_ntoa ((struct in_addr) { i * 2654435761U });
+  report ("address", "inet_ntoa", 1, BENCH_OPS, nsecs () - start);
+}
+
+
+/* ========================================================================= */
+
+/* The comparators of the hosts */
+#define CMP(x) { #x, x }
+static struct
+{
+  char * name;
+  sf * cmp;
+
+} comparators [] =
+{
+  CMP (sort_by_hwaddr),              CMP (sort_by_ip),                  CMP (sort_by_hostname),
+  CMP (sort_by_vendor),              CMP (sort_by_system),              CMP (sort_by_domain),
+  CMP (sort_by_age),                 CMP (sort_by_firstseen),           CMP (sort_by_lastseen),
+
+  CMP (sort_by_bytes_all),           CMP (sort_by_broadcast_bytes),     CMP (sort_by_multicast_bytes),
+  CMP (sort_by_ip_bytes_all),        CMP (sort_by_ip_broadcast_bytes),  CMP (sort_by_ip_multicast_bytes),
+  CMP (sort_by_tcp_bytes_all),       CMP (sort_by_udp_bytes_all),       CMP (sort_by_icmp_bytes_all),
+  CMP (sort_by_other_ip_bytes_all),
+  CMP (sort_by_bytes_sent),          CMP (sort_by_ip_bytes_sent),       CMP (sort_by_tcp_bytes_sent),
+  CMP (sort_by_udp_bytes_sent),      CMP (sort_by_icmp_bytes_sent),     CMP (sort_by_other_ip_bytes_sent),
+  CMP (sort_by_bytes_recv),          CMP (sort_by_ip_bytes_recv),       CMP (sort_by_tcp_bytes_recv),
+  CMP (sort_by_udp_bytes_recv),      CMP (sort_by_icmp_bytes_recv),     CMP (sort_by_other_ip_bytes_recv),
+  CMP (sort_by_current_bytes_all),   CMP (sort_by_average_bytes_all),   CMP (sort_by_peak_bytes_all),
+
+  CMP (sort_by_pkts_all),            CMP (sort_by_broadcast_pkts),      CMP (sort_by_multicast_pkts),
+  CMP (sort_by_ip_pkts_all),         CMP (sort_by_ip_broadcast_pkts),   CMP (sort_by_ip_multicast_pkts),
+  CMP (sort_by_tcp_pkts_all),        CMP (sort_by_udp_pkts_all),        CMP (sort_by_icmp_pkts_all),
+  CMP (sort_by_other_ip_pkts_all),
+  CMP (sort_by_pkts_sent),           CMP (sort_by_ip_pkts_sent),        CMP (sort_by_tcp_pkts_sent),
+  CMP (sort_by_udp_pkts_sent),       CMP (sort_by_icmp_pkts_sent),      CMP (sort_by_other_ip_pkts_sent),
+  CMP (sort_by_pkts_recv),           CMP (sort_by_ip_pkts_recv),        CMP (sort_by_tcp_pkts_recv),
+  CMP (sort_by_udp_pkts_recv),       CMP (sort_by_icmp_pkts_recv),      CMP (sort_by_other_ip_pkts_recv),
+  CMP (sort_by_current_pkts_all),    CMP (sort_by_average_pkts_all),    CMP (sort_by_peak_pkts_all),
+};
+
+
+/* A few names, as they would be resolved */
+static char * systems [] = { "Linux 2.6", "Windows XP", "FreeBSD 4.7", "Solaris 2.6 - 2.7", "Cisco IOS", NULL };
+static char * makers [] = { "Intel Corporate", "Apple, Inc.", "VMware, Inc.", "Cisco Systems, Inc", "Dell Inc.", NULL };
+
+
+/* All counters, with values spread over many orders of magnitude (and many ties on the small ones) */
+static void mkcounters (host_t * h)
+{
+  counter_t * c;
+
+  for (c = & h -> bytes_sent; c <= & h -> pkts_other_tcp_recv; c ++)
+    * c = rnd () >> (rnd () % 64);
+  h -> ttl_shortest = 64;
+  h -> ttl_longest  = 64;
+
+  h -> bytes_current = rnd () % 100000;
+  h -> bytes_average = rnd () % 100000;
+  h -> bytes_peak    = 1 + rnd () % 1000000;
+  h -> pkts_current  = rnd () % 1000;
+  h -> pkts_average  = rnd () % 1000;
+  h -> pkts_peak     = 1 + rnd () % 10000;
+}
+
+
+/* Make up 'n' hosts with realistic addresses, names and heavy-tailed counters */
+static host_t * makehosts (unsigned n)
+{
+  host_t * hosts = calloc (n, sizeof (host_t));
+  unsigned i;
+
+  if (! hosts)
+    return NULL;
+
+  for (i = 0; i < n; i ++)
+    {
+      host_t * h = & hosts [i];
+      char buf [64];
+      struct in_addr ip = { htonl (0x0a000000 | (rnd () & 0xffffff)) };
+
+      h -> id = i;
+      h -> hwaddress = strdup (mactoa ((u_char *) (uint64_t []) { rnd () }));
+      h -> ipaddr    = strdup (inet_ntoa (ip));
+      h -> ip        = ip;
+      snprintf (buf, sizeof (buf), "host-%06u.example.org", (unsigned) (rnd () % 1000000));
+      h -> hostname  = rnd () % 4 ? strdup (buf) : strdup (h -> ipaddr);
+      h -> vendor    = makers [rnd () % 5];
+      h -> system    = rnd () % 2 ? systems [rnd () % 5] : NULL;
+      h -> first . tv_sec  = 1000000 + rnd () % 3600;
+      h -> first . tv_usec = rnd () % 1000000;
+      h -> last . tv_sec   = h -> first . tv_sec + rnd () % 3600;
+      h -> last . tv_usec  = rnd () % 1000000;
+
+      mkcounters (h);
+    }
+
+  return hosts;
+}
+
+
+static void freehosts (host_t * hosts, unsigned n)
+{
+  unsigned i;
+
+  for (i = 0; i < n; i ++)
+    free (hosts [i] . hwaddress),
+      free (hosts [i] . ipaddr),
+      free (hosts [i] . hostname);
+  free (hosts);
+}
+
+
+/* Every sort_by_* comparator on 10K hosts and up, both via qsort() and via hostsort() (also for the first 20 only) */
+static void bench_sort (unsigned maxhosts)
+{
+  unsigned n;
+
+  for (n = 10000; n <= maxhosts; n *= 10)
+    {
+      host_t * hosts = makehosts (n);
+      host_t ** argv = calloc (n, sizeof (host_t *));
+      unsigned c;
+      unsigned i;
+
+      if (! hosts || ! argv)
+	{
+	  printf ("# sort: cannot make %u hosts (%s)\n", n, strerror (ENOMEM));
+	  free (argv);
+	  return;
+	}
+
+      for (c = 0; c < sizeof (comparators) / sizeof (comparators [0]); c ++)
+	{
+	  char name [128];
+	  uint64_t start;
+
+	  /* Each run starts from the same order */
+	  for (i = 0; i < n; i ++)
+	    argv [i] = & hosts [i];
+	  start = nsecs ();
+	  qsort (argv, n, sizeof (host_t *), comparators [c] . cmp);
+	  snprintf (name, sizeof (name), "qsort/%s", comparators [c] . name + 8);
+	  report ("sort", name, n, n, nsecs () - start);
+
+	  for (i = 0; i < n; i ++)
+	    argv [i] = & hosts [i];
+	  start = nsecs ();
+	  hostsort (argv, n, comparators [c] . cmp, false, 0);
+	  snprintf (name, sizeof (name), "hostsort/%s", comparators [c] . name + 8);
+	  report ("sort", name, n, n, nsecs () - start);
+
+	  for (i = 0; i < n; i ++)
+	    argv [i] = & hosts [i];
+	  start = nsecs ();
+	  hostsort (argv, n, comparators [c] . cmp, false, 20);
+	  snprintf (name, sizeof (name), "head20/%s", comparators [c] . name + 8);
+	  report ("sort", name, n, n, nsecs () - start);
+	}
+
+      free (argv);
+      freehosts (hosts, n);
+    }
+}
+
+
+/* ========================================================================= */
+
+/* The viewers, each run on the whole cache with its default options */
+static pksh_cmd_t * viewers [] =
+{
+  & cmd_hosts, & cmd_bytes, & cmd_packets, & cmd_protocols, & cmd_who, & cmd_last, & cmd_arp, & cmd_throughput, NULL
+};
+
+
+/* Grow the cache of 'intf' up to 'n' hosts, 3 out of 4 are local (known by both their HW and IP addresses) */
+static void populate (interface_t * intf, unsigned n)
+{
+  while (intf -> hostno < n)
+    {
+      host_t * h;
+      char buf [64];
+      struct in_addr ip = { htonl (0x0a000000 | (rnd () & 0xffffff)) };
+      char * ipaddr = inet_ntoa (ip);
+
+      if (rnd () % 4)
+	{
+	  char * mac = mactoa ((u_char *) (uint64_t []) { rnd () & 0xfeffffffffffULL });
+
+	  if (! (h = addtohwnames (intf, mac, 0)) || h -> hwaddress)
+	    continue;
+	  h -> hwaddress = strdup (mac);
+	  h -> vendor    = makers [rnd () % 5];
+	  bindtoipnames (intf, ipaddr, 0, h);
+	}
+      else if (! (h = addtoipnames (intf, ipaddr, 0)) || h -> ipaddr)
+	continue;
+
+      h -> ipaddr = strdup (ipaddr);
+      h -> ip     = ip;
+      snprintf (buf, sizeof (buf), "host-%06u.example.org", (unsigned) (rnd () % 1000000));
+      h -> hostname = rnd () % 4 ? strdup (buf) : strdup (h -> ipaddr);
+      h -> system   = rnd () % 2 ? systems [rnd () % 5] : NULL;
+      mkcounters (h);
+    }
+}
+
+
+/* Run a viewer on the interface 'name' with its output thrown away, false if it failed */
+static bool view (pksh_cmd_t * cmd, char * name)
+{
+  char * argv [] = { cmd -> name, "-i", name, NULL };
+  int out;
+  int null;
+
+  memset (viewclock, 0, sizeof (viewclock));
+
+  fflush (stdout);
+  if ((null = open ("/dev/null", O_WRONLY)) == -1 || (out = dup (STDOUT_FILENO)) == -1)
+    {
+      if (null != -1)
+	close (null);
+      return false;
+    }
+  dup2 (null, STDOUT_FILENO);
+  close (null);
+
+  cmd -> func (3, argv);
+
+  fflush (stdout);
+  dup2 (out, STDOUT_FILENO);
+  close (out);
+
+  return viewclock [VIEW_DONE] != 0;
+}
+
+
+/* Every viewer on a cache of 10K hosts and up, with the time of its phases (per host) */
+static void bench_viewers (unsigned maxhosts)
+{
+  static char * phases [] = { "enumerate", "filter", "sort", "render" };
+  interface_t * intf = NULL;
+  unsigned n;
+
+  interfaces = intfremote (interfaces, "bench0", & intf);
+  if (! intf)
+    {
+      printf ("# viewers: cannot make an interface (%s)\n", strerror (ENOMEM));
+      return;
+    }
+
+  /* A local interface as far as the viewers can tell */
+  intf -> remote = false;
+  viewtiming = true;
+
+  for (n = 10000; n <= maxhosts; n *= 10)
+    {
+      pksh_cmd_t ** v;
+
+      populate (intf, n);
+
+      for (v = viewers; * v; v ++)
+	{
+	  char name [128];
+	  unsigned p;
+
+	  if (! view (* v, intf -> name))
+	    {
+	      printf ("# viewers: %s failed on %u hosts\n", (* v) -> name, n);
+	      continue;
+	    }
+
+	  for (p = VIEW_ENUMERATE; p < VIEW_DONE; p ++)
+	    {
+	      snprintf (name, sizeof (name), "%s/%s", (* v) -> name, phases [p]);
+	      report ("viewers", name, n, n, viewclock [p + 1] - viewclock [p]);
+	    }
+	  snprintf (name, sizeof (name), "%s/total", (* v) -> name);
+	  report ("viewers", name, n, n, viewclock [VIEW_DONE] - viewclock [VIEW_ENUMERATE]);
+	}
+    }
+
+  viewtiming = false;
+  interfaces = intfsub (interfaces, "bench0");
+}
+
+
+/* ========================================================================= */
+
+/* A frame ready to be decoded */
+typedef struct
+{
+  struct pcap_pkthdr h;
+  u_char data [96];
+
+} frame_t;
+
+
+/* The frames decoded by a sniffer */
+typedef struct
+{
+  interface_t * intf;
+  frame_t * frames;
+  unsigned n;
+  void (* decoder) (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
+
+} feeder_t;
+
+
+/* Make an IPv4/UDP frame sent by one of the talkers of the device 'dev' (1 and up) to a few servers, in the cooked v2 format of 'any' or as Ethernet */
+static void mkframe (frame_t * f, unsigned dev, bool cooked)
+{
+  unsigned talker = rnd () % BENCH_TALKERS;
+  u_char mac [6] = { 0x02, 0x42, 0xac, dev >> 8, dev, talker };
+  u_char * p = f -> data;
+  unsigned hlen = cooked ? 20 : 14;
+  struct ip * ip = (struct ip *) (p + hlen);
+  struct udphdr * udp = (struct udphdr *) (ip + 1);
+
+  memset (f, 0, sizeof (* f));
+  if (cooked)
+    {
+      p [0]  = 0x08;                       /* IPv4 */
+      p [4]  = dev >> 24;                  /* interface index */
+      p [5]  = dev >> 16;
+      p [6]  = dev >> 8;
+      p [7]  = dev;
+      p [9]  = 1;                          /* Ethernet */
+      p [11] = sizeof (mac);
+      memcpy (p + 12, mac, sizeof (mac));
+    }
+  else
+    {
+      memcpy (p, (u_char []) { 0x02, 0x42, 0x00, 0x00, 0x00, 0x01 }, 6);
+      memcpy (p + 6, mac, sizeof (mac));
+      p [12] = 0x08;
+    }
+
+  ip -> ip_v   = 4;
+  ip -> ip_hl  = 5;
+  ip -> ip_ttl = 64;
+  ip -> ip_p   = IPPROTO_UDP;
+  ip -> ip_len = htons (sizeof (* ip) + sizeof (* udp) + 32);
+  ip -> ip_src . s_addr = htonl (0x0a000000 | dev << 8 | talker);
+  ip -> ip_dst . s_addr = htonl (0xc0a80000 | (unsigned) (rnd () % 4));
+  udp -> uh_sport = htons (32768 + talker);
+  udp -> uh_dport = htons (53);
+
+  f -> h . len = f -> h . caplen = hlen + sizeof (* ip) + sizeof (* udp) + 32;
+  gettimeofday (& f -> h . ts, NULL);
+}
+
+
+/* A sniffer decoding its frames */
+static void * feed (void * _feeder)
+{
+  feeder_t * f = _feeder;
+  unsigned i;
+
+  for (i = 0; i < f -> n; i ++)
+    f -> decoder (f -> intf, & f -> frames [i] . h, f -> frames [i] . data);
+  return NULL;
+}
+
+
+/* The CPU time of the whole process */
+static uint64_t cpunsecs (void)
+{
+  struct timespec t;
+
+  clock_gettime (CLOCK_PROCESS_CPUTIME_ID, & t);
+  return (uint64_t) t . tv_sec * 1000000000 + t . tv_nsec;
+}
+
+
+/* Decode the frames of all the 'feeders' (each in a thread of its own when there are more than one), the wall clock and CPU times in 'wall' and 'cpu' */
+static bool sniff (feeder_t * feeders, unsigned n, uint64_t * wall, uint64_t * cpu)
+{
+  pthread_t tid [BENCH_DEVICES];
+  unsigned i;
+  unsigned started = 0;
+
+  * wall = nsecs ();
+  * cpu  = cpunsecs ();
+
+  if (n == 1)
+    feed (feeders);
+  else
+    for (i = 0; i < n; i ++, started ++)
+      if (pthread_create (& tid [i], NULL, feed, & feeders [i]))
+	break;
+
+  for (i = 0; i < started; i ++)
+    pthread_join (tid [i], NULL);
+
+  * wall = nsecs () - * wall;
+  * cpu  = cpunsecs () - * cpu;
+
+  return n == 1 || started == n;
+}
+
+
+/* One sniffer on 'any' (cooked v2 frames of N devices) vs N sniffers (one per device), both once all the hosts are known */
+static void bench_any (unsigned maxhosts)
+{
+  frame_t * frames = calloc (BENCH_FRAMES, sizeof (frame_t));
+  interface_t * intfs [BENCH_DEVICES];
+  feeder_t feeders [BENCH_DEVICES];
+  unsigned devices;
+
+  if (! frames)
+    {
+      printf ("# any: cannot make %u frames (%s)\n", BENCH_FRAMES, strerror (ENOMEM));
+      return;
+    }
+
+  for (devices = 1; devices <= BENCH_DEVICES; devices *= 4)
+    {
+      unsigned per = BENCH_FRAMES / devices;
+      char name [64];
+      uint64_t wall;
+      uint64_t cpu;
+      unsigned d;
+      unsigned i;
+
+      /* A single sniffer on 'any', the devices of the frames are interleaved */
+      memset (intfs, 0, sizeof (intfs));
+      interfaces = intfremote (interfaces, "benchany", & intfs [0]);
+      if (! intfs [0])
+	break;
+      intfs [0] -> remote = false;
+
+      for (i = 0; i < per * devices; i ++)
+	mkframe (& frames [i], 1 + i % devices, true);
+
+      feeders [0] = (feeder_t) { intfs [0], frames, per * devices, sll2 };
+      sniff (feeders, 1, & wall, & cpu);                  /* learn the hosts */
+      sniff (feeders, 1, & wall, & cpu);
+
+      report ("any", "sll2/1-thread/wall", devices, per * devices, wall);
+      report ("any", "sll2/1-thread/cpu", devices, per * devices, cpu);
+
+      interfaces = intfsub (interfaces, "benchany");
+
+      /* A sniffer foreach device */
+      for (d = 0; d < devices; d ++)
+	{
+	  snprintf (name, sizeof (name), "benchveth%u", d);
+	  interfaces = intfremote (interfaces, name, & intfs [d]);
+	  if (! intfs [d])
+	    break;
+	  intfs [d] -> remote = false;
+
+	  for (i = 0; i < per; i ++)
+	    mkframe (& frames [d * per + i], 1 + d, false);
+	  feeders [d] = (feeder_t) { intfs [d], frames + d * per, per, ethernet };
+	  sniff (& feeders [d], 1, & wall, & cpu);        /* learn the hosts */
+	}
+
+      if (d == devices && sniff (feeders, devices, & wall, & cpu))
+	{
+	  snprintf (name, sizeof (name), "ethernet/%u-threads/wall", devices);
+	  report ("any", name, devices, per * devices, wall);
+	  snprintf (name, sizeof (name), "ethernet/%u-threads/cpu", devices);
+	  report ("any", name, devices, per * devices, cpu);
+	}
+      else
+	printf ("# any: cannot run %u sniffers\n", devices);
+
+      while (d --)
+	{
+	  snprintf (name, sizeof (name), "benchveth%u", d);
+	  interfaces = intfsub (interfaces, name);
+	}
+    }
+
+  free (frames);
+}
+
+
+/* ========================================================================= */
+
+/* The size of the frames decoded with and without checksums, and the # of them */
+#define BENCH_MTU     1514
+#define BENCH_BIGS    4096
+
+/* A full size frame ready to be decoded */
+typedef struct
+{
+  struct pcap_pkthdr h;
+  u_char data [BENCH_MTU];
+
+} bigframe_t;
+
+
+/* Make a full size Ethernet/IPv4/UDP frame with right checksums */
+static void mkbigframe (bigframe_t * f)
+{
+  u_char * p = f -> data;
+  struct ip * ip = (struct ip *) (p + 14);
+  struct udphdr * udp = (struct udphdr *) (ip + 1);
+  unsigned ulen = BENCH_MTU - 14 - sizeof (* ip);
+  unsigned i;
+  uint32_t sum;
+
+  memset (f, 0, sizeof (* f));
+  memcpy (p, (u_char []) { 0x02, 0x42, 0x00, 0x00, 0x00, 0x01, 0x02, 0x42, 0xac, 0x11, 0x00, rnd () % BENCH_TALKERS }, 12);
+  p [12] = 0x08;
+
+  for (i = 0; i < ulen - sizeof (* udp); i ++)
+    ((u_char *) (udp + 1)) [i] = rnd ();
+
+  ip -> ip_v   = 4;
+  ip -> ip_hl  = 5;
+  ip -> ip_ttl = 64;
+  ip -> ip_p   = IPPROTO_UDP;
+  ip -> ip_len = htons (BENCH_MTU - 14);
+  ip -> ip_src . s_addr = htonl (0x0a000000 | (unsigned) (rnd () % BENCH_TALKERS));
+  ip -> ip_dst . s_addr = htonl (0xc0a80000 | (unsigned) (rnd () % 4));
+  ip -> ip_sum = ~ cksumscalar (ip, sizeof (* ip), 0);
+
+  udp -> uh_sport = htons (32768 + rnd () % BENCH_TALKERS);
+  udp -> uh_dport = htons (53);
+  udp -> uh_ulen  = htons (ulen);
+  sum = cksumscalar (& ip -> ip_src, 2 * sizeof (struct in_addr), 0) + htons (IPPROTO_UDP) + htons (ulen);
+  udp -> uh_sum = ~ cksumscalar (udp, ulen, sum);
+
+  f -> h . len = f -> h . caplen = BENCH_MTU;
+  gettimeofday (& f -> h . ts, NULL);
+}
+
+
+/*
+ * The Internet checksum by the scalar and by the fastest kernel of this CPU on 64 to 9000 bytes,
+ * then the decoding of full size frames with and without the verification of their checksums.
+ * At 10Gbps a full size frame arrives every 1230 ns (1538 bytes on the wire), a minimum size one every 67 ns
+ */
+static void bench_checksum (unsigned maxhosts)
+{
+  static unsigned sizes [] = { 20, 64, 576, 1500, 9000 };
+  u_char * buf = malloc (9000 + 64);
+  bigframe_t * frames = calloc (BENCH_BIGS, sizeof (bigframe_t));
+  interface_t * intf = NULL;
+  unsigned mismatches = 0;
+  unsigned s;
+  unsigned i;
+
+  if (! buf || ! frames)
+    {
+      printf ("# checksum: cannot make the frames (%s)\n", strerror (ENOMEM));
+      free (buf);
+      free (frames);
+      return;
+    }
+
+  for (i = 0; i < 9000 + 64; i ++)
+    buf [i] = rnd ();
+
+  /* Both kernels must agree on any length and alignment */
+  for (i = 0; i < BENCH_OPS / 10; i ++)
+    {
+      unsigned off = rnd () % 64;
+      unsigned len = rnd () % 9000;
+      if (cksum (buf + off, len, 0) != cksumscalar (buf + off, len, 0))
+	mismatches ++;
+    }
+  if (mismatches)
+    printf ("# checksum: %s and scalar disagree %u times out of %u\n", cksumname (), mismatches, BENCH_OPS / 10);
+
+  for (s = 0; s < sizeof (sizes) / sizeof (sizes [0]); s ++)
+    {
+      unsigned ops = BENCH_OPS * 64 / (sizes [s] + 64);
+      uint64_t start;
+      uint64_t scalar;
+      uint64_t fastest;
+
+      start = nsecs ();
+      for (i = 0; i < ops; i ++)
+	sink += cksumscalar (buf + (i & 63), sizes [s], 0);
+      scalar = nsecs () - start;
+      report ("checksum", "scalar", sizes [s], ops, scalar);
+
+      start = nsecs ();
+      for (i = 0; i < ops; i ++)
+	sink += cksum (buf + (i & 63), sizes [s], 0);
+      fastest = nsecs () - start;
+      report ("checksum", cksumname (), sizes [s], ops, fastest);
+
+      if (sizes [s] == 1500 && fastest)
+	printf ("# checksum: %s at %.1f Gbps on %u bytes (scalar %.1f Gbps)\n", cksumname (),
+		(double) sizes [s] * 8 * ops / fastest, sizes [s], scalar ? (double) sizes [s] * 8 * ops / scalar : 0);
+    }
+
+  /* The whole decoder on full size frames, all the hosts already known */
+  interfaces = intfremote (interfaces, "benchsum", & intf);
+  if (intf)
+    {
+      intf -> remote = false;
+      for (i = 0; i < BENCH_BIGS; i ++)
+	mkbigframe (& frames [i]);
+
+      intf -> checksums = false;
+      for (i = 0; i < BENCH_BIGS; i ++)
+	ethernet (intf, & frames [i] . h, frames [i] . data);          /* learn the hosts */
+
+      for (s = 0; s < 2; s ++)
+	{
+	  uint64_t start;
+	  unsigned round;
+
+	  intf -> checksums = s;
+	  start = nsecs ();
+	  for (round = 0; round < 16; round ++)
+	    for (i = 0; i < BENCH_BIGS; i ++)
+	      ethernet (intf, & frames [i] . h, frames [i] . data);
+	  report ("checksum", s ? "decode/verified" : "decode/unverified", BENCH_MTU, 16 * BENCH_BIGS, nsecs () - start);
+	}
+
+      if (intf -> pkts_ip_badsum || intf -> pkts_udp_badsum || intf -> pkts_unverified)
+	printf ("# checksum: %lu IP and %lu UDP bad checksums, %lu unverified out of %u right frames\n",
+		intf -> pkts_ip_badsum, intf -> pkts_udp_badsum, intf -> pkts_unverified, 16 * BENCH_BIGS);
+
+      interfaces = intfsub (interfaces, "benchsum");
+    }
+
+  free (buf);
+  free (frames);
+}
+
+
+/*
+ * The payload signatures by the scalar and by the SSE2 scanner, on the first bytes of the payloads of
+ * HTTP, TLS, SSH, SMTP, IMAP, POP3 and of random (encrypted) data, then the decoding of full size frames
+ * with and without telling the application protocol of their conversations
+ */
+static void bench_payload (unsigned maxhosts)
+{
+  static struct
+  {
+    char * name;
+    char * bytes;
+    unsigned len;
+    unsigned app;
+  } payloads [] =
+  {
+    { "http",   "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\n",   0, APP_HTTP },
+    { "tls",    "\x16\x03\x01\x02\x00\x01\x00\x01\xfc\x03\x03",            11, APP_TLS  },
+    { "ssh",    "SSH-2.0-OpenSSH_9.6\r\n",                                   0, APP_SSH  },
+    { "smtp",   "220 mx.example.com ESMTP Postfix (Debian/GNU)\r\n",         0, APP_SMTP },
+    { "ftp",    "220 (vsFTPd 3.0.3)\r\n",                                    0, APP_NONE },
+    { "imap",   "* OK [CAPABILITY IMAP4rev1 SASL-IR] Dovecot ready.\r\n",    0, APP_IMAP },
+    { "pop3",   "+OK POP3 server ready\r\n",                                 0, APP_POP  },
+    { "random", NULL,                                                      0, APP_NONE },
+  };
+  bigframe_t * frames = calloc (BENCH_BIGS, sizeof (bigframe_t));
+  u_char noise [PAYLOAD_SCAN];
+  interface_t * intf = NULL;
+  unsigned s;
+  unsigned i;
+
+  if (! frames)
+    {
+      printf ("# payload: cannot make the frames (%s)\n", strerror (ENOMEM));
+      return;
+    }
+
+  for (i = 0; i < PAYLOAD_SCAN; i ++)
+    noise [i] = rnd ();
+
+  payloadinit ();
+
+  for (s = 0; s < sizeof (payloads) / sizeof (payloads [0]); s ++)
+    {
+      const u_char * p = payloads [s] . bytes ? (u_char *) payloads [s] . bytes : noise;
+      unsigned len = payloads [s] . len ? payloads [s] . len : payloads [s] . bytes ? strlen (payloads [s] . bytes) : PAYLOAD_SCAN;
+      char name [64];
+      uint64_t start;
+
+      if (payloads [s] . bytes && (payloadscan (p, len, IPPROTO_TCP) != payloads [s] . app || payloadscanscalar (p, len, IPPROTO_TCP) != payloads [s] . app))
+	printf ("# payload: %s told as %s rather than %s\n", payloads [s] . name,
+		appname (payloadscan (p, len, IPPROTO_TCP)), appname (payloads [s] . app));
+
+      snprintf (name, sizeof (name), "%s/scalar", payloads [s] . name);
+      start = nsecs ();
+      for (i = 0; i < BENCH_OPS; i ++)
+	sink += payloadscanscalar (p, len, IPPROTO_TCP);
+      report ("payload", name, len, BENCH_OPS, nsecs () - start);
+
+      snprintf (name, sizeof (name), "%s/simd", payloads [s] . name);
+      start = nsecs ();
+      for (i = 0; i < BENCH_OPS; i ++)
+	sink += payloadscan (p, len, IPPROTO_TCP);
+      report ("payload", name, len, BENCH_OPS, nsecs () - start);
+    }
+
+  /* The whole decoder on full size frames of BENCH_BIGS conversations, all the hosts already known */
+  interfaces = intfremote (interfaces, "benchpay", & intf);
+  if (intf)
+    {
+      intf -> remote = false;
+      for (i = 0; i < BENCH_BIGS; i ++)
+	mkbigframe (& frames [i]);
+
+      intf -> payload = false;
+      for (i = 0; i < BENCH_BIGS; i ++)
+	ethernet (intf, & frames [i] . h, frames [i] . data);          /* learn the hosts */
+
+      for (s = 0; s < 2; s ++)
+	{
+	  uint64_t start;
+	  unsigned round;
+
+	  intf -> payload = s;
+	  start = nsecs ();
+	  for (round = 0; round < 16; round ++)
+	    for (i = 0; i < BENCH_BIGS; i ++)
+	      ethernet (intf, & frames [i] . h, frames [i] . data);
+	  report ("payload", s ? "decode/by-payload" : "decode/by-port", BENCH_MTU, 16 * BENCH_BIGS, nsecs () - start);
+	}
+
+      printf ("# payload: %lu payloads scanned out of %u frames\n", intf -> pkts_scanned, 16 * BENCH_BIGS);
+      interfaces = intfsub (interfaces, "benchpay");
+    }
+
+  free (frames);
+}
+
+
+/* The table of suites */
+static struct
+{
+  char * name;
+  suite_f * run;
+  char * brief;
+
+} suites [] =
+{
+  { "hash",        bench_hash,        "hash_table_insert/search/refer at 1, 4, 16 and 64 items per bucket" },
+  { "vendor",      bench_vendor,      "vendor() with 100%, 50% and 0% of known hardware addresses"         },
+  { "fingerprint", bench_fingerprint, "osfingerprintmatch() with exact, wildcard MSS and unknown signatures" },
+  { "address",     bench_addresses,   "mactoa() and inet_ntoa()"                                            },
+  { "sort",        bench_sort,        "every sort_by_* comparator via qsort() and hostsort() on 10K+ hosts" },
+  { "viewers",     bench_viewers,     "the phases of every viewer to /dev/null on a cache of 10K+ hosts"    },
+  { "any",         bench_any,         "one sniffer on 'any' (Linux cooked v2) vs one sniffer foreach of 1-64 devices" },
+  { "checksum",    bench_checksum,    "the Internet checksum (scalar vs SIMD) and the decoding of full size frames with and without it" },
+  { "payload",     bench_payload,     "the payload signatures (scalar vs SIMD) and the decoding of full size frames with and without them" },
+  { NULL,          NULL,              NULL                                                                  },
+};
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  int s;
+
+  printf ("`%s' runs the microbenchmarks of the primitives and prints a line 'name size ops ns/op' foreach measure\n", progname);
+
+  printf ("\n");
+  printf ("Usage: %s [options]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s                    # run all the suites\n", progname);
+  printf ("   %s -s hash -s vendor  # run only the given suites\n", progname);
+  printf ("   %s -s sort -n 100000  # sort up to 100K hosts\n", progname);
+  printf ("   %s -s viewers         # time the viewers on 10K, 100K and 1M hosts\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -q, --quiet                  do not print the header\n");
+  printf ("   -l, --list                   list the suites\n");
+  printf ("   -s, --suite name             run the suite 'name' (more than once, default all)\n");
+  printf ("   -n, --hosts N                sort and view up to N hosts (default %d)\n", BENCH_HOSTS);
+
+  printf ("\n");
+  printf ("Suites are:\n");
+  for (s = 0; suites [s] . name; s ++)
+    printf ("   %-12s %s\n", suites [s] . name, suites [s] . brief);
+}
+
+
+int main (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+
+  /* Variables that are set according to the specified options */
+  bool quiet         = false;
+  char ** only       = NULL;
+  unsigned maxhosts  = BENCH_HOSTS;
+
+  int option;
+
+  /* Local variables */
+  int s;
+
+  while ((option = getopt_long (argc, argv, "hqs:n:l", lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:  usage (progname, lopts);           return 0;
+	case OPT_QUIET: quiet = true;                      break;
+
+	case OPT_SUITE: only = argsmore (only, optarg);    break;
+	case OPT_HOSTS: maxhosts = atoi (optarg);          break;
+	case OPT_LIST:
+	  for (s = 0; suites [s] . name; s ++)
+	    printf ("%s\n", suites [s] . name);
+	  return 0;
+	}
+    }
+
+  if (! quiet)
+    printf ("# name size ops ns/op\n");
+
+  for (s = 0; suites [s] . name; s ++)
+    if (! only || argsmember (only, suites [s] . name) != -1)
+      suites [s] . run (maxhosts);
+
+  /* Bye bye! */
+  argsclear (only);
+
+  return 0;
+}
@@ -0,0 +1,973 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Synthetic traffic generator: it writes Ethernet frames into a pcap file
+ * (or injects them into an interface, e.g. one end of a veth pair) with
+ * controlled distributions, to stress the decoders and counters at scale
+ * without production captures:
+ *
+ *   * local and foreign hosts (foreign ones are reached via a gateway)
+ *   * talkers chosen with a Zipf distribution
+ *   * ARP, IPv4 TCP/UDP/ICMP mixes
+ *   * broadcast and multicast mixes (the addresses known to datalinks.c)
+ *   * TCP SYNs crafted to match the signatures of the ettercap database
+ *   * frame sizes (minimum, maximum, uniform or IMIX)
+ *   * Poisson arrivals at a given rate
+ *
+ * The same seed always gives the same file.
+ */
+
+
+/* System headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <arpa/inet.h>
+
+/* Packet capture */
+#include <pcap.h>
+
+/* The ettercap passive OS fingerprints database */
+#include "ettercap.h"
+
+
+/* Default values */
+#define GEN_COUNT      100000       /* frames                              */
+#define GEN_LOCAL      254          /* hosts on the local network          */
+#define GEN_FOREIGN    1000         /* hosts beyond the gateway            */
+#define GEN_NETWORK    "192.168.1.0/24"
+#define GEN_ZIPF       1.0          /* the exponent of the talkers ranking */
+#define GEN_MIX        "70,20,5,5"  /* TCP,UDP,ICMP,ARP (percent)          */
+#define GEN_BROADCAST  2            /* percent                             */
+#define GEN_MULTICAST  3            /* percent                             */
+#define GEN_SYN        5            /* percent of TCP segments             */
+#define GEN_RATE       10000        /* frames per second                   */
+
+/* Ethernet */
+#define ETH_HLEN       14
+#define ETH_MIN        60           /* without the FCS */
+#define ETH_MAX        1514
+#define ETH_IP         0x0800
+#define ETH_ARP        0x0806
+#define ETH_IPV6       0x86dd
+
+/* IPv4 */
+#define IP_HLEN        20
+#define TCP_HLEN       20
+#define UDP_HLEN       8
+#define ICMP_HLEN      8
+#define ARP_LEN        28
+
+#if !defined(MIN)
+# define MIN(a, b)     ((a) < (b) ? (a) : (b))
+#endif
+#if !defined(MAX)
+# define MAX(a, b)     ((a) > (b) ? (a) : (b))
+#endif
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  /* Output */
+  OPT_WRITE       = 'w',
+  OPT_INTERFACE   = 'i',
+
+  OPT_COUNT       = 'c',
+  OPT_LOCAL       = 'l',
+  OPT_FOREIGN     = 'f',
+  OPT_NETWORK     = 'N',
+  OPT_ZIPF        = 'z',
+  OPT_SIZES       = 's',
+  OPT_MIX         = 'p',
+  OPT_BROADCAST   = 'b',
+  OPT_MULTICAST   = 'm',
+  OPT_SYN         = 'S',
+  OPT_RATE        = 'r',
+  OPT_START       = 't',
+
+  /* Long only options */
+  OPT_SEED        = 130,
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  /* Output */
+  { "write",         required_argument, NULL, OPT_WRITE       },
+  { "interface",     required_argument, NULL, OPT_INTERFACE   },
+
+  { "count",         required_argument, NULL, OPT_COUNT       },
+  { "local",         required_argument, NULL, OPT_LOCAL       },
+  { "foreign",       required_argument, NULL, OPT_FOREIGN     },
+  { "network",       required_argument, NULL, OPT_NETWORK     },
+  { "zipf",          required_argument, NULL, OPT_ZIPF        },
+  { "sizes",         required_argument, NULL, OPT_SIZES       },
+  { "mix",           required_argument, NULL, OPT_MIX         },
+  { "broadcast",     required_argument, NULL, OPT_BROADCAST   },
+  { "multicast",     required_argument, NULL, OPT_MULTICAST   },
+  { "syn",           required_argument, NULL, OPT_SYN         },
+  { "rate",          required_argument, NULL, OPT_RATE        },
+  { "start",         required_argument, NULL, OPT_START       },
+  { "seed",          required_argument, NULL, OPT_SEED        },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* The distributions of the frame sizes */
+typedef enum { SIZES_IMIX, SIZES_MIN, SIZES_MAX, SIZES_UNIFORM } sizes_t;
+
+/* A station on the wire */
+typedef struct
+{
+  u_char mac [6];
+  uint32_t ip;              /* network byte order                     */
+  bool local;
+  int os;                   /* index in the usable signatures, or -1 */
+
+} station_t;
+
+/* A signature of the ettercap database that can be reproduced on the wire */
+typedef struct
+{
+  uint16_t win;
+  int mss;                  /* -1 when the option is missing */
+  u_char ttl;
+  int ws;                   /* -1 when the option is missing */
+  bool sack;
+  bool nop;
+  bool df;
+  bool ts;
+  bool ack;
+  u_char optlen;            /* bytes of TCP options          */
+
+} signature_t;
+
+/* The multicast destinations, the same known by datalinks.c */
+typedef enum { MCAST_CDP, MCAST_STP, MCAST_IGMP, MCAST_MDNS, MCAST_IPV6 } mcast_t;
+
+/* The generator */
+typedef struct
+{
+  uint64_t rnd;
+
+  station_t * stations;
+  unsigned nstations;
+  unsigned nlocal;
+  double * cdf;             /* cumulative Zipf probabilities by rank */
+  unsigned * rank;          /* station by rank                       */
+
+  uint32_t network;         /* network byte order */
+  uint32_t netmask;
+
+  signature_t * sigs;
+  unsigned nsigs;
+
+  sizes_t sizes;
+  unsigned mix [4];         /* TCP, UDP, ICMP, ARP (cumulative percent) */
+  unsigned broadcast;
+  unsigned multicast;
+  unsigned syn;
+
+  /* What has been generated */
+  unsigned long kinds [7];
+
+} gen_t;
+
+enum { K_TCP, K_UDP, K_ICMP, K_ARP, K_SYN, K_BROADCAST, K_MULTICAST };
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' generates synthetic Ethernet traffic with controlled distributions, either into a pcap file\n", progname);
+  printf ("     or injected into a network interface (e.g. one end of a veth pair)\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] -w file | -i interface\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s -w /tmp/x.pcap                     # %d frames with the default distributions\n", progname, GEN_COUNT);
+  printf ("   %s -c 10000000 -f 100000 -w /tmp/x.pcap # 10M frames among 100K foreign hosts\n", progname);
+  printf ("   %s -z 1.2 -p 0,100,0,0 -w /tmp/x.pcap  # UDP only, with a steeper Zipf ranking\n", progname);
+  printf ("   %s -r 50000 -i veth1                   # inject 50K frames/s into veth1\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -q, --quiet                  run quietly\n");
+  printf ("   -w, --write file             write the frames into a pcap file\n");
+  printf ("   -i, --interface name         inject the frames into an interface (paced by their timestamps)\n");
+  printf ("   -c, --count N                generate N frames (default %d)\n", GEN_COUNT);
+  printf ("   -l, --local N                N hosts on the local network (default %d)\n", GEN_LOCAL);
+  printf ("   -f, --foreign N              N hosts beyond the gateway (default %d)\n", GEN_FOREIGN);
+  printf ("   -N, --network net/bits       the local network, as seen by pcap_lookupnet() (default %s)\n", GEN_NETWORK);
+  printf ("   -z, --zipf s                 the exponent of the Zipf ranking of the talkers (default %.1f)\n", GEN_ZIPF);
+  printf ("   -s, --sizes imix|min|max|uniform\n");
+  printf ("                                the distribution of the frame sizes (default imix)\n");
+  printf ("   -p, --mix tcp,udp,icmp,arp   the protocols mix in percent (default %s)\n", GEN_MIX);
+  printf ("   -b, --broadcast pct          percent of broadcast frames (default %d)\n", GEN_BROADCAST);
+  printf ("   -m, --multicast pct          percent of multicast frames (default %d)\n", GEN_MULTICAST);
+  printf ("   -S, --syn pct                percent of TCP SYNs fingerprinted as ettercap (default %d)\n", GEN_SYN);
+  printf ("   -r, --rate pps               the average rate of Poisson arrivals (default %d)\n", GEN_RATE);
+  printf ("   -t, --start secs             the timestamp of the first frame (default now)\n");
+  printf ("       --seed N                 seed of the pseudo-random generator (default 1)\n");
+}
+
+
+/* xorshift64* */
+static uint64_t rnd (gen_t * g)
+{
+  g -> rnd ^= g -> rnd >> 12;
+  g -> rnd ^= g -> rnd << 25;
+  g -> rnd ^= g -> rnd >> 27;
+  return g -> rnd * 0x2545f4914f6cdd1dULL;
+}
+
+
+/* A pseudo-random integer in [0, n) */
+static unsigned below (gen_t * g, unsigned n)
+{
+  return n ? (rnd (g) >> 32) % n : 0;
+}
+
+
+/* A pseudo-random real in (0, 1) */
+static double uniform (gen_t * g)
+{
+  return ((rnd (g) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+
+/* A station chosen by its Zipf rank */
+static station_t * talker (gen_t * g)
+{
+  double u = uniform (g);
+  unsigned lo = 0;
+  unsigned hi = g -> nstations - 1;
+
+  while (lo < hi)
+    {
+      unsigned mid = (lo + hi) / 2;
+      if (g -> cdf [mid] < u)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+
+  return & g -> stations [g -> rank [lo]];
+}
+
+
+/* A local station chosen by its Zipf rank (the gateway stands for the foreign ones) */
+static station_t * localtalker (gen_t * g)
+{
+  station_t * s = talker (g);
+
+  return s -> local ? s : & g -> stations [0];
+}
+
+
+/* Parse a signature of the ettercap database (false if it cannot be reproduced on the wire) */
+static bool signature (char * prefix, signature_t * s)
+{
+  char mss [5];
+  char ws [3];
+  unsigned win, ttl, sack, nop, df, ts, ll;
+  char flag;
+  unsigned need;
+
+  if (sscanf (prefix, "%4x:%4[^:]:%2x:%2[^:]:%1u:%1u:%1u:%1u:%c:%2x",
+	      & win, mss, & ttl, ws, & sack, & nop, & df, & ts, & flag, & ll) != 10)
+    return false;
+
+  s -> win  = win;
+  s -> mss  = strcmp (mss, "_MSS") ? strtol (mss, NULL, 16) : -1;
+  s -> ttl  = ttl;
+  s -> ws   = strcmp (ws, "WS") ? strtol (ws, NULL, 16) : -1;
+  s -> sack = sack;
+  s -> nop  = nop;
+  s -> df   = df;
+  s -> ts   = ts;
+  s -> ack  = flag == 'A';
+
+  /* The decoder rounds the TTL up to a power of 2 */
+  if (ttl < 16 || (ttl != 0xff && (ttl & (ttl - 1))))
+    return false;
+
+  /* The options must fit the length of the headers, padded with NOPs (or EOLs when no NOP is expected) */
+  need = (s -> mss != -1 ? 4 : 0) + (s -> ws != -1 ? 3 : 0) + (sack ? 2 : 0) + (ts ? 10 : 0) + (nop ? 1 : 0);
+  if (ll < IP_HLEN + TCP_HLEN + 4 || ll > IP_HLEN + TCP_HLEN + 40 || (ll - IP_HLEN - TCP_HLEN) % 4 ||
+      ll - IP_HLEN - TCP_HLEN < need)
+    return false;
+
+  s -> optlen = ll - IP_HLEN - TCP_HLEN;
+
+  return true;
+}
+
+
+/* Build the TCP options of a signature */
+static void options (signature_t * s, u_char * o)
+{
+  u_char * p = o;
+
+  if (s -> mss != -1)
+    * p ++ = 2, * p ++ = 4, * p ++ = s -> mss >> 8, * p ++ = s -> mss & 0xff;
+  if (s -> nop)
+    * p ++ = 1;
+  if (s -> ws != -1)
+    * p ++ = 3, * p ++ = 3, * p ++ = s -> ws;
+  if (s -> sack)
+    * p ++ = 4, * p ++ = 2;
+  if (s -> ts)
+    {
+      * p ++ = 8, * p ++ = 10;
+      memset (p, 0, 8);
+      p += 8;
+    }
+
+  /* Pad */
+  while (p < o + s -> optlen)
+    * p ++ = s -> nop ? 1 : 0;
+}
+
+
+/* The Internet checksum */
+static uint16_t cksum (const void * data, size_t len, uint32_t sum)
+{
+  const u_char * p = data;
+
+  while (len > 1)
+    sum += (p [0] << 8) | p [1], p += 2, len -= 2;
+  if (len)
+    sum += p [0] << 8;
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return htons (~sum & 0xffff);
+}
+
+
+/* The sum of the TCP/UDP pseudo header */
+static uint32_t pseudo (u_char * ip, u_char proto, unsigned len)
+{
+  uint32_t sum = 0;
+  unsigned i;
+
+  for (i = 12; i < 20; i += 2)
+    sum += (ip [i] << 8) | ip [i + 1];
+
+  return sum + proto + len;
+}
+
+
+static void put16 (u_char * p, uint16_t v)
+{
+  p [0] = v >> 8;
+  p [1] = v & 0xff;
+}
+
+
+/* The Ethernet header */
+static u_char * ethernet (u_char * f, const u_char * dst, const u_char * src, uint16_t type)
+{
+  memcpy (f, dst, 6);
+  memcpy (f + 6, src, 6);
+  put16 (f + 12, type);
+
+  return f + ETH_HLEN;
+}
+
+
+/* The IPv4 header ('len' is the total length) */
+static u_char * ipv4 (u_char * p, uint32_t src, uint32_t dst, u_char proto, unsigned len, u_char ttl, bool df, uint16_t id)
+{
+  p [0] = 0x45;
+  p [1] = 0;
+  put16 (p + 2, len);
+  put16 (p + 4, id);
+  put16 (p + 6, df ? 0x4000 : 0);
+  p [8] = ttl;
+  p [9] = proto;
+  put16 (p + 10, 0);
+  memcpy (p + 12, & src, 4);
+  memcpy (p + 16, & dst, 4);
+  memcpy (p + 10, (uint16_t []) { cksum (p, IP_HLEN, 0) }, 2);
+
+  return p + IP_HLEN;
+}
+
+
+/* Fill 'n' bytes of payload */
+static void payload (gen_t * g, u_char * p, unsigned n)
+{
+  uint64_t r = rnd (g);
+  unsigned i;
+
+  for (i = 0; i < n; i ++)
+    p [i] = r >> ((i & 7) * 8);
+}
+
+
+/* The length of the next frame */
+static unsigned framelen (gen_t * g)
+{
+  switch (g -> sizes)
+    {
+    case SIZES_MIN:     return ETH_MIN;
+    case SIZES_MAX:     return ETH_MAX;
+    case SIZES_UNIFORM: return ETH_MIN + below (g, ETH_MAX - ETH_MIN + 1);
+    default:
+      {
+	/* The simple IMIX 7:4:1 (IP packets of 40, 576 and 1500 bytes) */
+	unsigned r = below (g, 12);
+	return r < 7 ? ETH_MIN : r < 11 ? ETH_HLEN + 576 : ETH_MAX;
+      }
+    }
+}
+
+
+/* Well known ports, weighted by their popularity */
+static uint16_t tcpport (gen_t * g)
+{
+  static uint16_t ports [] = { 80, 80, 80, 443, 443, 443, 25, 22, 8080, 993 };
+  return ports [below (g, sizeof (ports) / sizeof (ports [0]))];
+}
+
+
+static uint16_t udpport (gen_t * g)
+{
+  static uint16_t ports [] = { 53, 53, 53, 53, 123, 123, 161, 514, 1900, 5060 };
+  return ports [below (g, sizeof (ports) / sizeof (ports [0]))];
+}
+
+
+static uint16_t ephemeral (gen_t * g)
+{
+  return 32768 + below (g, 28232);
+}
+
+
+/* TCP (possibly a fingerprinted SYN) */
+static unsigned tcp (gen_t * g, u_char * f, station_t * src, station_t * dst, station_t * gw)
+{
+  signature_t * s = src -> os != -1 && below (g, 100) < g -> syn ? & g -> sigs [src -> os] : NULL;
+  unsigned len = s ? ETH_HLEN + IP_HLEN + TCP_HLEN + s -> optlen : framelen (g);
+  unsigned optlen = s ? s -> optlen : 0;
+  unsigned seglen;
+  u_char * ip;
+  u_char * p;
+  bool reply = ! s && below (g, 2);
+  u_char ttl = s ? s -> ttl : src -> os != -1 ? g -> sigs [src -> os] . ttl : 64;
+
+  if (len < ETH_HLEN + IP_HLEN + TCP_HLEN)
+    len = ETH_HLEN + IP_HLEN + TCP_HLEN;
+  seglen = len - ETH_HLEN - IP_HLEN;
+
+  /* The frames of foreign hosts are seen on the wire a few hops away, and through the gateway */
+  if (! src -> local)
+    ttl -= 1 + below (g, MIN (10, ttl / 2 - 1));
+
+  ip = ethernet (f, dst -> local ? dst -> mac : gw -> mac, src -> local ? src -> mac : gw -> mac, ETH_IP);
+  p  = ipv4 (ip, src -> ip, dst -> ip, IPPROTO_TCP, IP_HLEN + seglen, ttl, s ? s -> df : true, below (g, 65536));
+
+  put16 (p, reply ? tcpport (g) : ephemeral (g));
+  put16 (p + 2, reply ? ephemeral (g) : tcpport (g));
+  memcpy (p + 4, (uint32_t []) { rnd (g) }, 4);
+  memcpy (p + 8, (uint32_t []) { s && ! s -> ack ? 0 : rnd (g) }, 4);
+  p [12] = ((TCP_HLEN + optlen) / 4) << 4;
+  p [13] = s ? (s -> ack ? 0x12 : 0x02) : 0x18;        /* SYN, SYN+ACK or PSH+ACK */
+  put16 (p + 14, s ? s -> win : 512 + below (g, 65024));
+  put16 (p + 16, 0);
+  put16 (p + 18, 0);
+  if (s)
+    options (s, p + TCP_HLEN);
+  else
+    payload (g, p + TCP_HLEN, seglen - TCP_HLEN);
+  memcpy (p + 16, (uint16_t []) { cksum (p, seglen, pseudo (ip, IPPROTO_TCP, seglen)) }, 2);
+
+  g -> kinds [K_TCP] ++;
+  if (s)
+    g -> kinds [K_SYN] ++;
+
+  /* Short frames are padded by the sender */
+  if (len < ETH_MIN)
+    {
+      memset (f + len, 0, ETH_MIN - len);
+      len = ETH_MIN;
+    }
+
+  return len;
+}
+
+
+/* UDP (to 'dst', to the broadcast or to the mDNS multicast group) */
+static unsigned udp (gen_t * g, u_char * f, station_t * src, station_t * dst, station_t * gw, u_char * mac, uint32_t to)
+{
+  unsigned len = MAX (framelen (g), ETH_MIN);
+  unsigned seglen = len - ETH_HLEN - IP_HLEN;
+  bool unicast = ! mac;
+  u_char * ip;
+  u_char * p;
+  uint16_t port = udpport (g);
+
+  if (unicast)
+    mac = dst -> local ? dst -> mac : gw -> mac, to = dst -> ip;
+  else if (to == htonl (0xe00000fb))
+    port = 5353;
+  else
+    port = 137;
+
+  ip = ethernet (f, mac, src -> local ? src -> mac : gw -> mac, ETH_IP);
+  p  = ipv4 (ip, src -> ip, to, IPPROTO_UDP, IP_HLEN + seglen, src -> local ? 64 : 64 - 1 - below (g, 10), false, below (g, 65536));
+
+  put16 (p, unicast ? ephemeral (g) : port);
+  put16 (p + 2, port);
+  put16 (p + 4, seglen);
+  put16 (p + 6, 0);
+  payload (g, p + UDP_HLEN, seglen - UDP_HLEN);
+  memcpy (p + 6, (uint16_t []) { cksum (p, seglen, pseudo (ip, IPPROTO_UDP, seglen)) }, 2);
+
+  g -> kinds [K_UDP] ++;
+
+  return len;
+}
+
+
+/* ICMP echo request/reply */
+static unsigned icmp (gen_t * g, u_char * f, station_t * src, station_t * dst, station_t * gw)
+{
+  unsigned len = MAX (MIN (framelen (g), ETH_HLEN + IP_HLEN + ICMP_HLEN + 56), ETH_MIN);
+  unsigned seglen = len - ETH_HLEN - IP_HLEN;
+  u_char * p;
+
+  p = ethernet (f, dst -> local ? dst -> mac : gw -> mac, src -> local ? src -> mac : gw -> mac, ETH_IP);
+  p = ipv4 (p, src -> ip, dst -> ip, IPPROTO_ICMP, IP_HLEN + seglen, src -> local ? 64 : 64 - 1 - below (g, 10), false, below (g, 65536));
+
+  p [0] = below (g, 2) ? 8 : 0;
+  p [1] = 0;
+  put16 (p + 2, 0);
+  put16 (p + 4, below (g, 65536));
+  put16 (p + 6, below (g, 65536));
+  payload (g, p + ICMP_HLEN, seglen - ICMP_HLEN);
+  memcpy (p + 2, (uint16_t []) { cksum (p, seglen, 0) }, 2);
+
+  g -> kinds [K_ICMP] ++;
+
+  return len;
+}
+
+
+/* ARP request (broadcast) or reply */
+static unsigned arp (gen_t * g, u_char * f, station_t * src, station_t * dst, bool request)
+{
+  static u_char broadcast [6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  static u_char unknown [6];
+  u_char * p;
+
+  p = ethernet (f, request ? broadcast : dst -> mac, src -> mac, ETH_ARP);
+
+  put16 (p, 1);                  /* Ethernet */
+  put16 (p + 2, ETH_IP);
+  p [4] = 6;
+  p [5] = 4;
+  put16 (p + 6, request ? 1 : 2);
+  memcpy (p + 8, src -> mac, 6);
+  memcpy (p + 14, & src -> ip, 4);
+  memcpy (p + 18, request ? unknown : dst -> mac, 6);
+  memcpy (p + 24, & dst -> ip, 4);
+  memset (p + ARP_LEN, 0, ETH_MIN - ETH_HLEN - ARP_LEN);
+
+  g -> kinds [K_ARP] ++;
+
+  return ETH_MIN;
+}
+
+
+/* Frames to the multicast addresses known by datalinks.c */
+static unsigned multicast (gen_t * g, u_char * f, station_t * src)
+{
+  static u_char cdp [6]  = { 0x01, 0x00, 0x0c, 0xcc, 0xcc, 0xcc };
+  static u_char stp [6]  = { 0x01, 0x80, 0xc2, 0x00, 0x00, 0x00 };
+  static u_char igmp [6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x16 };
+  static u_char mdns [6] = { 0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb };
+  static u_char ipv6 [6] = { 0x33, 0x33, 0x00, 0x00, 0x00, 0x01 };
+  u_char * p;
+
+  g -> kinds [K_MULTICAST] ++;
+
+  switch (below (g, 5))
+    {
+    case MCAST_CDP:
+    case MCAST_STP:
+      /* 802.3 frames with a length field and an LLC header */
+      p = ethernet (f, g -> rnd & 1 ? cdp : stp, src -> mac, ETH_MIN - ETH_HLEN);
+      p [0] = g -> rnd & 1 ? 0xaa : 0x42;
+      p [1] = p [0];
+      p [2] = 0x03;
+      payload (g, p + 3, ETH_MIN - ETH_HLEN - 3);
+      return ETH_MIN;
+
+    case MCAST_IGMP:
+      /* IGMPv3 membership report */
+      p = ethernet (f, igmp, src -> mac, ETH_IP);
+      p = ipv4 (p, src -> ip, htonl (0xe0000016), IPPROTO_IGMP, IP_HLEN + 16, 1, false, below (g, 65536));
+      memset (p, 0, 16);
+      p [0] = 0x22;
+      put16 (p + 6, 1);
+      p [8] = 4;
+      memcpy (p + 12, (uint32_t []) { htonl (0xef000000 | below (g, 1 << 24)) }, 4);
+      memcpy (p + 2, (uint16_t []) { cksum (p, 16, 0) }, 2);
+      memset (p + 16, 0, ETH_MIN - ETH_HLEN - IP_HLEN - 16);
+      return ETH_MIN;
+
+    case MCAST_MDNS:
+      return udp (g, f, src, NULL, src, mdns, htonl (0xe00000fb));
+
+    default:
+      /* IPv6 Neighbor Solicitation (not decoded as IP) */
+      p = ethernet (f, ipv6, src -> mac, ETH_IPV6);
+      payload (g, p, 72);
+      p [0] = 0x60;
+      put16 (p + 4, 32);
+      p [6] = 58;
+      p [7] = 255;
+      return ETH_HLEN + 72;
+    }
+}
+
+
+/* Generate the next frame into 'f' and return its length */
+static unsigned frame (gen_t * g, u_char * f)
+{
+  static u_char broadcast [6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+  station_t * gw = & g -> stations [0];
+  station_t * src;
+  station_t * dst;
+  unsigned r = below (g, 100);
+
+  /* Broadcasts and multicasts are only sent by local hosts */
+  if (r < g -> broadcast)
+    {
+      g -> kinds [K_BROADCAST] ++;
+      src = localtalker (g);
+      if (below (g, 2))
+	return udp (g, f, src, NULL, gw, broadcast, g -> network | ~ g -> netmask);
+      dst = localtalker (g);
+      return arp (g, f, src, dst, true);
+    }
+
+  if (r < g -> broadcast + g -> multicast)
+    return multicast (g, f, localtalker (g));
+
+  /* Unicast between two distinct hosts, at least one is local */
+  src = talker (g);
+  do
+    dst = talker (g);
+  while (dst == src && g -> nstations > 1);
+  if (! src -> local && ! dst -> local)
+    dst = localtalker (g);
+
+  r = below (g, 100);
+  if (r < g -> mix [0])
+    return tcp (g, f, src, dst, gw);
+  if (r < g -> mix [1])
+    return udp (g, f, src, dst, gw, NULL, 0);
+  if (r < g -> mix [2])
+    return icmp (g, f, src, dst, gw);
+
+  /* ARP replies are between local hosts */
+  return arp (g, f, src -> local ? src : gw, dst -> local ? dst : gw, false);
+}
+
+
+/* Load the signatures of the ettercap database that can be reproduced on the wire */
+static bool loadsignatures (gen_t * g)
+{
+  ettercap_t * os;
+
+  if (! (g -> sigs = calloc (sizeof (fingerprints) / sizeof (fingerprints [0]), sizeof (signature_t))))
+    return false;
+
+  for (os = fingerprints; os -> prefix; os ++)
+    if (signature (os -> prefix, & g -> sigs [g -> nsigs]))
+      g -> nsigs ++;
+
+  return true;
+}
+
+
+/* Lay out the hosts and rank them as talkers */
+static bool populate (gen_t * g, unsigned nlocal, unsigned nforeign, double zipf)
+{
+  /* A few real vendors, for the sake of the NIC vendor resolver */
+  static u_char ouis [] [3] =
+  {
+    { 0x00, 0x1b, 0x21 },   /* Intel  */
+    { 0x3c, 0x22, 0xfb },   /* Apple  */
+    { 0x00, 0x50, 0x56 },   /* VMware */
+    { 0x00, 0x1a, 0xa0 },   /* Dell   */
+    { 0x00, 0x00, 0x0c },   /* Cisco  */
+  };
+  double sum = 0;
+  unsigned i;
+
+  g -> nlocal    = nlocal;
+  g -> nstations = nlocal + nforeign;
+
+  if (! (g -> stations = calloc (g -> nstations, sizeof (station_t))) ||
+      ! (g -> cdf = calloc (g -> nstations, sizeof (double))) ||
+      ! (g -> rank = calloc (g -> nstations, sizeof (unsigned))))
+    return false;
+
+  for (i = 0; i < g -> nstations; i ++)
+    {
+      station_t * s = & g -> stations [i];
+
+      s -> local = i < nlocal;
+      s -> os    = g -> nsigs ? (int) below (g, g -> nsigs) : -1;
+      if (s -> local)
+	{
+	  /* The first local host is the gateway */
+	  memcpy (s -> mac, ouis [i % (sizeof (ouis) / sizeof (ouis [0]))], 3);
+	  s -> mac [3] = i >> 16;
+	  s -> mac [4] = i >> 8;
+	  s -> mac [5] = i;
+	  s -> ip = g -> network | htonl (i + 1);
+	}
+      else
+	{
+	  /* Anywhere unicast but on the local network */
+	  do
+	    s -> ip = htonl ((1 + below (g, 223)) << 24 | below (g, 1 << 24));
+	  while ((s -> ip & g -> netmask) == g -> network || (ntohl (s -> ip) >> 24) == 127);
+	}
+    }
+
+  /* The weight of the k-th talker is 1 / k^s */
+  for (i = 0; i < g -> nstations; i ++)
+    g -> cdf [i] = sum += 1 / pow (i + 1, zipf);
+  for (i = 0; i < g -> nstations; i ++)
+    g -> cdf [i] /= sum;
+
+  /* Talkers are ranked at random, local and foreign alike */
+  for (i = 0; i < g -> nstations; i ++)
+    g -> rank [i] = i;
+  for (i = g -> nstations - 1; i > 0; i --)
+    {
+      unsigned j = below (g, i + 1);
+      unsigned t = g -> rank [i];
+      g -> rank [i] = g -> rank [j];
+      g -> rank [j] = t;
+    }
+
+  return true;
+}
+
+
+int main (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+
+  /* Variables that are set according to the specified options */
+  bool quiet         = false;
+  char * file        = NULL;
+  char * name        = NULL;
+  unsigned long count = GEN_COUNT;
+  unsigned nlocal    = GEN_LOCAL;
+  unsigned nforeign  = GEN_FOREIGN;
+  char * network     = GEN_NETWORK;
+  double zipf        = GEN_ZIPF;
+  char * sizes       = "imix";
+  char * mix         = GEN_MIX;
+  double rate        = GEN_RATE;
+  time_t start       = time (NULL);
+
+  int option;
+
+  /* Local variables */
+  gen_t gen = { .rnd = 1, .broadcast = GEN_BROADCAST, .multicast = GEN_MULTICAST, .syn = GEN_SYN };
+  char errbuf [PCAP_ERRBUF_SIZE];
+  pcap_t * pcap;
+  pcap_dumper_t * dumper = NULL;
+  struct pcap_pkthdr h;
+  struct timespec began;
+  u_char f [ETH_MAX];
+  unsigned p [4];
+  char net [16];
+  unsigned bits;
+  double t = 0;
+  unsigned long n;
+  unsigned long bytes = 0;
+
+  while ((option = getopt_long (argc, argv, "hqw:i:c:l:f:N:z:s:p:b:m:S:r:t:", lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:      usage (progname, lopts);            return 0;
+	case OPT_QUIET:     quiet = true;                       break;
+
+	  /* Output */
+	case OPT_WRITE:     file = optarg;                      break;
+	case OPT_INTERFACE: name = optarg;                      break;
+
+	case OPT_COUNT:     count = strtoul (optarg, NULL, 0);  break;
+	case OPT_LOCAL:     nlocal = atoi (optarg);             break;
+	case OPT_FOREIGN:   nforeign = atoi (optarg);           break;
+	case OPT_NETWORK:   network = optarg;                   break;
+	case OPT_ZIPF:      zipf = atof (optarg);               break;
+	case OPT_SIZES:     sizes = optarg;                     break;
+	case OPT_MIX:       mix = optarg;                       break;
+	case OPT_BROADCAST: gen . broadcast = atoi (optarg);    break;
+	case OPT_MULTICAST: gen . multicast = atoi (optarg);    break;
+	case OPT_SYN:       gen . syn = atoi (optarg);          break;
+	case OPT_RATE:      rate = atof (optarg);               break;
+	case OPT_START:     start = atol (optarg);              break;
+	case OPT_SEED:      gen . rnd = strtoull (optarg, NULL, 0) | 1; break;
+	}
+    }
+
+  if (! file == ! name)
+    {
+      printf ("%s: either a file or an interface is required\n", progname);
+      printf ("Try '%s --help' for more information.\n", progname);
+      return 1;
+    }
+
+  /* The local network */
+  if (sscanf (network, "%15[0-9.]/%u", net, & bits) != 2 || bits < 8 || bits > 30 || inet_pton (AF_INET, net, & gen . network) != 1)
+    {
+      printf ("%s: invalid network [%s]\n", progname, network);
+      return 1;
+    }
+  gen . netmask  = htonl (~0U << (32 - bits));
+  gen . network &= gen . netmask;
+  if (! nlocal || nlocal > (1U << (32 - bits)) - 2)
+    {
+      printf ("%s: %u local hosts do not fit %s\n", progname, nlocal, network);
+      return 1;
+    }
+
+  /* The protocols mix */
+  if (sscanf (mix, "%u,%u,%u,%u", & p [0], & p [1], & p [2], & p [3]) != 4 || p [0] + p [1] + p [2] + p [3] != 100)
+    {
+      printf ("%s: invalid mix [%s] (percents of TCP,UDP,ICMP,ARP adding up to 100)\n", progname, mix);
+      return 1;
+    }
+  gen . mix [0] = p [0];
+  gen . mix [1] = gen . mix [0] + p [1];
+  gen . mix [2] = gen . mix [1] + p [2];
+  gen . mix [3] = gen . mix [2] + p [3];
+
+  if (! strcmp (sizes, "imix"))
+    gen . sizes = SIZES_IMIX;
+  else if (! strcmp (sizes, "min"))
+    gen . sizes = SIZES_MIN;
+  else if (! strcmp (sizes, "max"))
+    gen . sizes = SIZES_MAX;
+  else if (! strcmp (sizes, "uniform"))
+    gen . sizes = SIZES_UNIFORM;
+  else
+    {
+      printf ("%s: invalid sizes [%s]\n", progname, sizes);
+      return 1;
+    }
+
+  if (gen . broadcast + gen . multicast > 100 || gen . syn > 100 || rate <= 0)
+    {
+      printf ("%s: invalid percents or rate\n", progname);
+      return 1;
+    }
+
+  if (! loadsignatures (& gen) || ! populate (& gen, nlocal, nforeign, zipf))
+    {
+      printf ("%s: %s\n", progname, strerror (ENOMEM));
+      return 1;
+    }
+
+  /* Where the frames go */
+  if (file)
+    {
+      if (! (pcap = pcap_open_dead (DLT_EN10MB, 65535)) || ! (dumper = pcap_dump_open (pcap, file)))
+	{
+	  printf ("%s: cannot write %s (%s)\n", progname, file, pcap ? pcap_geterr (pcap) : strerror (errno));
+	  return 1;
+	}
+    }
+  else if (! (pcap = pcap_open_live (name, 65535, 0, 0, errbuf)))
+    {
+      printf ("%s: cannot open %s (%s)\n", progname, name, errbuf);
+      return 1;
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, & began);
+  for (n = 0; n < count; n ++)
+    {
+      /* Poisson arrivals */
+      t += - log (uniform (& gen)) / rate;
+      h . ts . tv_sec  = start + (time_t) t;
+      h . ts . tv_usec = (t - (time_t) t) * 1000000;
+      h . caplen = h . len = frame (& gen, f);
+      bytes += h . len;
+
+      if (dumper)
+	pcap_dump ((u_char *) dumper, & h, f);
+      else
+	{
+	  struct timespec now;
+	  double ahead;
+
+	  /* Do not run ahead of the timestamps */
+	  clock_gettime (CLOCK_MONOTONIC, & now);
+	  ahead = t - (now . tv_sec - began . tv_sec) - (now . tv_nsec - began . tv_nsec) / 1e9;
+	  if (ahead > 0.001)
+	    nanosleep (& (struct timespec) { ahead, (ahead - (time_t) ahead) * 1e9 }, NULL);
+	  if (pcap_inject (pcap, f, h . len) == -1 && ! quiet)
+	    printf ("%s: cannot inject into %s (%s)\n", progname, name, pcap_geterr (pcap));
+	}
+    }
+
+  if (dumper)
+    pcap_dump_close (dumper);
+  pcap_close (pcap);
+
+  if (! quiet)
+    {
+      printf ("%lu frames, %lu bytes over %.3f secs, %u hosts (%u local), %u ettercap signatures\n",
+	      count, bytes, t, gen . nstations, gen . nlocal, gen . nsigs);
+      printf ("  TCP %lu (SYN %lu), UDP %lu, ICMP %lu, ARP %lu, broadcast %lu, multicast %lu\n",
+	      gen . kinds [K_TCP], gen . kinds [K_SYN], gen . kinds [K_UDP], gen . kinds [K_ICMP], gen . kinds [K_ARP],
+	      gen . kinds [K_BROADCAST], gen . kinds [K_MULTICAST]);
+    }
+
+  /* Bye bye! */
+  return 0;
+}
@@ -31,6 +31,7 @@
 /* Project headers */
 #include "rlibc.h"
 #include "hash.h"
+#include "pkshm.h"
 
 
 /* Constants */
@@ -69,12 +70,80 @@
 #define DEFAULT_IP_SIZE   2048  /* initial hash table size for IP addresses         */
 #define DEFAULT_HOST_SIZE 4096  /* initial hash table size for hostnames            */
 
+/* Max # of IPv6 prefixes of an interface (to tell local hosts from foreign ones) */
+#define IP6_PREFIXES      8
+
+/* # of VLAN identifiers (802.1Q) */
+#define VLAN_IDS          4096
+
+/* The VLAN the hosts of the frame being decoded on 'intf' are keyed in (0 unless they are kept apart) */
+#define KEYVLAN(intf)     ((intf) -> vlankeys ? (intf) -> vlan : 0)
+
+/* The Linux device capturing on all the others (its frames are in the cooked format) */
+#define ANY_DEVICE        "any"
+
+/* Size of the table of the devices seen by the 'any' device (indexed by interface index, in chunks allocated on demand) */
+#define IFINDEX_CHUNK     256
+#define IFINDEX_CHUNKS    256
+
 #define LOOPBACK_ADDR     "127.0.0.1"
 #define NULL_IPADDR       "0.0.0.0"
 
 /* The 'ettercap' signatures are prefixed by 28 digits coded as WWWW:MSS:TTL:WS:S:N:D:T:F:LL */
 #define FPLEN    30
 
+/* Size of the registry of hosts (hosts are allocated in chunks never moved once allocated) */
+#define HOSTS_CHUNK      1024   /* # of contiguous hosts in a chunk   */
+#define HOSTS_CHUNKS     4096   /* max # of chunks per interface      */
+
+/* Depth of the per-host traffic history */
+#define HISTORY_MINUTES  60     /* per-minute buckets (the last hour)   */
+#define HISTORY_HOURS    24     /* per-hour buckets (the last day)      */
+
+/* The disk recorder of the captured frames (see pkdump) */
+#define RECORDER_QUEUE   (8 * 1024 * 1024)  /* bytes of the handoff queue from the sniffer */
+#define RECORDER_BATCH   (1024 * 1024)      /* bytes of each write to disk                 */
+#define RECORDER_ALIGN   4096               /* alignment of the batches (for O_DIRECT)      */
+
+/* The steps of the overload shedding of the sniffer, each one sheds the work of the previous ones too (see shed.c) */
+#define SHED_NONE         0     /* full decode                                               */
+#define SHED_FINGERPRINTS 1     /* no more OS fingerprints of the hosts nor payload scans    */
+#define SHED_HOSTS_L4     2     /* hosts are counted only up to IP (not by TCP, UDP, ...)    */
+#define SHED_SAMPLING     3     /* 1 frame out of SHED_SAMPLE is decoded (SHED_SAMPLE^2 ...) */
+#define SHED_MAX          5     /* the last step                                             */
+#define SHED_SAMPLE       10    /* sampling rate of the first sampling step                  */
+#define SHED_LAG          1000  /* msecs frames may wait in the kernel besides the timeout   */
+#define SHED_CALM         10    /* secs without drops nor lag before stepping back           */
+
+/* The application protocols told by the first bytes of the payload of a conversation (see payload.c) */
+#define APP_NONE          0     /* not told (yet), the well-known ports are looked at        */
+#define APP_HTTP          1
+#define APP_TLS           2
+#define APP_SSH           3
+#define APP_SMTP          4
+#define APP_IMAP          5
+#define APP_POP           6
+#define APP_DNS           7
+#define PAYLOAD_FLOWS     65536 /* slots of the table of the conversations (a power of 2)    */
+#define PAYLOAD_TRIES     4     /* segments with a payload looked at foreach conversation    */
+#define PAYLOAD_SCAN      64    /* bytes of the payload looked at                            */
+
+/* Size of the stdout buffer used for tables rendering */
+#define RENDER_BUFSIZE   (256 * 1024)
+
+/* The capture daemon and its binary protocol over a Unix socket (both ends run on the same box) */
+#define PKSHD_RUNDIR     "/run/pkshd"   /* owned by the system-wide daemon       */
+#define PKSHD_SOCKNAME   "pkshd.socket"
+#define PKSHD_MAGIC      0x504b5348   /* 'PKSH'                               */
+#define PKSHD_VERSION    1
+#define PKSHD_PAGE       4096         /* max # of hosts in a reply            */
+#define PKSHD_MAXMSG     (64 * 1024 * 1024)
+
+/* The exposition of the counters in the Prometheus text format (see pkmetrics) */
+#define METRICS_PORT     "9731"       /* loopback port served by default      */
+#define METRICS_HEAD     10           /* # of busiest hosts per interface     */
+#define METRICS_INTERVAL 1            /* lifetime in seconds of a page        */
+
 /* Characters for tables rendering */
 #define COL_BEGIN        '|'
 #define COL_SEP          ' '
@@ -103,11 +172,123 @@ typedef struct
 } pksh_cmd_t;
 
 
+/* A node of the prefix trie of the hosts identifiers (the children are kept in a list) */
+typedef struct trie
+{
+  struct trie * child;          /* first child                                   */
+  struct trie * sibling;        /* next child of the same parent                 */
+  char c;                       /* the character of the identifier at this depth */
+  bool key;                     /* an identifier ends here                       */
+
+} trie_t;
+
+
+/* The header of a record of a pcap file (also used by the in-memory queues of frames, where records are 8-byte aligned) */
+typedef struct
+{
+  uint32_t sec;
+  uint32_t usec;
+  uint32_t caplen;
+  uint32_t len;
+
+} rechdr_t;
+
+#define RECALIGN(n)  (((n) + 7) & ~7UL)
+
+
+/* The recorder of the frames captured on an interface into rotating pcap/pcapng files */
+typedef struct
+{
+  /* Settings */
+  char * path;                  /* the file (the rotated files are path.0, path.1, ...)   */
+  unsigned long limit;          /* rotate when a file gets this size (0 means never)       */
+  unsigned seconds;             /* rotate when a file gets this old (0 means never)        */
+  unsigned files;               /* # of rotated files kept (0 means all)                   */
+  bool pcapng;                  /* write pcapng rather than pcap                           */
+  int linktype;                 /* the data-link of the files                              */
+  int snaplen;                  /* the snapshot length of the files                        */
+
+  /* The single-producer single-consumer queue from the sniffer to the writer */
+  u_char * queue;               /* records of a pcap record header followed by the frame   */
+  size_t qsize;                 /* a power of two                                          */
+  unsigned long head;           /* next byte written by the sniffer                        */
+  unsigned long tail;           /* next byte read by the writer                            */
+
+  /* The writer thread */
+  pthread_t tid;
+  bool stop;                    /* the recorder has been asked to stop                     */
+  bool detached;                /* the sniffer no longer references the recorder           */
+  int fd;                       /* the current file                                        */
+  bool direct;                  /* the file was opened with O_DIRECT                       */
+  unsigned fileno;              /* # of the current file                                   */
+  time_t opened;                /* time the current file was opened                        */
+  unsigned long filebytes;      /* bytes written to the current file                       */
+  u_char * batch;               /* aligned buffer of the next write                        */
+  size_t batchlen;              /* bytes in the buffer                                     */
+
+  /* Statistics */
+  counter_t pkts;               /* frames handed to the writer                             */
+  counter_t dropped;            /* frames dropped because the queue was full               */
+  counter_t written;            /* bytes written to disk                                   */
+  unsigned rotated;             /* # of files completed                                    */
+  unsigned errors;              /* # of failed writes                                      */
+
+} recorder_t;
+
+
+/* The in-memory ring of the last frames captured on an interface (preallocated, the oldest frames are overwritten) */
+typedef struct
+{
+  u_char * buf;                 /* records of a numbered pcap record header and the frame  */
+  size_t size;                  /* a power of two (rounded down from the size asked for)   */
+  unsigned long head;           /* next byte written by the sniffer                        */
+  unsigned long tail;           /* first byte of the oldest record                         */
+
+  bool stop;                    /* the ring has been asked to go away                      */
+  bool detached;                /* the sniffer no longer references the ring               */
+
+  /* Statistics */
+  counter_t pkts;               /* frames stored                                           */
+  counter_t overwritten;        /* frames overwritten by newer ones                        */
+  counter_t dropped;            /* frames larger than the whole ring                       */
+
+} ring_t;
+
+
+/* The counters of a VLAN (in the dense table of an interface indexed by the VLAN identifier) */
+typedef struct
+{
+  counter_t bytes;
+  counter_t pkts;
+
+} vlan_t;
+
+
+/* A conversation in the table of an interface (both directions in the same slot, the last seen wins) */
+typedef struct
+{
+  uint64_t key;                 /* hash of the addresses, ports and protocol (0 if free)  */
+  uint8_t app;                  /* the application protocol told so far (APP_NONE)        */
+  uint8_t tries;                /* # of segments with a payload looked at                 */
+
+} flow_t;
+
+
+/* The counters of a device seen by the 'any' device (in the table of the interface indexed by the interface index) */
+typedef struct
+{
+  counter_t bytes;
+  counter_t pkts;
+
+} ifindex_t;
+
+
 /* All that is needed to handle a pcap-aware interface */
 typedef struct
 {
   char * name;                  /* interface name (eg. eth0)                              */
   int status;                   /* the status of the interface                            */
+  bool remote;                  /* a read-only mirror of an interface served by pkshd     */
 
   /* pcap related */
   int snapshot;                 /* maximum # of bytes to capture foreach pkt              */
@@ -126,6 +307,11 @@ typedef struct
   uint32_t networkbin;          /* network address (in host binary format)                */
   uint32_t broadcastbin;        /* broadcast address (in host binary format)              */
 
+  /* The IPv6 prefixes of the interface (link-local addresses are always local) */
+  struct in6_addr ip6prefix [IP6_PREFIXES];  /* the prefixes (with the host bits zeroed) */
+  u_char ip6prefixlen [IP6_PREFIXES];        /* their length in bits                     */
+  unsigned ip6prefixes;                      /* # of prefixes                            */
+
   /* Interface identifiers for humans */
   char * hwaddr;                /* HW address (resolved for humans)                       */
   char * ipaddr;                /* IP address (in dot notation xxx.xxx.xxx.xxx)           */
@@ -136,6 +322,44 @@ typedef struct
   int mtu;                      /* Maximum transmit unit                                  */
 
   pthread_t tid;                /* unique identifier of thread dedicated sniffer          */
+  time_t lasttick;              /* time the rate tick last run over the hosts cache       */
+  pkshm_header_t * shm;         /* the shared memory segment the counters are exported to */
+  size_t shmsize;               /* its size in bytes                                      */
+  recorder_t * recorder;        /* the recorder of the captured frames (if any)           */
+  ring_t * ring;                /* the ring of the last captured frames (if any)          */
+
+  /* VLANs */
+  vlan_t * vlans;               /* counters foreach VLAN identifier (VLAN_IDS, if tagged) */
+  bool vlankeys;                /* keep apart the same address seen in different VLANs    */
+  int vlan;                     /* VLAN of the frame being decoded (0 if untagged)        */
+
+  /* The devices seen by the 'any' device */
+  ifindex_t * ifindexes [IFINDEX_CHUNKS];  /* counters foreach interface index            */
+  unsigned ifindexmax;          /* the highest interface index seen + 1                   */
+  unsigned ifindex;             /* interface index of the frame being decoded (0 if none) */
+
+  /* The IP packet being decoded is a fragment (its upper-layer checksum cannot be verified) */
+  bool fragment;
+
+  /* The conversations whose application protocol is being told by the payload (PAYLOAD_FLOWS, see payload.c) */
+  flow_t * flows;
+
+  /* 1-in-N sampling (see sample.c) */
+  counter_t weight;             /* # of frames each decoded frame stands for (1 if none)  */
+  uint64_t samplernd;           /* state of the random selection done by the sniffer      */
+
+  /* Overload shedding (see shed.c) */
+  bool shed;                    /* shed work when the sniffer falls behind the kernel     */
+  unsigned shedsample;          /* 1 frame out of 'shedsample' is taken (0 if none)       */
+  unsigned long shedseq;        /* # of frames the selection above has been run on        */
+  unsigned shedcalm;            /* # of ticks in a row without drops nor lag              */
+  counter_t sheddrops;          /* # of frames dropped by the kernel at the last tick     */
+  long shedlag;                 /* age in msecs of the last frame read at the last tick   */
+
+  /* The 32-bit counters of the capture library at the last sample (see accttick) */
+  u_int pcaprecv;
+  u_int pcapdrop;
+  u_int pcapifdrop;
 
   /* Time */
   struct timeval started;       /* time interface was enabled to look at pkts             */
@@ -144,8 +368,19 @@ typedef struct
 
   struct hash_table hwnames;    /* the hash table with all viewed interface identifiers   */
   struct hash_table ipnames;    /* the hash table with all viewed IP addresses            */
+  struct hash_table ip6names;   /* the hash table with all viewed IPv6 addresses (binary) */
   struct hash_table hostnames;  /* the hash table with all viewed hostnames               */
 
+  /* The registry of hosts (each host once, indexed by its identifier) */
+  struct host * chunks [HOSTS_CHUNKS];  /* chunks of HOSTS_CHUNK contiguous hosts          */
+  unsigned hostno;              /* # of hosts in the cache (that is the next identifier)  */
+  unsigned hostno_local;        /* # of hosts known by their HW address                   */
+  unsigned hostno_foreign;      /* # of hosts known only by their IP address              */
+  counter_t hostsmissed;        /* # of times a new host was not cached (registry full)   */
+
+  /* The index of all the hosts identifiers for TAB-completion and globbing */
+  trie_t names;                 /* root of the prefix trie of HW/IP addresses and names   */
+
   /* Bytes and Packets counters */
   int shortest;
   int longest;
@@ -228,6 +463,66 @@ typedef struct
   counter_t bytes_smtp;
   counter_t pkts_smtp;
 
+  /* IPv6 counters (IPv6 packets are also counted as IP) */
+  counter_t headers_ip6;        /* length in bytes of IPv6 headers (and extension headers) */
+  counter_t bytes_ip6;          /* length in bytes of IPv6 data (including headers)       */
+  counter_t pkts_ip6;           /* total # of IPv6 packets received from data-link layer  */
+
+  /* 802.1Q/802.1ad tagged frames counters */
+  counter_t bytes_vlan;         /* length in bytes of tagged frames                       */
+  counter_t pkts_vlan;          /* total # of tagged frames                               */
+  counter_t pkts_qinq;          /* total # of frames with more than one tag (QinQ)        */
+
+  /* 1-in-N sampling (the counters above are estimates when 'sampling' is set) */
+  counter_t pkts_seen;          /* # of frames read by the sniffer                        */
+  counter_t pkts_decoded;       /* # of frames decoded (those in the sample)              */
+  unsigned sampling;            /* 1 frame out of 'sampling' is decoded (0 if none)       */
+  bool samplerandom;            /* frames are sampled at random rather than every N-th    */
+  bool samplekernel;            /* the kernel selects the frames ahead of the filter      */
+  unsigned shedding;            /* current step of the overload shedding (SHED_NONE)      */
+
+  /* Copy bandwidth (what the kernel copies to the sniffer against what is on the wire) */
+  counter_t bytes_seen;         /* length in bytes of the frames read by the sniffer      */
+  counter_t bytes_captured;     /* length in bytes of their portion copied (caplen)       */
+  bool headersonly;             /* the snapshot is just the headers the decoders look at  */
+
+  /* The time base of the hosts cache (first/last seen, idle, rate tick) */
+  struct timeval clock;         /* capture time of the last frame read (coarse when idle) */
+
+  /* Where the frames have gone, sampled all at once by the sniffer every second (see accttick) */
+  counter_t acct_recv;          /* # of frames received by the kernel (drops included)    */
+  counter_t acct_drop;          /* # of frames dropped by the kernel (buffer full)        */
+  counter_t acct_ifdrop;        /* # of frames dropped by the interface (driver/NIC)      */
+  counter_t acct_queued;        /* # of frames still queued in the kernel buffer          */
+  counter_t acct_read;          /* # of frames read by the sniffer                        */
+  counter_t acct_decoded;       /* # of frames decoded (the others are skipped)           */
+  counter_t acct_userdrop;      /* # of frames dropped by the recorder queue and the ring */
+  time_t acct_time;             /* time of the sample (0 if never taken)                  */
+
+  /* Damaged and fragmented IP packets (checksums are verified only when asked, see checksum.c) */
+  bool checksums;               /* verify the IP, TCP and UDP checksums                   */
+  counter_t pkts_ip_badsum;     /* # of IPv4 packets with a bad header checksum           */
+  counter_t pkts_tcp_badsum;    /* # of TCP segments with a bad checksum                  */
+  counter_t pkts_udp_badsum;    /* # of UDP datagrams with a bad checksum                 */
+  counter_t pkts_unverified;    /* # of TCP/UDP packets whose checksum cannot be verified */
+  counter_t pkts_ip_fragments;  /* # of IP fragments (IPv4 and IPv6)                      */
+  counter_t pkts_malformed;     /* # of IP packets with a malformed IP, TCP or UDP header */
+
+  /* Application protocols told by the payload (HTTP and SMTP are counted above, also by port) */
+  bool payload;                 /* look at the payload rather than only at the ports      */
+  counter_t pkts_scanned;       /* # of payloads looked at for a signature                */
+  counter_t pkts_identified;    /* # of them that told the application protocol           */
+  counter_t bytes_tls;          /* TLS over TCP (counted in Other TCP too)                */
+  counter_t pkts_tls;
+  counter_t bytes_ssh;          /* SSH over TCP (counted in Other TCP too)                */
+  counter_t pkts_ssh;
+  counter_t bytes_imap;         /* IMAP over TCP (counted in Other TCP too)               */
+  counter_t pkts_imap;
+  counter_t bytes_pop;          /* POP3 over TCP (counted in Other TCP too)               */
+  counter_t pkts_pop;
+  counter_t bytes_dns;          /* DNS over UDP                                           */
+  counter_t pkts_dns;
+
 } interface_t;
 
 
@@ -242,16 +537,40 @@ typedef struct
 } header_t;
 
 
-/* Define a host (all pointers to hash table items are simply referenced rather than locally copied) */
+/*
+ * Compact traffic history of a host.
+ * Each bucket pairs the bytes, coded as an 8-bit minifloat, with the mean size of
+ * its packets, coded in 4 bits (see history.c), so that 24 hours of per-minute and
+ * per-hour bytes and packets cost 144 bytes per host
+ */
 typedef struct
+{
+  uint64_t bytes;                         /* # of bytes accumulated during the current minute   */
+  uint32_t pkts;                          /* # of packets accumulated during the current minute */
+  uint32_t minute;                        /* the minute (since the Epoch) currently being filled */
+
+  uint8_t mbytes [HISTORY_MINUTES];       /* coded # of bytes foreach minute of the last hour    */
+  uint8_t hbytes [HISTORY_HOURS];         /* coded # of KBytes foreach hour of the last day      */
+  uint8_t msizes [HISTORY_MINUTES / 2];   /* coded mean packet size foreach minute (2 per byte)  */
+  uint8_t hsizes [HISTORY_HOURS / 2];     /* coded mean packet size foreach hour (2 per byte)    */
+
+} history_t;
+
+
+/* Define a host (all pointers to hash table items are simply referenced rather than locally copied) */
+typedef struct host
 {
   interface_t * intf;             /* reference to interface used to send/recv packets      */
+  unsigned id;                    /* dense identifier in the registry of the interface     */
+  int vlan;                       /* VLAN in the keys of the host (0 if none)              */
+  unsigned ifindex;               /* interface index it was first seen on ('any' device)   */
 
   struct timeval first;           /* time it was first seen                                */
   struct timeval last;            /* time it was last seen                                 */
 
   /* Interface identifiers for fast host addresses computation */
   struct in_addr ip;              /* internet address (in host binary format)              */  /* FIXME: should be removed? */
+  struct in6_addr ip6;            /* IPv6 address (when it is the address for humans)      */
 
   /* Interface identifiers for humans */
   char * hwaddress;               /* hw address human readable (xx:xx:xx:xx:xx:xx)         */
@@ -363,6 +682,11 @@ typedef struct
   counter_t pkts_smtp_recv;      /* tot # of SMTP packets received from the interface      */
   counter_t pkts_other_tcp_recv; /* tot # of Other-TCP packets received from the interface */
 
+  /* Damaged and fragmented packets sent (see checksum.c) */
+  counter_t pkts_badsum_sent;     /* tot # of packets sent with a bad IP/TCP/UDP checksum  */
+  counter_t pkts_fragments_sent;  /* tot # of IP fragments sent                            */
+  counter_t pkts_malformed_sent;  /* tot # of packets sent with a malformed TCP/UDP header */
+
   /* Throughput */
   int bytes_current;
   int bytes_average;
@@ -372,9 +696,139 @@ typedef struct
   int pkts_average;
   int pkts_peak;
 
+  /* Counters as seen by the previous rate tick */
+  counter_t bytes_tick;
+  counter_t pkts_tick;
+
+  /* Traffic distribution by minute/hour */
+  history_t history;
+
 } host_t;
 
 
+/* A column of a table compiled from its GNU-style specification (see colplan() in render.c) */
+typedef struct
+{
+  int code;                                   /* the formatting option code        */
+  char * label;                               /* the rendered title or the argument */
+  int width;                                  /* fixed width (0 if natural)         */
+  void (* print) (host_t * h);                /* formatter                          */
+  void (* lprint) (host_t * h, char * label); /* formatter with a width argument    */
+  bool unknown;                               /* not a formatting option at all     */
+
+} column_t;
+
+
+/* The plan to render the rows of a table */
+typedef struct
+{
+  int n;              /* # of columns          */
+  column_t * columns; /* the columns, in order */
+  char fsep;          /* field separator       */
+  char * name;        /* argv [0] of the specification, for errors */
+
+} colplan_t;
+
+
+/* The phases of the viewers, from the hosts cache to the rendered table */
+typedef enum
+{
+  VIEW_ENUMERATE,     /* all the hosts of the cache                     */
+  VIEW_FILTER,        /* only those to display according to the options */
+  VIEW_SORT,          /* in the order they have to be rendered          */
+  VIEW_RENDER,        /* the table                                      */
+  VIEW_DONE,
+  VIEW_PHASES
+
+} viewphase_t;
+
+
+/* Messages of the pkshd protocol */
+enum
+{
+  PKSHD_HELLO  = 1,  /* check both ends share the same layout of the data    */
+  PKSHD_STATUS = 2,  /* the interfaces with their counters                   */
+  PKSHD_HOSTS  = 3,  /* a page of the hosts cache of an interface            */
+  PKSHD_ERROR  = 4,  /* the request was not understood                       */
+};
+
+
+/* The header of each message, the 'length' bytes of payload follow */
+typedef struct
+{
+  uint32_t magic;
+  uint16_t type;
+  uint16_t version;
+  uint32_t length;
+  uint32_t arg;                   /* # of records in the payload of a reply */
+
+} pkshd_msg_t;
+
+
+/* An interface on the wire, the counters of the interface_t follow as they are */
+typedef struct
+{
+  char name [32];
+  char hwaddr [18];
+  char ipaddr [16];
+  char network [16];
+  char netmask [16];
+  char broadcast [16];
+  char hostname [128];
+  int32_t datalink;
+  int32_t snapshot;
+  int32_t promiscuous;
+  int32_t mtu;
+  uint32_t ipbin;
+  uint32_t netmaskbin;
+  uint32_t networkbin;
+  uint32_t broadcastbin;
+  uint32_t hostno;
+  struct timeval started;
+  struct timeval firstpkt;
+  struct timeval lastpkt;
+
+} pkshd_intf_t;
+
+
+/* A request for a page of hosts */
+typedef struct
+{
+  char name [32];                 /* the interface                                     */
+  uint32_t first;                 /* first identifier of the page                      */
+  uint32_t known;                 /* hosts below this identifier are already known...  */
+  int64_t since;                  /* ...so they are skipped when idle since this time  */
+
+} pkshd_query_t;
+
+
+/* The header of a page of hosts */
+typedef struct
+{
+  uint32_t next;                  /* first identifier of the next page             */
+  uint32_t hostno;                /* # of hosts in the cache                       */
+  int64_t now;                    /* the clock of the daemon                       */
+
+} pkshd_page_t;
+
+
+/*
+ * A host on the wire, the counters of the host_t follow as they are and then
+ * the strings (hwaddress, vendor, ipaddr, hostname, system) each 'len' bytes long
+ */
+typedef struct
+{
+  uint32_t id;
+  uint16_t len [5];               /* including the trailing '\0' (0 means NULL) */
+  struct timeval first;
+  struct timeval last;
+  struct in_addr ip;
+  uint16_t vlan;                  /* VLAN in the keys of the host (0 if none)   */
+  char fingerprint [FPLEN];
+
+} pkshd_host_t;
+
+
 /* Define a counter function */
 typedef void cf (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
 
@@ -414,12 +868,17 @@ extern pksh_run_t pksh_run;
 /* Public variables in file interface.c */
 extern interface_t ** interfaces;
 
+/* Public variables in file render.c */
+extern bool viewtiming;
+extern uint64_t viewclock [VIEW_PHASES];
+
 
 /* === Helpers === */
 extern pksh_cmd_t cmd_help;
 extern pksh_cmd_t cmd_about;
 extern pksh_cmd_t cmd_version;
 extern pksh_cmd_t cmd_license;
+extern pksh_cmd_t cmd_complete;
 
 
 /* === Network Interfaces === */
@@ -431,6 +890,9 @@ extern pksh_cmd_t cmd_status;
 extern pksh_cmd_t cmd_uptime;
 extern pksh_cmd_t cmd_filter;
 extern pksh_cmd_t cmd_swap;
+extern pksh_cmd_t cmd_attach;
+extern pksh_cmd_t cmd_metrics;
+extern pksh_cmd_t cmd_dump;
 
 /* === Viewers === */
 extern pksh_cmd_t cmd_packets;
@@ -440,6 +902,7 @@ extern pksh_cmd_t cmd_arp;
 extern pksh_cmd_t cmd_finger;
 extern pksh_cmd_t cmd_last;
 extern pksh_cmd_t cmd_who;
+extern pksh_cmd_t cmd_vlans;
 extern pksh_cmd_t cmd_protocols;
 extern pksh_cmd_t cmd_services;
 extern pksh_cmd_t cmd_throughput;
@@ -450,15 +913,74 @@ extern pksh_cmd_t cmd_throughput;
 /* Public functions in file cache.c */
 int hargslen (host_t * argv []);
 host_t ** hargsadd (host_t * argv [], host_t * h);
+host_t * hostbyid (interface_t * intf, unsigned id);
+host_t * hostfirst (interface_t * intf);
+host_t * hostnext (host_t * h);
 host_t ** hostsall (interface_t * intf);
 char ** hostskeys (interface_t * intf);
-int hostnolocal (host_t * hosts []);
-int hostnoforeign (host_t * hosts []);
 host_t * hostbykey (interface_t * intf, char * key);
-host_t * addtohwnames (interface_t * intf, char * key);
-host_t * addtoipnames (interface_t * intf, char * key);
-host_t * bindtoipnames (interface_t * intf, char * ipaddr, host_t * h);
+host_t * addtohwnames (interface_t * intf, char * key, int vlan);
+host_t * addtoipnames (interface_t * intf, char * key, int vlan);
+host_t * bindtoipnames (interface_t * intf, char * ipaddr, int vlan, host_t * h);
 host_t * bindtohostnames (interface_t * intf, char * hostname, host_t * h);
+unsigned long hash_ip6 (char * key);
+host_t * addtoip6names (interface_t * intf, struct in6_addr * addr, int vlan);
+host_t * bindtoip6names (interface_t * intf, struct in6_addr * addr, int vlan, host_t * h);
+
+/* Public functions in file trie.c */
+bool trieadd (trie_t * root, char * key);
+char ** trieprefix (trie_t * root, char * prefix);
+char ** triematch (trie_t * root, char * pattern);
+void triefree (trie_t * root);
+
+/* Public functions in file remote.c */
+void pkshdserve (int fd);
+char * pkshdsocket (bool listening);
+int remoteattach (char * path);
+void remotedetach (void);
+bool remoteattached (void);
+void remoterefresh (void);
+
+/* Public functions in file shm.c */
+int shmexport (interface_t * intf, unsigned capacity);
+void shmtick (interface_t * intf, time_t now);
+void shmunexport (interface_t * intf);
+
+/* Public functions in file prometheus.c */
+int metricsstart (char * addr, int busiest, int lifetime);
+void metricsstop (void);
+char * metricswhere (void);
+unsigned long metricsscrapes (void);
+
+/* Public functions in file recorder.c */
+recorder_t * recstart (interface_t * intf, char * path, unsigned long limit, unsigned seconds, unsigned files, bool pcapng, size_t qsize);
+void recstop (interface_t * intf);
+void recpkt (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
+
+/* Public functions in file ring.c */
+ring_t * ringstart (interface_t * intf, size_t size);
+void ringstop (interface_t * intf);
+void ringpkt (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
+void ringspan (ring_t * r, unsigned long * pkts, time_t * first, time_t * last);
+int ringsave (interface_t * intf, char * path, unsigned seconds, size_t bytes, unsigned long * saved, unsigned long * lost);
+
+/* Public functions in file sample.c */
+void samplestart (interface_t * intf, unsigned n, bool random);
+int samplesetfilter (interface_t * intf, struct bpf_program * prog);
+bool sampled (interface_t * intf);
+void samplenote (interface_t * intf);
+
+/* Public functions in file shed.c */
+void shedstart (interface_t * intf, bool enable);
+void shedtick (interface_t * intf, struct timeval * ts);
+unsigned shedsampling (unsigned level);
+char * shedname (unsigned level);
+
+/* Public functions in file history.c */
+void histtick (interface_t * intf, time_t now);
+void histminutes (history_t * hist, counter_t bytes [], counter_t pkts []);
+void histhours (history_t * hist, counter_t bytes [], counter_t pkts []);
+counter_t histlasthour (history_t * hist);
 
 /* === Containers === */
 
@@ -476,18 +998,30 @@ interface_t * lastestintf (void);
 void setactiveintf (interface_t * current);
 void resetactiveintf (interface_t * intf);
 char * getintfname (void);
+void intflock (void);
+void intfunlock (void);
 int intflen (interface_t * argv []);
 interface_t ** intfadd (interface_t * argv [], char * name, int snapshot, int promiscuous, int timeout, char * filter, pcap_t * pcap, interface_t ** more);
 interface_t ** intfsub (interface_t * argv [], char * name);
+interface_t ** intfremote (interface_t * argv [], char * name, interface_t ** more);
 void intfclean (interface_t * argv []);
 interface_t * intfbyname (interface_t * argv [], char * name);
 counter_t intfbytes (interface_t * argv []);
 counter_t intfpkts (interface_t * argv []);
+void accttick (interface_t * intf);
 
 /* Public functions in file render.c */
+void renderinit (void);
+void renderflush (void);
+void viewphase (viewphase_t phase);
+char * percentage_r (counter_t partial, counter_t total, char * str, size_t size);
+char * fmtbytes_r (counter_t bytes, char * str, size_t size);
+char * fmtpkts_r (counter_t pkts, char * str, size_t size);
+char * throughputfmt_r (float bytes, char * str, size_t size);
 char * percentage (counter_t partial, counter_t total);
 char * fmtbytes (counter_t bytes);
 char * fmtpkts (counter_t pkts);
+char * throughputfmt (float bytes);
 int hostlocal (host_t * h);
 int hostipless (host_t * h);
 int hostunresolved (host_t * h);
@@ -500,7 +1034,11 @@ void bytes_distribution (host_t * h);
 void packets_distribution (host_t * h);
 void protocols_distribution (host_t * h);
 void tcp_protocols_distribution (host_t * h);
+void bytes_all_by_hour (host_t * h);
 int hostlongest (host_t * argv [], int numeric);
+colplan_t * colplan (int argc, char * argv [], char fsep);
+void colprintf (colplan_t * plan, host_t * h);
+void colfree (colplan_t * plan);
 void hostprintf (host_t * h, int argc, char * argv [], char fsep);
 
 /* Public functions in file glob.c */
@@ -511,10 +1049,14 @@ int multicast (char * addr);
 char * mactoa (u_char * e);
 void ethernet (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
 void loopback (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
+void sll (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
+void sll2 (interface_t * intf, struct pcap_pkthdr * h, const u_char * p);
+unsigned headerslen (int datalink);
 
 /* Public functions in file decoders.c */
 void resolvvendorname (host_t * h);
 void ip (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
+void ip6 (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
 void arp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
 void rarp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
 void icmp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
@@ -523,6 +1065,25 @@ void udp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t
 void http (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
 void smtp (interface_t * intf, header_t * h, u_char * p, host_t * srchost, host_t * dsthost);
 
+/* Public functions in file checksum.c */
+uint16_t cksum (const void * p, size_t len, uint32_t sum);
+uint16_t cksumscalar (const void * p, size_t len, uint32_t sum);
+char * cksumname (void);
+bool ipsumok (struct ip * ip);
+int l4sumok (interface_t * intf, header_t * h, u_char * p, int proto);
+
+/* Public functions in file payload.c */
+void payloadinit (void);
+unsigned payloadscan (const u_char * p, unsigned caplen, int proto);
+unsigned payloadscanscalar (const u_char * p, unsigned caplen, int proto);
+unsigned payloadapp (interface_t * intf, const u_char * iph, const u_char * l4, int proto, header_t * h, u_char * p);
+char * appname (unsigned app);
+
+/* Public functions in file resolve.c */
+void resolvqueue (host_t * h);
+void resolvdrain (interface_t * intf);
+void resolvforget (interface_t * intf);
+
 /* Public functions in file sort.c */
 int sort_by_hwaddr (const void * _a, const void * _b);
 int sort_by_ip (const void * _a, const void * _b);
@@ -593,6 +1154,8 @@ int sort_by_other_ip_pkts_recv (const void * _a, const void * _b);
 int sort_by_current_pkts_all (const void * _a, const void * _b);
 int sort_by_average_pkts_all (const void * _a, const void * _b);
 int sort_by_peak_pkts_all (const void * _a, const void * _b);
+int hostsort (host_t * argv [], int n, sf * howtosort, bool reverse, int head);
+int hostshead (char * arg);
 
 int sort_by_ip_bytes_all (const void * _a, const void * _b);
 int sort_by_http_bytes_all (const void * _a, const void * _b);
@@ -626,6 +1189,7 @@ void pksh_init (char * progname, int quiet);
 
 /* Public functions in file prompt.c */
 void pksh_prompt (char * interface);
+void pksh_prompt_refresh (void);
 
 
 /* === Helpers === */
@@ -649,6 +1213,9 @@ int pksh_version (int argc, char * argv []);
 /* Public functions in file license.c */
 int pksh_license (int argc, char * argv []);
 
+/* Public functions in file complete.c */
+int pksh_pkcomplete (int argc, char * argv []);
+
 
 /* === Network Interfaces === */
 
@@ -676,6 +1243,15 @@ int pksh_pkfilter (int argc, char * argv []);
 /* Public functions in file swap.c */
 int pksh_pkswap (int argc, char * argv []);
 
+/* Public functions in file attach.c */
+int pksh_pkattach (int argc, char * argv []);
+
+/* Public functions in file metrics.c */
+int pksh_pkmetrics (int argc, char * argv []);
+
+/* Public functions in file dump.c */
+int pksh_pkdump (int argc, char * argv []);
+
 
 /* === Viewers === */
 
@@ -709,6 +1285,9 @@ int pksh_pklast (int argc, char * argv []);
 /* Public functions in file who.c */
 int pksh_pkwho (int argc, char * argv []);
 
+/* Public functions in file vlans.c */
+int pksh_pkvlans (int argc, char * argv []);
+
 
 /*
  * -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=
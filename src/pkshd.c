@@ -0,0 +1,352 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * The capture daemon: it owns the interfaces, their sniffers and caches
+ * and serves them over a Unix socket to any number of shells (see pkattach)
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <syslog.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* Inline sources */
+#include "missing.c"
+
+
+/* Identifiers */
+#define NAME         "pkshd"
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  OPT_SOCKET      = 's',
+  OPT_FOREGROUND  = 'f',
+  OPT_SHM         = 'm',
+  OPT_METRICS     = 'M',
+  OPT_VLANKEYS    = 'V',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  { "socket",        required_argument, NULL, OPT_SOCKET      },
+  { "foreground",    no_argument,       NULL, OPT_FOREGROUND  },
+  { "shm",           no_argument,       NULL, OPT_SHM         },
+  { "metrics",       required_argument, NULL, OPT_METRICS     },
+  { "vlan-keys",     no_argument,       NULL, OPT_VLANKEYS    },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* Set when the daemon has been asked to terminate */
+static volatile sig_atomic_t leave = 0;
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' captures packets on the given interfaces and serves their hosts caches\n", progname);
+  printf ("     over a Unix socket to the shells attached with 'pkattach'\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] interface[,interface...]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s eth0                # capture on eth0 and listen on %s\n", progname, pkshdsocket (true));
+  printf ("   %s -f -s /tmp/s eth0   # stay in foreground and listen on /tmp/s\n", progname);
+  printf ("   %s -m eth0             # also export the counters of eth0 to shared memory\n", progname);
+  printf ("   %s -M %s eth0        # also serve /metrics on 127.0.0.1:%s\n", progname, METRICS_PORT, METRICS_PORT);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -q, --quiet                  run quietly\n");
+  printf ("   -s, --socket path            listen on 'path' in a directory owned by the daemon (default %s)\n", pkshdsocket (true));
+  printf ("   -f, --foreground             do not detach from the terminal\n");
+  printf ("   -m, --shm                    export the counters to shared memory (see pkshm-dump)\n");
+  printf ("   -M, --metrics port|socket    serve /metrics to Prometheus scrapers (see pkmetrics)\n");
+  printf ("   -V, --vlan-keys              keep apart the same address seen in different VLANs (as address%%vlan)\n");
+}
+
+
+/* Terminate gracefully */
+static void onsignal (int sig)
+{
+  leave = 1;
+}
+
+
+/* One thread per attached shell */
+static void * client (void * fd)
+{
+  sigset_t mask;
+
+  sigemptyset (& mask);
+  sigaddset (& mask, SIGINT);
+  sigaddset (& mask, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, & mask, NULL);
+
+  pkshdserve ((int) (intptr_t) fd);
+  close ((int) (intptr_t) fd);
+
+  return NULL;
+}
+
+
+/*
+ * The directory of the socket 'path' must belong to the daemon and be writable by no one else,
+ * otherwise another local user could take the path over and pose as the daemon (it is created if missing)
+ */
+static bool ownsdir (char * path)
+{
+  char * dir = strdup (path);
+  char * slash = dir ? strrchr (dir, '/') : NULL;
+  struct stat st;
+  bool ok;
+
+  if (! dir)
+    return false;
+  if (slash == dir)
+    slash [1] = '\0';
+  else if (slash)
+    * slash = '\0';
+  else
+    strcpy (dir, ".");
+
+  if (mkdir (dir, 0750) == -1 && errno != EEXIST)
+    {
+      free (dir);
+      return false;
+    }
+
+  ok = ! lstat (dir, & st) && S_ISDIR (st . st_mode) && st . st_uid == geteuid () && ! (st . st_mode & (S_IWGRP | S_IWOTH));
+  free (dir);
+  if (! ok)
+    errno = EPERM;
+
+  return ok;
+}
+
+
+/* Bind and listen on the Unix socket 'path' */
+static int listento (char * path)
+{
+  struct sockaddr_un addr;
+  mode_t mask;
+  int fd;
+  int rc;
+
+  memset (& addr, 0, sizeof (addr));
+  addr . sun_family = AF_UNIX;
+  if (strlen (path) >= sizeof (addr . sun_path))
+    {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+  strcpy (addr . sun_path, path);
+
+  if (! ownsdir (path))
+    return -1;
+
+  if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1)
+    return -1;
+
+  /* The socket is born with its final permissions (rw for the owner and the group), there is no window to connect */
+  unlink (path);
+  mask = umask (S_IXUSR | S_IXGRP | S_IRWXO);
+  rc = bind (fd, (struct sockaddr *) & addr, sizeof (addr));
+  umask (mask);
+  if (rc == -1 || listen (fd, 16) == -1)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+
+/* Enable packet capturing on 'name' by means of the same builtin used by the shell */
+static int enable (char * name, bool shm, bool vlankeys)
+{
+  char * argv [6] = { "pkenable", "-q" };
+  int argc = 2;
+
+  if (shm)
+    argv [argc ++] = "-m";
+  if (vlankeys)
+    argv [argc ++] = "--vlan-keys";
+  argv [argc ++] = name;
+  argv [argc]    = NULL;
+
+  return pksh_pkenable (argc, argv);
+}
+
+
+int main (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+  char * sopts    = optlegitimate (lopts);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  char * path     = pkshdsocket (true);
+  bool foreground = false;
+  bool shm        = false;
+  char * metrics  = NULL;
+  bool vlankeys   = false;
+
+  int option;
+
+  /* Local variables */
+  struct sigaction sa;
+  sigset_t mask;
+  char * names;
+  char * name;
+  char * ptrptr;
+  interface_t ** i;
+  int fd;
+
+  while ((option = getopt_long (argc, argv, sopts, lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:       usage (progname, lopts); return 0;
+	case OPT_QUIET:      quiet = true;            break;
+
+	case OPT_SOCKET:     path = optarg;           break;
+	case OPT_FOREGROUND: foreground = true;       break;
+	case OPT_SHM:        shm = true;              break;
+	case OPT_METRICS:    metrics = optarg;        break;
+	case OPT_VLANKEYS:   vlankeys = true;         break;
+	}
+    }
+
+  if (optind >= argc)
+    {
+      printf ("%s: missing interface(s)\n", progname);
+      printf ("Try '%s --help' for more information.\n", progname);
+      return 1;
+    }
+
+  /* The socket is created early, so errors are reported while still attached to the terminal */
+  if ((fd = listento (path)) == -1)
+    {
+      printf ("%s: cannot listen on %s (%s)\n", progname, path, strerror (errno));
+      return 1;
+    }
+
+  /* The sniffers are threads, so the daemon must be running before they are started */
+  if (! foreground && daemon (0, 0) == -1)
+    {
+      printf ("%s: cannot run in background (%s)\n", progname, strerror (errno));
+      return 1;
+    }
+  openlog (NAME, LOG_PID | (foreground ? LOG_PERROR : 0), LOG_DAEMON);
+
+  /* The sniffers inherit a mask which leaves the termination signals to the main thread */
+  sigemptyset (& mask);
+  sigaddset (& mask, SIGINT);
+  sigaddset (& mask, SIGTERM);
+  pthread_sigmask (SIG_BLOCK, & mask, NULL);
+
+  /* Open and enable all the requested interfaces */
+  names = strdup (argv [optind]);
+  for (name = strtok_r (names, ",", & ptrptr); name; name = strtok_r (NULL, ",", & ptrptr))
+    if (enable (name, shm, vlankeys))
+      syslog (LOG_ERR, "cannot capture packets on %s", name);
+  free (names);
+
+  if (! intflen (interfaces))
+    {
+      syslog (LOG_ERR, "no interface enabled, bye bye!");
+      unlink (path);
+      return 1;
+    }
+
+  /* The listener is a thread as well, so it is started by the daemon */
+  if (metrics)
+    {
+      char * margv [] = { "pkmetrics", "-q", metrics, NULL };
+
+      if (pksh_pkmetrics (3, margv))
+	syslog (LOG_ERR, "cannot serve /metrics on %s", metrics);
+    }
+
+  /* Terminate on request, and do not die on shells gone away while answering them */
+  memset (& sa, 0, sizeof (sa));
+  sa . sa_handler = onsignal;
+  sigaction (SIGINT, & sa, NULL);
+  sigaction (SIGTERM, & sa, NULL);
+  signal (SIGPIPE, SIG_IGN);
+  pthread_sigmask (SIG_UNBLOCK, & mask, NULL);
+
+  syslog (LOG_INFO, "listening on %s", path);
+
+  while (! leave)
+    {
+      pthread_t tid;
+      int cfd = accept (fd, NULL, NULL);
+
+      if (cfd == -1)
+	continue;
+
+      if (pthread_create (& tid, NULL, client, (void *) (intptr_t) cfd))
+	close (cfd);
+      else
+	pthread_detach (tid);
+    }
+
+  /* Withdraw the shared memory segments, the sniffers die with the process */
+  for (i = interfaces; i && * i; i ++)
+    if ((* i) -> shm)
+      {
+	char shmname [64];
+
+	snprintf (shmname, sizeof (shmname), "%s%s", PKSHM_PREFIX, (* i) -> name);
+	shm_unlink (shmname);
+      }
+
+  if (metricswhere ())
+    metricsstop ();
+
+  syslog (LOG_INFO, "bye bye!");
+
+  /* Bye bye! */
+  close (fd);
+  unlink (path);
+
+  return 0;
+}
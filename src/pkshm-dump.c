@@ -0,0 +1,267 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Dump the counters exported to shared memory by 'pkenable --shm'
+ *
+ * It only depends on pkshm.h, so it is also a reference for external readers:
+ * the segment is mapped once and then read with no syscalls at all.
+ */
+
+
+/* System headers */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Project header */
+#include "pkshm.h"
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  OPT_WATCH       = 'w',
+  OPT_HEAD        = 'n',
+  OPT_NOHOSTS     = 'i',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  { "watch",         required_argument, NULL, OPT_WATCH       },
+  { "head",          required_argument, NULL, OPT_HEAD        },
+  { "interface-only",no_argument,       NULL, OPT_NOHOSTS     },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' dumps the counters of an interface and its hosts exported to shared memory by 'pkenable --shm'\n", progname);
+
+  printf ("\n");
+  printf ("Usage: %s [options] interface\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s eth0                # dump the counters of eth0 (segment %seth0)\n", progname, PKSHM_PREFIX);
+  printf ("   %s -w 1 -n 10 eth0     # dump the first 10 hosts of eth0 every second\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help                   only show this help message\n");
+  printf ("   -q, --quiet                  run quietly\n");
+  printf ("   -w, --watch secs             dump again every 'secs' seconds\n");
+  printf ("   -n, --head N                 dump at most N hosts\n");
+  printf ("   -i, --interface-only         do not dump the hosts\n");
+}
+
+
+/* Map read-only the segment of 'name' (NULL and errno on failure) */
+static pkshm_header_t * attach (char * name, size_t * size)
+{
+  pkshm_header_t * shm;
+  char path [64];
+  struct stat st;
+  int fd;
+
+  snprintf (path, sizeof (path), "%s%s", PKSHM_PREFIX, name);
+  if ((fd = shm_open (path, O_RDONLY, 0)) == -1)
+    return NULL;
+
+  if (fstat (fd, & st) == -1 || st . st_size < (off_t) sizeof (pkshm_header_t))
+    {
+      close (fd);
+      errno = EINVAL;
+      return NULL;
+    }
+
+  shm = mmap (NULL, st . st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (shm == MAP_FAILED)
+    return NULL;
+
+  /* Refuse segments written with a different layout */
+  if (__atomic_load_n (& shm -> magic, __ATOMIC_ACQUIRE) != PKSHM_MAGIC || shm -> version != PKSHM_VERSION ||
+      shm -> headersize != sizeof (pkshm_header_t) || shm -> hostsize != sizeof (pkshm_host_t) ||
+      shm -> hostoff + (size_t) shm -> capacity * shm -> hostsize > (size_t) st . st_size)
+    {
+      munmap (shm, st . st_size);
+      errno = EPROTO;
+      return NULL;
+    }
+
+  * size = st . st_size;
+  return shm;
+}
+
+
+/* Take a consistent snapshot of the interface record (false if the writer died while updating it) */
+static bool readintf (pkshm_header_t * shm, pkshm_intf_t * copy)
+{
+  uint32_t seq;
+
+  do
+    {
+      seq = pkshm_read_begin (& shm -> intf . seq);
+      memcpy (copy, (void *) & shm -> intf, sizeof (* copy));
+    }
+  while (pkshm_read_retry (& shm -> intf . seq, seq));
+
+  return ! (seq & 1);
+}
+
+
+/* Take a consistent snapshot of a host record (false if not yet published or the writer died while updating it) */
+static bool readhost (pkshm_host_t * slot, pkshm_host_t * copy)
+{
+  uint32_t seq;
+
+  do
+    {
+      if (! (seq = pkshm_read_begin (& slot -> seq)))
+	return false;
+      memcpy (copy, (void *) slot, sizeof (* copy));
+    }
+  while (pkshm_read_retry (& slot -> seq, seq));
+
+  return ! (seq & 1);
+}
+
+
+/* Dump the whole segment */
+static void dump (pkshm_header_t * shm, unsigned head, bool hosts)
+{
+  pkshm_host_t * slots = (pkshm_host_t *) ((char *) shm + shm -> hostoff);
+  pkshm_intf_t intf;
+  pkshm_host_t h;
+  unsigned hostno;
+  unsigned i;
+
+  if (! readintf (shm, & intf))
+    {
+      printf ("%s: pid %d, the counters were left in the middle of an update\n", shm -> name, shm -> pid);
+      return;
+    }
+
+  printf ("%s: pid %d, updated %lld, %u hosts (%u slots, %u dropped)\n",
+	  shm -> name, shm -> pid, (long long) intf . updated, intf . hostno, shm -> capacity, shm -> dropped);
+  printf ("  %-12s %14s %16s\n", "", "Packets", "Bytes");
+  printf ("  %-12s %14llu %16llu\n", "Total",     (unsigned long long) intf . pkts_total,     (unsigned long long) intf . bytes_total);
+  printf ("  %-12s %14llu %16llu\n", "Broadcast", (unsigned long long) intf . pkts_broadcast, (unsigned long long) intf . bytes_broadcast);
+  printf ("  %-12s %14llu %16llu\n", "Multicast", (unsigned long long) intf . pkts_multicast, (unsigned long long) intf . bytes_multicast);
+  printf ("  %-12s %14llu %16llu\n", "IP",        (unsigned long long) intf . pkts_ip,        (unsigned long long) intf . bytes_ip);
+  printf ("  %-12s %14llu %16llu\n", "TCP",       (unsigned long long) intf . pkts_tcp,       (unsigned long long) intf . bytes_tcp);
+  printf ("  %-12s %14llu %16llu\n", "UDP",       (unsigned long long) intf . pkts_udp,       (unsigned long long) intf . bytes_udp);
+  printf ("  %-12s %14llu %16llu\n", "ICMP",      (unsigned long long) intf . pkts_icmp,      (unsigned long long) intf . bytes_icmp);
+  printf ("  %-12s %14llu %16llu\n", "Other-IP",  (unsigned long long) intf . pkts_other_ip,  (unsigned long long) intf . bytes_other_ip);
+  printf ("  %-12s %14llu %16llu\n", "ARP",       (unsigned long long) intf . pkts_arp,       (unsigned long long) intf . bytes_arp);
+  printf ("  %-12s %14llu %16llu\n", "RARP",      (unsigned long long) intf . pkts_rarp,      (unsigned long long) intf . bytes_rarp);
+  printf ("  %-12s %14llu %16llu\n", "Non-IP",    (unsigned long long) intf . pkts_non_ip,    (unsigned long long) intf . bytes_non_ip);
+
+  if (! hosts)
+    return;
+
+  printf ("\n");
+  printf ("%8s %-17s %-39s %12s %14s %12s %14s %10s\n",
+	  "Id", "HW Address", "IP Address", "Pkts Sent", "Bytes Sent", "Pkts Recv", "Bytes Recv", "Bytes/s");
+
+  hostno = __atomic_load_n (& shm -> hostno, __ATOMIC_ACQUIRE);
+  for (i = 0; i < hostno && (! head || i < head); i ++)
+    if (readhost (& slots [i], & h))
+      printf ("%8u %-17s %-39s %12llu %14llu %12llu %14llu %10u\n",
+	      h . id, h . hwaddr [0] ? h . hwaddr : "-", h . ipaddr [0] ? h . ipaddr : "-",
+	      (unsigned long long) h . pkts_sent, (unsigned long long) h . bytes_sent,
+	      (unsigned long long) h . pkts_recv, (unsigned long long) h . bytes_recv,
+	      h . bytes_current);
+}
+
+
+int main (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  unsigned watch  = 0;
+  unsigned head   = 0;
+  bool hosts      = true;
+
+  int option;
+
+  /* Local variables */
+  pkshm_header_t * shm;
+  size_t size;
+
+  while ((option = getopt_long (argc, argv, "hqw:n:i", lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:    usage (progname, lopts); return 0;
+	case OPT_QUIET:   quiet = true;            break;
+
+	case OPT_WATCH:   watch = atoi (optarg);   break;
+	case OPT_HEAD:    head = atoi (optarg);    break;
+	case OPT_NOHOSTS: hosts = false;           break;
+	}
+    }
+
+  if (optind >= argc)
+    {
+      printf ("%s: missing interface\n", progname);
+      printf ("Try '%s --help' for more information.\n", progname);
+      return 1;
+    }
+
+  if (! (shm = attach (argv [optind], & size)))
+    {
+      if (! quiet)
+	printf ("%s: cannot map the counters of %s (%s)\n", progname, argv [optind], strerror (errno));
+      return 1;
+    }
+
+  do
+    {
+      dump (shm, head, hosts);
+      if (watch)
+	{
+	  printf ("\n");
+	  fflush (stdout);
+	  sleep (watch);
+	}
+    }
+  while (watch);
+
+  /* Bye bye! */
+  munmap (shm, size);
+
+  return 0;
+}
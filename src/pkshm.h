@@ -0,0 +1,186 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Layout of the POSIX shared memory segment where the sniffer of an interface
+ * publishes its counters (see 'pkenable --shm' and 'pkshm-dump').
+ *
+ * This header is self-contained on purpose: external readers only need it.
+ *
+ * The segment is named PKSHM_PREFIX followed by the name of the interface
+ * (eg. "/pksh-eth0"), it can be read by the group of the writer only and
+ * it is laid out as:
+ *
+ *   +------------------+  offset 0
+ *   | pkshm_header_t   |  magic, version, sizes and the interface record
+ *   +------------------+  offset header . hostoff
+ *   | pkshm_host_t [0] |  one slot per host, indexed by the host identifier
+ *   | pkshm_host_t [1] |
+ *   | ...              |
+ *   +------------------+  header . capacity slots
+ *
+ * All the integers are in host byte order.  Records are updated once per
+ * second by the rate tick of the sniffer and each one is protected by its
+ * own sequence lock: the writer makes 'seq' odd, updates the record and then
+ * makes 'seq' even again.  A reader copies a record between two reads of
+ * 'seq' and retries when it was odd or it has changed in the meantime:
+ *
+ *   do
+ *     {
+ *       seq = pkshm_read_begin (& slot -> seq);
+ *       copy = * slot;
+ *     }
+ *   while (pkshm_read_retry (& slot -> seq, seq));
+ *
+ * A writer that dies in the middle of an update leaves 'seq' odd for good,
+ * so a reader waits PKSHM_SPINS reads of it at most and then gets an odd
+ * 'seq' back: the copy is then not consistent and has to be discarded.
+ *
+ * Slots below header . hostno are in use (with hosts never removed), a slot
+ * whose 'seq' is still 0 has not been published yet.
+ */
+
+
+#ifndef __PKSHM_H__
+#define __PKSHM_H__
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+
+/* Identifiers */
+#define PKSHM_MAGIC     0x4d534b50        /* 'PKSM'                          */
+#define PKSHM_VERSION   2
+#define PKSHM_PREFIX    "/pksh-"          /* name of the segment (+ interface) */
+#define PKSHM_HOSTS     65536             /* default # of host slots          */
+#define PKSHM_SPINS     (1 << 24)         /* reads of an odd 'seq' before giving up */
+
+
+/* The counters of the interface */
+typedef struct
+{
+  volatile uint32_t seq;       /* sequence lock                               */
+  uint32_t hostno;             /* # of hosts in the cache of the sniffer       */
+  int64_t updated;             /* time of the last update (secs since Epoch)   */
+  int64_t started;             /* time the capture was started                 */
+
+  uint64_t pkts_total;
+  uint64_t bytes_total;
+  uint64_t headers_total;
+  uint64_t pkts_other;         /* unsupported data-links                       */
+  uint64_t bytes_other;
+
+  uint64_t pkts_broadcast;
+  uint64_t bytes_broadcast;
+  uint64_t pkts_multicast;
+  uint64_t bytes_multicast;
+
+  uint64_t pkts_ip;
+  uint64_t bytes_ip;
+  uint64_t pkts_tcp;
+  uint64_t bytes_tcp;
+  uint64_t pkts_udp;
+  uint64_t bytes_udp;
+  uint64_t pkts_icmp;
+  uint64_t bytes_icmp;
+  uint64_t pkts_other_ip;
+  uint64_t bytes_other_ip;
+
+  uint64_t pkts_arp;
+  uint64_t bytes_arp;
+  uint64_t pkts_rarp;
+  uint64_t bytes_rarp;
+  uint64_t pkts_non_ip;
+  uint64_t bytes_non_ip;
+
+} pkshm_intf_t;
+
+
+/* The counters of a host */
+typedef struct
+{
+  volatile uint32_t seq;       /* sequence lock                               */
+  uint32_t id;                 /* host identifier (that is the slot index)     */
+  char hwaddr [18];            /* xx:xx:xx:xx:xx:xx (empty if unknown)        */
+  char ipaddr [INET6_ADDRSTRLEN]; /* IPv4 or IPv6 notation (empty if unknown) */
+  int64_t first;               /* time it was first seen                      */
+  int64_t last;                /* time it was last seen                       */
+
+  uint64_t pkts_sent;
+  uint64_t bytes_sent;
+  uint64_t pkts_recv;
+  uint64_t bytes_recv;
+
+  uint64_t bytes_tcp_sent;
+  uint64_t bytes_tcp_recv;
+  uint64_t bytes_udp_sent;
+  uint64_t bytes_udp_recv;
+  uint64_t bytes_icmp_sent;
+  uint64_t bytes_icmp_recv;
+
+  uint32_t bytes_current;      /* throughput over the last second (bytes/s)    */
+  uint32_t pkts_current;       /* throughput over the last second (pkts/s)     */
+
+} pkshm_host_t;
+
+
+/* The header of the segment */
+typedef struct
+{
+  uint32_t magic;              /* PKSHM_MAGIC                                  */
+  uint32_t version;            /* PKSHM_VERSION                                */
+  uint32_t headersize;         /* sizeof (pkshm_header_t)                      */
+  uint32_t hostsize;           /* sizeof (pkshm_host_t)                        */
+  uint32_t hostoff;            /* offset of the first host slot                */
+  uint32_t capacity;           /* # of host slots                              */
+  volatile uint32_t hostno;    /* # of slots in use                            */
+  uint32_t dropped;            /* # of hosts not exported for lack of slots    */
+  int32_t pid;                 /* the process writing the segment              */
+  int32_t datalink;            /* DLT_* of the interface                       */
+  char name [32];              /* the interface                                */
+
+  pkshm_intf_t intf;
+
+} pkshm_header_t;
+
+
+/* Reader: wait for a stable record and return its sequence (still odd if the writer never ended its update) */
+static inline uint32_t pkshm_read_begin (const volatile uint32_t * seq)
+{
+  uint32_t s;
+  uint32_t spins = 0;
+
+  while (((s = __atomic_load_n (seq, __ATOMIC_ACQUIRE)) & 1) && ++ spins < PKSHM_SPINS)
+    ;
+  return s;
+}
+
+
+/* Reader: has the record changed while it was being copied? */
+static inline int pkshm_read_retry (const volatile uint32_t * seq, uint32_t s)
+{
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  return __atomic_load_n (seq, __ATOMIC_RELAXED) != s;
+}
+
+
+/* Writer: the record is going to be updated */
+static inline void pkshm_write_begin (volatile uint32_t * seq)
+{
+  __atomic_store_n (seq, * seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+
+/* Writer: the record is stable again */
+static inline void pkshm_write_end (volatile uint32_t * seq)
+{
+  __atomic_store_n (seq, * seq + 1, __ATOMIC_RELEASE);
+}
+
+
+#endif /* __PKSHM_H__ */
@@ -0,0 +1,617 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Exposition of the counters in the Prometheus text format over HTTP/1.1
+ *
+ * A single thread accepts the scrapers on a Unix socket or on a loopback port
+ * and answers GET /metrics.  The page is rendered into a buffer kept across
+ * scrapes and sized after the previous rendering, and it is served again as
+ * it is until it is older than the interval, so repeated scrapes cost O(1).
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* The largest request accepted (only the request line is of interest) */
+#define REQUEST_MAX  4096
+
+/* Room estimated for the series of an interface and of a host */
+#define INTF_ROOM    4096
+#define HOST_ROOM    1024
+
+
+/* The page as last rendered */
+typedef struct
+{
+  char * buf;           /* the page                                */
+  size_t size;          /* allocated bytes                         */
+  size_t len;           /* used bytes                              */
+  time_t generated;     /* when it was rendered                    */
+  unsigned long gen;    /* # of renderings                         */
+
+} page_t;
+
+
+/* The state of the listener */
+static pthread_t tid;
+static int lfd = -1;
+static volatile bool running = false;
+static char * where = NULL;             /* socket path or loopback address:port */
+static bool unixsocket = false;
+static int head = METRICS_HEAD;         /* # of busiest hosts per interface     */
+static int interval = METRICS_INTERVAL; /* lifetime of the page in seconds      */
+static unsigned long scrapes = 0;
+static page_t page;
+
+
+/* Append to the page (growing it only when the estimate was too small) */
+static void put (page_t * p, char * fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  va_start (ap, fmt);
+  n = vsnprintf (p -> buf + p -> len, p -> size - p -> len, fmt, ap);
+  va_end (ap);
+
+  if (n < 0)
+    return;
+
+  if (p -> len + n >= p -> size)
+    {
+      size_t size = MAX (p -> size * 2, p -> len + n + 1);
+      char * buf = realloc (p -> buf, size);
+
+      if (! buf)
+	return;
+      p -> buf  = buf;
+      p -> size = size;
+
+      va_start (ap, fmt);
+      vsnprintf (p -> buf + p -> len, p -> size - p -> len, fmt, ap);
+      va_end (ap);
+    }
+  p -> len += n;
+}
+
+
+/* Label values must have backslashes, quotes and newlines escaped */
+static char * escape (char * s, char * buf, size_t size)
+{
+  size_t i = 0;
+
+  for (; s && * s && i + 2 < size; s ++)
+    {
+      if (* s == '\\' || * s == '"')
+	buf [i ++] = '\\', buf [i ++] = * s;
+      else if (* s == '\n')
+	buf [i ++] = '\\', buf [i ++] = 'n';
+      else
+	buf [i ++] = * s;
+    }
+  buf [i] = '\0';
+
+  return buf;
+}
+
+
+/* The help and the type of a metric */
+static void family (page_t * p, char * name, char * type, char * help)
+{
+  put (p, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+
+/* The series of the interfaces (one metric family at a time, as required by the format) */
+static void intfseries (page_t * p, interface_t ** intfs)
+{
+  interface_t ** i;
+  char name [64];
+
+  family (p, "pksh_interface_packets_total", "counter", "Packets captured by protocol");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"all\"} %lu\n", name, (* i) -> pkts_total);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"ip\"} %lu\n", name, (* i) -> pkts_ip);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"ip6\"} %lu\n", name, (* i) -> pkts_ip6);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"vlan\"} %lu\n", name, (* i) -> pkts_vlan);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"qinq\"} %lu\n", name, (* i) -> pkts_qinq);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"tcp\"} %lu\n", name, (* i) -> pkts_tcp);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"udp\"} %lu\n", name, (* i) -> pkts_udp);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"http\"} %lu\n", name, (* i) -> pkts_http);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"tls\"} %lu\n", name, (* i) -> pkts_tls);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"ssh\"} %lu\n", name, (* i) -> pkts_ssh);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"smtp\"} %lu\n", name, (* i) -> pkts_smtp);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"imap\"} %lu\n", name, (* i) -> pkts_imap);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"pop3\"} %lu\n", name, (* i) -> pkts_pop);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"dns\"} %lu\n", name, (* i) -> pkts_dns);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"icmp\"} %lu\n", name, (* i) -> pkts_icmp);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"other-ip\"} %lu\n", name, (* i) -> pkts_other_ip);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"arp\"} %lu\n", name, (* i) -> pkts_arp);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"rarp\"} %lu\n", name, (* i) -> pkts_rarp);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"non-ip\"} %lu\n", name, (* i) -> pkts_non_ip);
+      put (p, "pksh_interface_packets_total{interface=\"%s\",protocol=\"unsupported\"} %lu\n", name, (* i) -> pkts_other);
+    }
+
+  family (p, "pksh_interface_bytes_total", "counter", "Bytes captured by protocol");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"all\"} %lu\n", name, (* i) -> bytes_total);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"ip\"} %lu\n", name, (* i) -> bytes_ip);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"ip6\"} %lu\n", name, (* i) -> bytes_ip6);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"vlan\"} %lu\n", name, (* i) -> bytes_vlan);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"tcp\"} %lu\n", name, (* i) -> bytes_tcp);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"udp\"} %lu\n", name, (* i) -> bytes_udp);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"http\"} %lu\n", name, (* i) -> bytes_http);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"tls\"} %lu\n", name, (* i) -> bytes_tls);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"ssh\"} %lu\n", name, (* i) -> bytes_ssh);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"smtp\"} %lu\n", name, (* i) -> bytes_smtp);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"imap\"} %lu\n", name, (* i) -> bytes_imap);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"pop3\"} %lu\n", name, (* i) -> bytes_pop);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"dns\"} %lu\n", name, (* i) -> bytes_dns);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"icmp\"} %lu\n", name, (* i) -> bytes_icmp);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"other-ip\"} %lu\n", name, (* i) -> bytes_other_ip);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"arp\"} %lu\n", name, (* i) -> bytes_arp);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"rarp\"} %lu\n", name, (* i) -> bytes_rarp);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"non-ip\"} %lu\n", name, (* i) -> bytes_non_ip);
+      put (p, "pksh_interface_bytes_total{interface=\"%s\",protocol=\"unsupported\"} %lu\n", name, (* i) -> bytes_other);
+    }
+
+  family (p, "pksh_interface_cast_packets_total", "counter", "Broadcast and multicast packets");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_cast_packets_total{interface=\"%s\",cast=\"broadcast\"} %lu\n", name, (* i) -> pkts_broadcast);
+      put (p, "pksh_interface_cast_packets_total{interface=\"%s\",cast=\"multicast\"} %lu\n", name, (* i) -> pkts_multicast);
+    }
+
+  /* Checksums are verified only when asked (pkenable --checksums) */
+  family (p, "pksh_interface_ip_packets_total", "counter", "Fragmented and damaged IP packets");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_ip_packets_total{interface=\"%s\",event=\"fragment\"} %lu\n", name, (* i) -> pkts_ip_fragments);
+      put (p, "pksh_interface_ip_packets_total{interface=\"%s\",event=\"malformed\"} %lu\n", name, (* i) -> pkts_malformed);
+      if (! (* i) -> checksums)
+	continue;
+      put (p, "pksh_interface_ip_packets_total{interface=\"%s\",event=\"badsum-ip\"} %lu\n", name, (* i) -> pkts_ip_badsum);
+      put (p, "pksh_interface_ip_packets_total{interface=\"%s\",event=\"badsum-tcp\"} %lu\n", name, (* i) -> pkts_tcp_badsum);
+      put (p, "pksh_interface_ip_packets_total{interface=\"%s\",event=\"badsum-udp\"} %lu\n", name, (* i) -> pkts_udp_badsum);
+      put (p, "pksh_interface_ip_packets_total{interface=\"%s\",event=\"unverified\"} %lu\n", name, (* i) -> pkts_unverified);
+    }
+
+  /* Where the frames have gone, as sampled by the sniffer every second (see accttick) */
+  family (p, "pksh_interface_pcap_packets_total", "counter", "Packets as accounted by the capture library");
+  for (i = intfs; i && * i; i ++)
+    {
+      if (! (* i) -> acct_time)
+	continue;
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_pcap_packets_total{interface=\"%s\",event=\"received\"} %lu\n", name, (* i) -> acct_recv);
+      put (p, "pksh_interface_pcap_packets_total{interface=\"%s\",event=\"dropped\"} %lu\n", name, (* i) -> acct_drop);
+      put (p, "pksh_interface_pcap_packets_total{interface=\"%s\",event=\"ifdropped\"} %lu\n", name, (* i) -> acct_ifdrop);
+    }
+
+  family (p, "pksh_interface_frames_total", "counter", "Frames as accounted by the sniffer");
+  for (i = intfs; i && * i; i ++)
+    {
+      if (! (* i) -> acct_time)
+	continue;
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_frames_total{interface=\"%s\",event=\"read\"} %lu\n", name, (* i) -> acct_read);
+      put (p, "pksh_interface_frames_total{interface=\"%s\",event=\"decoded\"} %lu\n", name, (* i) -> acct_decoded);
+      put (p, "pksh_interface_frames_total{interface=\"%s\",event=\"skipped\"} %lu\n", name, (* i) -> acct_read - (* i) -> acct_decoded);
+      put (p, "pksh_interface_frames_total{interface=\"%s\",event=\"userdropped\"} %lu\n", name, (* i) -> acct_userdrop);
+    }
+
+  family (p, "pksh_interface_queued_frames", "gauge", "Frames still queued in the kernel buffer");
+  for (i = intfs; i && * i; i ++)
+    {
+      if (! (* i) -> acct_time)
+	continue;
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_queued_frames{interface=\"%s\"} %lu\n", name, (* i) -> acct_queued);
+    }
+
+  /* The counters above are estimates when only 1 frame out of N is decoded (1 if not sampling) */
+  family (p, "pksh_interface_sampling", "gauge", "Frames each decoded frame is counted for");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_sampling{interface=\"%s\"} %u\n", name,
+	   ((* i) -> sampling ? (* i) -> sampling : 1) * (shedsampling ((* i) -> shedding) ? shedsampling ((* i) -> shedding) : 1));
+    }
+
+  family (p, "pksh_interface_shedding", "gauge", "Step of the overload shedding of the sniffer (0 is full decode)");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_shedding{interface=\"%s\"} %u\n", name, (* i) -> shedding);
+    }
+
+  family (p, "pksh_interface_hosts", "gauge", "Hosts in the cache");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_hosts{interface=\"%s\",kind=\"local\"} %u\n", name, (* i) -> hostno_local);
+      put (p, "pksh_interface_hosts{interface=\"%s\",kind=\"foreign\"} %u\n", name, (* i) -> hostno_foreign);
+    }
+
+  family (p, "pksh_interface_cache_entries", "gauge", "Entries in the hash tables of the hosts cache");
+  for (i = intfs; i && * i; i ++)
+    {
+      escape ((* i) -> name, name, sizeof (name));
+      put (p, "pksh_interface_cache_entries{interface=\"%s\",table=\"hw\"} %d\n", name, htno (& (* i) -> hwnames));
+      put (p, "pksh_interface_cache_entries{interface=\"%s\",table=\"ip\"} %d\n", name, htno (& (* i) -> ipnames));
+      put (p, "pksh_interface_cache_entries{interface=\"%s\",table=\"ip6\"} %d\n", name, htno (& (* i) -> ip6names));
+      put (p, "pksh_interface_cache_entries{interface=\"%s\",table=\"hostname\"} %d\n", name, htno (& (* i) -> hostnames));
+    }
+
+  family (p, "pksh_interface_started_seconds", "gauge", "Time the capture was started (seconds since the Epoch)");
+  for (i = intfs; i && * i; i ++)
+    put (p, "pksh_interface_started_seconds{interface=\"%s\"} %ld\n",
+	 escape ((* i) -> name, name, sizeof (name)), (long) (* i) -> started . tv_sec);
+}
+
+
+/* The series of the busiest hosts of all the interfaces */
+static void hostseries (page_t * p, interface_t ** intfs)
+{
+  static char * families [][3] =
+    {
+      { "pksh_host_bytes_total",   "counter", "Bytes sent and received by the busiest hosts"        },
+      { "pksh_host_packets_total", "counter", "Packets sent and received by the busiest hosts"      },
+      { "pksh_host_throughput",    "gauge",   "Bytes per second over the last second of the busiest hosts" },
+    };
+  interface_t ** i;
+  host_t *** top;
+  int * rows;
+  unsigned n = intflen (intfs);
+  unsigned f;
+  unsigned k;
+  int r;
+
+  if (! n || head <= 0)
+    return;
+
+  top  = calloc (n, sizeof (host_t **));
+  rows = calloc (n, sizeof (int));
+
+  /* The busiest hosts are selected once, not once per family */
+  for (k = 0, i = intfs; top && rows && * i; i ++, k ++)
+    if ((top [k] = hostsall (* i)))
+      rows [k] = hostsort (top [k], hargslen (top [k]), sort_by_bytes_all, false, head);
+
+  for (f = 0; top && rows && f < sizeof (families) / sizeof (families [0]); f ++)
+    {
+      family (p, families [f][0], families [f][1], families [f][2]);
+      for (k = 0, i = intfs; * i; i ++, k ++)
+	for (r = 0; top [k] && r < rows [k]; r ++)
+	  {
+	    host_t * h = top [k][r];
+	    char name [64];
+	    char host [128];
+	    char labels [512];
+
+	    snprintf (labels, sizeof (labels), "interface=\"%s\",host=\"%s\",hwaddr=\"%s\"",
+		      escape ((* i) -> name, name, sizeof (name)),
+		      escape (h -> ipaddr ? h -> ipaddr : h -> hwaddress, host, sizeof (host)),
+		      h -> hwaddress ? h -> hwaddress : "");
+
+	    switch (f)
+	      {
+	      case 0:
+		put (p, "%s{%s,direction=\"sent\"} %lu\n", families [f][0], labels, h -> bytes_sent);
+		put (p, "%s{%s,direction=\"recv\"} %lu\n", families [f][0], labels, h -> bytes_recv);
+		break;
+	      case 1:
+		put (p, "%s{%s,direction=\"sent\"} %lu\n", families [f][0], labels, h -> pkts_sent);
+		put (p, "%s{%s,direction=\"recv\"} %lu\n", families [f][0], labels, h -> pkts_recv);
+		break;
+	      case 2:
+		put (p, "%s{%s} %d\n", families [f][0], labels, h -> bytes_current);
+		break;
+	      }
+	  }
+    }
+
+  for (k = 0; top && k < n; k ++)
+    if (top [k])
+      free (top [k]);
+  if (top)
+    free (top);
+  if (rows)
+    free (rows);
+}
+
+
+/* Render the page from scratch into the buffer of the previous rendering */
+static void render (page_t * p, time_t now)
+{
+  size_t estimate;
+
+  /* The shell (or a pkshd client) may add or release interfaces while the page is rendered */
+  intflock ();
+  estimate = MAX (intflen (interfaces), 1) * (INTF_ROOM + head * HOST_ROOM);
+
+  /* The buffer only grows, so steady state renderings never allocate */
+  if (p -> size < estimate)
+    {
+      char * buf = realloc (p -> buf, estimate);
+      if (buf)
+	p -> buf = buf, p -> size = estimate;
+    }
+  if (! p -> buf)
+    {
+      intfunlock ();
+      return;
+    }
+  p -> len = 0;
+
+  intfseries (p, interfaces);
+  hostseries (p, interfaces);
+  intfunlock ();
+
+  family (p, "pksh_metrics_generation", "counter", "Renderings of this page");
+  put (p, "pksh_metrics_generation %lu\n", ++ p -> gen);
+  family (p, "pksh_metrics_scrapes_total", "counter", "Scrapes served");
+  put (p, "pksh_metrics_scrapes_total %lu\n", scrapes);
+
+  p -> generated = now;
+}
+
+
+/* Write all the 'len' bytes of 'buf' */
+static int writeall (int fd, char * buf, size_t len)
+{
+  while (len)
+    {
+      ssize_t n = send (fd, buf, len, MSG_NOSIGNAL);
+      if (n == -1 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	return -1;
+      buf += n;
+      len -= n;
+    }
+  return 0;
+}
+
+
+/* Serve one request on 'fd' */
+static void serve (int fd)
+{
+  char req [REQUEST_MAX + 1];
+  char hdr [256];
+  size_t len = 0;
+  ssize_t n;
+  time_t now;
+
+  /* Read up to the end of the headers (the body of a GET is ignored) */
+  while (len < REQUEST_MAX && (n = recv (fd, req + len, REQUEST_MAX - len, 0)) > 0)
+    {
+      len += n;
+      req [len] = '\0';
+      if (strstr (req, "\r\n\r\n") || strstr (req, "\n\n"))
+	break;
+    }
+  req [len] = '\0';
+
+  if (strncmp (req, "GET ", 4) && strncmp (req, "HEAD ", 5))
+    {
+      char * msg = "HTTP/1.1 405 Method Not Allowed\r\nAllow: GET, HEAD\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+      writeall (fd, msg, strlen (msg));
+      return;
+    }
+
+  if (strncmp (strchr (req, ' ') + 1, "/metrics", 8) || ! strchr (" ?", strchr (req, ' ') [9]))
+    {
+      char * msg = "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 10\r\nConnection: close\r\n\r\nnot found\n";
+      writeall (fd, msg, strlen (msg));
+      return;
+    }
+
+  /* The page is rendered again only when it is older than the interval */
+  now = time (NULL);
+  scrapes ++;
+  if (! page . len || now - page . generated >= interval)
+    render (& page, now);
+
+  snprintf (hdr, sizeof (hdr),
+	    "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+	    page . len);
+  if (writeall (fd, hdr, strlen (hdr)) == 0 && req [0] == 'G')
+    writeall (fd, page . buf, page . len);
+}
+
+
+/* The listener thread */
+static void * listener (void * _unused)
+{
+  struct timeval tv = { 2, 0 };
+  sigset_t mask;
+
+  /* Signals are left to the shell */
+  sigfillset (& mask);
+  pthread_sigmask (SIG_BLOCK, & mask, NULL);
+
+  while (running)
+    {
+      int fd = accept (lfd, NULL, NULL);
+
+      if (fd == -1)
+	{
+	  if (errno == EINTR || errno == ECONNABORTED)
+	    continue;
+	  break;
+	}
+
+      /* A stalled scraper cannot hold the listener for long */
+      setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, & tv, sizeof (tv));
+      setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, & tv, sizeof (tv));
+
+      serve (fd);
+      close (fd);
+    }
+
+  return NULL;
+}
+
+
+/* Bind 'lfd' to a Unix socket (when 'addr' is a path) or to a loopback port */
+static int bindto (char * addr)
+{
+  int fd;
+
+  if (strchr (addr, '/'))
+    {
+      struct sockaddr_un sa;
+
+      memset (& sa, 0, sizeof (sa));
+      sa . sun_family = AF_UNIX;
+      if (strlen (addr) >= sizeof (sa . sun_path))
+	{
+	  errno = ENAMETOOLONG;
+	  return -1;
+	}
+      strcpy (sa . sun_path, addr);
+
+      if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1)
+	return -1;
+      unlink (addr);
+      if (bind (fd, (struct sockaddr *) & sa, sizeof (sa)) == -1)
+	{
+	  close (fd);
+	  return -1;
+	}
+      unixsocket = true;
+    }
+  else
+    {
+      struct sockaddr_in sa;
+      int on = 1;
+
+      memset (& sa, 0, sizeof (sa));
+      sa . sin_family      = AF_INET;
+      sa . sin_port        = htons (atoi (addr));
+      sa . sin_addr . s_addr = htonl (INADDR_LOOPBACK);
+
+      if (! sa . sin_port)
+	{
+	  errno = EINVAL;
+	  return -1;
+	}
+
+      if ((fd = socket (AF_INET, SOCK_STREAM, 0)) == -1)
+	return -1;
+      setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, & on, sizeof (on));
+      if (bind (fd, (struct sockaddr *) & sa, sizeof (sa)) == -1)
+	{
+	  close (fd);
+	  return -1;
+	}
+      unixsocket = false;
+    }
+
+  if (listen (fd, 16) == -1)
+    {
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+
+/* Start serving /metrics on 'addr' (a socket path or a loopback port) */
+int metricsstart (char * addr, int busiest, int lifetime)
+{
+  if (running)
+    {
+      errno = EBUSY;
+      return -1;
+    }
+
+  if ((lfd = bindto (addr)) == -1)
+    return -1;
+
+  where    = strdup (addr);
+  head     = busiest;
+  interval = lifetime > 0 ? lifetime : METRICS_INTERVAL;
+  scrapes  = 0;
+  page . len = 0;
+
+  running = true;
+  if (pthread_create (& tid, NULL, listener, NULL))
+    {
+      running = false;
+      metricsstop ();
+      errno = EAGAIN;
+      return -1;
+    }
+
+  return 0;
+}
+
+
+/* Stop serving /metrics */
+void metricsstop (void)
+{
+  bool joinable = running;
+
+  running = false;
+
+  /* Wake up the listener blocked in accept() */
+  if (lfd != -1)
+    {
+      shutdown (lfd, SHUT_RDWR);
+      if (joinable)
+	pthread_join (tid, NULL);
+      close (lfd);
+      lfd = -1;
+    }
+
+  if (where && unixsocket)
+    unlink (where);
+  if (where)
+    free (where);
+  where = NULL;
+
+  if (page . buf)
+    free (page . buf);
+  memset (& page, 0, sizeof (page));
+}
+
+
+/* Where /metrics is served (NULL if it is not) */
+char * metricswhere (void)
+{
+  return running ? where : NULL;
+}
+
+
+/* # of scrapes served since started */
+unsigned long metricsscrapes (void)
+{
+  return scrapes;
+}
@@ -17,16 +17,29 @@
 #include "pksh.h"
 
 
+/* The step of the overload shedding shown in the prompt */
+static unsigned shown = SHED_NONE;
+
+
 /* Change the prompt */
 void pksh_prompt (char * interface)
 {
   Char Prompt [256];
   char * prompt = NULL;
+  interface_t * intf = interface ? intfbyname (interfaces, interface) : NULL;
 
   int i;
   int len;
 
-  if (interface)
+  shown = intf ? intf -> shedding : SHED_NONE;
+
+  if (interface && shown)
+    {
+      /* The sniffer of the interface is overloaded (see pkstatus) */
+      prompt = calloc (strlen (progname) + strlen (interface) + 200, 1);
+      sprintf (prompt, "%%S%s@%s [shed %u] %%!>%%s ", progname, interface, shown);
+    }
+  else if (interface)
     {
       prompt = calloc (strlen (progname) + strlen (interface) + 200, 1);
       sprintf (prompt, "%%S%s@%s %%!>%%s ", progname, interface);
@@ -45,3 +58,14 @@ void pksh_prompt (char * interface)
 
   setcopy (STRprompt, Strsave (Prompt), VAR_READWRITE);
 }
+
+
+/* Change the prompt again if the step of the overload shedding of the active interface has changed since it was set */
+void pksh_prompt_refresh (void)
+{
+  char * name = getintfname ();
+  interface_t * intf = name ? intfbyname (interfaces, name) : NULL;
+
+  if ((intf ? intf -> shedding : SHED_NONE) != shown)
+    pksh_prompt (name);
+}
@@ -0,0 +1,410 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * The recorder of the frames captured on an interface into rotating pcap/pcapng files
+ *
+ * The sniffer copies each frame into a single-producer single-consumer queue
+ * and never waits: when the queue is full the frame is dropped and counted.
+ * A writer thread drains the queue into an aligned buffer and writes it to
+ * disk in large batches (with O_DIRECT where the file system supports it),
+ * so the latency of the disk never backs up the capture.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <limits.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* pcapng blocks are 4-byte aligned */
+#define PAD4(n)      (((n) + 3) & ~3UL)
+
+/* How long the writer sleeps when the queue is empty (nsecs) */
+#define IDLE_NSECS   (10 * 1000 * 1000)
+
+
+/* Copy 'n' bytes into the queue at 'pos' (wrapping at its end) */
+static void qput (recorder_t * r, unsigned long pos, const void * src, size_t n)
+{
+  size_t off   = pos & (r -> qsize - 1);
+  size_t first = MIN (n, r -> qsize - off);
+
+  memcpy (r -> queue + off, src, first);
+  if (first < n)
+    memcpy (r -> queue, (u_char *) src + first, n - first);
+}
+
+
+/* Copy 'n' bytes out of the queue at 'pos' (wrapping at its end) */
+static void qget (recorder_t * r, unsigned long pos, void * dst, size_t n)
+{
+  size_t off   = pos & (r -> qsize - 1);
+  size_t first = MIN (n, r -> qsize - off);
+
+  memcpy (dst, r -> queue + off, first);
+  if (first < n)
+    memcpy ((u_char *) dst + first, r -> queue, n - first);
+}
+
+
+/* Append 'n' bytes to the buffer of the next write */
+static void append (recorder_t * r, const void * data, size_t n)
+{
+  memcpy (r -> batch + r -> batchlen, data, n);
+  r -> batchlen += n;
+}
+
+
+/* Write the aligned part of the buffer (or all of it) and keep the rest for the next write */
+static void flush (recorder_t * r, bool all)
+{
+  size_t n = all ? r -> batchlen : r -> batchlen & ~(RECORDER_ALIGN - 1UL);
+  size_t done = 0;
+
+  if (! n)
+    return;
+
+#if defined(O_DIRECT)
+  /* The tail of a file is not a multiple of the block size */
+  if (r -> fd != -1 && r -> direct && n % RECORDER_ALIGN)
+    {
+      fcntl (r -> fd, F_SETFL, fcntl (r -> fd, F_GETFL) & ~O_DIRECT);
+      r -> direct = false;
+    }
+#endif /* O_DIRECT */
+
+  while (r -> fd != -1 && done < n)
+    {
+      ssize_t w = write (r -> fd, r -> batch + done, n - done);
+      if (w == -1 && errno == EINTR)
+	continue;
+      if (w <= 0)
+	{
+	  r -> errors ++;
+	  break;
+	}
+      done += w;
+    }
+
+  r -> written   += done;
+  r -> filebytes += done;
+
+  /* Data which could not be written is lost anyway */
+  memmove (r -> batch, r -> batch + n, r -> batchlen - n);
+  r -> batchlen -= n;
+}
+
+
+/* Open the next file and put its header in the buffer */
+static int fileopen (recorder_t * r)
+{
+  int flags = O_WRONLY | O_CREAT | O_TRUNC;
+  char name [PATH_MAX];
+
+  if (r -> limit || r -> seconds)
+    snprintf (name, sizeof (name), "%s.%u", r -> path, r -> files ? r -> fileno % r -> files : r -> fileno);
+  else
+    snprintf (name, sizeof (name), "%s", r -> path);
+
+  r -> direct = false;
+#if defined(O_DIRECT)
+  if ((r -> fd = open (name, flags | O_DIRECT, 0644)) != -1)
+    r -> direct = true;
+  else if (errno == EINVAL)  /* not supported by the file system */
+#endif /* O_DIRECT */
+    r -> fd = open (name, flags, 0644);
+
+  r -> opened    = time (NULL);
+  r -> filebytes = 0;
+
+  if (r -> fd == -1)
+    return -1;
+
+  if (r -> pcapng)
+    {
+      /* Section Header Block and Interface Description Block (timestamps in usecs by default) */
+      uint32_t shb [7] = { 0x0a0d0d0a, 28, 0x1a2b3c4d, 0x00000001, 0xffffffff, 0xffffffff, 28 };
+      uint32_t idb [5] = { 0x00000001, 20, (uint32_t) r -> linktype & 0xffff, r -> snaplen, 20 };
+
+      append (r, shb, sizeof (shb));
+      append (r, idb, sizeof (idb));
+    }
+  else
+    {
+      /* The global header of a pcap file */
+      uint32_t gh [6] = { 0xa1b2c3d4, 0x00040002, 0, 0, r -> snaplen, r -> linktype };
+
+      append (r, gh, sizeof (gh));
+    }
+
+  return 0;
+}
+
+
+/* Complete the current file */
+static void fileclose (recorder_t * r)
+{
+  flush (r, true);
+  if (r -> fd != -1)
+    close (r -> fd);
+  r -> fd = -1;
+  r -> rotated ++;
+  r -> fileno ++;
+}
+
+
+/* Move on to the next file */
+static void nextfile (recorder_t * r)
+{
+  fileclose (r);
+  if (fileopen (r) == -1)
+    r -> errors ++;
+}
+
+
+/* Move a record from the queue to the buffer in the format of the file */
+static void encode (recorder_t * r, rechdr_t * rh, unsigned long pos)
+{
+  if (r -> pcapng)
+    {
+      /* Enhanced Packet Block */
+      uint64_t usecs = (uint64_t) rh -> sec * 1000000 + rh -> usec;
+      uint32_t total = 32 + PAD4 (rh -> caplen);
+      uint32_t epb [7] = { 0x00000006, total, 0, usecs >> 32, usecs & 0xffffffff, rh -> caplen, rh -> len };
+      uint32_t zero = 0;
+
+      append (r, epb, sizeof (epb));
+      qget (r, pos, r -> batch + r -> batchlen, rh -> caplen);
+      r -> batchlen += rh -> caplen;
+      append (r, & zero, PAD4 (rh -> caplen) - rh -> caplen);
+      append (r, & total, sizeof (total));
+    }
+  else
+    {
+      append (r, rh, sizeof (* rh));
+      qget (r, pos, r -> batch + r -> batchlen, rh -> caplen);
+      r -> batchlen += rh -> caplen;
+    }
+}
+
+
+/* Is it time to move on to the next file? (the age is on the wall clock, as when the file was opened, so idle links rotate too) */
+static bool rotate (recorder_t * r)
+{
+  return (r -> limit && r -> filebytes + r -> batchlen >= r -> limit) ||
+    (r -> seconds && time (NULL) - r -> opened >= r -> seconds);
+}
+
+
+/* The writer thread */
+static void * writer (void * _r)
+{
+  recorder_t * r = _r;
+  struct timespec idle = { 0, IDLE_NSECS };
+  sigset_t mask;
+
+  /* Signals are left to the shell */
+  sigfillset (& mask);
+  pthread_sigmask (SIG_BLOCK, & mask, NULL);
+
+  while (true)
+    {
+      unsigned long head = __atomic_load_n (& r -> head, __ATOMIC_ACQUIRE);
+      unsigned long tail = r -> tail;
+
+      if (head == tail)
+	{
+	  /* Done once the sniffer has let the recorder go and the queue has been drained */
+	  if (__atomic_load_n (& r -> detached, __ATOMIC_ACQUIRE)
+	      && __atomic_load_n (& r -> head, __ATOMIC_ACQUIRE) == tail)
+	    break;
+
+	  if (rotate (r))
+	    nextfile (r);
+	  nanosleep (& idle, NULL);
+	  continue;
+	}
+
+      while (tail != head)
+	{
+	  rechdr_t rh;
+
+	  qget (r, tail, & rh, sizeof (rh));
+
+	  /* The largest record always fits as the rest kept in the buffer is less than a block */
+	  if (r -> batchlen + 32 + PAD4 (rh . caplen) > RECORDER_BATCH)
+	    flush (r, false);
+
+	  encode (r, & rh, tail + sizeof (rh));
+
+	  /* Give the room back to the sniffer as soon as possible */
+	  tail += RECALIGN (sizeof (rh) + rh . caplen);
+	  __atomic_store_n (& r -> tail, tail, __ATOMIC_RELEASE);
+
+	  if (rotate (r))
+	    nextfile (r);
+	}
+    }
+
+  fileclose (r);
+
+  return NULL;
+}
+
+
+/* Hand a frame to the recorder of 'intf' (called by the sniffer, 'h' is NULL when there is no frame) */
+void recpkt (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
+{
+  recorder_t * r = __atomic_load_n (& intf -> recorder, __ATOMIC_ACQUIRE);
+  unsigned long head;
+  unsigned long tail;
+  rechdr_t rh;
+  size_t need;
+
+  if (! r)
+    return;
+
+  /* Let the recorder go, it is never referenced again */
+  if (__atomic_load_n (& r -> stop, __ATOMIC_ACQUIRE))
+    {
+      __atomic_store_n (& intf -> recorder, NULL, __ATOMIC_RELEASE);
+      __atomic_store_n (& r -> detached, true, __ATOMIC_RELEASE);
+      return;
+    }
+
+  if (! h)
+    return;
+
+  rh . sec    = h -> ts . tv_sec;
+  rh . usec   = h -> ts . tv_usec;
+  rh . caplen = MIN (h -> caplen, (uint32_t) r -> snaplen);
+  rh . len    = h -> len;
+  need = RECALIGN (sizeof (rh) + rh . caplen);
+
+  /* Never wait for the writer */
+  head = r -> head;
+  tail = __atomic_load_n (& r -> tail, __ATOMIC_ACQUIRE);
+  if (need > r -> qsize - (head - tail))
+    {
+      r -> dropped ++;
+      return;
+    }
+
+  qput (r, head, & rh, sizeof (rh));
+  qput (r, head + sizeof (rh), p, rh . caplen);
+  __atomic_store_n (& r -> head, head + need, __ATOMIC_RELEASE);
+
+  r -> pkts ++;
+}
+
+
+/* Release all the memory of a recorder */
+static void recfree (recorder_t * r)
+{
+  if (r -> fd != -1)
+    close (r -> fd);
+  free (r -> path);
+  free (r -> queue);
+  free (r -> batch);
+  free (r);
+}
+
+
+/* Start recording the frames captured on 'intf' into 'path' */
+recorder_t * recstart (interface_t * intf, char * path, unsigned long limit, unsigned seconds, unsigned files, bool pcapng, size_t qsize)
+{
+  recorder_t * r;
+  size_t size = 1;
+
+  if (intf -> recorder)
+    {
+      errno = EBUSY;
+      return NULL;
+    }
+
+  if (! (r = calloc (1, sizeof (recorder_t))))
+    return NULL;
+
+  /* The queue is a power of two, so positions just wrap */
+  while (size < MAX (qsize, 2 * (size_t) RECALIGN (sizeof (rechdr_t) + intf -> snapshot)))
+    size <<= 1;
+
+  r -> path     = strdup (path);
+  r -> limit    = limit;
+  r -> seconds  = seconds;
+  r -> files    = files;
+  r -> pcapng   = pcapng;
+  r -> linktype = intf -> datalink;
+  r -> snaplen  = intf -> snapshot;
+  r -> qsize    = size;
+  r -> queue    = malloc (size);
+  r -> fd       = -1;
+
+  if (! r -> path || ! r -> queue || posix_memalign ((void **) & r -> batch, RECORDER_ALIGN, RECORDER_BATCH))
+    {
+      r -> batch = NULL;
+      recfree (r);
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  /* The first file is opened here so the errors are reported to the user */
+  if (fileopen (r) == -1)
+    {
+      int e = errno;
+      recfree (r);
+      errno = e;
+      return NULL;
+    }
+
+  if (pthread_create (& r -> tid, NULL, writer, r))
+    {
+      recfree (r);
+      errno = EAGAIN;
+      return NULL;
+    }
+
+  __atomic_store_n (& intf -> recorder, r, __ATOMIC_RELEASE);
+
+  return r;
+}
+
+
+/* Stop recording on 'intf' once all the frames already captured are on disk */
+void recstop (interface_t * intf)
+{
+  recorder_t * r = intf -> recorder;
+  struct timespec idle = { 0, IDLE_NSECS };
+
+  if (! r)
+    return;
+
+  __atomic_store_n (& r -> stop, true, __ATOMIC_RELEASE);
+
+  /* Wait for the sniffer to let the recorder go (it does it itself unless it is not running) */
+  while (! __atomic_load_n (& r -> detached, __ATOMIC_ACQUIRE))
+    {
+      if (intf -> status != INTERFACE_ENABLED)
+	{
+	  __atomic_store_n (& intf -> recorder, NULL, __ATOMIC_RELEASE);
+	  __atomic_store_n (& r -> detached, true, __ATOMIC_RELEASE);
+	  break;
+	}
+      nanosleep (& idle, NULL);
+    }
+
+  pthread_join (r -> tid, NULL);
+  recfree (r);
+}
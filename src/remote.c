@@ -0,0 +1,654 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Both ends of the pkshd binary protocol over a Unix socket:
+ *  o the daemon answers requests about the interfaces it owns (pkshdserve)
+ *  o the shell keeps a read-only mirror of them in the table of interfaces
+ *    and refreshes it before each command, so the builtins run unchanged
+ *
+ * Both ends run on the same box and are built from the same sources, so
+ * counters go over the wire as they are, once checked the layout matches.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* Where the counters begin in the interface and host descriptors */
+#define INTF_COUNTERS  offsetof (interface_t, shortest)
+#define HOST_COUNTERS  offsetof (host_t, bytes_sent)
+
+/* The strings of a host on the wire */
+enum { WIRE_HWADDRESS, WIRE_VENDOR, WIRE_IPADDR, WIRE_HOSTNAME, WIRE_SYSTEM, WIRE_STRINGS };
+
+
+/* A growable buffer to build a reply */
+typedef struct
+{
+  char * data;
+  size_t len;
+  size_t room;
+
+} wirebuf_t;
+
+
+/* The connection to pkshd (if attached) */
+static int pkshd = -1;
+
+
+/* Write exactly 'n' bytes */
+static bool writen (int fd, const void * buf, size_t n)
+{
+  const char * p = buf;
+
+  while (n)
+    {
+      ssize_t w = write (fd, p, n);
+      if (w < 0 && errno == EINTR)
+	continue;
+      if (w <= 0)
+	return false;
+      p += w;
+      n -= w;
+    }
+
+  return true;
+}
+
+
+/* Read exactly 'n' bytes */
+static bool readn (int fd, void * buf, size_t n)
+{
+  char * p = buf;
+
+  while (n)
+    {
+      ssize_t r = read (fd, p, n);
+      if (r < 0 && errno == EINTR)
+	continue;
+      if (r <= 0)
+	return false;
+      p += r;
+      n -= r;
+    }
+
+  return true;
+}
+
+
+/* Send a message with its payload */
+static bool msgsend (int fd, uint16_t type, uint32_t arg, const void * payload, uint32_t length)
+{
+  pkshd_msg_t msg = { PKSHD_MAGIC, type, PKSHD_VERSION, length, arg };
+
+  return writen (fd, & msg, sizeof (msg)) && (! length || writen (fd, payload, length));
+}
+
+
+/* Receive a message and its payload (to be freed by the caller) */
+static bool msgrecv (int fd, pkshd_msg_t * msg, char ** payload)
+{
+  * payload = NULL;
+
+  if (! readn (fd, msg, sizeof (* msg)))
+    return false;
+
+  if (msg -> magic != PKSHD_MAGIC || msg -> version != PKSHD_VERSION || msg -> length > PKSHD_MAXMSG)
+    return false;
+
+  if (msg -> length && (! (* payload = malloc (msg -> length)) || ! readn (fd, * payload, msg -> length)))
+    {
+      free (* payload);
+      * payload = NULL;
+      return false;
+    }
+
+  return true;
+}
+
+
+/* Append 'n' bytes to the buffer */
+static bool wireput (wirebuf_t * b, const void * data, size_t n)
+{
+  if (b -> len + n > b -> room)
+    {
+      size_t room = b -> room ? b -> room : 64 * 1024;
+      char * more;
+
+      while (room < b -> len + n)
+	room *= 2;
+      if (! (more = realloc (b -> data, room)))
+	return false;
+      b -> data = more;
+      b -> room = room;
+    }
+
+  memcpy (b -> data + b -> len, data, n);
+  b -> len += n;
+
+  return true;
+}
+
+
+/* Copy a string into a fixed size field on the wire */
+static void wirestr (char * dst, size_t size, char * src)
+{
+  memset (dst, 0, size);
+  if (src)
+    strncpy (dst, src, size - 1);
+}
+
+
+/* Replace the string 'str' with a copy of 'value' when it has changed */
+static void setstr (char ** str, char * value)
+{
+  if (! value || ! * value || (* str && ! strcmp (* str, value)))
+    return;
+
+  free (* str);
+  * str = strdup (value);
+}
+
+
+/* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=- */
+
+
+/* The layout of the data shared by both ends */
+static void wirelayout (uint32_t layout [2])
+{
+  layout [0] = sizeof (interface_t);
+  layout [1] = sizeof (host_t);
+}
+
+
+/* Reply with the layout of the data */
+static bool replyhello (int fd)
+{
+  uint32_t layout [2];
+
+  wirelayout (layout);
+  return msgsend (fd, PKSHD_HELLO, 0, layout, sizeof (layout));
+}
+
+
+/* Reply with all the interfaces and their counters */
+static bool replystatus (int fd)
+{
+  wirebuf_t b = { NULL, 0, 0 };
+  interface_t ** intf;
+  uint32_t n = 0;
+  bool ok = true;
+
+  for (intf = interfaces; ok && intf && * intf; intf ++)
+    {
+      pkshd_intf_t rec;
+
+      memset (& rec, 0, sizeof (rec));
+      wirestr (rec . name, sizeof (rec . name), (* intf) -> name);
+      wirestr (rec . hwaddr, sizeof (rec . hwaddr), (* intf) -> hwaddr);
+      wirestr (rec . ipaddr, sizeof (rec . ipaddr), (* intf) -> ipaddr);
+      wirestr (rec . network, sizeof (rec . network), (* intf) -> network);
+      wirestr (rec . netmask, sizeof (rec . netmask), (* intf) -> netmask);
+      wirestr (rec . broadcast, sizeof (rec . broadcast), (* intf) -> broadcast);
+      wirestr (rec . hostname, sizeof (rec . hostname), (* intf) -> hostname);
+      rec . datalink     = (* intf) -> datalink;
+      rec . snapshot     = (* intf) -> snapshot;
+      rec . promiscuous  = (* intf) -> promiscuous;
+      rec . mtu          = (* intf) -> mtu;
+      rec . ipbin        = (* intf) -> ipbin;
+      rec . netmaskbin   = (* intf) -> netmaskbin;
+      rec . networkbin   = (* intf) -> networkbin;
+      rec . broadcastbin = (* intf) -> broadcastbin;
+      rec . hostno       = (* intf) -> hostno;
+      rec . started      = (* intf) -> started;
+      rec . firstpkt     = (* intf) -> firstpkt;
+      rec . lastpkt      = (* intf) -> lastpkt;
+
+      ok = wireput (& b, & rec, sizeof (rec)) &&
+	wireput (& b, (char *) * intf + INTF_COUNTERS, sizeof (interface_t) - INTF_COUNTERS);
+      n ++;
+    }
+
+  ok = ok && msgsend (fd, PKSHD_STATUS, n, b . data, b . len);
+  free (b . data);
+
+  return ok;
+}
+
+
+/* Reply with a page of the hosts cache of an interface */
+static bool replyhosts (int fd, pkshd_query_t * q)
+{
+  wirebuf_t b = { NULL, 0, 0 };
+  pkshd_page_t page;
+  interface_t * intf;
+  host_t * h;
+  uint32_t id;
+  uint32_t n = 0;
+  bool ok;
+
+  q -> name [sizeof (q -> name) - 1] = '\0';
+  if (! (intf = intfbyname (interfaces, q -> name)))
+    return msgsend (fd, PKSHD_ERROR, 0, NULL, 0);
+
+  /* Room for the header of the page, it is filled once done */
+  memset (& page, 0, sizeof (page));
+  ok = wireput (& b, & page, sizeof (page));
+
+  for (id = q -> first; ok && n < PKSHD_PAGE && (h = hostbyid (intf, id)); id ++)
+    {
+      pkshd_host_t rec;
+      char * strings [WIRE_STRINGS] = { h -> hwaddress, h -> vendor, h -> ipaddr, h -> hostname, h -> system };
+      unsigned i;
+
+      /* Hosts already known to the client and idle since its last refresh are left out */
+      if (id < q -> known && h -> last . tv_sec < q -> since)
+	continue;
+
+      memset (& rec, 0, sizeof (rec));
+      rec . id    = id;
+      rec . first = h -> first;
+      rec . last  = h -> last;
+      rec . ip    = h -> ip;
+      rec . vlan  = h -> vlan;
+      memcpy (rec . fingerprint, h -> fingerprint, FPLEN);
+      for (i = 0; i < WIRE_STRINGS; i ++)
+	rec . len [i] = strings [i] ? strlen (strings [i]) + 1 : 0;
+
+      ok = wireput (& b, & rec, sizeof (rec)) && wireput (& b, (char *) h + HOST_COUNTERS, sizeof (host_t) - HOST_COUNTERS);
+      for (i = 0; ok && i < WIRE_STRINGS; i ++)
+	if (rec . len [i])
+	  ok = wireput (& b, strings [i], rec . len [i]);
+      n ++;
+    }
+
+  page . next   = id;
+  page . hostno = __atomic_load_n (& intf -> hostno, __ATOMIC_ACQUIRE);
+  page . now    = intf -> clock . tv_sec;     /* the time base the hosts are seen by */
+  if (ok)
+    memcpy (b . data, & page, sizeof (page));
+
+  ok = ok && msgsend (fd, PKSHD_HOSTS, n, b . data, b . len);
+  free (b . data);
+
+  return ok;
+}
+
+
+/* Serve the requests of a client until it goes away (the daemon runs one per connection) */
+void pkshdserve (int fd)
+{
+  pkshd_msg_t msg;
+  char * payload;
+  bool ok = true;
+
+  while (ok && msgrecv (fd, & msg, & payload))
+    {
+      switch (msg . type)
+	{
+	case PKSHD_HELLO:  ok = replyhello (fd);  break;
+	case PKSHD_STATUS: ok = replystatus (fd); break;
+
+	case PKSHD_HOSTS:
+	  ok = msg . length == sizeof (pkshd_query_t) ? replyhosts (fd, (pkshd_query_t *) payload) : msgsend (fd, PKSHD_ERROR, 0, NULL, 0);
+	  break;
+
+	default: ok = msgsend (fd, PKSHD_ERROR, 0, NULL, 0); break;
+	}
+
+      free (payload);
+    }
+}
+
+
+/* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=- */
+
+
+/* Send a request and wait for its reply of the same type */
+static bool request (uint16_t type, void * query, uint32_t length, pkshd_msg_t * reply, char ** payload)
+{
+  if (! msgsend (pkshd, type, 0, query, length) || ! msgrecv (pkshd, reply, payload))
+    return false;
+
+  if (reply -> type != type)
+    {
+      free (* payload);
+      * payload = NULL;
+      return false;
+    }
+
+  return true;
+}
+
+
+/* Import a host in the mirror of the interface (hosts are created in the same order on both ends, so they get the same identifiers) */
+static bool hostimport (interface_t * mirror, pkshd_host_t * rec, char * counters, char * strings [])
+{
+  host_t * h = hostbyid (mirror, rec -> id);
+
+  /* The host is keyed in the mirror in its own VLAN, the same way it is in the process owning the capture */
+  if (! h)
+    {
+      if (rec -> id != mirror -> hostno)
+	return false;
+
+      if (strings [WIRE_HWADDRESS])
+	h = addtohwnames (mirror, strings [WIRE_HWADDRESS], rec -> vlan);
+      else if (strings [WIRE_IPADDR])
+	h = addtoipnames (mirror, strings [WIRE_IPADDR], rec -> vlan);
+
+      if (! h || h -> id != rec -> id)
+	return false;
+    }
+
+  if (strings [WIRE_IPADDR])
+    bindtoipnames (mirror, strings [WIRE_IPADDR], rec -> vlan, h);
+  if (strings [WIRE_HOSTNAME])
+    bindtohostnames (mirror, strings [WIRE_HOSTNAME], h);
+
+  setstr (& h -> hwaddress, strings [WIRE_HWADDRESS]);
+  setstr (& h -> vendor,    strings [WIRE_VENDOR]);
+  setstr (& h -> ipaddr,    strings [WIRE_IPADDR]);
+  setstr (& h -> hostname,  strings [WIRE_HOSTNAME]);
+  setstr (& h -> system,    strings [WIRE_SYSTEM]);
+
+  h -> first = rec -> first;
+  h -> last  = rec -> last;
+  h -> ip    = rec -> ip;
+  memcpy (h -> fingerprint, rec -> fingerprint, FPLEN);
+  memcpy ((char *) h + HOST_COUNTERS, counters, sizeof (host_t) - HOST_COUNTERS);
+
+  return true;
+}
+
+
+/* Refresh the hosts of the mirror of an interface, page by page */
+static bool hostsrefresh (interface_t * mirror)
+{
+  pkshd_query_t q;
+  pkshd_page_t page;
+  pkshd_msg_t reply;
+  char * payload;
+
+  memset (& q, 0, sizeof (q));
+  wirestr (q . name, sizeof (q . name), mirror -> name);
+  q . known = mirror -> hostno;
+  q . since = mirror -> lasttick ? mirror -> lasttick - 2 : 0;    /* a margin for the rate tick of the daemon */
+
+  do
+    {
+      char * p;
+      char * end;
+      uint32_t i;
+
+      if (! request (PKSHD_HOSTS, & q, sizeof (q), & reply, & payload) || reply . length < sizeof (page))
+	{
+	  free (payload);
+	  return false;
+	}
+
+      memcpy (& page, payload, sizeof (page));
+      p   = payload + sizeof (page);
+      end = payload + reply . length;
+
+      /* Records are packed, so they are copied out before being used */
+      for (i = 0; i < reply . arg; i ++)
+	{
+	  pkshd_host_t rec;
+	  char * counters;
+	  char * strings [WIRE_STRINGS];
+	  unsigned j;
+
+	  if (p + sizeof (rec) + sizeof (host_t) - HOST_COUNTERS > end)
+	    break;
+	  memcpy (& rec, p, sizeof (rec));
+	  counters = p + sizeof (rec);
+	  p = counters + sizeof (host_t) - HOST_COUNTERS;
+
+	  for (j = 0; j < WIRE_STRINGS; j ++)
+	    {
+	      strings [j] = rec . len [j] && p + rec . len [j] <= end && ! p [rec . len [j] - 1] ? p : NULL;
+	      p += rec . len [j];
+	    }
+
+	  if (p > end)
+	    break;
+
+	  /*
+	   * A new host published by the daemon before its HW or IP address is known cannot be keyed yet,
+	   * it is left pending (with all the new ones after it, to keep the same identifiers) until a later refresh
+	   */
+	  if (rec . id >= mirror -> hostno && ! strings [WIRE_HWADDRESS] && ! strings [WIRE_IPADDR])
+	    {
+	      free (payload);
+	      mirror -> lasttick = page . now;
+	      return true;
+	    }
+
+	  if (! hostimport (mirror, & rec, counters, strings))
+	    break;
+	}
+
+      free (payload);
+      if (i < reply . arg)
+	return false;
+
+      q . first = page . next;
+    }
+  while (q . first < page . hostno);
+
+  /* The clock of the daemon at the time of this refresh */
+  mirror -> lasttick = page . now;
+
+  return true;
+}
+
+
+/* Lost the connection, then forget about the mirrors */
+static void remotelost (void)
+{
+  printf ("pkshd: connection lost\n");
+  remotedetach ();
+}
+
+
+/* Refresh the mirrors of all the interfaces served by pkshd */
+void remoterefresh (void)
+{
+  pkshd_msg_t reply;
+  char * payload;
+  char * p;
+  uint32_t i;
+  size_t size = sizeof (pkshd_intf_t) + sizeof (interface_t) - INTF_COUNTERS;
+
+  if (pkshd == -1)
+    return;
+
+  if (! request (PKSHD_STATUS, NULL, 0, & reply, & payload) || reply . length < (size_t) reply . arg * size)
+    {
+      free (payload);
+      remotelost ();
+      return;
+    }
+
+  for (i = 0, p = payload; i < reply . arg; i ++, p += size)
+    {
+      pkshd_intf_t rec;
+      interface_t * mirror;
+
+      memcpy (& rec, p, sizeof (rec));
+      rec . name [sizeof (rec . name) - 1] = '\0';
+
+      /* A local interface with the same name wins */
+      if ((mirror = intfbyname (interfaces, rec . name)) && ! mirror -> remote)
+	continue;
+
+      if (! mirror)
+	{
+	  intflock ();
+	  interfaces = intfremote (interfaces, rec . name, & mirror);
+	  intfunlock ();
+	  if (! mirror)
+	    continue;
+	  if (! getintfname ())
+	    setactiveintf (mirror),
+	      pksh_prompt (mirror -> name);
+	}
+
+      setstr (& mirror -> hwaddr,    rec . hwaddr);
+      setstr (& mirror -> ipaddr,    rec . ipaddr);
+      setstr (& mirror -> network,   rec . network);
+      setstr (& mirror -> netmask,   rec . netmask);
+      setstr (& mirror -> broadcast, rec . broadcast);
+      setstr (& mirror -> hostname,  rec . hostname);
+      mirror -> datalink     = rec . datalink;
+      mirror -> snapshot     = rec . snapshot;
+      mirror -> promiscuous  = rec . promiscuous;
+      mirror -> mtu          = rec . mtu;
+      mirror -> ipbin        = rec . ipbin;
+      mirror -> netmaskbin   = rec . netmaskbin;
+      mirror -> networkbin   = rec . networkbin;
+      mirror -> broadcastbin = rec . broadcastbin;
+      mirror -> started      = rec . started;
+      mirror -> firstpkt     = rec . firstpkt;
+      mirror -> lastpkt      = rec . lastpkt;
+      memcpy ((char *) mirror + INTF_COUNTERS, p + sizeof (rec), sizeof (interface_t) - INTF_COUNTERS);
+
+      if (! hostsrefresh (mirror))
+	{
+	  free (payload);
+	  remotelost ();
+	  return;
+	}
+    }
+
+  free (payload);
+}
+
+
+/*
+ * The default socket of the daemon, always in a directory no other user can write to:
+ * $XDG_RUNTIME_DIR for a daemon run by an unprivileged user, PKSHD_RUNDIR for the
+ * system-wide one (a shell looks for the socket of its own user first)
+ */
+char * pkshdsocket (bool listening)
+{
+  static char path [PATH_MAX];
+  char * xdg = getenv ("XDG_RUNTIME_DIR");
+  struct stat st;
+
+  if (xdg && * xdg && (! listening || geteuid ()))
+    {
+      snprintf (path, sizeof (path), "%s/%s", xdg, PKSHD_SOCKNAME);
+      if (listening || ! stat (path, & st))
+	return path;
+    }
+
+  snprintf (path, sizeof (path), "%s/%s", PKSHD_RUNDIR, PKSHD_SOCKNAME);
+  return path;
+}
+
+
+/* Connect to the daemon listening on 'path' and mirror its interfaces */
+int remoteattach (char * path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  pkshd_msg_t reply;
+  char * payload;
+  uint32_t layout [2];
+  int fd;
+
+  if (pkshd != -1)
+    remotedetach ();
+
+  memset (& addr, 0, sizeof (addr));
+  addr . sun_family = AF_UNIX;
+  strncpy (addr . sun_path, path ? path : pkshdsocket (false), sizeof (addr . sun_path) - 1);
+
+  /* The mirror is only trusted from a daemon run by the superuser or by this same user */
+  if (lstat (addr . sun_path, & st) == -1)
+    return -1;
+  if (! S_ISSOCK (st . st_mode) || (st . st_uid && st . st_uid != geteuid ()))
+    {
+      errno = EPERM;
+      return -1;
+    }
+
+  if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1)
+    return -1;
+  if (connect (fd, (struct sockaddr *) & addr, sizeof (addr)) == -1)
+    {
+      close (fd);
+      return -1;
+    }
+  pkshd = fd;
+
+  /* Both ends must agree on the layout of the counters */
+  wirelayout (layout);
+  if (! request (PKSHD_HELLO, NULL, 0, & reply, & payload) || reply . length != sizeof (layout) || memcmp (payload, layout, sizeof (layout)))
+    {
+      free (payload);
+      close (fd);
+      pkshd = -1;
+      errno = EPROTO;
+      return -1;
+    }
+  free (payload);
+
+  remoterefresh ();
+
+  return pkshd != -1 ? 0 : -1;
+}
+
+
+/* Close the connection to the daemon and remove all the mirrors */
+void remotedetach (void)
+{
+  interface_t ** intf;
+
+  if (pkshd != -1)
+    close (pkshd);
+  pkshd = -1;
+
+  intf = interfaces;
+  while (intf && * intf)
+    if ((* intf) -> remote)
+      {
+	char * name = strdup ((* intf) -> name);
+
+	resetactiveintf (* intf);
+	intflock ();
+	interfaces = intfsub (interfaces, name);
+	intfunlock ();
+	free (name);
+	intf = interfaces;
+      }
+    else
+      intf ++;
+
+  pksh_prompt (getintfname ());
+}
+
+
+/* Is the shell attached to a daemon? */
+bool remoteattached (void)
+{
+  return pkshd != -1;
+}
@@ -33,161 +33,190 @@
 #define FIXED_LEN_OS_NAME 15
 #define FIXED_LEN_SEEN    19
 
+/*
+ * The render buffer.
+ *
+ * stdout is fully buffered into a large static area, so a whole screen of
+ * rows costs a single write(2); renderflush() is called once each builtin
+ * completes (and by long running viewers between screens) to keep the output
+ * in sync with the one of the shell
+ */
+static char renderbuf [RENDER_BUFSIZE];
+
+
+/* Make stdout fully buffered */
+void renderinit (void)
+{
+  setvbuf (stdout, renderbuf, _IOFBF, sizeof (renderbuf));
+}
+
+
+/* Flush the pending output to the terminal */
+void renderflush (void)
+{
+  fflush (stdout);
+}
+
+
+/* The clock of the phases of the viewers (it only runs when someone, i.e. pkbench, wants to time them) */
+bool viewtiming = false;
+uint64_t viewclock [VIEW_PHASES];
+
+
+/* Mark the beginning of a phase of a viewer */
+void viewphase (viewphase_t phase)
+{
+  struct timespec t;
+
+  if (! viewtiming)
+    return;
 
-/* Format a centered string */
+  clock_gettime (CLOCK_MONOTONIC, & t);
+  viewclock [phase] = (uint64_t) t . tv_sec * 1000000000 + t . tv_nsec;
+}
+
+
+/* Format a centered string into 'str' (at least 'max' + 1 bytes long) */
 static char * center (char * str, char * s, int max)
 {
   int x;  /* initial blanks */
   int y;  /* the string itself */
-  int z;  /* final blanks */
-  void * a;
-  void * b;
-  void * c;
 
   if (! s)
-    {
-      sprintf (str, "%*c", max, ' ');
-      return str;
-    }
+    s = "";
 
-  y = strlen (s);
+  y = MIN ((int) strlen (s), max);
   x = (max - y) / 2;
-  z = max - x - y;
-
-  a = calloc (1, max + 1);
-  b = calloc (1, max + 1);
-  c = calloc (1, max + 1);
-
-  if (x > 0)
-    sprintf (a, "%*c", x, ' ');         /* header */
-  if (y < max)
-    sprintf (b, "%-*.*s", y, y, s);     /* string */
-  else
-    sprintf (b, "%-*.*s", max, max, s);
-  if (z > 0)
-    sprintf (c, "%*c", z, ' ');         /* footer */
-
-  sprintf (str, "%s%s%s", (char *) a, (char *) b, (char *) c);
 
-  free (a); free (b); free (c);
+  sprintf (str, "%*s%.*s%*s", x, "", y, s, max - x - y, "");
 
   return str;
 }
 
 
-/* Format a centered number */
+/* Format a centered number into 'str' */
 static char * ncenter (char * str, counter_t n, int max)
 {
-  static char buffer [16];
+  char buffer [24];
   sprintf (buffer, "%lu", (unsigned long) n);
   return center (str, buffer, max);
 }
 
 
-/* Well formatted bytes counter */
-char * fmtbytes (counter_t bytes)
+/* Well formatted bytes counter (reentrant) */
+char * fmtbytes_r (counter_t bytes, char * str, size_t size)
 {
-  static char buffer [BUFFERS] [BUFFERSIZE];
-  static short which = -1;
-
-  which = (which + 1) % BUFFERS;   /* round-robin in the array of local buffers */
-
   if (bytes < 1024)
-    sprintf (buffer [which], "%lu Bytes", (unsigned long) bytes);
+    snprintf (str, size, "%lu Bytes", (unsigned long) bytes);
   else if (bytes < 1048576)
-    sprintf (buffer [which], "%5.1f Kb", (float) bytes / 1024);
+    snprintf (str, size, "%5.1f Kb", (float) bytes / 1024);
   else
     {
       float mega = bytes / 1048576;
       if (mega < 1024)
-	sprintf (buffer [which], "%5.1f MB", mega);
+	snprintf (str, size, "%5.1f MB", mega);
       else
 	{
 	  mega /= 1024;
 	  if (mega < 1024)
-	    sprintf (buffer [which], "%5.1f GB", mega);
+	    snprintf (str, size, "%5.1f GB", mega);
 	  else
-	    sprintf (buffer [which], "%.1f TB", mega / 1024);
+	    snprintf (str, size, "%.1f TB", mega / 1024);
 	}
     }
-  return buffer [which];
+  return str;
 }
 
 
-/* Well formatted bytes of fixed length for better rendering in tables */
-static char * nfmtbytes (counter_t bytes)
+/* Well formatted bytes counter */
+char * fmtbytes (counter_t bytes)
 {
-  static char buffer [BUFFERSIZE];
+  static __thread char buffer [BUFFERS] [BUFFERSIZE];
+  static __thread short which = -1;
 
+  which = (which + 1) % BUFFERS;   /* round-robin in the array of per-thread buffers */
+
+  return fmtbytes_r (bytes, buffer [which], BUFFERSIZE);
+}
+
+
+/* Well formatted bytes of fixed length for better rendering in tables */
+static char * nfmtbytes (char * str, counter_t bytes)
+{
   if (bytes < 1024)
-    return ncenter (buffer, bytes, FIXED_BYTES_LEN);
+    return ncenter (str, bytes, FIXED_BYTES_LEN);
   else if (bytes < 1048576)
-    sprintf (buffer, "%6.1f Kb", (float) bytes / 1024);
+    sprintf (str, "%6.1f Kb", (float) bytes / 1024);
   else
     {
       float mega = (float) (bytes / 1048576);
       if (mega < 1024)
-	sprintf (buffer, "%6.1f MB", mega);
+	sprintf (str, "%6.1f MB", mega);
       else
 	{
 	  mega /= 1024;
 	  if (mega < 1024)
-	    sprintf (buffer, "%6.1f GB", mega);
+	    sprintf (str, "%6.1f GB", mega);
 	  else
-	    sprintf (buffer, "%6.1f TB", (float) mega / 1024);
+	    sprintf (str, "%6.1f TB", (float) mega / 1024);
 	}
     }
-  return buffer;
+  return str;
 }
 
 
 #if defined(FIXME)
 /* Centered bytes (exactly) */
-static char * efmtbytes (counter_t bytes)
+static char * efmtbytes (char * str, counter_t bytes)
 {
-  static char buffer [BUFFERSIZE];
-  return ncenter (buffer, bytes, FIXED_BYTES_LEN);
+  return ncenter (str, bytes, FIXED_BYTES_LEN);
 }
 #endif /* FIXME */
 
-/* Well formatted Packets */
-char * fmtpkts (counter_t pkts)
+/* Well formatted Packets (reentrant) */
+char * fmtpkts_r (counter_t pkts, char * str, size_t size)
 {
-  static char buffer [BUFFERS] [BUFFERSIZE];
-  static short which = -1;
-
-  which = (which + 1) % BUFFERS;   /* round-robin in the array of local buffers */
-
   if (pkts < 1000)
-    sprintf (buffer [which], "%lu", (unsigned long) pkts);
+    snprintf (str, size, "%lu", (unsigned long) pkts);
   else if (pkts < 1000000)
-    sprintf (buffer [which], "%lu,%03lu", (unsigned long) pkts / 1000, (unsigned long) pkts % 1000);
+    snprintf (str, size, "%lu,%03lu", (unsigned long) pkts / 1000, (unsigned long) pkts % 1000);
   else
-    sprintf (buffer [which], "%lu,%03lu,%03lu",
-	     (unsigned long) (pkts / 1000000),
-	     (unsigned long) (pkts - (pkts / 1000000) * 1000000) / 1000,
-	     (unsigned long) pkts % 1000);
+    snprintf (str, size, "%lu,%03lu,%03lu",
+	      (unsigned long) (pkts / 1000000),
+	      (unsigned long) (pkts - (pkts / 1000000) * 1000000) / 1000,
+	      (unsigned long) pkts % 1000);
 
-  return buffer [which];
+  return str;
 }
 
 
-static char * nfmtpkts (counter_t pkts)
+/* Well formatted Packets */
+char * fmtpkts (counter_t pkts)
 {
-  static char buffer [BUFFERSIZE];
-  return ncenter (buffer, pkts, FIXED_PKTS_LEN);
+  static __thread char buffer [BUFFERS] [BUFFERSIZE];
+  static __thread short which = -1;
+
+  which = (which + 1) % BUFFERS;   /* round-robin in the array of per-thread buffers */
+
+  return fmtpkts_r (pkts, buffer [which], BUFFERSIZE);
 }
 
 
-/* Well formatted Throughput */
-char * throughputfmt (float bytes)
+static char * nfmtpkts (char * str, counter_t pkts)
 {
-  static char buffer [BUFFERS] [BUFFERSIZE];
-  static short which = -1;
+  return ncenter (str, pkts, FIXED_PKTS_LEN);
+}
 
-  float bits;
 
-  which = (which + 1) % BUFFERS;   /* round-robin in the array of local buffers */
+/* Print bytes/packets of fixed length with no need of a buffer at the caller */
+static void nbytes_printf (counter_t bytes) { char buf [BUFFERSIZE]; fputs (nfmtbytes (buf, bytes), stdout); }
+static void npkts_printf (counter_t pkts)   { char buf [BUFFERSIZE]; fputs (nfmtpkts (buf, pkts), stdout); }
+
+
+/* Well formatted Throughput (reentrant) */
+char * throughputfmt_r (float bytes, char * str, size_t size)
+{
+  float bits;
 
   if (bytes < 0)
     bytes = 0; /* Sanity check */
@@ -197,43 +226,62 @@ char * throughputfmt (float bytes)
     bits = 0; /* Avoid very small decimal values */
 
   if (bits < 1024)
-    sprintf (buffer [which], "%.1f ", bits);
+    snprintf (str, size, "%.1f ", bits);
   else if (bits < 1048576)
-    sprintf (buffer [which], "%.1f Kbps", bits / 1024);
+    snprintf (str, size, "%.1f Kbps", bits / 1024);
   else
-    sprintf (buffer [which], "%.1f Mbps", bits / 1048576);
+    snprintf (str, size, "%.1f Mbps", bits / 1048576);
 
-  return buffer [which];
+  return str;
 }
 
 
-/* Well formatted Percentage */
-char * percentage (counter_t partial, counter_t total)
+/* Well formatted Throughput */
+char * throughputfmt (float bytes)
 {
-#define ITEMS 10
-  static char buffer [ITEMS] [64];
-  static short k = -1;
+  static __thread char buffer [BUFFERS] [BUFFERSIZE];
+  static __thread short which = -1;
+
+  which = (which + 1) % BUFFERS;   /* round-robin in the array of per-thread buffers */
+
+  return throughputfmt_r (bytes, buffer [which], BUFFERSIZE);
+}
 
+
+/* Well formatted Percentage (reentrant) */
+char * percentage_r (counter_t partial, counter_t total, char * str, size_t size)
+{
 #define DECIMALS 2
   float percent;
 
-  k = (k + 1) % ITEMS;
-
   if (partial && total)
     {
       percent = (float) partial * 100 / (float) total;
 
       if (partial == total)
-	sprintf (buffer [k], " (%3d%%) ", (int) percent);
+	snprintf (str, size, " (%3d%%) ", (int) percent);
       else if (percent < 10)
-	sprintf (buffer [k], " (%4.*f%%)", DECIMALS, percent);  /* d.dd% */
+	snprintf (str, size, " (%4.*f%%)", DECIMALS, percent);  /* d.dd% */
       else
-	sprintf (buffer [k], "(%4.*f%%)", DECIMALS, percent);   /* d.dd% */
+	snprintf (str, size, "(%4.*f%%)", DECIMALS, percent);   /* d.dd% */
     }
   else
-    sprintf (buffer [k], "        ");    /* 8 blanks */
+    snprintf (str, size, "        ");    /* 8 blanks */
 
-  return buffer [k];
+  return str;
+}
+
+
+/* Well formatted Percentage */
+char * percentage (counter_t partial, counter_t total)
+{
+#define ITEMS 10
+  static __thread char buffer [ITEMS] [BUFFERSIZE];
+  static __thread short k = -1;
+
+  k = (k + 1) % ITEMS;
+
+  return percentage_r (partial, total, buffer [k], BUFFERSIZE);
 }
 
 
@@ -518,21 +566,24 @@ static void domain_printf (host_t * h, char * label)
 
 void firstseen_printf (host_t * h)
 {
-  printf ("%-*.*s", FIXED_LEN_SEEN, FIXED_LEN_SEEN, ctime (& h -> first . tv_sec));
+  char buf [32];
+  printf ("%-*.*s", FIXED_LEN_SEEN, FIXED_LEN_SEEN, ctime_r (& h -> first . tv_sec, buf));
 }
 
 
 void lastseen_printf (host_t * h)
 {
-  printf ("%-*.*s", FIXED_LEN_SEEN, FIXED_LEN_SEEN, ctime (& h -> last . tv_sec));
+  char buf [32];
+  printf ("%-*.*s", FIXED_LEN_SEEN, FIXED_LEN_SEEN, ctime_r (& h -> last . tv_sec, buf));
 }
 
 
 /* Age uptime-like format [ 0 day(s)  1:28:44] */
 static void age_last_printf (host_t * h)
 {
-  printf ("%-*.*s - ", FIXED_LEN_SEEN, FIXED_LEN_SEEN, ctime (& h -> first . tv_sec));
-  printf ("%-8.8s  ", ctime (& h -> last . tv_sec) + 11);
+  char buf [32];
+  printf ("%-*.*s - ", FIXED_LEN_SEEN, FIXED_LEN_SEEN, ctime_r (& h -> first . tv_sec, buf));
+  printf ("%-8.8s  ", ctime_r (& h -> last . tv_sec, buf) + 11);
   printf ("(%02d:%02d:%02d)",
 	  tvhours (& h -> last, & h -> first), tvmins (& h -> last, & h -> first), tvsecs (& h -> last, & h -> first));
 }
@@ -549,11 +600,11 @@ void age_uptime_printf (host_t * h)
 /* Idle uptime format */
 void idle_uptime_printf (host_t * h)
 {
-  struct timeval now;
-  gettimeofday (& now, NULL);
+  /* Idle by the time base of the capture, not by the wall clock (the frames may be replayed) */
+  struct timeval * now = & h -> intf -> clock;
 
   printf ("%3d day(s) %02d:%02d:%02d",
-	  tvdays (& now, & h -> last), tvhours (& now, & h -> last), tvmins (& now, & h -> last), tvsecs (& now, & h -> first));
+	  tvdays (now, & h -> last), tvhours (now, & h -> last), tvmins (now, & h -> last), tvsecs (now, & h -> last));
 }
 
 
@@ -594,108 +645,108 @@ int hostlongest (host_t * argv [], int numeric)
 
 
 /* Total bytes (sent + received) all protocols */
-static void total_bytes_all_printf (host_t * h)            { printf ("%s", nfmtbytes (h -> bytes_sent + h -> bytes_recv)); }
-static void total_bytes_unicast_printf (host_t * h)        { printf ("%s", nfmtbytes (h -> bytes_sent + h -> bytes_recv - h -> bytes_broadcast - h -> bytes_multicast)); }
-static void total_bytes_broadcast_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_broadcast)); }
-static void total_bytes_multicast_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_multicast)); }
-static void total_bytes_ip_all_printf (host_t * h)         { printf ("%s", nfmtbytes (h -> bytes_ip_sent + h -> bytes_ip_recv)); }
-static void total_bytes_ip_broadcast_printf (host_t * h)   { printf ("%s", nfmtbytes (h -> bytes_ip_broadcast)); }
-static void total_bytes_ip_multicast_printf (host_t * h)   { printf ("%s", nfmtbytes (h -> bytes_ip_multicast)); }
+static void total_bytes_all_printf (host_t * h)            { nbytes_printf (h -> bytes_sent + h -> bytes_recv); }
+static void total_bytes_unicast_printf (host_t * h)        { nbytes_printf (h -> bytes_sent + h -> bytes_recv - h -> bytes_broadcast - h -> bytes_multicast); }
+static void total_bytes_broadcast_printf (host_t * h)      { nbytes_printf (h -> bytes_broadcast); }
+static void total_bytes_multicast_printf (host_t * h)      { nbytes_printf (h -> bytes_multicast); }
+static void total_bytes_ip_all_printf (host_t * h)         { nbytes_printf (h -> bytes_ip_sent + h -> bytes_ip_recv); }
+static void total_bytes_ip_broadcast_printf (host_t * h)   { nbytes_printf (h -> bytes_ip_broadcast); }
+static void total_bytes_ip_multicast_printf (host_t * h)   { nbytes_printf (h -> bytes_ip_multicast); }
 #if defined(FIXME)
-static void total_bytes_ip_all_hosts_printf (host_t * h)   { printf ("%s", nfmtbytes (h -> bytes_ip_all_hosts)); }
+static void total_bytes_ip_all_hosts_printf (host_t * h)   { nbytes_printf (h -> bytes_ip_all_hosts); }
 #endif /* FIXME */
-static void total_bytes_arp_all_printf (host_t * h)        { printf ("%s", nfmtbytes (h -> bytes_arp_sent + h -> bytes_arp_recv)); }
-static void total_bytes_rarp_all_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_rarp_sent + h -> bytes_rarp_recv)); }
-static void total_bytes_non_ip_all_printf (host_t * h)     { printf ("%s", nfmtbytes (h -> bytes_non_ip_sent + h -> bytes_non_ip_recv)); }
-static void total_bytes_tcp_all_printf (host_t * h)        { printf ("%s", nfmtbytes (h -> bytes_tcp_sent + h -> bytes_tcp_recv)); }
-static void total_bytes_udp_all_printf (host_t * h)        { printf ("%s", nfmtbytes (h -> bytes_udp_sent + h -> bytes_udp_recv)); }
-static void total_bytes_icmp_all_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_icmp_sent + h -> bytes_icmp_recv)); }
-static void total_bytes_other_ip_all_printf (host_t * h)   { printf ("%s", nfmtbytes (h -> bytes_other_ip_sent + h -> bytes_other_ip_recv)); }
-static void total_bytes_http_all_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_http_sent + h -> bytes_http_recv)); }
-static void total_bytes_smtp_all_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_smtp_sent + h -> bytes_smtp_recv)); }
-static void total_bytes_other_tcp_all_printf (host_t * h)  { printf ("%s", nfmtbytes (h -> bytes_other_tcp_sent + h -> bytes_other_tcp_recv)); }
+static void total_bytes_arp_all_printf (host_t * h)        { nbytes_printf (h -> bytes_arp_sent + h -> bytes_arp_recv); }
+static void total_bytes_rarp_all_printf (host_t * h)       { nbytes_printf (h -> bytes_rarp_sent + h -> bytes_rarp_recv); }
+static void total_bytes_non_ip_all_printf (host_t * h)     { nbytes_printf (h -> bytes_non_ip_sent + h -> bytes_non_ip_recv); }
+static void total_bytes_tcp_all_printf (host_t * h)        { nbytes_printf (h -> bytes_tcp_sent + h -> bytes_tcp_recv); }
+static void total_bytes_udp_all_printf (host_t * h)        { nbytes_printf (h -> bytes_udp_sent + h -> bytes_udp_recv); }
+static void total_bytes_icmp_all_printf (host_t * h)       { nbytes_printf (h -> bytes_icmp_sent + h -> bytes_icmp_recv); }
+static void total_bytes_other_ip_all_printf (host_t * h)   { nbytes_printf (h -> bytes_other_ip_sent + h -> bytes_other_ip_recv); }
+static void total_bytes_http_all_printf (host_t * h)       { nbytes_printf (h -> bytes_http_sent + h -> bytes_http_recv); }
+static void total_bytes_smtp_all_printf (host_t * h)       { nbytes_printf (h -> bytes_smtp_sent + h -> bytes_smtp_recv); }
+static void total_bytes_other_tcp_all_printf (host_t * h)  { nbytes_printf (h -> bytes_other_tcp_sent + h -> bytes_other_tcp_recv); }
 
 /* Total bytes sent all protocols */
-static void total_bytes_sent_printf (host_t * h)           { printf ("%s", nfmtbytes (h -> bytes_sent)); }
-static void total_bytes_unicast_sent_printf (host_t * h)   { printf ("%s", nfmtbytes (h -> bytes_sent - h -> bytes_broadcast - h -> bytes_multicast)); }
-static void total_bytes_ip_sent_printf (host_t * h)        { printf ("%s", nfmtbytes (h -> bytes_ip_sent)); }
-static void total_bytes_arp_sent_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_arp_sent)); }
-static void total_bytes_rarp_sent_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_rarp_sent)); }
-static void total_bytes_non_ip_sent_printf (host_t * h)    { printf ("%s", nfmtbytes (h -> bytes_non_ip_sent)); }
-static void total_bytes_tcp_sent_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_tcp_sent)); }
-static void total_bytes_udp_sent_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_udp_sent)); }
-static void total_bytes_icmp_sent_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_icmp_sent)); }
-static void total_bytes_other_ip_sent_printf (host_t * h)  { printf ("%s", nfmtbytes (h -> bytes_other_ip_sent)); }
-static void total_bytes_http_sent_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_http_sent)); }
-static void total_bytes_smtp_sent_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_smtp_sent)); }
-static void total_bytes_other_tcp_sent_printf (host_t * h) { printf ("%s", nfmtbytes (h -> bytes_other_tcp_sent)); }
+static void total_bytes_sent_printf (host_t * h)           { nbytes_printf (h -> bytes_sent); }
+static void total_bytes_unicast_sent_printf (host_t * h)   { nbytes_printf (h -> bytes_sent - h -> bytes_broadcast - h -> bytes_multicast); }
+static void total_bytes_ip_sent_printf (host_t * h)        { nbytes_printf (h -> bytes_ip_sent); }
+static void total_bytes_arp_sent_printf (host_t * h)       { nbytes_printf (h -> bytes_arp_sent); }
+static void total_bytes_rarp_sent_printf (host_t * h)      { nbytes_printf (h -> bytes_rarp_sent); }
+static void total_bytes_non_ip_sent_printf (host_t * h)    { nbytes_printf (h -> bytes_non_ip_sent); }
+static void total_bytes_tcp_sent_printf (host_t * h)       { nbytes_printf (h -> bytes_tcp_sent); }
+static void total_bytes_udp_sent_printf (host_t * h)       { nbytes_printf (h -> bytes_udp_sent); }
+static void total_bytes_icmp_sent_printf (host_t * h)      { nbytes_printf (h -> bytes_icmp_sent); }
+static void total_bytes_other_ip_sent_printf (host_t * h)  { nbytes_printf (h -> bytes_other_ip_sent); }
+static void total_bytes_http_sent_printf (host_t * h)      { nbytes_printf (h -> bytes_http_sent); }
+static void total_bytes_smtp_sent_printf (host_t * h)      { nbytes_printf (h -> bytes_smtp_sent); }
+static void total_bytes_other_tcp_sent_printf (host_t * h) { nbytes_printf (h -> bytes_other_tcp_sent); }
 
 /* Total bytes received all protocols */
-static void total_bytes_recv_printf (host_t * h)           { printf ("%s", nfmtbytes (h -> bytes_recv)); }
-static void total_bytes_unicast_recv_printf (host_t * h)   { printf ("%s", nfmtbytes (h -> bytes_recv)); }
-static void total_bytes_ip_recv_printf (host_t * h)        { printf ("%s", nfmtbytes (h -> bytes_ip_recv)); }
-static void total_bytes_arp_recv_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_arp_recv)); }
-static void total_bytes_rarp_recv_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_rarp_recv)); }
-static void total_bytes_non_ip_recv_printf (host_t * h)    { printf ("%s", nfmtbytes (h -> bytes_non_ip_recv)); }
-static void total_bytes_tcp_recv_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_tcp_recv)); }
-static void total_bytes_udp_recv_printf (host_t * h)       { printf ("%s", nfmtbytes (h -> bytes_udp_recv)); }
-static void total_bytes_icmp_recv_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_icmp_recv)); }
-static void total_bytes_other_ip_recv_printf (host_t * h)  { printf ("%s", nfmtbytes (h -> bytes_other_ip_recv)); }
-static void total_bytes_http_recv_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_http_recv)); }
-static void total_bytes_smtp_recv_printf (host_t * h)      { printf ("%s", nfmtbytes (h -> bytes_smtp_recv)); }
-static void total_bytes_other_tcp_recv_printf (host_t * h) { printf ("%s", nfmtbytes (h -> bytes_other_tcp_recv)); }
+static void total_bytes_recv_printf (host_t * h)           { nbytes_printf (h -> bytes_recv); }
+static void total_bytes_unicast_recv_printf (host_t * h)   { nbytes_printf (h -> bytes_recv); }
+static void total_bytes_ip_recv_printf (host_t * h)        { nbytes_printf (h -> bytes_ip_recv); }
+static void total_bytes_arp_recv_printf (host_t * h)       { nbytes_printf (h -> bytes_arp_recv); }
+static void total_bytes_rarp_recv_printf (host_t * h)      { nbytes_printf (h -> bytes_rarp_recv); }
+static void total_bytes_non_ip_recv_printf (host_t * h)    { nbytes_printf (h -> bytes_non_ip_recv); }
+static void total_bytes_tcp_recv_printf (host_t * h)       { nbytes_printf (h -> bytes_tcp_recv); }
+static void total_bytes_udp_recv_printf (host_t * h)       { nbytes_printf (h -> bytes_udp_recv); }
+static void total_bytes_icmp_recv_printf (host_t * h)      { nbytes_printf (h -> bytes_icmp_recv); }
+static void total_bytes_other_ip_recv_printf (host_t * h)  { nbytes_printf (h -> bytes_other_ip_recv); }
+static void total_bytes_http_recv_printf (host_t * h)      { nbytes_printf (h -> bytes_http_recv); }
+static void total_bytes_smtp_recv_printf (host_t * h)      { nbytes_printf (h -> bytes_smtp_recv); }
+static void total_bytes_other_tcp_recv_printf (host_t * h) { nbytes_printf (h -> bytes_other_tcp_recv); }
 
 /* Total packets (sent + received) all protocols */
-static void total_pkts_all_printf (host_t * h)             { printf ("%s", nfmtpkts (h -> pkts_sent + h -> pkts_recv)); }
-static void total_pkts_unicast_printf (host_t * h)         { printf ("%s", nfmtpkts (h -> pkts_sent + h -> pkts_recv - h -> pkts_broadcast - h -> pkts_multicast)); }
-static void total_pkts_broadcast_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_broadcast)); }
-static void total_pkts_multicast_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_multicast)); }
-static void total_pkts_ip_all_printf (host_t * h)          { printf ("%s", nfmtpkts (h -> pkts_ip_sent + h -> pkts_ip_recv)); }
-static void total_pkts_ip_broadcast_printf (host_t * h)    { printf ("%s", nfmtpkts (h -> pkts_ip_broadcast)); }
-static void total_pkts_ip_multicast_printf (host_t * h)    { printf ("%s", nfmtpkts (h -> pkts_ip_multicast)); }
+static void total_pkts_all_printf (host_t * h)             { npkts_printf (h -> pkts_sent + h -> pkts_recv); }
+static void total_pkts_unicast_printf (host_t * h)         { npkts_printf (h -> pkts_sent + h -> pkts_recv - h -> pkts_broadcast - h -> pkts_multicast); }
+static void total_pkts_broadcast_printf (host_t * h)       { npkts_printf (h -> pkts_broadcast); }
+static void total_pkts_multicast_printf (host_t * h)       { npkts_printf (h -> pkts_multicast); }
+static void total_pkts_ip_all_printf (host_t * h)          { npkts_printf (h -> pkts_ip_sent + h -> pkts_ip_recv); }
+static void total_pkts_ip_broadcast_printf (host_t * h)    { npkts_printf (h -> pkts_ip_broadcast); }
+static void total_pkts_ip_multicast_printf (host_t * h)    { npkts_printf (h -> pkts_ip_multicast); }
 #if defined(FIXME)
-static void total_pkts_ip_all_hosts_printf (host_t * h)    { printf ("%s", nfmtpkts (h -> pkts_ip_all_hosts)); }
+static void total_pkts_ip_all_hosts_printf (host_t * h)    { npkts_printf (h -> pkts_ip_all_hosts); }
 #endif /* FIXME */
-static void total_pkts_arp_all_printf (host_t * h)         { printf ("%s", nfmtpkts (h -> pkts_arp_sent + h -> pkts_arp_recv)); }
-static void total_pkts_rarp_all_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_rarp_sent + h -> pkts_rarp_recv)); }
-static void total_pkts_non_ip_all_printf (host_t * h)      { printf ("%s", nfmtpkts (h -> pkts_non_ip_sent + h -> pkts_non_ip_recv)); }
-static void total_pkts_tcp_all_printf (host_t * h)         { printf ("%s", nfmtpkts (h -> pkts_tcp_sent + h -> pkts_tcp_recv)); }
-static void total_pkts_udp_all_printf (host_t * h)         { printf ("%s", nfmtpkts (h -> pkts_udp_sent + h -> pkts_udp_recv)); }
-static void total_pkts_icmp_all_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_icmp_sent + h -> pkts_icmp_recv)); }
-static void total_pkts_other_ip_all_printf (host_t * h)    { printf ("%s", nfmtpkts (h -> pkts_other_ip_sent + h -> pkts_other_ip_recv)); }
-static void total_pkts_http_all_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_http_sent + h -> pkts_http_recv)); }
-static void total_pkts_smtp_all_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_smtp_sent + h -> pkts_smtp_recv)); }
-static void total_pkts_other_tcp_all_printf (host_t * h)   { printf ("%s", nfmtpkts (h -> pkts_other_tcp_sent + h -> pkts_other_tcp_recv)); }
+static void total_pkts_arp_all_printf (host_t * h)         { npkts_printf (h -> pkts_arp_sent + h -> pkts_arp_recv); }
+static void total_pkts_rarp_all_printf (host_t * h)        { npkts_printf (h -> pkts_rarp_sent + h -> pkts_rarp_recv); }
+static void total_pkts_non_ip_all_printf (host_t * h)      { npkts_printf (h -> pkts_non_ip_sent + h -> pkts_non_ip_recv); }
+static void total_pkts_tcp_all_printf (host_t * h)         { npkts_printf (h -> pkts_tcp_sent + h -> pkts_tcp_recv); }
+static void total_pkts_udp_all_printf (host_t * h)         { npkts_printf (h -> pkts_udp_sent + h -> pkts_udp_recv); }
+static void total_pkts_icmp_all_printf (host_t * h)        { npkts_printf (h -> pkts_icmp_sent + h -> pkts_icmp_recv); }
+static void total_pkts_other_ip_all_printf (host_t * h)    { npkts_printf (h -> pkts_other_ip_sent + h -> pkts_other_ip_recv); }
+static void total_pkts_http_all_printf (host_t * h)        { npkts_printf (h -> pkts_http_sent + h -> pkts_http_recv); }
+static void total_pkts_smtp_all_printf (host_t * h)        { npkts_printf (h -> pkts_smtp_sent + h -> pkts_smtp_recv); }
+static void total_pkts_other_tcp_all_printf (host_t * h)   { npkts_printf (h -> pkts_other_tcp_sent + h -> pkts_other_tcp_recv); }
 
 /* Total packets sent all protocols */
-static void total_pkts_sent_printf (host_t * h)            { printf ("%s", nfmtpkts (h -> pkts_sent)); }
-static void total_pkts_unicast_sent_printf (host_t * h)    { printf ("%s", nfmtpkts (h -> pkts_sent - h -> pkts_broadcast - h -> pkts_multicast)); }
-static void total_pkts_ip_sent_printf (host_t * h)         { printf ("%s", nfmtpkts (h -> pkts_ip_sent)); }
-static void total_pkts_arp_sent_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_arp_sent)); }
-static void total_pkts_rarp_sent_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_rarp_sent)); }
-static void total_pkts_non_ip_sent_printf (host_t * h)     { printf ("%s", nfmtpkts (h -> pkts_non_ip_sent)); }
-static void total_pkts_tcp_sent_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_tcp_sent)); }
-static void total_pkts_udp_sent_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_udp_sent)); }
-static void total_pkts_icmp_sent_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_icmp_sent)); }
-static void total_pkts_other_ip_sent_printf (host_t * h)   { printf ("%s", nfmtpkts (h -> pkts_other_ip_sent)); }
-static void total_pkts_http_sent_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_http_sent)); }
-static void total_pkts_smtp_sent_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_smtp_sent)); }
-static void total_pkts_other_tcp_sent_printf (host_t * h)  { printf ("%s", nfmtpkts (h -> pkts_other_tcp_sent)); }
+static void total_pkts_sent_printf (host_t * h)            { npkts_printf (h -> pkts_sent); }
+static void total_pkts_unicast_sent_printf (host_t * h)    { npkts_printf (h -> pkts_sent - h -> pkts_broadcast - h -> pkts_multicast); }
+static void total_pkts_ip_sent_printf (host_t * h)         { npkts_printf (h -> pkts_ip_sent); }
+static void total_pkts_arp_sent_printf (host_t * h)        { npkts_printf (h -> pkts_arp_sent); }
+static void total_pkts_rarp_sent_printf (host_t * h)       { npkts_printf (h -> pkts_rarp_sent); }
+static void total_pkts_non_ip_sent_printf (host_t * h)     { npkts_printf (h -> pkts_non_ip_sent); }
+static void total_pkts_tcp_sent_printf (host_t * h)        { npkts_printf (h -> pkts_tcp_sent); }
+static void total_pkts_udp_sent_printf (host_t * h)        { npkts_printf (h -> pkts_udp_sent); }
+static void total_pkts_icmp_sent_printf (host_t * h)       { npkts_printf (h -> pkts_icmp_sent); }
+static void total_pkts_other_ip_sent_printf (host_t * h)   { npkts_printf (h -> pkts_other_ip_sent); }
+static void total_pkts_http_sent_printf (host_t * h)       { npkts_printf (h -> pkts_http_sent); }
+static void total_pkts_smtp_sent_printf (host_t * h)       { npkts_printf (h -> pkts_smtp_sent); }
+static void total_pkts_other_tcp_sent_printf (host_t * h)  { npkts_printf (h -> pkts_other_tcp_sent); }
 
 /* Total packets received all protocols */
-static void total_pkts_recv_printf (host_t * h)            { printf ("%s", nfmtpkts (h -> pkts_recv)); }
-static void total_pkts_unicast_recv_printf (host_t * h)    { printf ("%s", nfmtpkts (h -> pkts_recv)); }
-static void total_pkts_ip_recv_printf (host_t * h)         { printf ("%s", nfmtpkts (h -> pkts_ip_recv)); }
-static void total_pkts_arp_recv_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_arp_recv)); }
-static void total_pkts_rarp_recv_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_rarp_recv)); }
-static void total_pkts_non_ip_recv_printf (host_t * h)     { printf ("%s", nfmtpkts (h -> pkts_non_ip_recv)); }
-static void total_pkts_tcp_recv_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_tcp_recv)); }
-static void total_pkts_udp_recv_printf (host_t * h)        { printf ("%s", nfmtpkts (h -> pkts_udp_recv)); }
-static void total_pkts_icmp_recv_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_icmp_recv)); }
-static void total_pkts_other_ip_recv_printf (host_t * h)   { printf ("%s", nfmtpkts (h -> pkts_other_ip_recv)); }
-static void total_pkts_http_recv_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_http_recv)); }
-static void total_pkts_smtp_recv_printf (host_t * h)       { printf ("%s", nfmtpkts (h -> pkts_smtp_recv)); }
-static void total_pkts_other_tcp_recv_printf (host_t * h)  { printf ("%s", nfmtpkts (h -> pkts_other_tcp_recv)); }
+static void total_pkts_recv_printf (host_t * h)            { npkts_printf (h -> pkts_recv); }
+static void total_pkts_unicast_recv_printf (host_t * h)    { npkts_printf (h -> pkts_recv); }
+static void total_pkts_ip_recv_printf (host_t * h)         { npkts_printf (h -> pkts_ip_recv); }
+static void total_pkts_arp_recv_printf (host_t * h)        { npkts_printf (h -> pkts_arp_recv); }
+static void total_pkts_rarp_recv_printf (host_t * h)       { npkts_printf (h -> pkts_rarp_recv); }
+static void total_pkts_non_ip_recv_printf (host_t * h)     { npkts_printf (h -> pkts_non_ip_recv); }
+static void total_pkts_tcp_recv_printf (host_t * h)        { npkts_printf (h -> pkts_tcp_recv); }
+static void total_pkts_udp_recv_printf (host_t * h)        { npkts_printf (h -> pkts_udp_recv); }
+static void total_pkts_icmp_recv_printf (host_t * h)       { npkts_printf (h -> pkts_icmp_recv); }
+static void total_pkts_other_ip_recv_printf (host_t * h)   { npkts_printf (h -> pkts_other_ip_recv); }
+static void total_pkts_http_recv_printf (host_t * h)       { npkts_printf (h -> pkts_http_recv); }
+static void total_pkts_smtp_recv_printf (host_t * h)       { npkts_printf (h -> pkts_smtp_recv); }
+static void total_pkts_other_tcp_recv_printf (host_t * h)  { npkts_printf (h -> pkts_other_tcp_recv); }
 
 
 /* Print network usage in terms of bytes */
@@ -775,6 +826,14 @@ void packets_distribution (host_t * h)
       total_pkts_multicast_printf (h); printf (" %s", percentage (h -> pkts_multicast, h -> pkts_sent + h -> pkts_recv));
       printf ("\n");
     }
+
+  /* Only the sender of a damaged packet is known for sure */
+  if (h -> pkts_fragments_sent)
+    printf ("  Fragments    : %s sent %s\n", fmtpkts (h -> pkts_fragments_sent), percentage (h -> pkts_fragments_sent, h -> pkts_sent));
+  if (h -> pkts_malformed_sent)
+    printf ("  Malformed    : %s sent %s\n", fmtpkts (h -> pkts_malformed_sent), percentage (h -> pkts_malformed_sent, h -> pkts_sent));
+  if (h -> pkts_badsum_sent)
+    printf ("  Bad checksum : %s sent %s\n", fmtpkts (h -> pkts_badsum_sent), percentage (h -> pkts_badsum_sent, h -> pkts_sent));
 }
 
 
@@ -948,254 +1007,414 @@ void tcp_protocols_distribution (host_t * h)
 }
 
 
-/* Format and print data from the internal hosts cache */
-void hostprintf (host_t * h, int argc, char * argv [], char fsep)
+/* Render 'n' values as a sparkline (one UTF-8 block character foreach value) */
+static char * sparkline (char * str, counter_t values [], int n)
 {
-  /* G N U  F o r m a t t i n g  o p t i o n s */
-  static struct option const long_options [] =
-    {
-      /* Administrative [range 100 - 119] */
-
-      { "label",                  required_argument, NULL, 100 },
-
-      /* Identifiers */
-
-      { "interface",              no_argument,       NULL, 101 },
-      { "datalink",               no_argument,       NULL, 102 },
-      { "mac-address",            no_argument,       NULL, 103 },
-      { "ip-address",             no_argument,       NULL, 104 },
-      { "hostname",               optional_argument, NULL, 105 },
-      { "host-numeric",           optional_argument, NULL, 106 },
-      { "host-identifier",        optional_argument, NULL, 107 },
-      { "host-ipless",            optional_argument, NULL, 108 },
-      { "vendor-name",            optional_argument, NULL, 109 },
-      { "os-name",                optional_argument, NULL, 110 },
-      { "domain-name",            optional_argument, NULL, 111 },
-      { "first-seen",             no_argument,       NULL, 112 },
-      { "last-seen",              no_argument,       NULL, 113 },
-      { "age-last",               no_argument,       NULL, 114 },
-      { "age-uptime",             no_argument,       NULL, 115 },
-
-      /* Total bytes (sent + received) for all protocols [range 120 - 139] */
-
-      { "total-bytes-all",        no_argument,       NULL, 120 },
-      { "broadcast-bytes",        no_argument,       NULL, 121 },
-      { "multicast-bytes",        no_argument,       NULL, 122 },
-      { "ip-bytes-all",           no_argument,       NULL, 123 },
-      { "ip-broadcast-bytes",     no_argument,       NULL, 124 },
-      { "ip-multicast-bytes",     no_argument,       NULL, 125 },
-      { "arp-bytes-all",          no_argument,       NULL, 126 },
-      { "rarp-bytes-all",         no_argument,       NULL, 127 },
-      { "non-ip-bytes-all",       no_argument,       NULL, 128 },
-      { "tcp-bytes-all",          no_argument,       NULL, 129 },
-      { "udp-bytes-all",          no_argument,       NULL, 130 },
-      { "icmp-bytes-all",         no_argument,       NULL, 131 },
-      { "other-ip-bytes-all",     no_argument,       NULL, 132 },
-
-      /* Total bytes sent for all protocols [range 140 - 159] */
-
-      { "total-bytes-sent",       no_argument,       NULL, 140 },
-      { "ip-bytes-sent",          no_argument,       NULL, 141 },
-      { "arp-bytes-sent",         no_argument,       NULL, 142 },
-      { "rarp-bytes-sent",        no_argument,       NULL, 143 },
-      { "non-ip-bytes-sent",      no_argument,       NULL, 144 },
-      { "tcp-bytes-sent",         no_argument,       NULL, 145 },
-      { "udp-bytes-sent",         no_argument,       NULL, 146 },
-      { "icmp-bytes-sent",        no_argument,       NULL, 147 },
-      { "other-ip-bytes-sent",    no_argument,       NULL, 148 },
-
-      { "bytes-sent-to-local",    no_argument,       NULL, 151 },
-      { "bytes-sent-to-remote",   no_argument,       NULL, 152 },
-
-      /* Total bytes received for all protocols [range 160 - 179] */
-
-      { "total-bytes-recv",       no_argument,       NULL, 160 },
-      { "ip-bytes-recv",          no_argument,       NULL, 161 },
-      { "arp-bytes-recv",         no_argument,       NULL, 162 },
-      { "rarp-bytes-recv",        no_argument,       NULL, 163 },
-      { "non-ip-bytes-recv",      no_argument,       NULL, 164 },
-      { "tcp-bytes-recv",         no_argument,       NULL, 165 },
-      { "udp-bytes-recv",         no_argument,       NULL, 166 },
-      { "icmp-ip-bytes-recv",     no_argument,       NULL, 167 },
-      { "other-ip-bytes-recv",    no_argument,       NULL, 168 },
-
-      { "bytes-recv-from-local",  no_argument,       NULL, 170 },
-      { "bytes-recv-from-remote", no_argument,       NULL, 171 },
-
-      /* Total packets (sent + received) for all protocols [range 180 - 199] */
-
-      { "total-pkts-all",         no_argument,       NULL, 180 },
-      { "broadcast-pkts-sent",    no_argument,       NULL, 181 },
-      { "multicast-pkts-sent",    no_argument,       NULL, 182 },
-      { "ip-pkts-all",            no_argument,       NULL, 183 },
-      { "ip-broadcast-pkts-sent", no_argument,       NULL, 184 },
-      { "ip-multicast-pkts-sent", no_argument,       NULL, 185 },
-      { "arp-pkts-all",           no_argument,       NULL, 186 },
-      { "rarp-pkts-all",          no_argument,       NULL, 187 },
-      { "non-ip-pkts-all",        no_argument,       NULL, 188 },
-      { "tcp-pkts-all",           no_argument,       NULL, 189 },
-      { "udp-pkts-all",           no_argument,       NULL, 190 },
-      { "icmp-pkts-all",          no_argument,       NULL, 191 },
-      { "other-ip-pkts-all",      no_argument,       NULL, 192 },
-
-      /* Total packets sent for all protocols [range 200 - 219] */
-
-      { "total-pkts-sent",        no_argument,       NULL, 200 },
-      { "ip-pkts-sent",           no_argument,       NULL, 201 },
-      { "arp-pkts-sent",          no_argument,       NULL, 202 },
-      { "rarp-pkts-sent",         no_argument,       NULL, 203 },
-      { "non-ip-pkts-sent",       no_argument,       NULL, 204 },
-      { "tcp-pkts-sent",          no_argument,       NULL, 205 },
-      { "udp-pkts-sent",          no_argument,       NULL, 206 },
-      { "icmp-pkts-sent",         no_argument,       NULL, 207 },
-      { "other-ip-pkts-sent",     no_argument,       NULL, 208 },
-
-      { "pkts-sent-to-local",     no_argument,       NULL, 209 },
-      { "pkts-sent-to-remote",    no_argument,       NULL, 210 },
-
-      /* Total packets received for all protocols [range 220 - 239] */
-
-      { "total-pkts-recv",        no_argument,       NULL, 220 },
-      { "ip-pkts-recv",           no_argument,       NULL, 221 },
-      { "arp-pkts-recv",          no_argument,       NULL, 222 },
-      { "rarp-pkts-recv",         no_argument,       NULL, 223 },
-      { "non-ip-pkts-recv",       no_argument,       NULL, 224 },
-      { "tcp-pkts-recv",          no_argument,       NULL, 225 },
-      { "udp-pkts-recv",          no_argument,       NULL, 226 },
-      { "icmp-pkts-recv",         no_argument,       NULL, 227 },
-      { "other-ip-pkts-recv",     no_argument,       NULL, 228 },
-
-      { "pkts-recv-from-local",   no_argument,       NULL, 230 },
-      { "pkts-recv-from-remote",  no_argument,       NULL, 231 },
-
-      { NULL,                     0,                 NULL, 0 }
-    };
+  static char * blocks [] = { " ", "\u2581", "\u2582", "\u2583", "\u2584", "\u2585", "\u2586", "\u2587", "\u2588" };
+  counter_t max = 0;
+  int i;
 
-  int option;
-  char tsep = '\0';
+  for (i = 0; i < n; i ++)
+    max = MAX (max, values [i]);
+
+  * str = '\0';
+  for (i = 0; i < n; i ++)
+    strcat (str, blocks [max ? (values [i] * 8 + max - 1) / max : 0]);
+
+  return str;
+}
+
+
+/* Print traffic distribution by minute (last hour) and by hour (last day) */
+void bytes_all_by_hour (host_t * h)
+{
+  counter_t mbytes [HISTORY_MINUTES];
+  counter_t mpkts [HISTORY_MINUTES];
+  counter_t hbytes [HISTORY_HOURS];
+  counter_t hpkts [HISTORY_HOURS];
+  char line [HISTORY_MINUTES * 4];
+  char b [BUFFERSIZE];
+  char p [BUFFERSIZE];
+  int i;
+  int indent;
+  counter_t bytes = 0;
+  counter_t pkts = 0;
+
+  histminutes (& h -> history, mbytes, mpkts);
+  histhours (& h -> history, hbytes, hpkts);
+
+  printf ("\n");
+  printf ("Traffic             Total       Pkts    History (bytes, then packets)\n");
+
+  /* The packets are drawn right below the bytes */
+  for (i = 0; i < HISTORY_MINUTES; i ++)
+    bytes += mbytes [i], pkts += mpkts [i];
+  indent = printf ("  Last hour    : %s %s    ", nfmtbytes (b, bytes), nfmtpkts (p, pkts));
+  printf ("[%s]\n", sparkline (line, mbytes, HISTORY_MINUTES));
+  printf ("%*s[%s]\n", indent, "", sparkline (line, mpkts, HISTORY_MINUTES));
+
+  for (bytes = pkts = i = 0; i < HISTORY_HOURS; i ++)
+    bytes += hbytes [i], pkts += hpkts [i];
+  indent = printf ("  Last day     : %s %s    ", nfmtbytes (b, bytes), nfmtpkts (p, pkts));
+  printf ("[%s]\n", sparkline (line, hbytes, HISTORY_HOURS));
+  printf ("%*s[%s]\n", indent, "", sparkline (line, hpkts, HISTORY_HOURS));
+}
+
+
+/* Throughput */
+static void thrput_current_bytes_printf (host_t * h)  { char buf [BUFFERSIZE]; char t [BUFFERSIZE]; printf ("%s", center (buf, throughputfmt_r (h -> bytes_current, t, sizeof (t)), 11)); }
+static void thrput_average_bytes_printf (host_t * h)  { char buf [BUFFERSIZE]; char t [BUFFERSIZE]; printf ("%s", center (buf, throughputfmt_r (h -> bytes_average, t, sizeof (t)), 11)); }
+static void thrput_peak_bytes_printf (host_t * h)     { char buf [BUFFERSIZE]; char t [BUFFERSIZE]; printf ("%s", center (buf, throughputfmt_r (h -> bytes_peak, t, sizeof (t)), 11)); }
+static void thrput_lasthour_bytes_printf (host_t * h) { char buf [BUFFERSIZE]; char t [BUFFERSIZE]; printf ("%s", center (buf, fmtbytes_r (histlasthour (& h -> history), t, sizeof (t)), 11)); }
+static void thrput_current_pkts_printf (host_t * h)   { char buf [BUFFERSIZE]; printf ("%s", ncenter (buf, h -> pkts_current, 11)); }
+static void thrput_average_pkts_printf (host_t * h)   { char buf [BUFFERSIZE]; printf ("%s", ncenter (buf, h -> pkts_average, 11)); }
+static void thrput_peak_pkts_printf (host_t * h)      { char buf [BUFFERSIZE]; printf ("%s", ncenter (buf, h -> pkts_peak, 11)); }
 
-  char fmt [1024];
-  char label [1024];
-  int width = 0;
 
-  /* table separator */
-  if (tsep)
-    printf ("%c", tsep);
+/* Formatters foreach column of the tables (indexed by the GNU formatting option code) */
+static struct
+{
+  int code;
+  void (* print) (host_t * h);
+  void (* lprint) (host_t * h, char * label);
+} formatters [] =
+{
+  { 101, interface_printf,                   NULL                 },  /* Network interface name (FIXED_LEN_NAME)     */
+  { 102, datalink_printf,                    NULL                 },  /* Data-link type                              */
+  { 103, mac_printf,                         NULL                 },  /* MAC address (FIXED_LEN_MAC bytes long)      */
+  { 104, ip_printf,                          NULL                 },  /* IP address (FIXED_LEN_IP bytes long)        */
+  { 105, NULL,                               hostname_printf      },  /* Hostname Address (Symbolic)                 */
+  { 106, NULL,                               numeric_id_printf    },  /* Host numeric identifier                     */
+  { 107, NULL,                               unique_id_printf     },  /* Host unique identifier                      */
+  { 108, NULL,                               ipless_id_printf     },  /* Host unique identifier for IP-Less          */
+  { 109, NULL,                               vendor_printf        },  /* NIC Vendor Name resolved via IEEE database  */
+  { 110, NULL,                               os_system_printf     },  /* OS System Name resolved via fingerprint     */
+  { 111, NULL,                               domain_printf        },  /* Domain name                                 */
+  { 112, firstseen_printf,                   NULL                 },  /* First Seen (fixed size left aligned)        */
+  { 113, lastseen_printf,                    NULL                 },  /* Last Seen (fixed size left aligned)         */
+  { 114, age_last_printf,                    NULL                 },  /* Age last-like format                        */
+  { 115, age_uptime_printf,                  NULL                 },  /* Age uptime-like format                      */
+
+  { 120, total_bytes_all_printf,             NULL                 },  /* Total bytes all (sent + received)           */
+  { 121, total_bytes_broadcast_printf,       NULL                 },  /* Total Broadcast bytes sent                  */
+  { 122, total_bytes_multicast_printf,       NULL                 },  /* Total Multicast bytes sent                  */
+  { 123, total_bytes_ip_all_printf,          NULL                 },  /* Total IP bytes all (sent + received)        */
+  { 124, total_bytes_ip_broadcast_printf,    NULL                 },  /* Total IP Broadcast bytes sent               */
+  { 125, total_bytes_ip_multicast_printf,    NULL                 },  /* Total IP Multicast bytes sent               */
+  { 126, total_bytes_arp_all_printf,         NULL                 },  /* Total ARP bytes all (sent + received)       */
+  { 127, total_bytes_rarp_all_printf,        NULL                 },  /* Total RARP bytes all (sent + received)      */
+  { 128, total_bytes_non_ip_all_printf,      NULL                 },  /* Total Non-IP bytes all (sent + received)    */
+  { 129, total_bytes_tcp_all_printf,         NULL                 },  /* Total TCP bytes all (sent + received)       */
+  { 130, total_bytes_udp_all_printf,         NULL                 },  /* Total UDP bytes all (sent + received)       */
+  { 131, total_bytes_icmp_all_printf,        NULL                 },  /* Total ICMP bytes all (sent + received)      */
+  { 132, total_bytes_other_ip_all_printf,    NULL                 },  /* Total Other-IP bytes all (sent + received)  */
+
+  { 140, total_bytes_sent_printf,            NULL                 },  /* Total bytes sent                            */
+  { 141, total_bytes_ip_sent_printf,         NULL                 },  /* Total IP bytes sent                         */
+  { 142, total_bytes_arp_sent_printf,        NULL                 },  /* Total ARP bytes sent                        */
+  { 143, total_bytes_rarp_sent_printf,       NULL                 },  /* Total RARP bytes sent                       */
+  { 144, total_bytes_non_ip_sent_printf,     NULL                 },  /* Total Non-IP bytes sent                     */
+  { 145, total_bytes_tcp_sent_printf,        NULL                 },  /* Total TCP bytes sent                        */
+  { 146, total_bytes_udp_sent_printf,        NULL                 },  /* Total UDP bytes sent                        */
+  { 147, total_bytes_icmp_sent_printf,       NULL                 },  /* Total ICMP bytes sent                       */
+  { 148, total_bytes_other_ip_sent_printf,   NULL                 },  /* Total Other-IP bytes sent                   */
+
+  { 151, NULL,                               NULL                 },  /* Total bytes sent to local network           */
+  { 152, NULL,                               NULL                 },  /* Total bytes sent to remote networks         */
+
+  { 160, total_bytes_recv_printf,            NULL                 },  /* Total bytes received                        */
+  { 161, total_bytes_ip_recv_printf,         NULL                 },  /* Total IP bytes received                     */
+  { 162, total_bytes_arp_recv_printf,        NULL                 },  /* Total ARP bytes received                    */
+  { 163, total_bytes_rarp_recv_printf,       NULL                 },  /* Total RARP bytes received                   */
+  { 164, total_bytes_non_ip_recv_printf,     NULL                 },  /* Total Non-IP bytes received                 */
+  { 165, total_bytes_tcp_recv_printf,        NULL                 },  /* Total TCP bytes received                    */
+  { 166, total_bytes_udp_recv_printf,        NULL                 },  /* Total UDP bytes received                    */
+  { 167, total_bytes_icmp_recv_printf,       NULL                 },  /* Total ICMP bytes received                   */
+  { 168, total_bytes_other_ip_recv_printf,   NULL                 },  /* Total Other-IP bytes received               */
+
+  { 170, NULL,                               NULL                 },  /* Total bytes received from local network     */
+  { 171, NULL,                               NULL                 },  /* Total bytes received from remote networks   */
+
+  { 180, total_pkts_all_printf,              NULL                 },  /* Total packets all (sent + received)         */
+  { 181, total_pkts_broadcast_printf,        NULL                 },  /* Total Broadcast packets sent                */
+  { 182, total_pkts_multicast_printf,        NULL                 },  /* Total Multicast packets all sent            */
+  { 183, total_pkts_ip_all_printf,           NULL                 },  /* Total IP packets all (sent + received)      */
+  { 184, total_pkts_ip_broadcast_printf,     NULL                 },  /* Total IP Broadcast packets sent             */
+  { 185, total_pkts_ip_multicast_printf,     NULL                 },  /* Total IP Multicast packets sent             */
+  { 186, total_pkts_arp_all_printf,          NULL                 },  /* Total ARP packets all (sent + received)     */
+  { 187, total_pkts_rarp_all_printf,         NULL                 },  /* Total RARP packets all (sent + received)    */
+  { 188, total_pkts_non_ip_all_printf,       NULL                 },  /* Total Non-IP packets all (sent + received)  */
+  { 189, total_pkts_tcp_all_printf,          NULL                 },  /* Total TCP packets all (sent + received)     */
+  { 190, total_pkts_udp_all_printf,          NULL                 },  /* Total UDP packets all (sent + received)     */
+  { 191, total_pkts_icmp_all_printf,         NULL                 },  /* Total ICMP packets all (sent + received)    */
+  { 192, total_pkts_other_ip_all_printf,     NULL                 },  /* Total Other-IP packets all (sent + received)*/
+
+  { 200, total_pkts_sent_printf,             NULL                 },  /* Total packets sent                          */
+  { 201, total_pkts_ip_sent_printf,          NULL                 },  /* Total IP packets sent                       */
+  { 202, total_pkts_arp_sent_printf,         NULL                 },  /* Total ARP packets sent                      */
+  { 203, total_pkts_rarp_sent_printf,        NULL                 },  /* Total RARP packets sent                     */
+  { 204, total_pkts_non_ip_sent_printf,      NULL                 },  /* Total Non-IP packets sent                   */
+  { 205, total_pkts_tcp_sent_printf,         NULL                 },  /* Total TCP packets sent                      */
+  { 206, total_pkts_udp_sent_printf,         NULL                 },  /* Total UDP packets sent                      */
+  { 207, total_pkts_icmp_sent_printf,        NULL                 },  /* Total ICMP packets sent                     */
+  { 208, total_pkts_other_ip_sent_printf,    NULL                 },  /* Total Other-IP packets sent                 */
+
+  { 209, NULL,                               NULL                 },  /* Total packets sent to local network         */
+  { 210, NULL,                               NULL                 },  /* Total packets sent to remote networks       */
+
+  { 220, total_pkts_recv_printf,             NULL                 },  /* Total packets received                      */
+  { 221, total_pkts_ip_recv_printf,          NULL                 },  /* Total IP packets received                   */
+  { 222, total_pkts_arp_recv_printf,         NULL                 },  /* Total ARP packets received                  */
+  { 223, total_pkts_rarp_recv_printf,        NULL                 },  /* Total RARP packets received                 */
+  { 224, total_pkts_non_ip_recv_printf,      NULL                 },  /* Total Non-IP packets received               */
+  { 225, total_pkts_tcp_recv_printf,         NULL                 },  /* Total TCP packets received                  */
+  { 226, total_pkts_udp_recv_printf,         NULL                 },  /* Total UDP packets received                  */
+  { 227, total_pkts_icmp_recv_printf,        NULL                 },  /* Total ICMP packets received                 */
+  { 228, total_pkts_other_ip_recv_printf,    NULL                 },  /* Total Other-IP packets received             */
+
+  { 230, NULL,                               NULL                 },  /* Total packets received from local network   */
+  { 231, NULL,                               NULL                 },  /* Total packets received from remote networks */
+
+  { 240, thrput_current_bytes_printf,        NULL                 },  /* Current throughput in bytes                 */
+  { 241, thrput_average_bytes_printf,        NULL                 },  /* Average throughput in bytes                 */
+  { 242, thrput_peak_bytes_printf,           NULL                 },  /* Peak throughput in bytes                    */
+  { 243, thrput_lasthour_bytes_printf,       NULL                 },  /* Bytes seen during the last hour             */
+  { 244, thrput_current_pkts_printf,         NULL                 },  /* Current throughput in packets               */
+  { 245, thrput_average_pkts_printf,         NULL                 },  /* Average throughput in packets               */
+  { 246, thrput_peak_pkts_printf,            NULL                 },  /* Peak throughput in packets                  */
+};
+
+
+/* G N U  F o r m a t t i n g  o p t i o n s */
+static struct option const columns_options [] =
+  {
+    /* Administrative [range 100 - 119] */
+
+    { "label",                  required_argument, NULL, 100 },
+
+    /* Identifiers */
+
+    { "interface",              no_argument,       NULL, 101 },
+    { "datalink",               no_argument,       NULL, 102 },
+    { "mac-address",            no_argument,       NULL, 103 },
+    { "ip-address",             no_argument,       NULL, 104 },
+    { "hostname",               optional_argument, NULL, 105 },
+    { "host-numeric",           optional_argument, NULL, 106 },
+    { "host-identifier",        optional_argument, NULL, 107 },
+    { "host-ipless",            optional_argument, NULL, 108 },
+    { "vendor-name",            optional_argument, NULL, 109 },
+    { "os-name",                optional_argument, NULL, 110 },
+    { "domain-name",            optional_argument, NULL, 111 },
+    { "first-seen",             no_argument,       NULL, 112 },
+    { "last-seen",              no_argument,       NULL, 113 },
+    { "age-last",               no_argument,       NULL, 114 },
+    { "age-uptime",             no_argument,       NULL, 115 },
+
+    /* Total bytes (sent + received) for all protocols [range 120 - 139] */
+
+    { "total-bytes-all",        no_argument,       NULL, 120 },
+    { "broadcast-bytes",        no_argument,       NULL, 121 },
+    { "multicast-bytes",        no_argument,       NULL, 122 },
+    { "ip-bytes-all",           no_argument,       NULL, 123 },
+    { "ip-broadcast-bytes",     no_argument,       NULL, 124 },
+    { "ip-multicast-bytes",     no_argument,       NULL, 125 },
+    { "arp-bytes-all",          no_argument,       NULL, 126 },
+    { "rarp-bytes-all",         no_argument,       NULL, 127 },
+    { "non-ip-bytes-all",       no_argument,       NULL, 128 },
+    { "tcp-bytes-all",          no_argument,       NULL, 129 },
+    { "udp-bytes-all",          no_argument,       NULL, 130 },
+    { "icmp-bytes-all",         no_argument,       NULL, 131 },
+    { "other-ip-bytes-all",     no_argument,       NULL, 132 },
+
+    /* Total bytes sent for all protocols [range 140 - 159] */
+
+    { "total-bytes-sent",       no_argument,       NULL, 140 },
+    { "ip-bytes-sent",          no_argument,       NULL, 141 },
+    { "arp-bytes-sent",         no_argument,       NULL, 142 },
+    { "rarp-bytes-sent",        no_argument,       NULL, 143 },
+    { "non-ip-bytes-sent",      no_argument,       NULL, 144 },
+    { "tcp-bytes-sent",         no_argument,       NULL, 145 },
+    { "udp-bytes-sent",         no_argument,       NULL, 146 },
+    { "icmp-bytes-sent",        no_argument,       NULL, 147 },
+    { "other-ip-bytes-sent",    no_argument,       NULL, 148 },
+
+    { "bytes-sent-to-local",    no_argument,       NULL, 151 },
+    { "bytes-sent-to-remote",   no_argument,       NULL, 152 },
+
+    /* Total bytes received for all protocols [range 160 - 179] */
+
+    { "total-bytes-recv",       no_argument,       NULL, 160 },
+    { "ip-bytes-recv",          no_argument,       NULL, 161 },
+    { "arp-bytes-recv",         no_argument,       NULL, 162 },
+    { "rarp-bytes-recv",        no_argument,       NULL, 163 },
+    { "non-ip-bytes-recv",      no_argument,       NULL, 164 },
+    { "tcp-bytes-recv",         no_argument,       NULL, 165 },
+    { "udp-bytes-recv",         no_argument,       NULL, 166 },
+    { "icmp-ip-bytes-recv",     no_argument,       NULL, 167 },
+    { "other-ip-bytes-recv",    no_argument,       NULL, 168 },
+
+    { "bytes-recv-from-local",  no_argument,       NULL, 170 },
+    { "bytes-recv-from-remote", no_argument,       NULL, 171 },
+
+    /* Total packets (sent + received) for all protocols [range 180 - 199] */
+
+    { "total-pkts-all",         no_argument,       NULL, 180 },
+    { "broadcast-pkts-sent",    no_argument,       NULL, 181 },
+    { "multicast-pkts-sent",    no_argument,       NULL, 182 },
+    { "ip-pkts-all",            no_argument,       NULL, 183 },
+    { "ip-broadcast-pkts-sent", no_argument,       NULL, 184 },
+    { "ip-multicast-pkts-sent", no_argument,       NULL, 185 },
+    { "arp-pkts-all",           no_argument,       NULL, 186 },
+    { "rarp-pkts-all",          no_argument,       NULL, 187 },
+    { "non-ip-pkts-all",        no_argument,       NULL, 188 },
+    { "tcp-pkts-all",           no_argument,       NULL, 189 },
+    { "udp-pkts-all",           no_argument,       NULL, 190 },
+    { "icmp-pkts-all",          no_argument,       NULL, 191 },
+    { "other-ip-pkts-all",      no_argument,       NULL, 192 },
+
+    /* Total packets sent for all protocols [range 200 - 219] */
+
+    { "total-pkts-sent",        no_argument,       NULL, 200 },
+    { "ip-pkts-sent",           no_argument,       NULL, 201 },
+    { "arp-pkts-sent",          no_argument,       NULL, 202 },
+    { "rarp-pkts-sent",         no_argument,       NULL, 203 },
+    { "non-ip-pkts-sent",       no_argument,       NULL, 204 },
+    { "tcp-pkts-sent",          no_argument,       NULL, 205 },
+    { "udp-pkts-sent",          no_argument,       NULL, 206 },
+    { "icmp-pkts-sent",         no_argument,       NULL, 207 },
+    { "other-ip-pkts-sent",     no_argument,       NULL, 208 },
+
+    { "pkts-sent-to-local",     no_argument,       NULL, 209 },
+    { "pkts-sent-to-remote",    no_argument,       NULL, 210 },
+
+    /* Total packets received for all protocols [range 220 - 239] */
+
+    { "total-pkts-recv",        no_argument,       NULL, 220 },
+    { "ip-pkts-recv",           no_argument,       NULL, 221 },
+    { "arp-pkts-recv",          no_argument,       NULL, 222 },
+    { "rarp-pkts-recv",         no_argument,       NULL, 223 },
+    { "non-ip-pkts-recv",       no_argument,       NULL, 224 },
+    { "tcp-pkts-recv",          no_argument,       NULL, 225 },
+    { "udp-pkts-recv",          no_argument,       NULL, 226 },
+    { "icmp-pkts-recv",         no_argument,       NULL, 227 },
+    { "other-ip-pkts-recv",     no_argument,       NULL, 228 },
+
+    { "pkts-recv-from-local",   no_argument,       NULL, 230 },
+    { "pkts-recv-from-remote",  no_argument,       NULL, 231 },
+
+    /* Throughput [range 240 - 259] */
+
+    { "thrput-current-bytes",    no_argument,       NULL, 240 },
+    { "thrput-average-bytes",    no_argument,       NULL, 241 },
+    { "thrput-peak-bytes",       no_argument,       NULL, 242 },
+    { "thrput-lasthour-bytes",   no_argument,       NULL, 243 },
+    { "thrput-current-packets",  no_argument,       NULL, 244 },
+    { "thrput-average-packets",  no_argument,       NULL, 245 },
+    { "thrput-peak-packets",     no_argument,       NULL, 246 },
+
+    { NULL,                     0,                 NULL, 0 }
+  };
+
+
+/*
+ * Compile the GNU-style columns specification in 'argv' into a plan
+ * of typed column descriptors, once for all the rows of a table
+ */
+colplan_t * colplan (int argc, char * argv [], char fsep)
+{
+  colplan_t * plan = calloc (1, sizeof (colplan_t));
+  int option;
+
+  plan -> fsep = fsep;
+  plan -> name = argv [0];
 
   /* Parse command line options */
   optind = 0;
   optarg = NULL;
-  while ((option = getopt_long (argc, argv, "", long_options, NULL)) != -1)
+  while ((option = getopt_long (argc, argv, "", columns_options, NULL)) != -1)
     {
-      width = 0;
-      switch (option)
+      column_t * col;
+      unsigned i;
+
+      plan -> columns = realloc (plan -> columns, (plan -> n + 1) * sizeof (column_t));
+      col = & plan -> columns [plan -> n ++];
+      memset (col, 0, sizeof (column_t));
+      col -> code = option;
+
+      if (option == 100)
 	{
-	case 100:    /* Label */
-	  sscanf (optarg, "%[^[][%d][^]]]", label, & width);
-	  printf ("%s", center (fmt, label, width ? width : strlen (label)));
-	  break;
-
-	case 101: interface_printf (h);                  break; /* Network interface name (FIXED_LEN_NAME)     */
-	case 102: datalink_printf (h);                   break; /* Data-link type                              */
-	case 103: mac_printf (h);                        break; /* MAC address (FIXED_LEN_MAC bytes long)      */
-	case 104: ip_printf (h);                         break; /* IP address (FIXED_LEN_IP bytes long)        */
-	case 105: hostname_printf (h, optarg);           break; /* Hostname Address (Symbolic)                 */
-	case 106: numeric_id_printf (h, optarg);         break; /* Host numeric identifier                     */
-	case 107: unique_id_printf (h, optarg);          break; /* Host unique identifier                      */
-	case 108: ipless_id_printf (h, optarg);          break; /* Host unique identifier for IP-Less          */
-	case 109: vendor_printf (h, optarg);             break; /* NIC Vendor Name resolved via IEEE database  */
-	case 110: os_system_printf (h, optarg);          break; /* OS System Name resolved via fingerprint     */
-	case 111: domain_printf (h, optarg);             break; /* Domain name                                 */
-	case 112: firstseen_printf (h);                  break; /* First Seen (fixed size left aligned)        */
-	case 113: lastseen_printf (h);                   break; /* Last Seen (fixed size left aligned)         */
-	case 114: age_last_printf (h);                   break; /* Age last-like format                        */
-	case 115: age_uptime_printf (h);                 break; /* Age uptime-like format                      */
-
-	case 120: total_bytes_all_printf (h);            break; /* Total bytes all (sent + received)           */
-	case 121: total_bytes_broadcast_printf (h);      break; /* Total Broadcast bytes sent                  */
-	case 122: total_bytes_multicast_printf (h);      break; /* Total Multicast bytes sent                  */
-	case 123: total_bytes_ip_all_printf (h);         break; /* Total IP bytes all (sent + received)        */
-	case 124: total_bytes_ip_broadcast_printf (h);   break; /* Total IP Broadcast bytes sent               */
-	case 125: total_bytes_ip_multicast_printf (h);   break; /* Total IP Multicast bytes sent               */
-	case 126: total_bytes_arp_all_printf (h);        break; /* Total ARP bytes all (sent + received)       */
-	case 127: total_bytes_rarp_all_printf (h);       break; /* Total RARP bytes all (sent + received)      */
-	case 128: total_bytes_non_ip_all_printf (h);     break; /* Total Non-IP bytes all (sent + received)    */
-	case 129: total_bytes_tcp_all_printf (h);        break; /* Total TCP bytes all (sent + received)       */
-	case 130: total_bytes_udp_all_printf (h);        break; /* Total UDP bytes all (sent + received)       */
-	case 131: total_bytes_icmp_all_printf (h);       break; /* Total ICMP bytes all (sent + received)      */
-	case 132: total_bytes_other_ip_all_printf (h);   break; /* Total Other-IP bytes all (sent + received)  */
-
-	case 140: total_bytes_sent_printf (h);           break; /* Total bytes sent                            */
-	case 141: total_bytes_ip_sent_printf (h);        break; /* Total IP bytes sent                         */
-	case 142: total_bytes_arp_sent_printf (h);       break; /* Total ARP bytes sent                        */
-	case 143: total_bytes_rarp_sent_printf (h);      break; /* Total RARP bytes sent                       */
-	case 144: total_bytes_non_ip_sent_printf (h);    break; /* Total Non-IP bytes sent                     */
-	case 145: total_bytes_tcp_sent_printf (h);       break; /* Total TCP bytes sent                        */
-	case 146: total_bytes_udp_sent_printf (h);       break; /* Total UDP bytes sent                        */
-	case 147: total_bytes_icmp_sent_printf (h);      break; /* Total ICMP bytes sent                       */
-	case 148: total_bytes_other_ip_sent_printf (h);  break; /* Total Other-IP bytes sent                   */
-
-	case 151:                                        break; /* Total bytes sent to local network           */
-	case 152:                                        break; /* Total bytes sent to remote networks         */
-
-	case 160: total_bytes_recv_printf (h);           break; /* Total bytes received                        */
-	case 161: total_bytes_ip_recv_printf (h);        break; /* Total IP bytes received                     */
-	case 162: total_bytes_arp_recv_printf (h);       break; /* Total ARP bytes received                    */
-	case 163: total_bytes_rarp_recv_printf (h);      break; /* Total RARP bytes received                   */
-	case 164: total_bytes_non_ip_recv_printf (h);    break; /* Total Non-IP bytes received                 */
-	case 165: total_bytes_tcp_recv_printf (h);       break; /* Total TCP bytes received                    */
-	case 166: total_bytes_udp_recv_printf (h);       break; /* Total UDP bytes received                    */
-	case 167: total_bytes_icmp_recv_printf (h);      break; /* Total ICMP bytes received                   */
-	case 168: total_bytes_other_ip_recv_printf (h);  break; /* Total Other-IP bytes received               */
-
-	case 169:                                        break; /* Total bytes received from local network     */
-	case 170:                                        break; /* Total bytes received from remote networks   */
-
-	case 180: total_pkts_all_printf (h);             break; /* Total packets all (sent + received)         */
-	case 181: total_pkts_broadcast_printf (h);       break; /* Total Broadcast packets sent                */
-	case 182: total_pkts_multicast_printf (h);       break; /* Total Multicast packets all sent            */
-	case 183: total_pkts_ip_all_printf (h);          break; /* Total IP packets all (sent + received)      */
-	case 184: total_pkts_ip_broadcast_printf (h);    break; /* Total IP Broadcast packets sent             */
-	case 185: total_pkts_ip_multicast_printf (h);    break; /* Total IP Multicast packets sent             */
-	case 186: total_pkts_arp_all_printf (h);         break; /* Total ARP packets all (sent + received)     */
-	case 187: total_pkts_rarp_all_printf (h);        break; /* Total RARP packets all (sent + received)    */
-	case 188: total_pkts_non_ip_all_printf (h);      break; /* Total Non-IP packets all (sent + received)  */
-	case 189: total_pkts_tcp_all_printf (h);         break; /* Total TCP packets all (sent + received)     */
-	case 190: total_pkts_udp_all_printf (h);         break; /* Total UDP packets all (sent + received)     */
-	case 191: total_pkts_icmp_all_printf (h);        break; /* Total ICMP packets all (sent + received)    */
-	case 192: total_pkts_other_ip_all_printf (h);    break; /* Total Other-IP packets all (sent + received)*/
-
-	case 200: total_pkts_sent_printf (h);            break; /* Total packets sent                          */
-	case 201: total_pkts_ip_sent_printf (h);         break; /* Total IP packets sent                       */
-	case 202: total_pkts_arp_sent_printf (h);        break; /* Total ARP packets sent                      */
-	case 203: total_pkts_rarp_sent_printf (h);       break; /* Total RARP packets sent                     */
-	case 204: total_pkts_non_ip_sent_printf (h);     break; /* Total Non-IP packets sent                   */
-	case 205: total_pkts_tcp_sent_printf (h);        break; /* Total TCP packets sent                      */
-	case 206: total_pkts_udp_sent_printf (h);        break; /* Total UDP packets sent                      */
-	case 207: total_pkts_icmp_sent_printf (h);       break; /* Total ICMP packets sent                     */
-	case 208: total_pkts_other_ip_sent_printf (h);   break; /* Total Other-IP packets sent                 */
-
-	case 209:                                        break; /* Total packets sent to local network         */
-	case 210:                                        break; /* Total packets sent to remote networks       */
-
-	case 220: total_pkts_recv_printf (h);            break; /* Total packets received                      */
-	case 221: total_pkts_ip_recv_printf (h);         break; /* Total IP packets received                   */
-	case 222: total_pkts_arp_recv_printf (h);        break; /* Total ARP packets received                  */
-	case 223: total_pkts_rarp_recv_printf (h);       break; /* Total RARP packets received                 */
-	case 224: total_pkts_non_ip_recv_printf (h);     break; /* Total Non-IP packets received               */
-	case 225: total_pkts_tcp_recv_printf (h);        break; /* Total TCP packets received                  */
-	case 226: total_pkts_udp_recv_printf (h);        break; /* Total UDP packets received                  */
-	case 227: total_pkts_icmp_recv_printf (h);       break; /* Total ICMP packets received                 */
-	case 228: total_pkts_other_ip_recv_printf (h);   break; /* Total Other-IP packets received             */
-
-	case 229:                                        break; /* Total packets received from local network   */
-	case 230:                                        break; /* Total packets received from remote networks */
-
-	default: printf ("%s: unknown option '%d'", argv [0], option); break;
+	  /* Label, rendered once for all */
+	  char label [1024] = "";
+	  sscanf (optarg, "%1023[^[][%d][^]]]", label, & col -> width);
+	  col -> width = col -> width ? col -> width : strlen (label);
+	  col -> label = calloc (1, col -> width + 1);
+	  center (col -> label, label, col -> width);
+	  continue;
 	}
 
+      if (optarg)
+	col -> label = strdup (optarg),
+	  col -> width = atoi (optarg);
+
+      for (i = 0; i < sizeof (formatters) / sizeof (formatters [0]); i ++)
+	if (formatters [i] . code == option)
+	  {
+	    col -> print = formatters [i] . print;
+	    col -> lprint = formatters [i] . lprint;
+	    break;
+	  }
+      col -> unknown = i == sizeof (formatters) / sizeof (formatters [0]);
+    }
+
+  return plan;
+}
+
+
+/* Format and print data of host 'h' according to the columns in 'plan' (titles only if 'h' is NULL) */
+void colprintf (colplan_t * plan, host_t * h)
+{
+  column_t * col;
+
+  for (col = plan -> columns; col < plan -> columns + plan -> n; col ++)
+    {
+      if (col -> code == 100)
+	fputs (col -> label, stdout);
+      else if (col -> print)
+	col -> print (h);
+      else if (col -> lprint)
+	col -> lprint (h, col -> label);
+      else if (col -> unknown)
+	printf ("%s: unknown option '%d'", plan -> name, col -> code);
+
       /* field separator */
-      if (fsep)
-	printf ("%c", fsep);
+      if (plan -> fsep)
+	putchar (plan -> fsep);
     }
 }
+
+
+/* Free a plan of columns */
+void colfree (colplan_t * plan)
+{
+  column_t * col;
+
+  if (! plan)
+    return;
+
+  for (col = plan -> columns; col < plan -> columns + plan -> n; col ++)
+    if (col -> label)
+      free (col -> label);
+  if (plan -> columns)
+    free (plan -> columns);
+  free (plan);
+}
+
+
+/* Format and print data from the internal hosts cache */
+void hostprintf (host_t * h, int argc, char * argv [], char fsep)
+{
+  colplan_t * plan = colplan (argc, argv, fsep);
+
+  colprintf (plan, h);
+  colfree (plan);
+}
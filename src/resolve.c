@@ -0,0 +1,192 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Reverse lookups of the IPv6 hosts off the capture path
+ *
+ * Privacy and temporary addresses make a steady stream of new IPv6 hosts,
+ * so the sniffer never waits for the DNS: it queues the address of each new
+ * host and a resolver thread looks its name up.  The answers are taken back
+ * by the sniffer on its next rate tick, as only the sniffer may change the
+ * hash tables of its interface.  While the queue is full or the sniffer is
+ * shedding the hosts are just known by their address.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* # of lookups waiting for the resolver (and of answers waiting for the sniffers) */
+#define RESOLV_QUEUE  1024
+
+
+/* A lookup and its answer */
+typedef struct
+{
+  interface_t * intf;           /* the interface of the host                          */
+  unsigned id;                  /* the identifier of the host in its registry         */
+  struct in6_addr addr;         /* its address                                        */
+  char * name;                  /* its name (NULL if the address has none)            */
+
+} resolv_t;
+
+
+/* Everything below is shared by the sniffers and the resolver */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_once_t started = PTHREAD_ONCE_INIT;
+
+static resolv_t pending [RESOLV_QUEUE];   /* a FIFO of lookups                   */
+static unsigned head;
+static unsigned npending;
+static resolv_t done [RESOLV_QUEUE];      /* the answers, in no order            */
+static unsigned ndone;
+static interface_t * busy;                /* the interface of the lookup running */
+
+
+/* The resolver thread */
+static void * resolver (void * unused)
+{
+  sigset_t mask;
+
+  /* Signals are left to the shell */
+  sigfillset (& mask);
+  pthread_sigmask (SIG_BLOCK, & mask, NULL);
+
+  pthread_mutex_lock (& mutex);
+  while (true)
+    {
+      struct sockaddr_in6 sa;
+      char host [NI_MAXHOST];
+      resolv_t r;
+      bool found;
+
+      while (! npending)
+	pthread_cond_wait (& wakeup, & mutex);
+
+      r = pending [head];
+      head = (head + 1) % RESOLV_QUEUE;
+      npending --;
+      busy = r . intf;
+      pthread_mutex_unlock (& mutex);
+
+      memset (& sa, 0, sizeof (sa));
+      sa . sin6_family = AF_INET6;
+      sa . sin6_addr   = r . addr;
+      found = ! getnameinfo ((struct sockaddr *) & sa, sizeof (sa), host, sizeof (host), NULL, 0, NI_NAMEREQD);
+
+      /* The interface may have gone in the meantime (see resolvforget) */
+      pthread_mutex_lock (& mutex);
+      if (busy && ndone < RESOLV_QUEUE)
+	r . name = found ? strdup (host) : NULL,
+	  done [ndone ++] = r;
+      busy = NULL;
+    }
+
+  return NULL;
+}
+
+
+static void resolvstart (void)
+{
+  pthread_t tid;
+
+  if (! pthread_create (& tid, NULL, resolver, NULL))
+    pthread_detach (tid);
+}
+
+
+/* Name the host 'h' ('name' is taken over, its address when NULL) and make the name known */
+static void resolvname (host_t * h, char * name)
+{
+  h -> hostname = name ? name : strdup (h -> ipaddr);
+  bindtohostnames (h -> intf, h -> hostname, h);
+}
+
+
+/* Queue the reverse lookup of the IPv6 host 'h' (called by the sniffer) */
+void resolvqueue (host_t * h)
+{
+  bool queued = false;
+
+  if (! h || ! h -> ipaddr || h -> hostname)
+    return;
+
+  if (h -> intf -> shedding < SHED_FINGERPRINTS)
+    {
+      pthread_once (& started, resolvstart);
+
+      pthread_mutex_lock (& mutex);
+      if (npending < RESOLV_QUEUE)
+	{
+	  pending [(head + npending ++) % RESOLV_QUEUE] = (resolv_t) { h -> intf, h -> id, h -> ip6, NULL };
+	  pthread_cond_signal (& wakeup);
+	  queued = true;
+	}
+      pthread_mutex_unlock (& mutex);
+    }
+
+  if (! queued)
+    resolvname (h, NULL);
+}
+
+
+/* Take the answers about the hosts of 'intf' (called by the sniffer on its rate tick) */
+void resolvdrain (interface_t * intf)
+{
+  unsigned i = 0;
+
+  pthread_mutex_lock (& mutex);
+  while (i < ndone)
+    if (done [i] . intf == intf)
+      {
+	host_t * h = hostbyid (intf, done [i] . id);
+
+	if (h && ! h -> hostname)
+	  resolvname (h, done [i] . name);
+	else
+	  free (done [i] . name);
+	done [i] = done [-- ndone];
+      }
+    else
+      i ++;
+  pthread_mutex_unlock (& mutex);
+}
+
+
+/* Forget the lookups and the answers about the hosts of 'intf' (it is going away) */
+void resolvforget (interface_t * intf)
+{
+  unsigned kept = 0;
+  unsigned i;
+
+  pthread_mutex_lock (& mutex);
+
+  for (i = 0; i < npending; i ++)
+    if (pending [(head + i) % RESOLV_QUEUE] . intf != intf)
+      pending [(head + kept ++) % RESOLV_QUEUE] = pending [(head + i) % RESOLV_QUEUE];
+  npending = kept;
+
+  for (i = 0; i < ndone; )
+    if (done [i] . intf == intf)
+      free (done [i] . name),
+	done [i] = done [-- ndone];
+    else
+      i ++;
+
+  if (busy == intf)
+    busy = NULL;
+
+  pthread_mutex_unlock (& mutex);
+}
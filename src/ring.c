@@ -0,0 +1,325 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * The in-memory ring of the last frames captured on an interface
+ *
+ * The ring is allocated once and the sniffer copies each frame into it,
+ * overwriting the oldest records when room is needed, so there is no
+ * allocation per packet.  The sniffer moves 'tail' past the records it is
+ * going to overwrite before touching them: a reader copying a record checks
+ * 'tail' again afterwards and throws the copy away if the record was reached
+ * in the meantime (the same way the readers of a sequence lock do).
+ * Each record is numbered, so a reader tells how many frames it missed.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <errno.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* How long to wait for the sniffer to let the ring go (nsecs) */
+#define IDLE_NSECS   (10 * 1000 * 1000)
+
+
+/* The header of a record in the ring: the pcap record header and the # of the frame since the ring was allocated */
+typedef struct
+{
+  rechdr_t rh;
+  uint64_t seq;
+
+} ringhdr_t;
+
+
+/* Copy 'n' bytes into the ring at 'pos' (wrapping at its end) */
+static void rput (ring_t * r, unsigned long pos, const void * src, size_t n)
+{
+  size_t off   = pos & (r -> size - 1);
+  size_t first = MIN (n, r -> size - off);
+
+  memcpy (r -> buf + off, src, first);
+  if (first < n)
+    memcpy (r -> buf, (u_char *) src + first, n - first);
+}
+
+
+/* Copy 'n' bytes out of the ring at 'pos' (wrapping at its end) */
+static void rget (ring_t * r, unsigned long pos, void * dst, size_t n)
+{
+  size_t off   = pos & (r -> size - 1);
+  size_t first = MIN (n, r -> size - off);
+
+  memcpy (dst, r -> buf + off, first);
+  if (first < n)
+    memcpy ((u_char *) dst + first, r -> buf, n - first);
+}
+
+
+/* Has the record at 'pos' been overwritten while it was being copied? */
+static bool overrun (ring_t * r, unsigned long pos)
+{
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  return __atomic_load_n (& r -> tail, __ATOMIC_RELAXED) > pos;
+}
+
+
+/* Store a frame into the ring of 'intf' (called by the sniffer, 'h' is NULL when there is no frame) */
+void ringpkt (interface_t * intf, struct pcap_pkthdr * h, const u_char * p)
+{
+  ring_t * r = __atomic_load_n (& intf -> ring, __ATOMIC_ACQUIRE);
+  unsigned long head;
+  unsigned long tail;
+  ringhdr_t rh;
+  size_t need;
+
+  if (! r)
+    return;
+
+  /* Let the ring go, it is never referenced again */
+  if (__atomic_load_n (& r -> stop, __ATOMIC_ACQUIRE))
+    {
+      __atomic_store_n (& intf -> ring, NULL, __ATOMIC_RELEASE);
+      __atomic_store_n (& r -> detached, true, __ATOMIC_RELEASE);
+      return;
+    }
+
+  if (! h)
+    return;
+
+  rh . rh . sec    = h -> ts . tv_sec;
+  rh . rh . usec   = h -> ts . tv_usec;
+  rh . rh . caplen = h -> caplen;
+  rh . rh . len    = h -> len;
+  rh . seq         = r -> pkts;
+  need = RECALIGN (sizeof (rh) + rh . rh . caplen);
+
+  if (need > r -> size)
+    {
+      r -> dropped ++;
+      return;
+    }
+
+  /* Make room by evicting the oldest records, readers are told before they are overwritten */
+  head = r -> head;
+  tail = r -> tail;
+  if (r -> size - (head - tail) < need)
+    {
+      while (r -> size - (head - tail) < need)
+	{
+	  ringhdr_t old;
+
+	  rget (r, tail, & old, sizeof (old));
+	  tail += RECALIGN (sizeof (old) + old . rh . caplen);
+	  r -> overwritten ++;
+	}
+      __atomic_store_n (& r -> tail, tail, __ATOMIC_RELAXED);
+      __atomic_thread_fence (__ATOMIC_RELEASE);
+    }
+
+  rput (r, head, & rh, sizeof (rh));
+  rput (r, head + sizeof (rh), p, rh . rh . caplen);
+  __atomic_store_n (& r -> head, head + need, __ATOMIC_RELEASE);
+
+  r -> pkts ++;
+}
+
+
+/* Allocate the ring of 'intf' with room for at most 'size' bytes of records (see its size) */
+ring_t * ringstart (interface_t * intf, size_t size)
+{
+  ring_t * r;
+  size_t s = 1;
+
+  if (intf -> ring)
+    {
+      errno = EBUSY;
+      return NULL;
+    }
+
+  /* The ring is a power of two, so positions just wrap (never more memory than asked for) */
+  while (s <= size / 2)
+    s <<= 1;
+
+  if (! (r = calloc (1, sizeof (ring_t))) || ! (r -> buf = malloc (s)))
+    {
+      if (r)
+	free (r);
+      errno = ENOMEM;
+      return NULL;
+    }
+  r -> size = s;
+
+  __atomic_store_n (& intf -> ring, r, __ATOMIC_RELEASE);
+
+  return r;
+}
+
+
+/* Release the ring of 'intf' */
+void ringstop (interface_t * intf)
+{
+  ring_t * r = intf -> ring;
+  struct timespec idle = { 0, IDLE_NSECS };
+
+  if (! r)
+    return;
+
+  __atomic_store_n (& r -> stop, true, __ATOMIC_RELEASE);
+
+  /* Wait for the sniffer to let the ring go (it does it itself unless it is not running) */
+  while (! __atomic_load_n (& r -> detached, __ATOMIC_ACQUIRE))
+    {
+      if (intf -> status != INTERFACE_ENABLED)
+	{
+	  __atomic_store_n (& intf -> ring, NULL, __ATOMIC_RELEASE);
+	  break;
+	}
+      nanosleep (& idle, NULL);
+    }
+
+  free (r -> buf);
+  free (r);
+}
+
+
+/* The # of frames held in the ring and the time span they cover */
+void ringspan (ring_t * r, unsigned long * pkts, time_t * first, time_t * last)
+{
+  unsigned long head = __atomic_load_n (& r -> head, __ATOMIC_ACQUIRE);
+  unsigned long pos  = __atomic_load_n (& r -> tail, __ATOMIC_ACQUIRE);
+  ringhdr_t rh;
+
+  * pkts  = 0;
+  * first = 0;
+  * last  = 0;
+
+  while (pos < head)
+    {
+      rget (r, pos, & rh, sizeof (rh));
+      if (overrun (r, pos))
+	{
+	  pos = __atomic_load_n (& r -> tail, __ATOMIC_ACQUIRE);
+	  continue;
+	}
+
+      if (! * pkts)
+	* first = rh . rh . sec;
+      * last = rh . rh . sec;
+      (* pkts) ++;
+      pos += RECALIGN (sizeof (rh) + rh . rh . caplen);
+    }
+}
+
+
+/*
+ * Save into the pcap file 'path' the frames of the ring of 'intf' captured over the last 'seconds'
+ * (all if 0) and within the last 'bytes' of the ring (all if 0), while the sniffer keeps capturing.
+ * Frames overwritten before they could be saved are counted in 'lost' (told by the gaps in their numbers).
+ */
+int ringsave (interface_t * intf, char * path, unsigned seconds, size_t bytes, unsigned long * saved, unsigned long * lost)
+{
+  ring_t * r = intf -> ring;
+  pcap_dumper_t * dumper;
+  unsigned long head;
+  unsigned long pos;
+  u_char * frame;
+  size_t largest = MAX (intf -> snapshot, 65535);
+  time_t since = 0;
+  uint64_t expected = 0;
+  bool started = false;
+  ringhdr_t rh;
+
+  * saved = 0;
+  * lost  = 0;
+
+  if (! r)
+    {
+      errno = ENOENT;
+      return -1;
+    }
+
+  /* Only the frames already in the ring are saved, newer ones keep it moving */
+  head = __atomic_load_n (& r -> head, __ATOMIC_ACQUIRE);
+
+  if (seconds)
+    {
+      unsigned long pkts;
+      time_t first;
+      time_t last;
+
+      ringspan (r, & pkts, & first, & last);
+      since = last - seconds + 1;
+    }
+
+  if (! (dumper = pcap_dump_open (intf -> pcap, path)))
+    {
+      errno = EIO;
+      return -1;
+    }
+
+  if (! (frame = malloc (largest)))
+    {
+      pcap_dump_close (dumper);
+      errno = ENOMEM;
+      return -1;
+    }
+
+  pos = __atomic_load_n (& r -> tail, __ATOMIC_ACQUIRE);
+  while (pos < head)
+    {
+      struct pcap_pkthdr h;
+      unsigned long next;
+
+      /* Overwritten while being copied, go on from the oldest record (the frames in between are told by the next number) */
+      rget (r, pos, & rh, sizeof (rh));
+      if (overrun (r, pos))
+	{
+	  pos = __atomic_load_n (& r -> tail, __ATOMIC_ACQUIRE);
+	  continue;
+	}
+      next = pos + RECALIGN (sizeof (rh) + rh . rh . caplen);
+
+      /* Out of the window (or larger than any frame of the interface) */
+      if ((bytes && head - pos > bytes) || rh . rh . sec < since || rh . rh . caplen > largest)
+	{
+	  expected = rh . seq + 1;
+	  started  = true;
+	  pos = next;
+	  continue;
+	}
+
+      rget (r, pos + sizeof (rh), frame, rh . rh . caplen);
+      if (overrun (r, pos))
+	{
+	  pos = __atomic_load_n (& r -> tail, __ATOMIC_ACQUIRE);
+	  continue;
+	}
+
+      if (started && rh . seq > expected)
+	* lost += rh . seq - expected;
+      expected = rh . seq + 1;
+      started  = true;
+
+      h . ts . tv_sec  = rh . rh . sec;
+      h . ts . tv_usec = rh . rh . usec;
+      h . caplen       = rh . rh . caplen;
+      h . len          = rh . rh . len;
+      pcap_dump ((u_char *) dumper, & h, frame);
+      (* saved) ++;
+
+      pos = next;
+    }
+
+  free (frame);
+  pcap_dump_close (dumper);
+
+  return 0;
+}
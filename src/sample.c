@@ -0,0 +1,179 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * 1-in-N sampling of the frames captured on an interface
+ *
+ * Only one frame out of N is decoded and it is counted as N frames, so the
+ * counters of the interface and of its hosts are estimates rather than exact
+ * counts.  Frames are taken either every N-th or at random.  At random the
+ * selection is done (when it can) by the Linux kernel in front of the filter
+ * of the interface, so the frames left out are not even copied to the sniffer.
+ * Each frame is then taken when a 32-bit random value is not above 2^32 / N,
+ * there is no state to keep in the kernel to take exactly every N-th frame.
+ * When libpcap cannot set the filter in the kernel it runs it in userland,
+ * where the random load takes no frame at all, so the sniffer takes the
+ * frames of the sample itself in that case.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <sys/socket.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* The random number the Linux kernel gives to a socket filter (see linux/filter.h) */
+#define SKF_AD_OFF     (-0x1000)
+#define SKF_AD_RANDOM  56
+
+/* # of instructions put in front of the filter to select the frames */
+#define SAMPLE_INSNS   3
+
+
+/* The largest 32-bit value taken by a random selection of 1 frame out of 'n' */
+static uint32_t threshold (unsigned n)
+{
+  return 0xffffffffU / n;
+}
+
+
+/* Set 1-in-'n' sampling (none if 'n' is less than 2) on 'intf', frames are taken at random or every n-th */
+void samplestart (interface_t * intf, unsigned n, bool random)
+{
+  intf -> sampling     = n > 1 ? n : 0;
+  intf -> weight       = n > 1 ? n : 1;
+  intf -> samplerandom = n > 1 && random;
+  intf -> samplekernel = false;        /* until the filter is set, see samplefilter() */
+  intf -> samplernd    = (uint64_t) time (NULL) << 20 ^ (uintptr_t) intf ^ 0x9e3779b97f4a7c15ULL;
+}
+
+
+/*
+ * Put the random selection of the kernel in front of the compiled filter 'prog' of 'intf' (before it is set)
+ * Return false if the frames are still to be selected by the sniffer
+ */
+static bool samplefilter (interface_t * intf, struct bpf_program * prog)
+{
+#if defined(__linux__) && defined(SO_GET_FILTER)
+  struct bpf_insn * insns;
+
+  intf -> samplekernel = false;
+
+  /* libpcap moves the loads of cooked captures (the 'any' device) past the header it makes up */
+  if (! intf -> samplerandom || intf -> datalink == DLT_LINUX_SLL)
+    return false;
+#if defined(DLT_LINUX_SLL2)
+  if (intf -> datalink == DLT_LINUX_SLL2)
+    return false;
+#endif /* DLT_LINUX_SLL2 */
+
+  if (! (insns = calloc (prog -> bf_len + SAMPLE_INSNS, sizeof (struct bpf_insn))))
+    return false;
+
+  /* A = random; if (A > 2^32 / N) drop the frame; otherwise run the filter */
+  insns [0] = (struct bpf_insn) { BPF_LD  | BPF_W   | BPF_ABS, 0, 0, (bpf_u_int32) (SKF_AD_OFF + SKF_AD_RANDOM) };
+  insns [1] = (struct bpf_insn) { BPF_JMP | BPF_JGT | BPF_K,   0, 1, threshold (intf -> sampling) };
+  insns [2] = (struct bpf_insn) { BPF_RET | BPF_K,             0, 0, 0 };
+  memcpy (insns + SAMPLE_INSNS, prog -> bf_insns, prog -> bf_len * sizeof (struct bpf_insn));
+
+  /* The program is released by pcap_freecode() as usual */
+  free (prog -> bf_insns);
+  prog -> bf_insns = insns;
+  prog -> bf_len  += SAMPLE_INSNS;
+
+  intf -> samplekernel = true;
+  return true;
+#else
+  intf -> samplekernel = false;
+  return false;
+#endif /* __linux__ && SO_GET_FILTER */
+}
+
+
+/*
+ * Set the compiled filter 'prog' on 'intf' with the random selection of the kernel in front of it (when it can).
+ * Return -1 if libpcap cannot set it, as pcap_setfilter()
+ */
+int samplesetfilter (interface_t * intf, struct bpf_program * prog)
+{
+  if (! samplefilter (intf, prog))
+    return pcap_setfilter (intf -> pcap, prog);
+
+  if (pcap_setfilter (intf -> pcap, prog) == -1)
+    return -1;
+
+#if defined(__linux__) && defined(SO_GET_FILTER)
+  {
+    socklen_t len = 0;
+
+    /* With no room the kernel tells the # of instructions of the filter attached to the socket (none when libpcap runs it itself) */
+    if (getsockopt (pcap_fileno (intf -> pcap), SOL_SOCKET, SO_GET_FILTER, NULL, & len) == 0 && len == prog -> bf_len)
+      return 0;
+  }
+#endif /* __linux__ && SO_GET_FILTER */
+
+  /* Filtered in userland, the selection is taken out of the filter and left to the sniffer */
+  memmove (prog -> bf_insns, prog -> bf_insns + SAMPLE_INSNS, (prog -> bf_len - SAMPLE_INSNS) * sizeof (struct bpf_insn));
+  prog -> bf_len -= SAMPLE_INSNS;
+  intf -> samplekernel = false;
+
+  return pcap_setfilter (intf -> pcap, prog);
+}
+
+
+/* Is the frame in the sample set by the user? */
+static bool userpick (interface_t * intf)
+{
+  uint64_t x;
+
+  /* Not sampling, or the kernel has already made the choice */
+  if (! intf -> sampling || intf -> samplekernel)
+    return true;
+
+  if (! intf -> samplerandom)
+    return intf -> pkts_seen % intf -> sampling == 0;
+
+  /* xorshift64, the upper 32 bits are compared as the kernel does */
+  x = intf -> samplernd;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  intf -> samplernd = x;
+
+  return (uint32_t) (x >> 32) <= threshold (intf -> sampling);
+}
+
+
+/* Is the frame just read by the sniffer of 'intf' in the sample? */
+bool sampled (interface_t * intf)
+{
+  intf -> pkts_seen ++;
+
+  if (! userpick (intf))
+    return false;
+
+  /* An overloaded sniffer takes a part of them only (see shed.c) */
+  return ! intf -> shedsample || ++ intf -> shedseq % intf -> shedsample == 0;
+}
+
+
+/* Tell that the counters of 'intf' are estimates or incomplete (if they are) */
+void samplenote (interface_t * intf)
+{
+  if (intf -> sampling)
+    printf ("\nEstimates: 1 frame out of %u%s on %s is decoded and counted %u times\n",
+	    intf -> sampling, intf -> samplerandom ? " (at random)" : "", intf -> name, intf -> sampling);
+  if (intf -> shedding >= SHED_SAMPLING)
+    printf ("%sEstimates: the sniffer of %s is overloaded and decodes only 1 frame out of %u%s (see pkstatus)\n",
+	    intf -> sampling ? "" : "\n", intf -> name, shedsampling (intf -> shedding), intf -> sampling ? " of them" : "");
+  else if (intf -> shedding >= SHED_HOSTS_L4)
+    printf ("%sIncomplete: the sniffer of %s is overloaded and no longer counts the hosts by TCP, UDP, ... (see pkstatus)\n",
+	    intf -> sampling ? "" : "\n", intf -> name);
+}
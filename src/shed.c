@@ -0,0 +1,117 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Overload shedding of the sniffer
+ *
+ * Once per second the sniffer looks at the frames dropped by the kernel and
+ * at the age of the frames it reads (how long they have been waiting in the
+ * kernel).  While it falls behind it sheds work one step per second: first
+ * the OS fingerprints of the hosts and the payload signatures (protocols are
+ * then told by port), then the per-host counters over IP, then it decodes
+ * only 1 frame out of SHED_SAMPLE (and SHED_SAMPLE times fewer at each
+ * further step), counting it for the frames it stands for.  After SHED_CALM
+ * seconds in a row without drops nor growing lag it steps back.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* Move 'intf' to the step 'level' of the shedding */
+static void shedto (interface_t * intf, unsigned level)
+{
+  intf -> shedding   = level;
+  intf -> shedsample = shedsampling (level);
+  intf -> weight     = (counter_t) (intf -> sampling ? intf -> sampling : 1) * (intf -> shedsample ? intf -> shedsample : 1);
+  intf -> shedcalm   = 0;
+}
+
+
+/* 1 frame out of how many is decoded at the step 'level' (0 if all) */
+unsigned shedsampling (unsigned level)
+{
+  unsigned n = level >= SHED_SAMPLING ? SHED_SAMPLE : 0;
+
+  for (; level > SHED_SAMPLING; level --)
+    n *= SHED_SAMPLE;
+
+  return n;
+}
+
+
+/* What is shed at the step 'level' */
+char * shedname (unsigned level)
+{
+  switch (level)
+    {
+    case SHED_NONE:         return "full decode";
+    case SHED_FINGERPRINTS: return "no OS fingerprints nor payload signatures";
+    case SHED_HOSTS_L4:     return "no OS fingerprints nor payload signatures, hosts counted up to IP";
+    default:                return "no OS fingerprints nor payload signatures, hosts counted up to IP, frames sampled";
+    }
+}
+
+
+/* Start (or stop) shedding work on 'intf' when its sniffer falls behind, with full decode at first */
+void shedstart (interface_t * intf, bool enable)
+{
+  accttick (intf);
+
+  intf -> shed      = enable;
+  intf -> sheddrops = intf -> acct_drop;
+  intf -> shedlag   = 0;
+  shedto (intf, SHED_NONE);
+}
+
+
+/*
+ * Step the shedding up or down (called by the sniffer once per second, just after accttick(),
+ * 'ts' is the time of the last frame read or NULL)
+ */
+void shedtick (interface_t * intf, struct timeval * ts)
+{
+  struct timeval now;
+  bool dropping;
+  bool lagging;
+  long lag = 0;
+
+  if (! intf -> shed)
+    return;
+
+  /* The kernel has dropped frames since the last tick */
+  dropping = intf -> acct_drop != intf -> sheddrops;
+  intf -> sheddrops = intf -> acct_drop;
+
+  /* How long the frame just read has been waiting (frames are handed in batches every 'timeout' msecs) */
+  if (ts)
+    {
+      gettimeofday (& now, NULL);
+      lag = (now . tv_sec - ts -> tv_sec) * 1000 + (now . tv_usec - ts -> tv_usec) / 1000;
+    }
+
+  lagging = lag > intf -> timeout + SHED_LAG;
+
+  /* Falling behind, unless the backlog is already being drained */
+  if (dropping || (lagging && lag >= intf -> shedlag))
+    {
+      if (intf -> shedding < SHED_MAX)
+	shedto (intf, intf -> shedding + 1);
+      else
+	intf -> shedcalm = 0;
+    }
+  else if (lagging)
+    intf -> shedcalm = 0;
+  else if (intf -> shedding && ++ intf -> shedcalm >= SHED_CALM)
+    shedto (intf, intf -> shedding - 1);
+
+  intf -> shedlag = lag;
+}
@@ -0,0 +1,202 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Export of the counters of an interface and its hosts to a POSIX shared
+ * memory segment (the layout is documented in pkshm.h)
+ *
+ * The sniffer is the only writer: it publishes the records at each rate tick,
+ * so readers mapping the segment never block it and never issue a syscall.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* Copy a string into a fixed size field of the segment (always terminated) */
+static void shmstr (char * dst, char * src, size_t size)
+{
+  if (src)
+    {
+      strncpy (dst, src, size - 1);
+      dst [size - 1] = '\0';
+    }
+  else
+    * dst = '\0';
+}
+
+
+/* Publish the counters of the interface */
+static void shmintf (interface_t * intf, pkshm_intf_t * r, time_t now)
+{
+  pkshm_write_begin (& r -> seq);
+
+  r -> hostno          = intf -> hostno;
+  r -> updated         = now;
+  r -> started         = intf -> started . tv_sec;
+
+  r -> pkts_total      = intf -> pkts_total;
+  r -> bytes_total     = intf -> bytes_total;
+  r -> headers_total   = intf -> headers_total;
+  r -> pkts_other      = intf -> pkts_other;
+  r -> bytes_other     = intf -> bytes_other;
+
+  r -> pkts_broadcast  = intf -> pkts_broadcast;
+  r -> bytes_broadcast = intf -> bytes_broadcast;
+  r -> pkts_multicast  = intf -> pkts_multicast;
+  r -> bytes_multicast = intf -> bytes_multicast;
+
+  r -> pkts_ip         = intf -> pkts_ip;
+  r -> bytes_ip        = intf -> bytes_ip;
+  r -> pkts_tcp        = intf -> pkts_tcp;
+  r -> bytes_tcp       = intf -> bytes_tcp;
+  r -> pkts_udp        = intf -> pkts_udp;
+  r -> bytes_udp       = intf -> bytes_udp;
+  r -> pkts_icmp       = intf -> pkts_icmp;
+  r -> bytes_icmp      = intf -> bytes_icmp;
+  r -> pkts_other_ip   = intf -> pkts_other_ip;
+  r -> bytes_other_ip  = intf -> bytes_other_ip;
+
+  r -> pkts_arp        = intf -> pkts_arp;
+  r -> bytes_arp       = intf -> bytes_arp;
+  r -> pkts_rarp       = intf -> pkts_rarp;
+  r -> bytes_rarp      = intf -> bytes_rarp;
+  r -> pkts_non_ip     = intf -> pkts_non_ip;
+  r -> bytes_non_ip    = intf -> bytes_non_ip;
+
+  pkshm_write_end (& r -> seq);
+}
+
+
+/* Publish the counters of a host into its slot */
+static void shmhost (host_t * h, pkshm_host_t * r)
+{
+  pkshm_write_begin (& r -> seq);
+
+  /* Identifiers are set once but a host may learn its IP address later */
+  r -> id              = h -> id;
+  shmstr (r -> hwaddr, h -> hwaddress, sizeof (r -> hwaddr));
+  shmstr (r -> ipaddr, h -> ipaddr, sizeof (r -> ipaddr));
+  r -> first           = h -> first . tv_sec;
+  r -> last            = h -> last . tv_sec;
+
+  r -> pkts_sent       = h -> pkts_sent;
+  r -> bytes_sent      = h -> bytes_sent;
+  r -> pkts_recv       = h -> pkts_recv;
+  r -> bytes_recv      = h -> bytes_recv;
+
+  r -> bytes_tcp_sent  = h -> bytes_tcp_sent;
+  r -> bytes_tcp_recv  = h -> bytes_tcp_recv;
+  r -> bytes_udp_sent  = h -> bytes_udp_sent;
+  r -> bytes_udp_recv  = h -> bytes_udp_recv;
+  r -> bytes_icmp_sent = h -> bytes_icmp_sent;
+  r -> bytes_icmp_recv = h -> bytes_icmp_recv;
+
+  r -> bytes_current   = h -> bytes_current;
+  r -> pkts_current    = h -> pkts_current;
+
+  pkshm_write_end (& r -> seq);
+}
+
+
+/* Create the segment of 'intf' with room for 'capacity' hosts and map it (0 on success, -1 and errno otherwise) */
+int shmexport (interface_t * intf, unsigned capacity)
+{
+  pkshm_header_t * shm;
+  char name [64];
+  size_t size;
+  int fd;
+
+  if (intf -> shm)
+    return 0;
+
+  snprintf (name, sizeof (name), "%s%s", PKSHM_PREFIX, intf -> name);
+  size = sizeof (pkshm_header_t) + (size_t) capacity * sizeof (pkshm_host_t);
+
+  /* A segment left behind by a previous run is recreated from scratch */
+  shm_unlink (name);
+  if ((fd = shm_open (name, O_CREAT | O_EXCL | O_RDWR, 0640)) == -1)
+    return -1;
+
+  /* The segment is sparse, pages of the host slots are only touched when hosts are seen */
+  if (ftruncate (fd, size) == -1 || (shm = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      int e = errno;
+      close (fd);
+      shm_unlink (name);
+      errno = e;
+      return -1;
+    }
+  close (fd);
+
+  shm -> version    = PKSHM_VERSION;
+  shm -> headersize = sizeof (pkshm_header_t);
+  shm -> hostsize   = sizeof (pkshm_host_t);
+  shm -> hostoff    = sizeof (pkshm_header_t);
+  shm -> capacity   = capacity;
+  shm -> hostno     = 0;
+  shm -> dropped    = 0;
+  shm -> pid        = getpid ();
+  shm -> datalink   = intf -> datalink;
+  shmstr (shm -> name, intf -> name, sizeof (shm -> name));
+
+  /* The magic comes last so readers never see a half initialized header */
+  __atomic_store_n (& shm -> magic, PKSHM_MAGIC, __ATOMIC_RELEASE);
+
+  intf -> shm     = shm;
+  intf -> shmsize = size;
+
+  return 0;
+}
+
+
+/* Publish the counters of 'intf' and its hosts (called by the sniffer at each rate tick) */
+void shmtick (interface_t * intf, time_t now)
+{
+  pkshm_header_t * shm = intf -> shm;
+  pkshm_host_t * slots;
+  host_t * h;
+
+  if (! shm)
+    return;
+
+  shmintf (intf, & shm -> intf, now);
+
+  /* Slots are indexed by the dense host identifiers */
+  slots = (pkshm_host_t *) ((char *) shm + shm -> hostoff);
+  for (h = hostfirst (intf); h && h -> id < shm -> capacity; h = hostnext (h))
+    shmhost (h, & slots [h -> id]);
+
+  shm -> dropped = intf -> hostno > shm -> capacity ? intf -> hostno - shm -> capacity : 0;
+  __atomic_store_n (& shm -> hostno, MIN (intf -> hostno, shm -> capacity), __ATOMIC_RELEASE);
+}
+
+
+/* Withdraw the segment of 'intf' (readers still mapping it keep their copy until they unmap it) */
+void shmunexport (interface_t * intf)
+{
+  char name [64];
+
+  if (! intf -> shm)
+    return;
+
+  snprintf (name, sizeof (name), "%s%s", PKSHM_PREFIX, intf -> name);
+  munmap (intf -> shm, intf -> shmsize);
+  shm_unlink (name);
+
+  intf -> shm     = NULL;
+  intf -> shmsize = 0;
+}
@@ -10,6 +10,12 @@
  */
 
 
+/* System headers */
+#include <stddef.h>
+#include <errno.h>
+#include <limits.h>
+#include <arpa/inet.h>
+
 /* Project header */
 #include "pksh.h"
 
@@ -41,6 +47,22 @@ int sort_by_ip (const void * _a, const void * _b)
     return -1;
   else if (! (* b) -> ipaddr)
     return 1;
+  else if (strchr ((* a) -> ipaddr, ':') || strchr ((* b) -> ipaddr, ':'))
+    {
+      /* IPv6 addresses after IPv4 ones */
+      struct in6_addr ip1 = IN6ADDR_ANY_INIT;
+      struct in6_addr ip2 = IN6ADDR_ANY_INIT;
+
+      if (! strchr ((* a) -> ipaddr, ':'))
+	return -1;
+      if (! strchr ((* b) -> ipaddr, ':'))
+	return 1;
+
+      inet_pton (AF_INET6, (* a) -> ipaddr, & ip1);
+      inet_pton (AF_INET6, (* b) -> ipaddr, & ip2);
+
+      return memcmp (& ip1, & ip2, sizeof (ip1));
+    }
   else
     {
       int a1; int b1; int c1; int d1;
@@ -532,3 +554,405 @@ int sort_by_peak_pkts_all (const void * _a, const void * _b)
 {
   return ((* (host_t **) _b) -> pkts_peak - (* (host_t **) _a) -> pkts_peak);
 }
+
+
+/* ========================================================================= */
+
+/*
+ * Decorate-sort of the hosts cache
+ *
+ * A fixed-width binary key is extracted once per host, so that the
+ * comparators above (that sscanf addresses and chase string pointers)
+ * are not called O(n log n) times. Keys are ordered ascending, so the
+ * counters that the comparators sort descending are stored one-complemented.
+ * Keys of strings are only prefixes of them, therefore runs of equal keys
+ * are finally sorted with the original comparator.
+ */
+
+
+/* A decorated host */
+typedef struct
+{
+  uint64_t key;
+  host_t * host;
+
+} hostkey_t;
+
+
+/* Define a key extractor */
+typedef uint64_t kf (host_t * h);
+
+
+/* Hardware address as a 48-bit number, flagged on bit 48 when present */
+static uint64_t key_hwaddr (host_t * h)
+{
+  unsigned m [6];
+  uint64_t key = (uint64_t) 1 << 48;
+  int i;
+
+  if (! h -> hwaddress)
+    return 0;
+
+  if (sscanf (h -> hwaddress, "%x:%x:%x:%x:%x:%x", & m [0], & m [1], & m [2], & m [3], & m [4], & m [5]) == 6)
+    for (i = 0; i < 6; i ++)
+      key |= (uint64_t) (m [i] & 0xff) << (40 - 8 * i);
+
+  return key;
+}
+
+
+/* IP address after IP-less hosts (sorted by their hardware address), IPv6 addresses (by their first 48 bits) after IPv4 ones */
+static uint64_t key_ip (host_t * h)
+{
+  struct in_addr addr;
+  struct in6_addr addr6;
+  uint64_t key = (uint64_t) 3 << 48;
+  int i;
+
+  if (! h -> ipaddr)
+    return key_hwaddr (h);
+
+  if (inet_pton (AF_INET6, h -> ipaddr, & addr6) == 1)
+    {
+      for (i = 0; i < 6; i ++)
+	key |= (uint64_t) addr6 . s6_addr [i] << (40 - 8 * i);
+      return key;
+    }
+
+  return inet_pton (AF_INET, h -> ipaddr, & addr) == 1 ? ((uint64_t) 2 << 48) | ntohl (addr . s_addr) : (uint64_t) 2 << 48;
+}
+
+
+/* The first 8 characters of 'str' (0 for unknown) */
+static uint64_t key_prefix (char * str)
+{
+  uint64_t key = 0;
+  int i;
+
+  for (i = 0; str && i < 8 && str [i]; i ++)
+    key |= (uint64_t) (unsigned char) str [i] << (56 - 8 * i);
+
+  return key;
+}
+
+
+/*
+ * Hostnames after unresolved hosts (sorted by their address).
+ * The original comparator orders numeric hostnames by their address but all the others as strings,
+ * so the hostnames up to '9' (numeric or not) share one key and are left to it.
+ */
+static uint64_t key_hostname (host_t * h)
+{
+  if (! h -> hostname)
+    return key_ip (h);
+
+  if ((unsigned char) h -> hostname [0] <= '9')
+    return (uint64_t) 1 << 56;
+
+  return key_prefix (h -> hostname);
+}
+
+
+static uint64_t key_vendor (host_t * h)   { return key_prefix (h -> vendor); }
+static uint64_t key_system (host_t * h)   { return key_prefix (h -> system); }
+static uint64_t key_domain (host_t * h)   { return 0; }
+
+
+/* Time based keys (more recent/longer first) */
+static uint64_t usecs (struct timeval * t)  { return (uint64_t) t -> tv_sec * 1000000 + t -> tv_usec; }
+static uint64_t key_age (host_t * h)       { return ~ (usecs (& h -> last) - usecs (& h -> first)); }
+static uint64_t key_firstseen (host_t * h) { return ~ usecs (& h -> first); }
+static uint64_t key_lastseen (host_t * h)  { return ~ usecs (& h -> last); }
+
+
+/* Throughput keys (higher first) */
+static uint64_t key_current_bytes (host_t * h) { return ~ (uint64_t) MAX (h -> bytes_current, 0); }
+static uint64_t key_average_bytes (host_t * h) { return ~ (uint64_t) MAX (h -> bytes_average, 0); }
+static uint64_t key_peak_bytes (host_t * h)    { return ~ (uint64_t) MAX (h -> bytes_peak, 0); }
+static uint64_t key_current_pkts (host_t * h)  { return ~ (uint64_t) MAX (h -> pkts_current, 0); }
+static uint64_t key_average_pkts (host_t * h)  { return ~ (uint64_t) MAX (h -> pkts_average, 0); }
+static uint64_t key_peak_pkts (host_t * h)     { return ~ (uint64_t) MAX (h -> pkts_peak, 0); }
+
+
+#define NOFIELD ((size_t) -1)
+#define FIELD(f) offsetof (host_t, f)
+
+/* How to extract the key foreach comparator (either via a function or summing up to two counters in descending order) */
+static struct
+{
+  sf * cmp;
+  kf * key;
+  bool exact;   /* no need to resolve ties with the comparator */
+  size_t a;
+  size_t b;
+
+} sortkeys [] =
+{
+  { sort_by_hwaddr,              key_hwaddr,        false, NOFIELD,                     NOFIELD                    },
+  { sort_by_ip,                  key_ip,            false, NOFIELD,                     NOFIELD                    },
+  { sort_by_hostname,            key_hostname,      false, NOFIELD,                     NOFIELD                    },
+  { sort_by_vendor,              key_vendor,        false, NOFIELD,                     NOFIELD                    },
+  { sort_by_system,              key_system,        false, NOFIELD,                     NOFIELD                    },
+  { sort_by_domain,              key_domain,        true,  NOFIELD,                     NOFIELD                    },
+
+  { sort_by_age,                 key_age,           true,  NOFIELD,                     NOFIELD                    },
+  { sort_by_firstseen,           key_firstseen,     true,  NOFIELD,                     NOFIELD                    },
+  { sort_by_lastseen,            key_lastseen,      true,  NOFIELD,                     NOFIELD                    },
+
+  { sort_by_bytes_all,           NULL,              true,  FIELD (bytes_sent),          FIELD (bytes_recv)         },
+  { sort_by_broadcast_bytes,     NULL,              true,  FIELD (bytes_broadcast),     NOFIELD                    },
+  { sort_by_multicast_bytes,     NULL,              true,  FIELD (bytes_multicast),     NOFIELD                    },
+  { sort_by_ip_bytes_all,        NULL,              true,  FIELD (bytes_ip_sent),       FIELD (bytes_ip_recv)      },
+  { sort_by_ip_broadcast_bytes,  NULL,              true,  FIELD (bytes_ip_broadcast),  NOFIELD                    },
+  { sort_by_ip_multicast_bytes,  NULL,              true,  FIELD (bytes_ip_multicast),  NOFIELD                    },
+  { sort_by_tcp_bytes_all,       NULL,              true,  FIELD (bytes_tcp_sent),      FIELD (bytes_tcp_recv)     },
+  { sort_by_udp_bytes_all,       NULL,              true,  FIELD (bytes_udp_sent),      FIELD (bytes_udp_recv)     },
+  { sort_by_icmp_bytes_all,      NULL,              true,  FIELD (bytes_icmp_sent),     FIELD (bytes_icmp_recv)    },
+  { sort_by_other_ip_bytes_all,  NULL,              true,  FIELD (bytes_other_ip_sent), FIELD (bytes_other_ip_recv)},
+
+  { sort_by_bytes_sent,          NULL,              true,  FIELD (bytes_sent),          NOFIELD                    },
+  { sort_by_ip_bytes_sent,       NULL,              true,  FIELD (bytes_ip_sent),       NOFIELD                    },
+  { sort_by_tcp_bytes_sent,      NULL,              true,  FIELD (bytes_tcp_sent),      NOFIELD                    },
+  { sort_by_udp_bytes_sent,      NULL,              true,  FIELD (bytes_udp_sent),      NOFIELD                    },
+  { sort_by_icmp_bytes_sent,     NULL,              true,  FIELD (bytes_icmp_sent),     NOFIELD                    },
+  { sort_by_other_ip_bytes_sent, NULL,              true,  FIELD (bytes_other_ip_sent), NOFIELD                    },
+
+  { sort_by_bytes_recv,          NULL,              true,  FIELD (bytes_recv),          NOFIELD                    },
+  { sort_by_ip_bytes_recv,       NULL,              true,  FIELD (bytes_ip_recv),       NOFIELD                    },
+  { sort_by_tcp_bytes_recv,      NULL,              true,  FIELD (bytes_tcp_recv),      NOFIELD                    },
+  { sort_by_udp_bytes_recv,      NULL,              true,  FIELD (bytes_udp_recv),      NOFIELD                    },
+  { sort_by_icmp_bytes_recv,     NULL,              true,  FIELD (bytes_icmp_recv),     NOFIELD                    },
+  { sort_by_other_ip_bytes_recv, NULL,              true,  FIELD (bytes_other_ip_recv), NOFIELD                    },
+
+  { sort_by_current_bytes_all,   key_current_bytes, true,  NOFIELD,                     NOFIELD                    },
+  { sort_by_average_bytes_all,   key_average_bytes, true,  NOFIELD,                     NOFIELD                    },
+  { sort_by_peak_bytes_all,      key_peak_bytes,    true,  NOFIELD,                     NOFIELD                    },
+
+  { sort_by_pkts_all,            NULL,              true,  FIELD (pkts_sent),           FIELD (pkts_recv)          },
+  { sort_by_broadcast_pkts,      NULL,              true,  FIELD (pkts_broadcast),      NOFIELD                    },
+  { sort_by_multicast_pkts,      NULL,              true,  FIELD (pkts_multicast),      NOFIELD                    },
+  { sort_by_ip_pkts_all,         NULL,              true,  FIELD (pkts_ip_sent),        FIELD (pkts_ip_recv)       },
+  { sort_by_ip_broadcast_pkts,   NULL,              true,  FIELD (pkts_ip_broadcast),   NOFIELD                    },
+  { sort_by_ip_multicast_pkts,   NULL,              true,  FIELD (pkts_ip_multicast),   NOFIELD                    },
+  { sort_by_tcp_pkts_all,        NULL,              true,  FIELD (pkts_tcp_sent),       FIELD (pkts_tcp_recv)      },
+  { sort_by_udp_pkts_all,        NULL,              true,  FIELD (pkts_udp_sent),       FIELD (pkts_udp_recv)      },
+  { sort_by_icmp_pkts_all,       NULL,              true,  FIELD (pkts_icmp_sent),      FIELD (pkts_icmp_recv)     },
+  { sort_by_other_ip_pkts_all,   NULL,              true,  FIELD (pkts_other_ip_sent),  FIELD (pkts_other_ip_recv) },
+
+  { sort_by_pkts_sent,           NULL,              true,  FIELD (pkts_sent),           NOFIELD                    },
+  { sort_by_ip_pkts_sent,        NULL,              true,  FIELD (pkts_ip_sent),        NOFIELD                    },
+  { sort_by_tcp_pkts_sent,       NULL,              true,  FIELD (pkts_tcp_sent),       NOFIELD                    },
+  { sort_by_udp_pkts_sent,       NULL,              true,  FIELD (pkts_udp_sent),       NOFIELD                    },
+  { sort_by_icmp_pkts_sent,      NULL,              true,  FIELD (pkts_icmp_sent),      NOFIELD                    },
+  { sort_by_other_ip_pkts_sent,  NULL,              true,  FIELD (pkts_other_ip_sent),  NOFIELD                    },
+
+  { sort_by_pkts_recv,           NULL,              true,  FIELD (pkts_recv),           NOFIELD                    },
+  { sort_by_ip_pkts_recv,        NULL,              true,  FIELD (pkts_ip_recv),        NOFIELD                    },
+  { sort_by_tcp_pkts_recv,       NULL,              true,  FIELD (pkts_tcp_recv),       NOFIELD                    },
+  { sort_by_udp_pkts_recv,       NULL,              true,  FIELD (pkts_udp_recv),       NOFIELD                    },
+  { sort_by_icmp_pkts_recv,      NULL,              true,  FIELD (pkts_icmp_recv),      NOFIELD                    },
+  { sort_by_other_ip_pkts_recv,  NULL,              true,  FIELD (pkts_other_ip_recv),  NOFIELD                    },
+
+  { sort_by_current_pkts_all,    key_current_pkts,  true,  NOFIELD,                     NOFIELD                    },
+  { sort_by_average_pkts_all,    key_average_pkts,  true,  NOFIELD,                     NOFIELD                    },
+  { sort_by_peak_pkts_all,       key_peak_pkts,     true,  NOFIELD,                     NOFIELD                    },
+};
+
+
+/* Sum up the counters at offsets 'a' and 'b' of 'h' */
+static counter_t counters (host_t * h, size_t a, size_t b)
+{
+  return * (counter_t *) ((char *) h + a) + (b != NOFIELD ? * (counter_t *) ((char *) h + b) : 0);
+}
+
+
+/* LSD radix sort of 'n' keys using 'tmp' as scratch area (passes on bytes equal foreach key are skipped) */
+static void radixsort (hostkey_t * keys, hostkey_t * tmp, int n)
+{
+  unsigned shift;
+
+  for (shift = 0; shift < 64; shift += 8)
+    {
+      unsigned count [256] = { 0 };
+      unsigned pos = 0;
+      int i;
+
+      for (i = 0; i < n; i ++)
+	count [(keys [i] . key >> shift) & 0xff] ++;
+
+      if (count [(keys [0] . key >> shift) & 0xff] == (unsigned) n)
+	continue;
+
+      for (i = 0; i < 256; i ++)
+	{
+	  unsigned c = count [i];
+	  count [i] = pos;
+	  pos += c;
+	}
+
+      for (i = 0; i < n; i ++)
+	tmp [count [(keys [i] . key >> shift) & 0xff] ++] = keys [i];
+
+      /* The output becomes the input of the next pass */
+      memcpy (keys, tmp, n * sizeof (hostkey_t));
+    }
+}
+
+
+/* Partition 'keys' around its k-th smallest key (quickselect), so that the 'k' smallest ones come first */
+static void selectkeys (hostkey_t * keys, int n, int k)
+{
+  int lo = 0;
+  int hi = n - 1;
+
+  while (lo < hi)
+    {
+      uint64_t pivot = keys [lo + (hi - lo) / 2] . key;
+      int i = lo;
+      int j = hi;
+
+      while (i <= j)
+	{
+	  while (keys [i] . key < pivot)
+	    i ++;
+	  while (keys [j] . key > pivot)
+	    j --;
+	  if (i <= j)
+	    {
+	      hostkey_t t = keys [i];
+	      keys [i ++] = keys [j];
+	      keys [j --] = t;
+	    }
+	}
+
+      if (k <= j)
+	hi = j;
+      else if (k >= i)
+	lo = i;
+      else
+	break;
+    }
+}
+
+
+/* Comparators used to resolve ties on keys */
+static sf * tiecmp;
+static bool tiereverse;
+
+static int sort_by_tie (const void * _a, const void * _b)
+{
+  host_t * a = ((hostkey_t *) _a) -> host;
+  host_t * b = ((hostkey_t *) _b) -> host;
+
+  return tiereverse ? tiecmp (& b, & a) : tiecmp (& a, & b);
+}
+
+
+/*
+ * Sort the 'n' hosts in 'argv' according to 'howtosort' (reversed if 'reverse'),
+ * and only the first 'head' of them if 'head' is not zero.
+ * Return the # of hosts (in order) to be rendered in the first positions of 'argv'.
+ */
+int hostsort (host_t * argv [], int n, sf * howtosort, bool reverse, int head)
+{
+  hostkey_t * keys;
+  unsigned s;
+  int rows = head > 0 && head < n ? head : n;
+  int sorted;
+  int i;
+
+  if (n < 1)
+    return 0;
+
+  /* No sorting at all */
+  if (! howtosort)
+    {
+      for (i = 0; reverse && i < n / 2; i ++)
+	{
+	  host_t * t = argv [i];
+	  argv [i] = argv [n - i - 1];
+	  argv [n - i - 1] = t;
+	}
+      return rows;
+    }
+
+  for (s = 0; s < sizeof (sortkeys) / sizeof (sortkeys [0]); s ++)
+    if (sortkeys [s] . cmp == howtosort)
+      break;
+
+  /* Unknown comparator, nothing to decorate */
+  if (s == sizeof (sortkeys) / sizeof (sortkeys [0]))
+    {
+      qsort (argv, n, sizeof (host_t *), howtosort);
+      if (reverse)
+	hostsort (argv, n, NULL, true, 0);
+      return rows;
+    }
+
+  /* Decorate */
+  keys = calloc (2 * n, sizeof (hostkey_t));
+  for (i = 0; i < n; i ++)
+    {
+      keys [i] . host = argv [i];
+      keys [i] . key = sortkeys [s] . key ? sortkeys [s] . key (argv [i]) : ~ (uint64_t) counters (argv [i], sortkeys [s] . a, sortkeys [s] . b);
+      if (reverse)
+	keys [i] . key = ~ keys [i] . key;
+    }
+
+  /* Partial selection of the first 'rows' keys instead of a full sort */
+  sorted = n;
+  if (rows < n)
+    {
+      selectkeys (keys, n, rows - 1);
+      sorted = rows;
+
+      /* Ties with the last selected key have to be resolved too, so they must take part to the sorting */
+      for (i = rows; ! sortkeys [s] . exact && i < n; i ++)
+	if (keys [i] . key == keys [rows - 1] . key)
+	  {
+	    hostkey_t t = keys [sorted];
+	    keys [sorted ++] = keys [i];
+	    keys [i] = t;
+	  }
+    }
+
+  /* Sort */
+  radixsort (keys, keys + n, sorted);
+
+  /* Resolve ties with the original comparator */
+  if (! sortkeys [s] . exact)
+    {
+      tiecmp = howtosort;
+      tiereverse = reverse;
+      for (i = 0; i < sorted; )
+	{
+	  int j = i + 1;
+	  while (j < sorted && keys [j] . key == keys [i] . key)
+	    j ++;
+	  if (j - i > 1)
+	    qsort (keys + i, j - i, sizeof (hostkey_t), sort_by_tie);
+	  i = j;
+	}
+    }
+
+  /* Undecorate */
+  for (i = 0; i < n; i ++)
+    argv [i] = keys [i] . host;
+
+  free (keys);
+
+  return rows;
+}
+
+
+/* The # of hosts 'arg' of the option --head (-1 if it is not a positive number) */
+int hostshead (char * arg)
+{
+  char * end;
+  long n;
+
+  errno = 0;
+  n = strtol (arg, & end, 10);
+
+  return errno || end == arg || * end || n < 1 || n > INT_MAX ? -1 : n;
+}
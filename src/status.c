@@ -11,7 +11,9 @@
 
 
 /* System headers */
+#include <stdlib.h>
 #include <time.h>
+#include <net/if.h>
 
 /* Project header */
 #include "pksh.h"
@@ -65,6 +67,48 @@ static void usage (char * progname, struct option * options)
 }
 
 
+/* Tell about the devices seen by the 'any' device, with the hosts first seen on each of them */
+static void devices (interface_t * intf)
+{
+  unsigned max = __atomic_load_n (& intf -> ifindexmax, __ATOMIC_ACQUIRE);
+  unsigned * hosts = calloc (max, sizeof (unsigned));
+  host_t * h;
+  unsigned i;
+
+  char name [IF_NAMESIZE + 8];
+  char pbuf [64];
+  char bbuf [64];
+
+  if (hosts)
+    for (h = hostfirst (intf); h; h = hostnext (h))
+      if (h -> ifindex < max)
+	hosts [h -> ifindex] ++;
+
+  printf ("Devices:\n");
+  for (i = 0; i < max; i ++)
+    {
+      ifindex_t * chunk = __atomic_load_n (& intf -> ifindexes [i / IFINDEX_CHUNK], __ATOMIC_ACQUIRE);
+      ifindex_t * d = chunk ? chunk + i % IFINDEX_CHUNK : NULL;
+
+      if (! d || ! d -> pkts)
+	continue;
+
+      /* Devices may have gone in the meantime (e.g. the veth of a container) */
+      if (! i)
+	strcpy (name, "unknown");
+      else if (! if_indextoname (i, name))
+	snprintf (name, sizeof (name), "#%u", i);
+
+      printf ("  %-18s : %s pkts %s [%s] %u hosts\n", name,
+	      fmtpkts_r (d -> pkts, pbuf, sizeof (pbuf)), percentage (d -> pkts, intf -> pkts_total),
+	      fmtbytes_r (d -> bytes, bbuf, sizeof (bbuf)), hosts ? hosts [i] : 0);
+    }
+  printf ("\n");
+
+  free (hosts);
+}
+
+
 /* Print current network interface information in a format readable for humans */
 int pksh_pkstatus (int argc, char * argv [])
 {
@@ -80,10 +124,15 @@ int pksh_pkstatus (int argc, char * argv [])
   char * name = NULL;
   interface_t * interface;
 
-  struct pcap_stat stats;
+  double effective;
 
   struct timeval * now = tvnow ();
 
+  int hostno;
+
+  char pbuf [64];
+  char bbuf [64];
+
   /* Lookup for the command in the static table of registered extensions */
   if (! cmd_by_name (progname))
     {
@@ -125,8 +174,9 @@ int pksh_pkstatus (int argc, char * argv [])
       return -1;
     }
 
-  /* Get packet statistics from the start of the run to current time */
-  pcap_stats (interface -> pcap, & stats);
+  /* The sniffer samples where the frames have gone every second, the library is asked here only when it is not running */
+  if (interface -> status != INTERFACE_ENABLED && ! interface -> remote)
+    accttick (interface);
 
   /* Give general information about the interface */
   printf ("Network interface    : %s [%s - %s] [%s] [mtu %d] set to %s mode\n",
@@ -140,44 +190,76 @@ int pksh_pkstatus (int argc, char * argv [])
 	    interface -> network, interface -> netmask, interface -> broadcast);
 
   printf ("Sampling since       : %s [%*.*s]", elapsedtime (& interface -> started, now), 24, 24, ctime (& interface -> started . tv_sec));
+  if (interface -> recorder)
+    printf ("Recording to         : %s [%s, %u files] %s pkts, %s written, %s dropped, %u errors\n",
+	    interface -> recorder -> path, interface -> recorder -> pcapng ? "pcapng" : "pcap", interface -> recorder -> rotated + 1,
+	    fmtpkts_r (interface -> recorder -> pkts, pbuf, sizeof (pbuf)), fmtbytes_r (interface -> recorder -> written, bbuf, sizeof (bbuf)),
+	    fmtpkts (interface -> recorder -> dropped), interface -> recorder -> errors);
+  if (interface -> ring)
+    {
+      unsigned long held;
+      time_t first;
+      time_t last;
+
+      ringspan (interface -> ring, & held, & first, & last);
+      printf ("Ring of last frames  : %s [%lu frames over %ld secs] %s overwritten, %s dropped\n",
+	      fmtbytes_r (interface -> ring -> size, bbuf, sizeof (bbuf)), held, held ? (long) (last - first + 1) : 0L,
+	      fmtpkts_r (interface -> ring -> overwritten, pbuf, sizeof (pbuf)), fmtpkts (interface -> ring -> dropped));
+    }
+  /* The copy bandwidth saved by a short snapshot (the frames on the wire against their portions copied to the sniffer) */
+  if (interface -> headersonly || interface -> bytes_captured != interface -> bytes_seen)
+    printf ("Snapshot             : %d bytes%s, copied %s of %s on the wire (%.1f%% saved)\n",
+	    interface -> snapshot, interface -> headersonly ? " (headers only)" : "",
+	    fmtbytes_r (interface -> bytes_captured, bbuf, sizeof (bbuf)), fmtbytes (interface -> bytes_seen),
+	    interface -> bytes_seen ? 100.0 * (interface -> bytes_seen - interface -> bytes_captured) / interface -> bytes_seen : 0.0);
+  /* How many frames on the link each decoded frame stands for, so far (the frames dropped by the kernel included) */
+  effective = interface -> acct_decoded ?
+    (double) (interface -> acct_read + interface -> acct_drop) * (interface -> samplekernel ? interface -> sampling : 1) / interface -> acct_decoded : 0.0;
+
+  if (interface -> sampling)
+    printf ("Frame sampling       : 1 in %u (%s) %s decoded out of %s read, effective rate 1 in %.1f\n",
+	    interface -> sampling,
+	    interface -> samplekernel ? "at random, taken by the kernel" : interface -> samplerandom ? "at random" : "in sequence",
+	    fmtpkts_r (interface -> pkts_decoded, pbuf, sizeof (pbuf)), fmtpkts (interface -> pkts_seen), effective);
+  if (interface -> shedding >= SHED_SAMPLING)
+    printf ("Overload shedding    : step %u of %u [%s, 1 in %u] effective rate 1 in %.1f\n",
+	    interface -> shedding, SHED_MAX, shedname (interface -> shedding), shedsampling (interface -> shedding), effective);
+  else if (interface -> shedding)
+    printf ("Overload shedding    : step %u of %u [%s]\n", interface -> shedding, SHED_MAX, shedname (interface -> shedding));
+  /* The application protocols are told by the first payloads of each conversation (by port when they tell nothing) */
+  if (interface -> payload)
+    printf ("Applications         : by payload, then by port [%s payloads scanned, %s told]\n",
+	    fmtpkts_r (interface -> pkts_scanned, pbuf, sizeof (pbuf)), fmtpkts (interface -> pkts_identified));
   printf ("\n\n");
 
   printf ("Packets:\n");
 
-  if (stats . ps_recv != interface -> pkts_total)
+  /*
+   * Where the frames have gone, as sampled all at once (so they add up):
+   * received by the kernel = dropped by the kernel + still queued + read by the sniffer (= decoded + skipped)
+   */
+  if (interface -> acct_time)
     {
-      if (interface -> datalink == DLT_NULL)
-	printf ("  Received by kernel : %s\n", fmtpkts (stats . ps_recv));
-      else
-	printf ("  Received by kernel : %s\n", fmtpkts (stats . ps_recv));
+      printf ("  Received by kernel : %s [sampled %lds ago]\n", fmtpkts (interface -> acct_recv), (long) (time (NULL) - interface -> acct_time));
+      printf ("  Dropped by kernel  : %s %s\n",
+	      fmtpkts (interface -> acct_drop), percentage (interface -> acct_drop, interface -> acct_recv));
+      if (interface -> acct_ifdrop)
+	printf ("  Dropped by NIC     : %s (by the interface itself)\n", fmtpkts (interface -> acct_ifdrop));
+      printf ("  Still enqueued     : %s %s\n",
+	      fmtpkts (interface -> acct_queued), percentage (interface -> acct_queued, interface -> acct_recv));
+      printf ("  Read by sniffer    : %s %s\n",
+	      fmtpkts (interface -> acct_read), percentage (interface -> acct_read, interface -> acct_recv));
+      printf ("    Decoded          : %s %s\n",
+	      fmtpkts (interface -> acct_decoded), percentage (interface -> acct_decoded, interface -> acct_read));
+      printf ("    Skipped          : %s %s%s\n",
+	      fmtpkts (interface -> acct_read - interface -> acct_decoded), percentage (interface -> acct_read - interface -> acct_decoded, interface -> acct_read),
+	      interface -> acct_read != interface -> acct_decoded ? " (sampling and shedding)" : "");
+      if (interface -> acct_userdrop)
+	printf ("  Dropped by pksh    : %s (recorder queue and ring, the frames are decoded anyway)\n", fmtpkts (interface -> acct_userdrop));
     }
 
-  if (stats . ps_drop)
-    printf ("  Dropped by kernel  : %s\n", fmtpkts (stats . ps_drop));
-  if (stats . ps_recv != stats . ps_drop + interface -> pkts_total)
-    printf ("  Still enqueued     : %s\n",
-	    stats . ps_recv > stats . ps_drop + interface -> pkts_total ?
-	    fmtpkts (stats . ps_recv - stats . ps_drop - interface -> pkts_total) :
-	    fmtpkts (stats . ps_drop + interface -> pkts_total - stats . ps_recv));
-
-  if (interface -> datalink == DLT_NULL)
-    {
-      if (stats . ps_recv / 2 == interface -> pkts_total)
-	printf ("  Total counted      : %s %s\n", fmtpkts (interface -> pkts_total),
-		intflen (interfaces) > 1 ? percentage (interface -> pkts_total, intfpkts (interfaces)) : "");
-      else
-	printf ("  Total counted      : %s %s\n", fmtpkts (interface -> pkts_total),
-		intflen (interfaces) > 1 ? percentage (interface -> pkts_total, intfpkts (interfaces)) : "");
-    }
-  else
-    {
-      if (stats . ps_recv == interface -> pkts_total)
-	printf ("  Total counted      : %s %s\n", fmtpkts (interface -> pkts_total),
-		intflen (interfaces) > 1 ? percentage (interface -> pkts_total, intfpkts (interfaces)) : "");
-      else
-	printf ("  Total counted      : %s %s\n", fmtpkts (interface -> pkts_total),
-		intflen (interfaces) > 1 ? percentage (interface -> pkts_total, intfpkts (interfaces)) : "");
-    }
+  printf ("  Total %-12s : %s %s\n", interface -> sampling ? "estimated" : "counted", fmtpkts (interface -> pkts_total),
+	  intflen (interfaces) > 1 ? percentage (interface -> pkts_total, intfpkts (interfaces)) : "");
 
   /* Packets distribution */
   if (interface -> pkts_total)
@@ -222,24 +304,70 @@ int pksh_pkstatus (int argc, char * argv [])
       if (interface -> pkts_multicast)
 	printf ("    Multicast        : %s %s\n", fmtpkts (interface -> pkts_multicast),
 		percentage (interface -> pkts_multicast, interface -> pkts_total));
+      if (interface -> pkts_vlan)
+	printf ("    VLAN tagged      : %s %s\n", fmtpkts (interface -> pkts_vlan),
+		percentage (interface -> pkts_vlan, interface -> pkts_total));
+      if (interface -> pkts_qinq)
+	printf ("      QinQ           : %s %s\n", fmtpkts (interface -> pkts_qinq),
+		percentage (interface -> pkts_qinq, interface -> pkts_vlan));
       printf ("\n");
 
       if (interface -> pkts_ip)
 	printf ("    IP               : %s %s\n", fmtpkts (interface -> pkts_ip),
 		percentage (interface -> pkts_ip, interface -> pkts_total));
+      if (interface -> pkts_ip6)
+	printf ("      IPv6           : %s %s\n", fmtpkts (interface -> pkts_ip6),
+		percentage (interface -> pkts_ip6, interface -> pkts_ip));
 
       if (interface -> pkts_tcp)
 	printf ("      TCP            : %s %s\n", fmtpkts (interface -> pkts_tcp),
 		percentage (interface -> pkts_tcp, interface -> pkts_ip));
+      if (interface -> pkts_http)
+	printf ("        HTTP         : %s %s\n", fmtpkts (interface -> pkts_http),
+		percentage (interface -> pkts_http, interface -> pkts_tcp));
+      if (interface -> pkts_tls)
+	printf ("        TLS          : %s %s\n", fmtpkts (interface -> pkts_tls),
+		percentage (interface -> pkts_tls, interface -> pkts_tcp));
+      if (interface -> pkts_ssh)
+	printf ("        SSH          : %s %s\n", fmtpkts (interface -> pkts_ssh),
+		percentage (interface -> pkts_ssh, interface -> pkts_tcp));
+      if (interface -> pkts_smtp)
+	printf ("        SMTP         : %s %s\n", fmtpkts (interface -> pkts_smtp),
+		percentage (interface -> pkts_smtp, interface -> pkts_tcp));
+      if (interface -> pkts_imap)
+	printf ("        IMAP         : %s %s\n", fmtpkts (interface -> pkts_imap),
+		percentage (interface -> pkts_imap, interface -> pkts_tcp));
+      if (interface -> pkts_pop)
+	printf ("        POP3         : %s %s\n", fmtpkts (interface -> pkts_pop),
+		percentage (interface -> pkts_pop, interface -> pkts_tcp));
       if (interface -> pkts_udp)
 	printf ("      UDP            : %s %s\n", fmtpkts (interface -> pkts_udp),
 		percentage (interface -> pkts_udp, interface -> pkts_ip));
+      if (interface -> pkts_dns)
+	printf ("        DNS          : %s %s\n", fmtpkts (interface -> pkts_dns),
+		percentage (interface -> pkts_dns, interface -> pkts_udp));
       if (interface -> pkts_icmp)
 	printf ("      ICMP           : %s %s\n", fmtpkts (interface -> pkts_icmp),
 		percentage (interface -> pkts_icmp, interface -> pkts_ip));
       if (interface -> pkts_other_ip)
 	printf ("      Other IP       : %s %s\n", fmtpkts (interface -> pkts_other_ip),
 		percentage (interface -> pkts_other_ip, interface -> pkts_ip));
+      if (interface -> pkts_ip_fragments)
+	printf ("      Fragments      : %s %s\n", fmtpkts (interface -> pkts_ip_fragments),
+		percentage (interface -> pkts_ip_fragments, interface -> pkts_ip));
+      if (interface -> pkts_malformed)
+	printf ("      Malformed      : %s %s\n", fmtpkts (interface -> pkts_malformed),
+		percentage (interface -> pkts_malformed, interface -> pkts_ip));
+
+      /* Outgoing segments whose checksum is left to the NIC (offload) are captured before it is computed */
+      if (interface -> checksums)
+	{
+	  printf ("      Bad checksums  : %s IP %s", fmtpkts (interface -> pkts_ip_badsum),
+		  percentage (interface -> pkts_ip_badsum, interface -> pkts_ip - interface -> pkts_ip6));
+	  printf (", %s TCP %s", fmtpkts (interface -> pkts_tcp_badsum), percentage (interface -> pkts_tcp_badsum, interface -> pkts_tcp));
+	  printf (", %s UDP %s", fmtpkts (interface -> pkts_udp_badsum), percentage (interface -> pkts_udp_badsum, interface -> pkts_udp));
+	  printf (" [%s not verifiable, %s]\n", fmtpkts (interface -> pkts_unverified), cksumname ());
+	}
 
       if (interface -> pkts_arp)
 	printf ("    ARP              : %s %s\n", fmtpkts (interface -> pkts_arp),
@@ -263,13 +391,37 @@ int pksh_pkstatus (int argc, char * argv [])
       if (interface -> bytes_ip)
 	printf ("    IP               : %s %s\n", fmtbytes (interface -> bytes_ip),
 		percentage (interface -> bytes_ip, interface -> bytes_total - interface -> headers_total));
+      if (interface -> bytes_ip6)
+	printf ("      IPv6           : %s %s\n", fmtbytes (interface -> bytes_ip6),
+		percentage (interface -> bytes_ip6, interface -> bytes_ip));
 
       if (interface -> bytes_tcp)
 	printf ("      TCP            : %s %s\n", fmtbytes (interface -> bytes_tcp),
 		percentage (interface -> bytes_tcp, interface -> bytes_ip - interface -> headers_ip));
+      if (interface -> bytes_http)
+	printf ("        HTTP         : %s %s\n", fmtbytes (interface -> bytes_http),
+		percentage (interface -> bytes_http, interface -> bytes_tcp));
+      if (interface -> bytes_tls)
+	printf ("        TLS          : %s %s\n", fmtbytes (interface -> bytes_tls),
+		percentage (interface -> bytes_tls, interface -> bytes_tcp));
+      if (interface -> bytes_ssh)
+	printf ("        SSH          : %s %s\n", fmtbytes (interface -> bytes_ssh),
+		percentage (interface -> bytes_ssh, interface -> bytes_tcp));
+      if (interface -> bytes_smtp)
+	printf ("        SMTP         : %s %s\n", fmtbytes (interface -> bytes_smtp),
+		percentage (interface -> bytes_smtp, interface -> bytes_tcp));
+      if (interface -> bytes_imap)
+	printf ("        IMAP         : %s %s\n", fmtbytes (interface -> bytes_imap),
+		percentage (interface -> bytes_imap, interface -> bytes_tcp));
+      if (interface -> bytes_pop)
+	printf ("        POP3         : %s %s\n", fmtbytes (interface -> bytes_pop),
+		percentage (interface -> bytes_pop, interface -> bytes_tcp));
       if (interface -> bytes_udp)
 	printf ("      UDP            : %s %s\n", fmtbytes (interface -> bytes_udp),
 		percentage (interface -> bytes_udp, interface -> bytes_ip - interface -> headers_ip));
+      if (interface -> bytes_dns)
+	printf ("        DNS          : %s %s\n", fmtbytes (interface -> bytes_dns),
+		percentage (interface -> bytes_dns, interface -> bytes_udp));
       if (interface -> bytes_icmp)
 	printf ("      ICMP           : %s %s\n", fmtbytes (interface -> bytes_icmp),
 		percentage (interface -> bytes_icmp, interface -> bytes_ip - interface -> headers_ip));
@@ -290,7 +442,6 @@ int pksh_pkstatus (int argc, char * argv [])
 #if defined(FIXME)
       printf ("      NetBIOS      : %s\n", fmtbytes (interface -> ));
       printf ("      EGP          : %s\n", fmtbytes (interface -> ));
-      printf ("      IPv6         : %s\n", fmtbytes (interface -> ));
       printf ("      AppleTalk    : %s\n", fmtbytes (interface -> ));
       printf ("      DecNET       : %s\n", fmtbytes (interface -> ));
       printf ("      DLC          : %s\n", fmtbytes (interface -> ));
@@ -301,6 +452,25 @@ int pksh_pkstatus (int argc, char * argv [])
 
   printf ("\n");
 
+  /* The devices seen by the 'any' device */
+  if (interface -> ifindexmax)
+    devices (interface);
+
+  /* Hosts cache and its memory footprint */
+  hostno = interface -> hostno;
+
+  printf ("Hosts:\n");
+  printf ("  Total cached       : %d\n", hostno);
+  if (interface -> hostsmissed)
+    printf ("  Cache full         : %s new hosts left out (each time they were seen)\n", fmtpkts (interface -> hostsmissed));
+  printf ("  Memory per host    : %lu bytes (traffic history of bytes and packets %lu bytes)\n",
+	  (unsigned long) sizeof (host_t), (unsigned long) sizeof (history_t));
+  printf ("  Memory total       : %s (%u chunks of %u hosts)\n",
+	  fmtbytes ((counter_t) ((hostno + HOSTS_CHUNK - 1) / HOSTS_CHUNK) * HOSTS_CHUNK * sizeof (host_t)),
+	  (hostno + HOSTS_CHUNK - 1) / HOSTS_CHUNK, HOSTS_CHUNK);
+
+  printf ("\n");
+
   /* Bye bye! */
   return 0;
 }
@@ -36,65 +36,13 @@ typedef int handler (int argc, char * argv []);
 
 /* =-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=- */
 
-/* My own variables as extensions to those available from tcsh */
-static Char hosts [] = {'h', 'o', 's', 't', 's', '\0'};   /* just a new variable */
-
-
-/* Fill the $hosts variable */
-static void fillhosts (void)
+/* The index of hosts identifiers of the active interface (if any is capturing packets) */
+static trie_t * hostsindex (void)
 {
   char * name = getintfname ();
   interface_t * interface = name ? intfbyname (interfaces, name) : NULL;
 
-  /* The unsorted array of unique hosts identifiers */
-  char ** keys;
-  char ** s;
-
-  char ** nargv;
-
-  /* Lookup for the name of the active interface in the table of the enabled interfaces */
-  if (! interface || interface -> status != INTERFACE_ENABLED || ! interface -> pkts_total)
-    return;
-
-  /* Set the $hosts variable */
-  nargv = argsmore (NULL, "set");
-  nargv = argsmore (nargv, "hosts");
-  nargv = argsmore (nargv, "=");
-  nargv = argsmore (nargv, "(");
-
-  /* Get all the currently known unique MAC identifiers */
-  if (htno (& interface -> hwnames))
-    {
-      keys = htkeys (& interface -> hwnames);
-      for (s = keys; s && * s; s ++)
-	nargv = argsmore (nargv, * s);
-      argsclear (keys);
-    }
-
-  /* Get all the currently known unique IP */
-  if (htno (& interface -> ipnames))
-    {
-      keys = htkeys (& interface -> ipnames);
-      for (s = keys; s && * s; s ++)
-	nargv = argsmore (nargv, * s);
-      argsclear (keys);
-    }
-
-  /* Get all the currently known unique hostnames */
-  if (htno (& interface -> hostnames))
-    {
-      keys = htkeys (& interface -> hostnames);
-      for (s = keys; s && * s; s ++)
-	nargv = argsmore (nargv, * s);
-      argsclear (keys);
-    }
-
-  nargv = argsmore (nargv, ")");
-
-  /* Update the $hosts variable */
-  tcsh_builtins (argslen (nargv), nargv);
-
-  argsclear (nargv);
+  return interface && interface -> status == INTERFACE_ENABLED ? & interface -> names : NULL;
 }
 
 
@@ -147,6 +95,13 @@ static void set_array (char * name, char ** values)
 }
 
 
+/* Write out whatever a function has rendered (see the cleanups of tcsh) */
+static void renderdone (void * unused)
+{
+  renderflush ();
+}
+
+
 /* How to call the [pksh] extensions from tcsh */
 static void tcsh_xxx (Char ** v, handler * func)
 {
@@ -155,21 +110,18 @@ static void tcsh_xxx (Char ** v, handler * func)
   /* Insert command name as argv [0] */
   char ** argv = argsmore (NULL, short2str (* vv ++));
 
-  /* Check if the command in 'v' should also update the $hosts variable */
+  /* Check if the command in 'v' should also expand hosts identifiers */
   if (check_completion (argv [0]))
     {
-      struct varent * nn = adrof (hosts);                           /* address of the $hosts variable */
-
-      /* Update the [$hosts] variable for hosts names TAB-completion and globbing (only a subset of commands) */
-      fillhosts ();
+      trie_t * index = hostsindex ();
 
-      /* optional parameters on the command line? */
-      while (nn && * vv)
+      /* optional parameters on the command line are globbed against the index of hosts identifiers */
+      while (* vv)
 	{
 	  char * what = strdup (short2str (* vv));          /* Why do I need a local copy? */
 	  char ** gargv;
 
-	  gargv = globargs (blklen (nn -> vec), short2blk (nn -> vec), what);
+	  gargv = index ? triematch (index, what) : NULL;
 	  if (gargv)
 	    {
 	      /* Found! We have a subset to look for */
@@ -179,7 +131,7 @@ static void tcsh_xxx (Char ** v, handler * func)
 	      while (* w)
 		argv = argsmore (argv, * w ++);
 
-	      /* free memory returned by globargs() */
+	      /* free memory returned by triematch() */
 	      argsclear (gargv);
 	    }
 	  else
@@ -194,9 +146,24 @@ static void tcsh_xxx (Char ** v, handler * func)
     while (* vv)
       argv = argsmore (argv, short2str (* vv ++));
 
+  /* Interfaces captured by pkshd (if attached) are refreshed before each command */
+  if (remoteattached ())
+    remoterefresh ();
+
+  /*
+   * Write out whatever the function renders before the shell speaks again,
+   * also when an interrupt makes the shell unwind to its main loop (reset() runs the cleanups)
+   */
+  cleanup_push (& func, renderdone);
+
   /* It's time to execute the function */
   if ((* func) (argslen (argv), argv))
     setcopy (STRstatus, Strsave (STR1), VAR_READWRITE);         /* set the $status variable */
+
+  cleanup_until (& func);
+
+  /* The prompt tells whether the sniffer of the active interface is shedding work */
+  pksh_prompt_refresh ();
 }
 
 
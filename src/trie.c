@@ -0,0 +1,210 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Prefix trie of the hosts identifiers (HW addresses, IP addresses and hostnames)
+ * used as an index for TAB-completion and globbing.
+ *
+ * The sniffer is the only writer and it never removes a node, so each new node
+ * is published once fully initialized and the shell can walk the trie at any time.
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+#include <fnmatch.h>
+
+/* Project header */
+#include "pksh.h"
+
+
+/* Longest identifier ever indexed (hostnames are the longest ones, up to 255 chars) */
+#define TRIE_MAXKEY  256
+
+
+/* The matching keys, growing by doubling */
+typedef struct
+{
+  char ** argv;
+  unsigned argc;
+  unsigned room;
+
+} matches_t;
+
+
+/* Characters which make a pattern a glob rather than a literal */
+static bool ismeta (char c)
+{
+  return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+
+/* Lookup for the child of 'node' labeled 'c' */
+static trie_t * triechild (trie_t * node, char c)
+{
+  trie_t * n;
+
+  for (n = __atomic_load_n (& node -> child, __ATOMIC_ACQUIRE); n; n = __atomic_load_n (& n -> sibling, __ATOMIC_ACQUIRE))
+    if (n -> c == c)
+      return n;
+
+  return NULL;
+}
+
+
+/* Add a key to the matches */
+static void matchesadd (matches_t * m, char * key)
+{
+  if (m -> argc + 1 >= m -> room)
+    {
+      char ** argv = realloc (m -> argv, (m -> room ? m -> room * 2 : 64) * sizeof (char *));
+      if (! argv)
+	return;
+      m -> argv = argv;
+      m -> room = m -> room ? m -> room * 2 : 64;
+    }
+
+  m -> argv [m -> argc ++] = strdup (key);
+  m -> argv [m -> argc] = NULL;
+}
+
+
+/* Visit the subtree rooted at 'node' whose path is 'key [0 .. depth - 1]' and collect the keys matching 'pattern' (if any) */
+static void triewalk (trie_t * node, char * key, unsigned depth, char * pattern, matches_t * m)
+{
+  trie_t * n;
+
+  key [depth] = '\0';
+  if (__atomic_load_n (& node -> key, __ATOMIC_ACQUIRE) && (! pattern || ! fnmatch (pattern, key, 0)))
+    matchesadd (m, key);
+
+  if (depth + 1 >= TRIE_MAXKEY)
+    return;
+
+  for (n = __atomic_load_n (& node -> child, __ATOMIC_ACQUIRE); n; n = __atomic_load_n (& n -> sibling, __ATOMIC_ACQUIRE))
+    {
+      key [depth] = n -> c;
+      triewalk (n, key, depth + 1, pattern, m);
+    }
+}
+
+
+/* Compare two keys (for qsort) */
+static int keycmp (const void * _a, const void * _b)
+{
+  return strcmp (* (char **) _a, * (char **) _b);
+}
+
+
+/*
+ * Descend the literal prefix of 'pattern' and collect all the keys below it.
+ * When 'glob' is set the rest of 'pattern' is evaluated by fnmatch(3) on each candidate,
+ * and a pattern with no meta character at all matches only the key spelled the same.
+ */
+static char ** triecollect (trie_t * root, char * pattern, bool glob)
+{
+  char key [TRIE_MAXKEY];
+  matches_t m = { NULL, 0, 0 };
+  trie_t * node = root;
+  unsigned depth = 0;
+
+  if (! root || ! pattern)
+    return NULL;
+
+  while (pattern [depth] && (! glob || ! ismeta (pattern [depth])))
+    {
+      if (depth + 1 >= TRIE_MAXKEY || ! (node = triechild (node, pattern [depth])))
+	return NULL;
+      key [depth] = pattern [depth];
+      depth ++;
+    }
+
+  if (glob && ! pattern [depth])
+    {
+      key [depth] = '\0';
+      if (__atomic_load_n (& node -> key, __ATOMIC_ACQUIRE))
+	matchesadd (& m, key);
+      return m . argv;
+    }
+
+  triewalk (node, key, depth, glob ? pattern : NULL, & m);
+
+  /* Sorted the same way the shell does */
+  if (m . argc)
+    qsort (m . argv, m . argc, sizeof (char *), keycmp);
+
+  return m . argv;
+}
+
+
+/* Index 'key' under 'root' and return true if it was not already there (only the sniffer may call it) */
+bool trieadd (trie_t * root, char * key)
+{
+  trie_t * node = root;
+  unsigned depth;
+
+  if (! root || ! key || ! * key || strlen (key) >= TRIE_MAXKEY)
+    return false;
+
+  for (depth = 0; key [depth]; depth ++)
+    {
+      trie_t * n = triechild (node, key [depth]);
+
+      if (! n)
+	{
+	  if (! (n = calloc (1, sizeof (trie_t))))
+	    return false;
+
+	  /* New children are pushed in front, the node becomes visible only when complete */
+	  n -> c = key [depth];
+	  n -> sibling = node -> child;
+	  __atomic_store_n (& node -> child, n, __ATOMIC_RELEASE);
+	}
+      node = n;
+    }
+
+  if (node -> key)
+    return false;
+
+  __atomic_store_n (& node -> key, true, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+/* Return all the keys starting with 'prefix' in a sorted NULL terminated table (NULL if none) */
+char ** trieprefix (trie_t * root, char * prefix)
+{
+  return triecollect (root, prefix, false);
+}
+
+
+/* Return all the keys matching the glob 'pattern' in a sorted NULL terminated table (NULL if none) */
+char ** triematch (trie_t * root, char * pattern)
+{
+  return triecollect (root, pattern, true);
+}
+
+
+/* Release all the nodes below 'root' (the root itself is owned by the caller) */
+void triefree (trie_t * root)
+{
+  trie_t * n;
+  trie_t * next;
+
+  if (! root)
+    return;
+
+  for (n = root -> child; n; n = next)
+    {
+      next = n -> sibling;
+      triefree (n);
+      free (n);
+    }
+
+  root -> child = NULL;
+  root -> key   = false;
+}
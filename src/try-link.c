@@ -49,6 +49,7 @@ static void try_pksh_helpers_all (int argc, char * argv [])
   pksh_about (argc, argv);
   pksh_version (argc, argv);
   pksh_license (argc, argv);
+  pksh_pkcomplete (argc, argv);
 }
 
 
@@ -63,6 +64,9 @@ static void try_pksh_interfaces_all (int argc, char * argv [])
   pksh_pkuptime (argc, argv);
   pksh_pkfilter (argc, argv);
   pksh_pkswap (argc, argv);
+  pksh_pkattach (argc, argv);
+  pksh_pkmetrics (argc, argv);
+  pksh_pkdump (argc, argv);
 }
 
 
@@ -80,6 +84,7 @@ static void try_pksh_viewers_all (int argc, char * argv [])
   pksh_pkarp (argc, argv);
   pksh_pklast (argc, argv);
   pksh_pkwho (argc, argv);
+  pksh_pkvlans (argc, argv);
   pksh_pkfinger (argc, argv);
 }
 
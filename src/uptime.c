@@ -125,16 +125,13 @@ int pksh_pkuptime (int argc, char * argv [])
   intf = interfaces;
   while (intf && * intf)
     {
-      host_t ** hosts = hostsall (* intf);
-      int local = hostnolocal (hosts);
-      int foreign = hostnoforeign (hosts);
+      int local = (* intf) -> hostno_local;
+      int foreign = (* intf) -> hostno_foreign;
       printf ("(%s) -- %s [%s],   %s Pkts / %s,   %d hosts [%d local   %d foreign]\n",
 	      (* intf) -> name, (* intf) -> hostname, (* intf) -> ipaddr,
 	      fmtpkts ((* intf) -> pkts_total), fmtbytes ((* intf) -> bytes_total),
 	      local + foreign, local, foreign);
       intf ++;
-      if (hosts)
-	free (hosts);
     }
 
   /* Bye bye! */
@@ -0,0 +1,227 @@
+/*
+ * pksh - The Packet Shell
+ *
+ * R. Carbone (rocco@tecsiel.it)
+ * 2008-2009, 2022
+ *
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Display the traffic of the VLANs (802.1Q and 802.1ad/QinQ) seen on a network interface
+ */
+
+
+/* System headers */
+#include <stdlib.h>
+
+/* Project header */
+#include "pksh.h"
+
+/* Identifiers */
+#define NAME         "pkvlans"
+#define BRIEF        "Display the traffic of the VLANs seen on a network interface"
+#define SYNOPSIS     "pkvlans [options] [interface]"
+#define DESCRIPTION  "No description yet"
+
+/* Public variable */
+pksh_cmd_t cmd_vlans = { NAME, BRIEF, SYNOPSIS, DESCRIPTION, pksh_pkvlans };
+
+
+/* GNU short options */
+enum
+{
+  /* Startup */
+  OPT_HELP        = 'h',
+  OPT_QUIET       = 'q',
+
+  OPT_BY_ID       = 'n',
+};
+
+
+/* GNU long options */
+static struct option lopts [] =
+{
+  /* Startup */
+  { "help",          no_argument,       NULL, OPT_HELP        },
+  { "quiet",         no_argument,       NULL, OPT_QUIET       },
+
+  { "by-id",         no_argument,       NULL, OPT_BY_ID       },
+
+  { NULL,            0,                 NULL, 0               }
+};
+
+
+/* A row of the table */
+typedef struct
+{
+  unsigned id;
+  vlan_t counters;
+  unsigned hosts;
+
+} vlanrow_t;
+
+
+/* Display the syntax */
+static void usage (char * progname, struct option * options)
+{
+  printf ("`%s' prints the packets and bytes foreach VLAN seen on a network interface\n", progname);
+  printf ("     (QinQ frames are counted in the VLAN of their innermost tag, VLAN 0 are the priority tagged frames)\n");
+
+  printf ("\n");
+  printf ("Usage: %s [options] [interface]\n", progname);
+
+  printf ("\n");
+  printf ("Examples:\n");
+  printf ("   %s           # print the VLANs of the active interface (if any), the busiest first\n", progname);
+  printf ("   %s -n eth1   # print the VLANs of interface eth1 ordered by their identifier\n", progname);
+
+  printf ("\n");
+  printf ("Main options are:\n");
+  printf ("   -h, --help           only show this help message\n");
+  printf ("   -n, --by-id          order by VLAN identifier rather than by bytes\n");
+}
+
+
+/* The busiest VLANs first */
+static int bybytes (const void * _a, const void * _b)
+{
+  const vlanrow_t * a = _a;
+  const vlanrow_t * b = _b;
+
+  return a -> counters . bytes < b -> counters . bytes ? 1 : a -> counters . bytes > b -> counters . bytes ? -1 : (int) a -> id - (int) b -> id;
+}
+
+
+/* Print the traffic of the VLANs seen on a network interface */
+int pksh_pkvlans (int argc, char * argv [])
+{
+  char * progname = basename (argv [0]);
+  char * sopts    = optlegitimate (lopts);
+
+  /* Variables that are set according to the specified options */
+  bool quiet      = false;
+  bool byid       = false;
+
+  int option;
+
+  /* Local variables */
+  char * name = NULL;
+  interface_t * interface;
+  vlanrow_t * rows;
+  unsigned n = 0;
+  unsigned i;
+  host_t * h;
+
+  char pbuf [64];
+  char bbuf [64];
+
+  /* Lookup for the command in the static table of registered extensions */
+  if (! cmd_by_name (progname))
+    {
+      printf ("%s: Command [%s] not found.\n", progname, progname);
+      return -1;
+    }
+
+  /* Parse command line options */
+  optind = 0;
+  optarg = NULL;
+  argv [0] = progname;
+  while ((option = getopt_long (argc, argv, sopts, lopts, NULL)) != -1)
+    {
+      switch (option)
+	{
+	default: if (! quiet) printf ("Try '%s --help' for more information.\n", progname); return 1;
+
+	  /* Startup */
+	case OPT_HELP:  usage (progname, lopts); return 0;
+	case OPT_QUIET: quiet = true;            break;
+
+	case OPT_BY_ID: byid = true;             break;
+	}
+    }
+
+  /* Check if the user has specified an interface */
+  if (optind < argc)
+    name = argv [optind ++];
+
+  /* Safe to play with the 'active' interface (if any) in case no specific one was chosen by the user */
+  if (! name && ! (name = getintfname ()))
+    {
+      printf ("%s: no interface is currently enabled for packet sniffing\n", progname);
+      return -1;
+    }
+
+  /* Lookup for the given name in the table of enabled interfaces */
+  if (! (interface = intfbyname (interfaces, name)))
+    {
+      printf ("%s: unknown interface %s\n", progname, name);
+      return -1;
+    }
+
+  /* Only the process owning the capture counts the frames foreach VLAN */
+  if (! interface -> vlans)
+    {
+      if (! quiet)
+	{
+	  if (interface -> remote && interface -> pkts_vlan)
+	    printf ("%s: %s tagged frames seen on %s, they are counted foreach VLAN only by pkshd\n",
+		    progname, fmtpkts (interface -> pkts_vlan), name);
+	  else
+	    printf ("%s: no tagged frames seen on %s\n", progname, name);
+	}
+      return 0;
+    }
+
+  /* A snapshot of the VLANs seen so far */
+  if (! (rows = calloc (VLAN_IDS, sizeof (vlanrow_t))))
+    {
+      printf ("%s: out of memory\n", progname);
+      return -1;
+    }
+
+  /* Hosts are known foreach VLAN only when they are kept apart */
+  if (interface -> vlankeys)
+    for (h = hostfirst (interface); h; h = hostnext (h))
+      rows [h -> vlan] . hosts ++;
+
+  /* The table is packed in place, a VLAN never moves past its own identifier */
+  for (i = 0; i < VLAN_IDS; i ++)
+    if (interface -> vlans [i] . pkts)
+      {
+	rows [n] . id       = i;
+	rows [n] . counters = interface -> vlans [i];
+	rows [n] . hosts    = rows [i] . hosts;
+	n ++;
+      }
+
+  if (! byid)
+    qsort (rows, n, sizeof (vlanrow_t), bybytes);
+
+  printf ("%-6s %14s %8s %14s %8s", "VLAN", "Packets", "", "Bytes", "");
+  if (interface -> vlankeys)
+    printf (" %8s", "Hosts");
+  printf ("\n");
+
+  for (i = 0; i < n; i ++)
+    {
+      printf ("%-6u %14s %8s", rows [i] . id,
+	      fmtpkts_r (rows [i] . counters . pkts, pbuf, sizeof (pbuf)), percentage (rows [i] . counters . pkts, interface -> pkts_vlan));
+      printf (" %14s %8s", fmtbytes_r (rows [i] . counters . bytes, bbuf, sizeof (bbuf)),
+	      percentage (rows [i] . counters . bytes, interface -> bytes_vlan));
+      if (interface -> vlankeys)
+	printf (" %8u", rows [i] . hosts);
+      printf ("\n");
+    }
+
+  if (! quiet)
+    {
+      printf ("\n%u VLANs, %s tagged frames (%s QinQ) %s of all the frames seen on %s\n",
+	      n, fmtpkts_r (interface -> pkts_vlan, pbuf, sizeof (pbuf)), fmtpkts (interface -> pkts_qinq),
+	      percentage (interface -> pkts_vlan, interface -> pkts_total), name);
+      samplenote (interface);
+    }
+
+  free (rows);
+
+  /* Bye bye! */
+  return 0;
+}